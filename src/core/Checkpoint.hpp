@@ -0,0 +1,201 @@
+#ifndef CHECKPOINT
+#define CHECKPOINT
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <zlib.h>
+
+#include "Matrix.hpp"
+
+/**
+ * @brief Sequential checkpoint stream.
+ *
+ * A checkpoint starts with a magic and a compression flag, followed by whatever the owner writes: scalars as raw
+ * bytes and arrays as a sequence of chunks of at most CHUNK_SIZE bytes. Every chunk is prefixed with its raw and
+ * stored size and is compressed on its own, so neither side ever holds more than one chunk of a field in extra memory.
+ */
+class CheckpointWriter
+{
+public:
+	static inline constexpr char   MAGIC[8]   = "D2Q9CKP";
+	static inline constexpr size_t CHUNK_SIZE = 1 << 20;
+
+private:
+	std::string       mPath;
+	std::ofstream     mFile;
+	bool              mCompress;
+	std::vector<char> mChunk;
+
+public:
+	/**
+	 * @param compress Deflate each chunk, chunks that do not shrink are stored as they are.
+	 */
+	CheckpointWriter(const std::string& path, bool compress = false)
+		: mPath(path), mFile(path, std::ios::binary), mCompress(compress)
+	{
+		if(!mFile) {
+			throw std::runtime_error("Unable to open checkpoint file " + path);
+		}
+		mFile.write(MAGIC, sizeof(MAGIC));
+		write<std::uint8_t>(compress);
+		if(compress) {
+			mChunk.resize(compressBound(CHUNK_SIZE));
+		}
+	}
+
+	template<typename T>
+	void write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written as raw bytes.");
+		mFile.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void writeArray(const double* data, size_t length)
+	{
+		const char* bytes = reinterpret_cast<const char*>(data);
+		size_t      total = sizeof(double) * length;
+		for(size_t offset = 0; offset < total; offset += CHUNK_SIZE) {
+			std::uint32_t rawSize    = std::min(CHUNK_SIZE, total - offset);
+			std::uint32_t storedSize = rawSize;
+			const char*   stored     = bytes + offset;
+			if(mCompress) {
+				uLongf compressedSize = mChunk.size();
+				if(compress2(reinterpret_cast<Bytef*>(mChunk.data()),
+							 &compressedSize,
+							 reinterpret_cast<const Bytef*>(bytes + offset),
+							 rawSize,
+							 Z_BEST_SPEED) == Z_OK &&
+				   compressedSize < rawSize) {
+					storedSize = compressedSize;
+					stored     = mChunk.data();
+				}
+			}
+			write(rawSize);
+			write(storedSize);
+			mFile.write(stored, storedSize);
+		}
+	}
+
+	/**
+	 * @brief Dimensions and shift indices followed by the unshifted storage, without any row padding.
+	 */
+	void writeMatrix(const Matrix<double>& matrix)
+	{
+		write<std::uint32_t>(matrix.getN());
+		write<std::uint32_t>(matrix.getM());
+		write<std::uint32_t>(matrix.getRowShiftIndex());
+		write<std::uint32_t>(matrix.getColShiftIndex());
+		if(matrix.getPitch() == matrix.getM()) {
+			writeArray(matrix.getDataData(), matrix.getLength());
+		} else {
+			const std::vector<double> data = matrix.getData();
+			writeArray(data.data(), data.size());
+		}
+	}
+
+	/**
+	 * @brief Flush and report any write error, the destructor cannot.
+	 */
+	void close()
+	{
+		mFile.close();
+		if(!mFile) {
+			throw std::runtime_error("Unable to write checkpoint file " + mPath);
+		}
+	}
+};
+
+class CheckpointReader
+{
+private:
+	std::string       mPath;
+	std::ifstream     mFile;
+	std::vector<char> mChunk;
+
+public:
+	CheckpointReader(const std::string& path): mPath(path), mFile(path, std::ios::binary)
+	{
+		if(!mFile) {
+			throw std::runtime_error("Unable to open checkpoint file " + path);
+		}
+		char magic[sizeof(CheckpointWriter::MAGIC)];
+		mFile.read(magic, sizeof(magic));
+		if(!mFile || std::memcmp(magic, CheckpointWriter::MAGIC, sizeof(magic)) != 0) {
+			throw std::runtime_error("Not a checkpoint file: " + path);
+		}
+		read<std::uint8_t>();  // compression flag, every chunk records its own stored size
+	}
+
+	template<typename T>
+	T read()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read as raw bytes.");
+		T value;
+		mFile.read(reinterpret_cast<char*>(&value), sizeof(T));
+		if(!mFile) {
+			throw std::runtime_error("Truncated checkpoint file " + mPath);
+		}
+		return value;
+	}
+
+	void readArray(double* data, size_t length)
+	{
+		char*  bytes = reinterpret_cast<char*>(data);
+		size_t total = sizeof(double) * length;
+		for(size_t offset = 0; offset < total;) {
+			std::uint32_t rawSize    = read<std::uint32_t>();
+			std::uint32_t storedSize = read<std::uint32_t>();
+			if(rawSize == 0 || rawSize > total - offset || storedSize > compressBound(rawSize)) {
+				throw std::runtime_error("Corrupted checkpoint file " + mPath);
+			}
+			if(storedSize == rawSize) {
+				mFile.read(bytes + offset, rawSize);
+			} else {
+				mChunk.resize(storedSize);
+				mFile.read(mChunk.data(), storedSize);
+				uLongf uncompressedSize = rawSize;
+				if(mFile && (uncompress(reinterpret_cast<Bytef*>(bytes + offset),
+										&uncompressedSize,
+										reinterpret_cast<const Bytef*>(mChunk.data()),
+										storedSize) != Z_OK ||
+							 uncompressedSize != rawSize)) {
+					throw std::runtime_error("Corrupted checkpoint file " + mPath);
+				}
+			}
+			if(!mFile) {
+				throw std::runtime_error("Truncated checkpoint file " + mPath);
+			}
+			offset += rawSize;
+		}
+	}
+
+	/**
+	 * @brief Read a matrix written by CheckpointWriter::writeMatrix, including its shift indices.
+	 * @throw std::invalid_argument if the stored dimensions differ from the given matrix.
+	 */
+	void readMatrix(Matrix<double>& matrix)
+	{
+		unsigned int n = read<std::uint32_t>();
+		unsigned int m = read<std::uint32_t>();
+		if(n != matrix.getN() || m != matrix.getM()) {
+			throw std::invalid_argument("Checkpoint matrix dimension mismatch.");
+		}
+		unsigned int rowShiftIndex = read<std::uint32_t>();
+		unsigned int colShiftIndex = read<std::uint32_t>();
+		if(rowShiftIndex >= n || colShiftIndex >= m) {
+			throw std::runtime_error("Corrupted checkpoint file " + mPath);
+		}
+		const unsigned int pitch = matrix.getPitch();
+		matrix                   = Matrix<double>(n, m, 0, rowShiftIndex, colShiftIndex);
+		readArray(matrix.getDataData(), matrix.getLength());
+		matrix.setRowPitch(pitch);
+	}
+};
+#endif  // CHECKPOINT
@@ -0,0 +1,260 @@
+#ifndef COLLISION_OPERATOR
+#define COLLISION_OPERATOR
+
+#include <array>
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+#include "Lattice.hpp"
+
+/**
+ * @brief Collision operators of the populations, chosen per field (density, temperature).
+ *
+ * All of them relax the non-equilibrium part n = f - f_eq of a node, f <- f - R n:
+ * - BGK: R = omega, one rate for every direction.
+ * - TRT: the symmetric part (n_k + n_opposite) / 2 and the antisymmetric part (n_k - n_opposite) / 2 relax with
+ *   their own rates. The field's omega sets the transport coefficient, the even rate for the density (viscosity) and
+ *   the odd rate for the temperature (diffusion). The other rate follows from the magic parameter
+ *   (1 / omega_even - 1/2) (1 / omega_odd - 1/2) = TRT_MAGIC.
+ * - MRT: R = MRT_INVERSE * S * MRT_MATRIX in the moment basis of Lallemand and Luo. Density, momentum and stress
+ *   relax with omega, which keeps the transport coefficients of BGK, the energy and heat flux moments (which carry
+ *   no transport coefficient) with the fixed rates of MRT_GHOST_RATE.
+ *
+ * The host functions take the descriptor as a template parameter, D2Q9 unless given. BGK and TRT work for any of
+ * them, MRT only for D2Q9, whose moment basis MRT_MATRIX is. The numeric values are passed to the kernels, keep them
+ * in sync with collisionOperatorSource().
+ */
+enum class CollisionOperator { BGK = 0, TRT = 1, MRT = 2 };
+
+inline constexpr double TRT_MAGIC         = 0.25;
+inline constexpr double MRT_GHOST_RATE[9] = {0, 1.64, 1.54, 0, 1.9, 0, 1.9, 0, 0};  // 0: the field's omega
+
+// Rows: density, energy, energy squared, momentum x, heat flux x, momentum y, heat flux y, normal and shear stress
+inline constexpr double MRT_MATRIX[9][9] = {{1, 1, 1, 1, 1, 1, 1, 1, 1},
+											{-4, -1, -1, -1, -1, 2, 2, 2, 2},
+											{4, -2, -2, -2, -2, 1, 1, 1, 1},
+											{0, 1, 0, -1, 0, 1, -1, -1, 1},
+											{0, -2, 0, 2, 0, 1, -1, -1, 1},
+											{0, 0, 1, 0, -1, 1, 1, -1, -1},
+											{0, 0, -2, 0, 2, 1, 1, -1, -1},
+											{0, 1, -1, 1, -1, 0, 0, 0, 0},
+											{0, 0, 0, 0, 0, 1, -1, 1, -1}};
+
+/**
+ * @brief The rows of MRT_MATRIX are orthogonal, its inverse is the transpose scaled by the squared row norms.
+ */
+inline constexpr std::array<std::array<double, 9>, 9> mrtInverse()
+{
+	std::array<std::array<double, 9>, 9> inverse{};
+	for(unsigned int moment = 0; moment < 9; moment++) {
+		double norm = 0;
+		for(unsigned int k = 0; k < 9; k++) {
+			norm += MRT_MATRIX[moment][k] * MRT_MATRIX[moment][k];
+		}
+		for(unsigned int k = 0; k < 9; k++) {
+			inverse[k][moment] = MRT_MATRIX[moment][k] / norm;
+		}
+	}
+	return inverse;
+}
+
+inline constexpr std::array<std::array<double, 9>, 9> MRT_INVERSE = mrtInverse();
+
+/**
+ * @brief TRT rate paired with omega by TRT_MAGIC.
+ */
+inline double trtPartnerRate(double omega)
+{
+	return 1 / (0.5 + TRT_MAGIC / (1 / omega - 0.5));
+}
+
+/**
+ * @brief Smagorinsky subgrid model: the relaxation rate of a node whose non-equilibrium part is n.
+ *
+ * The filtered strain rate follows from the local non-equilibrium stress Pi = sum_k c_k c_k n_k, no finite
+ * differences needed. With Q = |Pi| the total relaxation time solves tau (tau - tau_0) = sqrt(2) C^2 Q / (2 c_s^4 rho),
+ * tau_0 = 1 / omega being the molecular one. The stress sums skip the zero components, which for D2Q9 gives the sums
+ * of the kernel twin term by term.
+ * @param smagorinsky Smagorinsky constant C, typically 0.1 to 0.2.
+ */
+template<class DESCRIPTOR = D2Q9>
+inline double smagorinskyRate(const double (&n)[DESCRIPTOR::Q], double omega, double rho, double smagorinsky)
+{
+	constexpr double C  = DESCRIPTOR::INVERSE_SOUND_SPEED_SQUARED;
+	double           xx = 0;
+	double           yy = 0;
+	double           xy = 0;
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		const int cx = DESCRIPTOR::CX[k];
+		const int cy = DESCRIPTOR::CY[k];
+		if(cx != 0) {
+			xx += cx * cx * n[k];
+		}
+		if(cy != 0) {
+			yy += cy * cy * n[k];
+		}
+		if(cx * cy != 0) {
+			xy += cx * cy * n[k];
+		}
+	}
+	const double Q = std::sqrt(xx * xx + yy * yy + 2 * xy * xy);
+	if(rho <= 0) {
+		return omega;
+	}
+	const double tau = 1 / omega;
+	return 2 / (tau + std::sqrt(tau * tau + 2 * C * C * std::sqrt(2.0) * smagorinsky * smagorinsky * Q / rho));
+}
+
+/**
+ * @brief Collide the populations f of one node with the equilibrium eq, in place.
+ * @param temperature The field's omega relaxes the odd moments (diffusion) instead of the even ones (viscosity).
+ */
+template<CollisionOperator OPERATOR, class DESCRIPTOR = D2Q9>
+inline void relax(double (&f)[DESCRIPTOR::Q], const double (&eq)[DESCRIPTOR::Q], double omega, bool temperature)
+{
+	double n[DESCRIPTOR::Q];
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		n[k] = f[k] - eq[k];
+	}
+
+	if constexpr(OPERATOR == CollisionOperator::TRT) {
+		const double partner = trtPartnerRate(omega);
+		const double even    = temperature ? partner : omega;
+		const double odd     = temperature ? omega : partner;
+		f[0] -= even * n[0];
+		for(unsigned int k = 1; k < DESCRIPTOR::Q; k++) {
+			const unsigned int o = LATTICE_OPPOSITE<DESCRIPTOR>[k];
+			f[k] -= even * 0.5 * (n[k] + n[o]) + odd * 0.5 * (n[k] - n[o]);
+		}
+	} else if constexpr(OPERATOR == CollisionOperator::MRT) {
+		static_assert(std::is_same_v<DESCRIPTOR, D2Q9>, "MRT_MATRIX is the moment basis of D2Q9.");
+		double m[9];
+		for(unsigned int moment = 0; moment < 9; moment++) {
+			double sum = 0;
+			for(unsigned int k = 0; k < 9; k++) {
+				sum += MRT_MATRIX[moment][k] * n[k];
+			}
+			m[moment] = (MRT_GHOST_RATE[moment] == 0 ? omega : MRT_GHOST_RATE[moment]) * sum;
+		}
+		for(unsigned int k = 0; k < 9; k++) {
+			double sum = 0;
+			for(unsigned int moment = 0; moment < 9; moment++) {
+				sum += MRT_INVERSE[k][moment] * m[moment];
+			}
+			f[k] -= sum;
+		}
+	} else {
+		for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+			f[k] -= omega * n[k];
+		}
+	}
+}
+
+/**
+ * @brief Guo forcing term of a body force (fx, fy) at velocity (u, v), per direction and before the rate correction
+ * applied by force().
+ */
+template<class DESCRIPTOR = D2Q9>
+inline void guoSource(double (&source)[DESCRIPTOR::Q], double u, double v, double fx, double fy)
+{
+	constexpr double C = DESCRIPTOR::INVERSE_SOUND_SPEED_SQUARED;
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		const int cx = DESCRIPTOR::CX[k];
+		const int cy = DESCRIPTOR::CY[k];
+		source[k]    = DESCRIPTOR::WEIGHT[k] *
+					(C * ((cx - u) * fx + (cy - v) * fy) + C * C * (cx * u + cy * v) * (cx * fx + cy * fy));
+	}
+}
+
+/**
+ * @brief Add the forcing term to the collided density populations: f <- f + (1 - R / 2) source, R being the
+ * relaxation of relax(), so every moment of the source is corrected by its own rate.
+ */
+template<CollisionOperator OPERATOR, class DESCRIPTOR = D2Q9>
+inline void force(double (&f)[DESCRIPTOR::Q], const double (&source)[DESCRIPTOR::Q], double omega)
+{
+	const double zero[DESCRIPTOR::Q] = {};
+	double       relaxed[DESCRIPTOR::Q];
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		relaxed[k] = source[k];
+	}
+	relax<OPERATOR, DESCRIPTOR>(relaxed, zero, omega, false);
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		f[k] += 0.5 * (source[k] + relaxed[k]);
+	}
+}
+
+/**
+ * @brief OpenCL C of smagorinskyRate(), relaxTRT(), relaxMRT() and guoSource(), the kernel twins of the functions
+ * above, with the tables printed from the constants above so both sides use the same values. Starts with
+ * latticeSource() of D2Q9.
+ */
+inline std::string collisionOperatorSource()
+{
+	auto table = [](const char* declaration, const double* values, unsigned int count) {
+		std::string source = declaration;
+		for(unsigned int i = 0; i < count; i++) {
+			source += (i == 0 ? "{" : ", ") + latticeLiteral(values[i]);
+		}
+		return source + "};\n";
+	};
+
+	std::string source = latticeSource<D2Q9>();
+	source += table("constant double TRT_MAGIC[1] = ", &TRT_MAGIC, 1);
+	source += table("constant double MRT_MATRIX[81] = ", &MRT_MATRIX[0][0], 81);
+	source += table("constant double MRT_INVERSE[81] = ", MRT_INVERSE[0].data(), 81);
+	source += table("constant double MRT_GHOST_RATE[9] = ", MRT_GHOST_RATE, 9);
+	source += R"(
+	double trtPartnerRate(double omega) {
+		return 1 / (0.5 + TRT_MAGIC[0] / (1 / omega - 0.5));
+	}
+
+	double smagorinskyRate(const double* n, double omega, double rho, double smagorinsky) {
+		double xx = n[1] + n[3] + n[5] + n[6] + n[7] + n[8];
+		double yy = n[2] + n[4] + n[5] + n[6] + n[7] + n[8];
+		double xy = n[5] - n[6] + n[7] - n[8];
+		double Q  = sqrt(xx * xx + yy * yy + 2 * xy * xy);
+		if (rho <= 0) {
+			return omega;
+		}
+		double tau = 1 / omega;
+		return 2 / (tau + sqrt(tau * tau + 18 * sqrt(2.0) * smagorinsky * smagorinsky * Q / rho));
+	}
+
+	void relaxTRT(double* f, const double* n, double even, double odd) {
+		f[0] -= even * n[0];
+		for (int k = 1; k < 9; k++) {
+			int o = OPPOSITE[k];
+			f[k] -= even * 0.5 * (n[k] + n[o]) + odd * 0.5 * (n[k] - n[o]);
+		}
+	}
+
+	void relaxMRT(double* f, const double* n, double omega) {
+		double m[9];
+		for (int moment = 0; moment < 9; moment++) {
+			double sum = 0;
+			for (int k = 0; k < 9; k++) {
+				sum += MRT_MATRIX[moment * 9 + k] * n[k];
+			}
+			m[moment] = (MRT_GHOST_RATE[moment] == 0 ? omega : MRT_GHOST_RATE[moment]) * sum;
+		}
+		for (int k = 0; k < 9; k++) {
+			double sum = 0;
+			for (int moment = 0; moment < 9; moment++) {
+				sum += MRT_INVERSE[k * 9 + moment] * m[moment];
+			}
+			f[k] -= sum;
+		}
+	}
+
+	void guoSource(double* source, double u, double v, double fx, double fy) {
+		for (int k = 0; k < 9; k++) {
+			source[k] = WEIGHT[k] * (3 * ((CX[k] - u) * fx + (CY[k] - v) * fy) +
+									 9 * (CX[k] * u + CY[k] * v) * (CX[k] * fx + CY[k] * fy));
+		}
+	}
+)";
+	return source;
+}
+#endif  // COLLISION_OPERATOR
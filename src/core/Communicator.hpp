@@ -0,0 +1,88 @@
+#ifndef COMMUNICATOR
+#define COMMUNICATOR
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Point-to-point messaging between the ranks of a decomposed simulation.
+ *
+ * The calls follow MPI semantics (MPI_Comm_rank, MPI_Comm_size, MPI_Isend, MPI_Irecv, MPI_Test, MPI_Wait,
+ * MPI_Sendrecv, MPI_Barrier on MPI_DOUBLE buffers) so an MPI transport is a thin wrapper. A receive takes the oldest
+ * message from its source with its tag, whatever was sent in between, and must name that message's element count.
+ * The blocking calls are built on the non-blocking ones.
+ */
+class Communicator
+{
+public:
+	using Request = int;
+
+	virtual ~Communicator() = default;
+
+	virtual int getRank() const = 0;
+	virtual int getSize() const = 0;
+
+	/**
+	 * @brief Start a send, the buffer must stay untouched until the request completes.
+	 */
+	virtual Request isend(const double* buffer, size_t count, int destination, int tag) = 0;
+
+	/**
+	 * @brief Start a receive of exactly count values into buffer.
+	 */
+	virtual Request ireceive(double* buffer, size_t count, int source, int tag) = 0;
+
+	/**
+	 * @brief Advance outstanding transfers and check one of them.
+	 * @return true once the request is complete, the request is then released.
+	 * @throw std::runtime_error if the message matching a receive has a different count.
+	 */
+	virtual bool test(Request request) = 0;
+
+	virtual void barrier() = 0;
+
+	virtual void wait(Request request)
+	{
+		while(!test(request)) {
+			std::this_thread::yield();
+		}
+	}
+
+	void waitAll(const std::vector<Request>& requests)
+	{
+		for(Request request : requests) {
+			wait(request);
+		}
+	}
+
+	/**
+	 * @brief Blocking send, returns once the buffer can be reused.
+	 */
+	virtual void send(const double* buffer, size_t count, int destination, int tag)
+	{
+		wait(isend(buffer, count, destination, tag));
+	}
+
+	virtual void receive(double* buffer, size_t count, int source, int tag)
+	{
+		wait(ireceive(buffer, count, source, tag));
+	}
+
+	/**
+	 * @brief Send and receive at the same time, safe when every rank sends to its neighbour first.
+	 */
+	virtual void sendReceive(const double* sendBuffer,
+							 size_t        sendCount,
+							 int           destination,
+							 int           sendTag,
+							 double*       receiveBuffer,
+							 size_t        receiveCount,
+							 int           source,
+							 int           receiveTag)
+	{
+		waitAll({isend(sendBuffer, sendCount, destination, sendTag),
+				 ireceive(receiveBuffer, receiveCount, source, receiveTag)});
+	}
+};
+#endif  // COMMUNICATOR
@@ -0,0 +1,260 @@
+#ifndef FIELD_FILE
+#define FIELD_FILE
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief On-disk header of a binary field file.
+ *
+ * The header is followed by fieldCount names of FIELD_NAME_LENGTH bytes each, then by the fields themselves as raw
+ * row-major arrays of n * m values, back to back in name order. The first field starts at a 64 byte aligned offset so
+ * a mapped file can be read in place. Values are stored in native byte order.
+ */
+struct FieldFileHeader {
+	char          magic[8];
+	std::uint32_t version;
+	std::uint32_t precision;  // bytes per value, 4 or 8
+	std::uint32_t n;          // rows
+	std::uint32_t m;          // columns
+	std::uint64_t step;
+	double        time;
+	std::uint32_t fieldCount;
+	std::uint32_t reserved;
+};
+
+/**
+ * @brief Read-only view of one field inside a mapped file, valid while the FieldFile is alive.
+ */
+template<typename T>
+struct FieldView {
+	const T*     data;
+	unsigned int n;
+	unsigned int m;
+
+	T operator()(unsigned int row, unsigned int col) const
+	{
+		return data[row * m + col];
+	}
+	size_t size() const
+	{
+		return static_cast<size_t>(n) * m;
+	}
+};
+
+/**
+ * @brief Binary snapshot file, written in one pass and read back through mmap without copying.
+ */
+class FieldFile
+{
+public:
+	static inline constexpr char          MAGIC[8]          = "D2Q9FLD";
+	static inline constexpr std::uint32_t VERSION           = 1;
+	static inline constexpr size_t        FIELD_NAME_LENGTH = 32;
+	static inline constexpr size_t        DATA_ALIGNMENT    = 64;
+
+private:
+	void*                    mMapping;
+	size_t                   mSize;
+	FieldFileHeader          mHeader;
+	std::vector<std::string> mNames;
+	const char*              mData;
+
+public:
+	/**
+	 * @brief Map the file and validate its header.
+	 */
+	FieldFile(const std::string& path): mMapping(MAP_FAILED), mSize(0)
+	{
+		int descriptor = ::open(path.c_str(), O_RDONLY);
+		if(descriptor < 0) {
+			throw std::runtime_error("Unable to open field file " + path);
+		}
+		struct stat status;
+		if(::fstat(descriptor, &status) == 0) {
+			mSize = status.st_size;
+		}
+		if(mSize >= sizeof(FieldFileHeader)) {
+			mMapping = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, descriptor, 0);
+		}
+		::close(descriptor);
+		if(mMapping == MAP_FAILED) {
+			throw std::runtime_error("Unable to map field file " + path);
+		}
+
+		std::memcpy(&mHeader, mMapping, sizeof(FieldFileHeader));
+		if(std::memcmp(mHeader.magic, MAGIC, sizeof(MAGIC)) != 0 || mHeader.version != VERSION ||
+		   (mHeader.precision != sizeof(float) && mHeader.precision != sizeof(double))) {
+			::munmap(mMapping, mSize);
+			throw std::runtime_error("Not a field file: " + path);
+		}
+		size_t offset = dataOffset(mHeader.fieldCount);
+		if(mSize < offset || !fieldsFit(mSize - offset)) {
+			::munmap(mMapping, mSize);
+			throw std::runtime_error("Truncated field file: " + path);
+		}
+
+		const char* names = static_cast<const char*>(mMapping) + sizeof(FieldFileHeader);
+		for(size_t i = 0; i < mHeader.fieldCount; i++) {
+			const char* name = names + i * FIELD_NAME_LENGTH;
+			mNames.push_back(std::string(name, strnlen(name, FIELD_NAME_LENGTH)));
+		}
+		mData = static_cast<const char*>(mMapping) + offset;
+	}
+
+	~FieldFile()
+	{
+		::munmap(mMapping, mSize);
+	}
+
+	// The views point into the mapping, keep it unique
+	FieldFile(FieldFile const&)            = delete;
+	FieldFile& operator=(FieldFile const&) = delete;
+
+	unsigned int getN() const
+	{
+		return mHeader.n;
+	}
+	unsigned int getM() const
+	{
+		return mHeader.m;
+	}
+	unsigned int getPrecision() const
+	{
+		return mHeader.precision;
+	}
+	std::uint64_t getStep() const
+	{
+		return mHeader.step;
+	}
+	double getTime() const
+	{
+		return mHeader.time;
+	}
+	const std::vector<std::string>& getFieldNames() const
+	{
+		return mNames;
+	}
+
+	/**
+	 * @brief Zero-copy view of the named field.
+	 * @tparam T float or double, must match the stored precision.
+	 */
+	template<typename T>
+	FieldView<T> getField(const std::string& name) const
+	{
+		if(sizeof(T) != mHeader.precision) {
+			throw std::invalid_argument("Field precision mismatch.");
+		}
+		for(size_t i = 0; i < mNames.size(); i++) {
+			if(mNames[i] == name) {
+				const T* data = reinterpret_cast<const T*>(mData + i * fieldBytes(mHeader));
+				return FieldView<T>{data, mHeader.n, mHeader.m};
+			}
+		}
+		throw std::out_of_range("No field named " + name);
+	}
+
+	/**
+	 * @brief Write fields stored back to back as n * m doubles each.
+	 * @param precision sizeof(double) to keep the values as they are, sizeof(float) to halve the file size.
+	 */
+	static void write(const std::string&              path,
+					  unsigned int                    n,
+					  unsigned int                    m,
+					  std::uint64_t                   step,
+					  double                          time,
+					  const std::vector<std::string>& names,
+					  const double*                   data,
+					  unsigned int                    precision = sizeof(double))
+	{
+		if(precision != sizeof(float) && precision != sizeof(double)) {
+			throw std::invalid_argument("Field precision must be 4 or 8 bytes.");
+		}
+
+		FieldFileHeader header = {};
+		std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+		header.version    = VERSION;
+		header.precision  = precision;
+		header.n          = n;
+		header.m          = m;
+		header.step       = step;
+		header.time       = time;
+		header.fieldCount = names.size();
+
+		std::vector<char> preamble(dataOffset(names.size()), 0);
+		std::memcpy(preamble.data(), &header, sizeof(FieldFileHeader));
+		for(size_t i = 0; i < names.size(); i++) {
+			if(names[i].size() > FIELD_NAME_LENGTH) {
+				throw std::invalid_argument("Field name too long: " + names[i]);
+			}
+			std::memcpy(preamble.data() + sizeof(FieldFileHeader) + i * FIELD_NAME_LENGTH,
+						names[i].data(),
+						names[i].size());
+		}
+
+		std::ofstream file(path, std::ios::binary);
+		if(!file) {
+			throw std::runtime_error("Unable to open field file " + path);
+		}
+		file.write(preamble.data(), preamble.size());
+
+		size_t length = names.size() * n * m;
+		if(precision == sizeof(double)) {
+			file.write(reinterpret_cast<const char*>(data), sizeof(double) * length);
+		} else {
+			// Narrow in blocks so large frames do not need a second full-size buffer
+			constexpr size_t   BLOCK = 4096;
+			std::vector<float> block(BLOCK);
+			for(size_t i = 0; i < length; i += BLOCK) {
+				size_t count = std::min(BLOCK, length - i);
+				for(size_t j = 0; j < count; j++) {
+					block[j] = static_cast<float>(data[i + j]);
+				}
+				file.write(reinterpret_cast<const char*>(block.data()), sizeof(float) * count);
+			}
+		}
+		if(!file) {
+			throw std::runtime_error("Unable to write field file " + path);
+		}
+	}
+
+private:
+	static size_t dataOffset(size_t fieldCount)
+	{
+		size_t size = sizeof(FieldFileHeader) + fieldCount * FIELD_NAME_LENGTH;
+		return (size + DATA_ALIGNMENT - 1) / DATA_ALIGNMENT * DATA_ALIGNMENT;
+	}
+
+	/**
+	 * @brief Whether the fields of the header fit into size bytes. The header comes from the file, so its values are
+	 * divided into the size instead of multiplied up, which could wrap around and pass a crafted header.
+	 */
+	bool fieldsFit(size_t size) const
+	{
+		if(mHeader.fieldCount == 0) {
+			return true;
+		}
+		const size_t values = static_cast<size_t>(mHeader.n) * mHeader.m;  // two 32-bit factors, no wrap-around
+		if(values == 0 || values > size / mHeader.precision) {
+			return false;
+		}
+		return mHeader.fieldCount <= size / (values * mHeader.precision);
+	}
+
+	static size_t fieldBytes(const FieldFileHeader& header)
+	{
+		return static_cast<size_t>(header.n) * header.m * header.precision;
+	}
+};
+#endif  // FIELD_FILE
@@ -0,0 +1,331 @@
+#ifndef LATTICE
+#define LATTICE
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+/**
+ * @brief Compile-time lattice descriptors: the velocities c_k = (CX[k], CY[k]) and weights w_k of a velocity set,
+ * direction 0 at rest.
+ *
+ * Kernels take the descriptor as a template parameter. Their loops over the directions then have a constant trip
+ * count and read constant tables, so the compiler unrolls them and folds the zero components of c_k away, the same
+ * code as the hand-unrolled nine lines. x points to the right and y up while the rows of the solvers count
+ * downwards: f_k moves by (-CY[k], CX[k]) in (row, column) per step.
+ */
+struct D2Q5 {
+	static inline constexpr unsigned int Q                           = 5;
+	static inline constexpr double       INVERSE_SOUND_SPEED_SQUARED = 3;
+	static inline constexpr int          CX[Q]                       = {0, 1, 0, -1, 0};
+	static inline constexpr int          CY[Q]                       = {0, 0, 1, 0, -1};
+	static inline constexpr double       WEIGHT[Q]                   = {1 / 3.0, 1 / 6.0, 1 / 6.0, 1 / 6.0, 1 / 6.0};
+};
+
+/**
+ * @brief The velocity set of the solvers, in the direction order documented in LatticeBoltzmannMethodD2Q9.
+ */
+struct D2Q9 {
+	static inline constexpr unsigned int Q                           = 9;
+	static inline constexpr double       INVERSE_SOUND_SPEED_SQUARED = 3;
+	static inline constexpr int          CX[Q]                       = {0, 1, 0, -1, 0, 1, -1, -1, 1};
+	static inline constexpr int          CY[Q]                       = {0, 0, 1, 0, -1, 1, 1, -1, -1};
+	static inline constexpr double       WEIGHT[Q] = {
+		4 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 36.0, 1 / 36.0, 1 / 36.0, 1 / 36.0};
+};
+
+/**
+ * @brief D2Q9 plus the four axis velocities of length 2, isotropic to fourth order with c_s^2 = 1/2.
+ */
+struct D2Q13 {
+	static inline constexpr unsigned int Q                           = 13;
+	static inline constexpr double       INVERSE_SOUND_SPEED_SQUARED = 2;
+	static inline constexpr int          CX[Q]                       = {0, 1, 0, -1, 0, 1, -1, -1, 1, 2, 0, -2, 0};
+	static inline constexpr int          CY[Q]                       = {0, 0, 1, 0, -1, 1, 1, -1, -1, 0, 2, 0, -2};
+	static inline constexpr double       WEIGHT[Q] = {
+		3 / 8.0, 1 / 12.0, 1 / 12.0, 1 / 12.0, 1 / 12.0, 1 / 16.0, 1 / 16.0, 1 / 16.0, 1 / 16.0,
+		1 / 96.0, 1 / 96.0, 1 / 96.0, 1 / 96.0};
+};
+
+/**
+ * @brief Direction of -c_k for every k.
+ */
+template<class DESCRIPTOR>
+inline constexpr std::array<unsigned int, DESCRIPTOR::Q> latticeOpposite()
+{
+	std::array<unsigned int, DESCRIPTOR::Q> opposite{};
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		for(unsigned int o = 0; o < DESCRIPTOR::Q; o++) {
+			if(DESCRIPTOR::CX[o] == -DESCRIPTOR::CX[k] && DESCRIPTOR::CY[o] == -DESCRIPTOR::CY[k]) {
+				opposite[k] = o;
+			}
+		}
+	}
+	return opposite;
+}
+
+template<class DESCRIPTOR>
+inline constexpr std::array<unsigned int, DESCRIPTOR::Q> LATTICE_OPPOSITE = latticeOpposite<DESCRIPTOR>();
+
+/**
+ * @brief Movement of f_k in rows per step, the column moves by CX[k].
+ */
+template<class DESCRIPTOR>
+inline constexpr std::array<int, DESCRIPTOR::Q> latticeRowOffset()
+{
+	std::array<int, DESCRIPTOR::Q> offset{};
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		offset[k] = -DESCRIPTOR::CY[k];
+	}
+	return offset;
+}
+
+/**
+ * @brief Largest number of rows or columns a population moves per step, 1 for D2Q5 and D2Q9, 2 for D2Q13.
+ */
+template<class DESCRIPTOR>
+inline constexpr int latticeReach()
+{
+	int reach = 0;
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		const int cx = DESCRIPTOR::CX[k] < 0 ? -DESCRIPTOR::CX[k] : DESCRIPTOR::CX[k];
+		const int cy = DESCRIPTOR::CY[k] < 0 ? -DESCRIPTOR::CY[k] : DESCRIPTOR::CY[k];
+		reach        = cx > reach ? cx : reach;
+		reach        = cy > reach ? cy : reach;
+	}
+	return reach;
+}
+
+/**
+ * @brief Whether f_k enters the lattice through a side, sides in top, bottom, left, right order.
+ */
+template<class DESCRIPTOR>
+inline constexpr bool latticeEnters(unsigned int side, unsigned int k)
+{
+	switch(side) {
+	case 0: return DESCRIPTOR::CY[k] < 0;
+	case 1: return DESCRIPTOR::CY[k] > 0;
+	case 2: return DESCRIPTOR::CX[k] > 0;
+	default: return DESCRIPTOR::CX[k] < 0;
+	}
+}
+
+/**
+ * @brief Moment sum_k c_x^a c_y^b w_k of the weights, used to check the isotropy of a descriptor.
+ */
+template<class DESCRIPTOR>
+inline constexpr double latticeMoment(unsigned int a, unsigned int b)
+{
+	double moment = 0;
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		double term = DESCRIPTOR::WEIGHT[k];
+		for(unsigned int i = 0; i < a; i++) {
+			term *= DESCRIPTOR::CX[k];
+		}
+		for(unsigned int i = 0; i < b; i++) {
+			term *= DESCRIPTOR::CY[k];
+		}
+		moment += term;
+	}
+	return moment;
+}
+
+/**
+ * @brief Weighted sum of the populations f[k * stride] of one node, summed in direction order.
+ */
+template<class DESCRIPTOR>
+inline double latticeSum(const double* f, std::ptrdiff_t stride)
+{
+	double sum = f[0] * DESCRIPTOR::WEIGHT[0];
+	for(unsigned int k = 1; k < DESCRIPTOR::Q; k++) {
+		sum += f[k * stride] * DESCRIPTOR::WEIGHT[k];
+	}
+	return sum;
+}
+
+/**
+ * @brief Linear advection factor 1 + c_k.u / c_s^2 of the scalar equilibrium, without terms for zero components.
+ */
+template<class DESCRIPTOR>
+inline double latticeAdvection(unsigned int k, double u, double v)
+{
+	double factor = 1;
+	if(DESCRIPTOR::CX[k] != 0) {
+		factor += DESCRIPTOR::INVERSE_SOUND_SPEED_SQUARED * DESCRIPTOR::CX[k] * u;
+	}
+	if(DESCRIPTOR::CY[k] != 0) {
+		factor += DESCRIPTOR::INVERSE_SOUND_SPEED_SQUARED * DESCRIPTOR::CY[k] * v;
+	}
+	return factor;
+}
+
+/**
+ * @brief Coefficients of the flow equilibrium factor 1 + u U + v V + u^2 U2 + v^2 V2 + |u|^2 UV2 of one direction.
+ *
+ * The factor is the one the solvers have always used, 1 + c_k.u / c_s^2 + (c_x^2 u^2 + c_y^2 v^2) / (2 c_s^4) -
+ * |u|^2 / (2 c_s^2) without the mixed term c_x c_y u v. On a diagonal with c_x^2 = c_y^2 the quadratic terms fold
+ * into one of |u|^2, which keeps the sums of the hand-written D2Q9 lines.
+ */
+struct LatticeEquilibriumTerms {
+	double u;
+	double v;
+	double u2;
+	double v2;
+	double uv2;
+};
+
+template<class DESCRIPTOR>
+inline constexpr LatticeEquilibriumTerms latticeEquilibriumTerms(unsigned int k)
+{
+	constexpr double C  = DESCRIPTOR::INVERSE_SOUND_SPEED_SQUARED;
+	const double     cx = DESCRIPTOR::CX[k];
+	const double     cy = DESCRIPTOR::CY[k];
+	if(cx != 0 && cx * cx == cy * cy) {
+		return {C * cx, C * cy, 0, 0, C * C / 2 * cx * cx - C / 2};
+	}
+	return {C * cx, C * cy, C * C / 2 * cx * cx, C * C / 2 * cy * cy, -C / 2};
+}
+
+/**
+ * @brief Flow equilibrium factor of direction k, see LatticeEquilibriumTerms, summed in the order of the terms.
+ */
+template<class DESCRIPTOR>
+inline double latticeEquilibrium(unsigned int k, double u, double v)
+{
+	const LatticeEquilibriumTerms terms  = latticeEquilibriumTerms<DESCRIPTOR>(k);
+	double                        factor = latticeAdvection<DESCRIPTOR>(k, u, v);
+	if(terms.u2 != 0) {
+		factor += terms.u2 * (u * u);
+	}
+	if(terms.v2 != 0) {
+		factor += terms.v2 * (v * v);
+	}
+	return factor + terms.uv2 * (u * u + v * v);
+}
+
+/**
+ * @brief A double as kernel or formula text, printed with enough digits to read back to the same value.
+ */
+inline std::string latticeLiteral(double value)
+{
+	char number[32];
+	std::snprintf(number, sizeof(number), "%.17g", value);
+	return number;
+}
+
+/**
+ * @brief The text " + c * variable" or " - |c| * variable".
+ */
+inline std::string latticeTerm(double coefficient, const std::string& variable)
+{
+	return (coefficient < 0 ? " - " : " + ") + latticeLiteral(std::abs(coefficient)) + " * " + variable;
+}
+
+/**
+ * @brief latticeAdvection() as text over the given variable names, valid OpenCL C and OpenCLMain formula alike.
+ */
+template<class DESCRIPTOR>
+inline std::string latticeAdvectionFormula(unsigned int k, const std::string& u, const std::string& v)
+{
+	const LatticeEquilibriumTerms terms   = latticeEquilibriumTerms<DESCRIPTOR>(k);
+	std::string                   formula = "1";
+	if(terms.u != 0) {
+		formula += latticeTerm(terms.u, u);
+	}
+	if(terms.v != 0) {
+		formula += latticeTerm(terms.v, v);
+	}
+	return formula;
+}
+
+/**
+ * @brief latticeEquilibrium() as text, the squares passed as names (or parenthesised expressions) of their own.
+ */
+template<class DESCRIPTOR>
+inline std::string latticeEquilibriumFormula(unsigned int       k,
+											 const std::string& u,
+											 const std::string& v,
+											 const std::string& u2,
+											 const std::string& v2,
+											 const std::string& uv2)
+{
+	const LatticeEquilibriumTerms terms   = latticeEquilibriumTerms<DESCRIPTOR>(k);
+	std::string                   formula = latticeAdvectionFormula<DESCRIPTOR>(k, u, v);
+	if(terms.u2 != 0) {
+		formula += latticeTerm(terms.u2, u2);
+	}
+	if(terms.v2 != 0) {
+		formula += latticeTerm(terms.v2, v2);
+	}
+	return formula + latticeTerm(terms.uv2, uv2);
+}
+
+/**
+ * @brief latticeSum() as an OpenCLMain formula over the inputs A, B, ... in direction order.
+ */
+template<class DESCRIPTOR>
+inline std::string latticeSumFormula()
+{
+	std::string formula;
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		formula += (k == 0 ? "" : " + ") + std::string(1, static_cast<char>('A' + k)) + " * (" +
+				   latticeLiteral(DESCRIPTOR::WEIGHT[k]) + ")";
+	}
+	return formula;
+}
+
+/**
+ * @brief OpenCL C of the descriptor: the tables CX, CY, ROW_OFFSET, OPPOSITE and WEIGHT, INVERSE_SOUND_SPEED_SQUARED
+ * and the kernel twins latticeSum(), latticeEnters(), latticeAdvection() and latticeEquilibrium() of the functions
+ * above, so kernels and host code use the same numbers in the same order.
+ */
+template<class DESCRIPTOR>
+inline std::string latticeSource()
+{
+	auto table = [](const char* declaration, auto value) {
+		std::string source = declaration + std::string("[") + std::to_string(DESCRIPTOR::Q) + "] = ";
+		for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+			source += (k == 0 ? "{" : ", ") + latticeLiteral(value(k));
+		}
+		return source + "};\n";
+	};
+
+	std::string source = table("constant int CX", [](unsigned int k) { return DESCRIPTOR::CX[k]; });
+	source += table("constant int CY", [](unsigned int k) { return DESCRIPTOR::CY[k]; });
+	source += table("constant int ROW_OFFSET", [](unsigned int k) { return -DESCRIPTOR::CY[k]; });
+	source += table("constant int OPPOSITE", [](unsigned int k) { return LATTICE_OPPOSITE<DESCRIPTOR>[k]; });
+	source += table("constant double WEIGHT", [](unsigned int k) { return DESCRIPTOR::WEIGHT[k]; });
+	source += "constant double INVERSE_SOUND_SPEED_SQUARED = " +
+			  latticeLiteral(DESCRIPTOR::INVERSE_SOUND_SPEED_SQUARED) + ";\n";
+
+	source += R"(
+	double latticeSum(const double* f) {
+		double sum = f[0] * WEIGHT[0];
+		for (int k = 1; k < )" + std::to_string(DESCRIPTOR::Q) + R"(; k++) {
+			sum += f[k] * WEIGHT[k];
+		}
+		return sum;
+	}
+
+	bool latticeEnters(int side, int k) {
+		switch (side) {
+		case 0: return CY[k] < 0;
+		case 1: return CY[k] > 0;
+		case 2: return CX[k] > 0;
+		default: return CX[k] < 0;
+		}
+	}
+)";
+	std::string advection   = "\tdouble latticeAdvection(int k, double u, double v) {\n\t\tswitch (k) {\n";
+	std::string equilibrium = "\tdouble latticeEquilibrium(int k, double u, double v) {\n\t\tdouble u2  = u * u;\n"
+							  "\t\tdouble v2  = v * v;\n\t\tdouble uv2 = u2 + v2;\n\t\tswitch (k) {\n";
+	for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+		const std::string label = "\t\tcase " + std::to_string(k) + ": return ";
+		advection += label + latticeAdvectionFormula<DESCRIPTOR>(k, "u", "v") + ";\n";
+		equilibrium += label + latticeEquilibriumFormula<DESCRIPTOR>(k, "u", "v", "u2", "v2", "uv2") + ";\n";
+	}
+	return source + "\n" + advection + "\t\t}\n\t\treturn 1;\n\t}\n\n" + equilibrium + "\t\t}\n\t\treturn 1;\n\t}\n";
+}
+#endif  // LATTICE
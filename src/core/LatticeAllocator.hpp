@@ -0,0 +1,146 @@
+#ifndef LATTICE_ALLOCATOR
+#define LATTICE_ALLOCATOR
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+
+inline constexpr size_t LATTICE_ALIGNMENT  = 4096;  // a page, more than any CL_DEVICE_MEM_BASE_ADDR_ALIGN
+inline constexpr size_t LATTICE_CACHE_LINE = 64;
+
+/**
+ * @brief Size of the block LatticeAllocator reserves for the given bytes, rounded up to whole cache lines. Buffers
+ * wrapping Matrix storage may cover all of it.
+ */
+inline size_t latticeAllocationBytes(size_t bytes)
+{
+	return (bytes + LATTICE_CACHE_LINE - 1) / LATTICE_CACHE_LINE * LATTICE_CACHE_LINE;
+}
+
+/**
+ * @brief Allocator for lattice storage that leaves the first touch to the kernels.
+ *
+ * Linux places a page on the NUMA node of the thread that first writes it. std::vector value-initialises new
+ * elements on the calling thread, which puts a whole lattice on one socket. This allocator default-initialises
+ * instead, so resize() does not write anything, and Matrix then initialises its rows in parallel with the same
+ * static row split the kernels use (see rowTile()). Each row tile ends up on the node of the thread that will work
+ * on it.
+ *
+ * Blocks start on a page and span whole cache lines (see latticeAllocationBytes()), the placement OpenCL CPU
+ * devices need to use host memory in place: a buffer created with CL_MEM_USE_HOST_PTR over Matrix storage is then
+ * zero-copy.
+ */
+template<typename T>
+class LatticeAllocator
+{
+public:
+	using value_type = T;
+
+	template<typename U>
+	struct rebind {
+		using other = LatticeAllocator<U>;
+	};
+
+	LatticeAllocator() noexcept = default;
+	template<typename U>
+	LatticeAllocator(const LatticeAllocator<U>&) noexcept
+	{
+	}
+
+	T* allocate(size_t n)
+	{
+		if(n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+			throw std::bad_array_new_length();
+		}
+		void* block = ::operator new(latticeAllocationBytes(n * sizeof(T)), std::align_val_t(LATTICE_ALIGNMENT));
+		return static_cast<T*>(block);
+	}
+
+	void deallocate(T* pointer, size_t) noexcept
+	{
+		::operator delete(pointer, std::align_val_t(LATTICE_ALIGNMENT));
+	}
+
+	// Default-initialisation, a no-op for arithmetic types, so the memory stays untouched
+	template<typename U>
+	void construct(U* pointer) noexcept(std::is_nothrow_default_constructible<U>::value)
+	{
+		::new(static_cast<void*>(pointer)) U;
+	}
+
+	template<typename U, typename... Args>
+	void construct(U* pointer, Args&&... args)
+	{
+		::new(static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+	}
+
+	template<typename U>
+	bool operator==(const LatticeAllocator<U>&) const noexcept
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const LatticeAllocator<U>&) const noexcept
+	{
+		return false;
+	}
+};
+
+/**
+ * @brief Rows [first, second) of an n-row lattice owned by the given thread.
+ *
+ * The same contiguous split as `#pragma omp parallel for schedule(static)` over rows, so a row loop written that way
+ * touches exactly the rows its thread placed.
+ */
+inline std::pair<unsigned int, unsigned int> rowTile(unsigned int rows, unsigned int thread, unsigned int threads)
+{
+	unsigned int chunk     = rows / threads;
+	unsigned int remainder = rows % threads;
+	unsigned int first     = thread * chunk + std::min(thread, remainder);
+	return std::pair<unsigned int, unsigned int>(first, first + chunk + (thread < remainder ? 1 : 0));
+}
+
+/**
+ * @brief Pin every OpenMP thread to one CPU of the process affinity mask, thread i to the i-th allowed CPU.
+ *
+ * Call before building lattices, otherwise the scheduler may later move a thread away from the memory it touched.
+ * Setting OMP_PROC_BIND/OMP_PLACES in the environment achieves the same without code.
+ */
+inline void pinThreads()
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if(sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) {
+		throw std::runtime_error("Unable to read the CPU affinity mask.");
+	}
+	int cpuCount = CPU_COUNT(&allowed);
+
+	bool failed = false;
+#pragma omp parallel reduction(|| : failed)
+	{
+		int target = omp_get_thread_num() % cpuCount;
+		for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if(CPU_ISSET(cpu, &allowed) && target-- == 0) {
+				cpu_set_t single;
+				CPU_ZERO(&single);
+				CPU_SET(cpu, &single);
+				failed = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &single) != 0;
+				break;
+			}
+		}
+	}
+	if(failed) {
+		throw std::runtime_error("Unable to pin OpenMP threads.");
+	}
+}
+#endif  // LATTICE_ALLOCATOR
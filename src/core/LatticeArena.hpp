@@ -0,0 +1,82 @@
+#ifndef LATTICE_ARENA
+#define LATTICE_ARENA
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Matrix.hpp"
+
+/**
+ * @brief Pool of scratch fields recycling lattice-sized storage from one step to the next.
+ *
+ * acquire() hands out a field, taking the storage of a field given back by release() when the dimensions match and
+ * allocating only when none does. A solver releases every field a step replaces, so once the first steps have filled
+ * the pool the following ones find all their fields in it and the number of allocations stops growing.
+ *
+ * Only the lattice-sized storage is pooled. A step of the CPU backend allocates nothing at all. The OpenCL kernels are
+ * created once per stream and solver, but a step of the OpenCL solver still makes small bookkeeping allocations per
+ * formula call: the tokens of the parsed formulas, the input lists, the generated source and the result map of
+ * OpenCLStream::evaluateArithmeticFormulas(). Their size does not grow with the lattice.
+ */
+class LatticeArena
+{
+private:
+	std::vector<Matrix<double>> mFree;
+	size_t                      mAllocations = 0;
+
+public:
+	/**
+	 * @brief An unshifted, unpadded nRow x nColumn field. A recycled field keeps its old values, overwrite them.
+	 */
+	Matrix<double> acquire(const unsigned int nRow, const unsigned int nColumn)
+	{
+		for(size_t i = mFree.size(); i-- > 0;) {
+			if(mFree[i].getN() == nRow && mFree[i].getM() == nColumn) {
+				Matrix<double> field(std::move(mFree[i]));
+				mFree[i] = std::move(mFree.back());
+				mFree.pop_back();
+				field.resetShift();
+				return field;
+			}
+		}
+		mAllocations++;
+		return Matrix<double>(nRow, nColumn);
+	}
+
+	/**
+	 * @brief Give the storage of a field back to the pool, the field is left empty. Empty and padded fields are not
+	 * kept.
+	 */
+	void release(Matrix<double>&& field)
+	{
+		if(field.getLength() != 0 && field.getPitch() == field.getM()) {
+			mFree.push_back(std::move(field));
+		}
+	}
+
+	/**
+	 * @brief Fields allocated by acquire() so far. It stays constant once stepping has reached a steady state.
+	 */
+	size_t getAllocationCount() const
+	{
+		return mAllocations;
+	}
+
+	/**
+	 * @brief Fields waiting in the pool.
+	 */
+	size_t getFreeCount() const
+	{
+		return mFree.size();
+	}
+
+	/**
+	 * @brief Free the storage of every pooled field.
+	 */
+	void clear()
+	{
+		mFree = std::vector<Matrix<double>>();
+	}
+};
+#endif  // LATTICE_ARENA
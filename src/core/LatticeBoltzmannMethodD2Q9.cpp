@@ -2,9 +2,197 @@
 
 #include <omp.h>
 #include <cassert>
+#include <cmath>
+#include <limits>
 
+#include "Checkpoint.hpp"
 #include "OpenCLMain.hpp"
 
+namespace
+{
+// Collision of both fields in one node visit, the twins of collideAndPushFused() in LatticeBoltzmannMethodD2Q9CPU with
+// the operators and FlowModel extensions chosen at run time. Each population is read through its shift like the
+// formula kernels read it, the output is unshifted.
+const std::string fusedCollisionKernelCode = collisionOperatorSource() + R"(
+	// f <- f - R n, R being the relaxation of the operator, see relax()
+	void relaxWith(double* f, const double* n, double omega, const int collisionOperator, const int temperature) {
+		if (collisionOperator == 1) {  // TRT
+			double partner = trtPartnerRate(omega);
+			relaxTRT(f, n, temperature ? partner : omega, temperature ? omega : partner);
+		} else if (collisionOperator == 2) {  // MRT
+			relaxMRT(f, n, omega);
+		} else {  // BGK
+			for (int k = 0; k < 9; k++) {
+				f[k] -= omega * n[k];
+			}
+		}
+	}
+
+	void kernel fusedCollision(global double* out, global const double* in, global const int* shifts, global const double* fields, const int densityOperator, const int temperatureOperator, const double smagorinsky, const double gravityX, const double gravityY, const double referenceTemperature, const unsigned int N, const unsigned int M) {
+		unsigned int i      = get_global_id(0);
+		unsigned int length = N * M;
+		unsigned int row    = i / M;
+		unsigned int col    = i % M;
+
+		double f[9];
+		double g[9];
+		for (int k = 0; k < 9; k++) {
+			int d = k;
+			int t = 9 + k;
+			f[k]  = in[d * length + ((row + shifts[2 * d]) % N) * M + (col + M - shifts[2 * d + 1]) % M];
+			g[k]  = in[t * length + ((row + shifts[2 * t]) % N) * M + (col + M - shifts[2 * t + 1]) % M];
+		}
+
+		double rho    = fields[i];
+		double T      = fields[length + i];
+		double omegaM = fields[2 * length + i];
+		double omegaS = fields[3 * length + i];
+		double u      = fields[4 * length + i];
+		double v      = fields[5 * length + i];
+
+		double eq[9];
+		double n[9];
+		for (int k = 0; k < 9; k++) {
+			eq[k] = WEIGHT[0] * T * latticeAdvection(k, u, v);
+			n[k]  = g[k] - eq[k];
+		}
+		relaxWith(g, n, omegaS, temperatureOperator, 1);
+
+		for (int k = 0; k < 9; k++) {
+			eq[k] = WEIGHT[0] * rho * latticeEquilibrium(k, u, v);
+			n[k]  = f[k] - eq[k];
+		}
+		if (smagorinsky > 0) {
+			omegaM = smagorinskyRate(n, omegaM, rho, smagorinsky);
+		}
+		relaxWith(f, n, omegaM, densityOperator, 0);
+
+		// Boussinesq buoyancy as a Guo force, f <- f + (1 - R / 2) source, see force()
+		if (gravityX != 0 || gravityY != 0) {
+			double buoyancy = rho * (T - referenceTemperature);
+			double source[9];
+			double relaxed[9];
+			guoSource(source, u, v, buoyancy * gravityX, buoyancy * gravityY);
+			for (int k = 0; k < 9; k++) {
+				relaxed[k] = source[k];
+			}
+			relaxWith(relaxed, source, omegaM, densityOperator, 0);
+			for (int k = 0; k < 9; k++) {
+				f[k] += 0.5 * (source[k] + relaxed[k]);
+			}
+		}
+
+		for (int k = 0; k < 9; k++) {
+			out[k * length + i]       = f[k];
+			out[(9 + k) * length + i] = g[k];
+		}
+	}
+)";
+
+// BGK collision of every passive scalar in one node visit, the twin of collideAndPushScalars() in
+// LatticeBoltzmannMethodD2Q9CPU: u and v are read once and shared by all scalars. Populations are read through their
+// shifts, the output is unshifted.
+const std::string scalarCollisionKernelCode = collisionOperatorSource() + R"(
+	void kernel scalarCollision(global double* out, global const double* in, global const int* shifts, global const double* fields, const unsigned int count, const unsigned int N, const unsigned int M) {
+		unsigned int i      = get_global_id(0);
+		unsigned int length = N * M;
+		unsigned int row    = i / M;
+		unsigned int col    = i % M;
+		double       u      = fields[count * length + i];
+		double       v      = fields[(count + 1) * length + i];
+
+		for (unsigned int s = 0; s < count; s++) {
+			double g[9];
+			double T = 0;
+			for (int k = 0; k < 9; k++) {
+				unsigned int t = s * 9 + k;
+				g[k] = in[t * length + ((row + shifts[2 * t]) % N) * M + (col + M - shifts[2 * t + 1]) % M];
+				T += WEIGHT[k] * g[k];
+			}
+			double omega = 1 / ((fields[s * length + i] * INVERSE_SOUND_SPEED_SQUARED) + 0.5);
+			double geq   = omega * WEIGHT[0] * T;
+			for (int k = 0; k < 9; k++) {
+				out[(s * 9 + k) * length + i] = g[k] * (1 - omega) + geq * latticeAdvection(k, u, v);
+			}
+		}
+	}
+)";
+
+// The resulting matrix of the nine populations A-I, the formula twin of buildResultingMatrix()
+const std::string resultingFormula = latticeSumFormula<D2Q9>();
+
+// The BGK collision of one field, one formula per direction: A-I are the populations, J omega, K the resulting matrix,
+// L and M the velocity. The shared terms (1 - J, J * w_0 * K, u^2, v^2, ...) are computed once per node for all nine
+// directions. Built once, the steps only pass them on.
+std::vector<std::pair<std::string, std::string>> collisionFormulas(bool temperature)
+{
+	const std::string scale = " * (1 - J) + J * (" + latticeLiteral(D2Q9::WEIGHT[0]) + ") * K * (";
+
+	std::vector<std::pair<std::string, std::string>> formulas;
+	for(unsigned int k = 0; k < D2Q9::Q; k++) {
+		const std::string name(1, static_cast<char>('A' + k));
+		std::string       factor = latticeAdvectionFormula<D2Q9>(k, "L", "M");
+		if(!temperature) {
+			factor = latticeEquilibriumFormula<D2Q9>(k, "L", "M", "(L * L)", "(M * M)", "(L * L + M * M)");
+		}
+		formulas.emplace_back(name, name + scale + factor + ")");
+	}
+	return formulas;
+}
+
+const std::vector<std::pair<std::string, std::string>> temperatureCollisionFormulas = collisionFormulas(true);
+const std::vector<std::pair<std::string, std::string>> densityCollisionFormulas     = collisionFormulas(false);
+
+LatticeBoltzmannMethodD2Q9CPU::Boundary toCPUBoundary(const LatticeBoltzmannMethodD2Q9::Boundary& side)
+{
+	switch(side.boundary) {
+	case LatticeBoltzmannMethodD2Q9::ADIABATIC: return {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0};
+	case LatticeBoltzmannMethodD2Q9::CONSTANT: return {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, side.parameter1};
+	default: return {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0};
+	}
+}
+
+// Non-blocking copies between a matrix's storage and offset bytes into a buffer of packed rows, the row padding
+// skipped by a rectangular transfer
+void enqueueWriteRows(cl::CommandQueue& queue, const cl::Buffer& buffer, size_t offset, const Matrix<double>& matrix)
+{
+	const size_t rowBytes = sizeof(double) * matrix.getM();
+	if(matrix.getPitch() == matrix.getM()) {
+		queue.enqueueWriteBuffer(buffer, CL_FALSE, offset, rowBytes * matrix.getN(), matrix.getDataData());
+		return;
+	}
+	queue.enqueueWriteBufferRect(buffer,
+								 CL_FALSE,
+								 {offset, 0, 0},
+								 {0, 0, 0},
+								 {rowBytes, matrix.getN(), 1},
+								 rowBytes,
+								 0,
+								 sizeof(double) * matrix.getPitch(),
+								 0,
+								 matrix.getDataData());
+}
+
+void enqueueReadRows(cl::CommandQueue& queue, const cl::Buffer& buffer, size_t offset, Matrix<double>& matrix)
+{
+	const size_t rowBytes = sizeof(double) * matrix.getM();
+	if(matrix.getPitch() == matrix.getM()) {
+		queue.enqueueReadBuffer(buffer, CL_FALSE, offset, rowBytes * matrix.getN(), matrix.getDataData());
+		return;
+	}
+	queue.enqueueReadBufferRect(buffer,
+								CL_FALSE,
+								{offset, 0, 0},
+								{0, 0, 0},
+								{rowBytes, matrix.getN(), 1},
+								rowBytes,
+								0,
+								sizeof(double) * matrix.getPitch(),
+								0,
+								matrix.getDataData());
+}
+}  // namespace
+
 LatticeBoltzmannMethodD2Q9::LatticeBoltzmannMethodD2Q9(unsigned int        height,
 													   unsigned int        width,
 													   Boundary            top,
@@ -16,17 +204,33 @@ LatticeBoltzmannMethodD2Q9::LatticeBoltzmannMethodD2Q9(unsigned int        heigh
 													   std::vector<double> initialDensityArray,
 													   std::vector<double> initialTemperatureArray)
 {
-	mHeight = height + 1;
-	mWidth  = width + 1;
-	mLength = mHeight * mWidth;
-	mTop    = top;
-	mBottom = bottom;
-	mLeft   = left;
-	mRight  = right;
+	mHeight  = height + 1;
+	mWidth   = width + 1;
+	mLength  = mHeight * mWidth;
+	mStep    = 0;
+	mBackend = Backend::OPENCL;
+	mTop     = top;
+	mBottom  = bottom;
+	mLeft    = left;
+	mRight   = right;
 	// mEntities = entities;
 
+	mDiagnosticsInterval    = 0;
+	mScalarBufferCount      = 0;
+	mConvergenceTolerance   = 0;
+	mConvergenceInterval    = 1;
+	mConvergenceMinInterval = 1;
+	mConvergenceMaxInterval = 1;
+	mConvergenceCheckStep   = 0;
+	mConverged              = false;
+	mResidual               = 0;
+
+	mDensityCollision     = CollisionOperator::BGK;
+	mTemperatureCollision = CollisionOperator::BGK;
+
 	mKinematicViscosityRevised   = true;
 	mDiffusionCoefficientRevised = true;
+	mRowPitch                    = mHeight;
 	mKinematicViscosity          = Matrix<double>(mWidth, mHeight, kinematicViscosityArray);
 	mDiffusionCoefficient        = Matrix<double>(mWidth, mHeight, diffusionCoefficientArray);
 
@@ -37,101 +241,328 @@ LatticeBoltzmannMethodD2Q9::LatticeBoltzmannMethodD2Q9(unsigned int        heigh
 		initialTemperatureArray.resize(mLength);
 	}
 
-#pragma omp parallel sections
-	{
-#pragma omp section
-		{mDensity[0] = Matrix<double>(mWidth, mHeight, initialDensityArray, 4 / 9.0);
+	// One matrix after the other: each constructor first-touches its rows in parallel with the static row split
+	// the kernels use, so every thread's rows are placed on its own NUMA node
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		mDensity[k]     = Matrix<double>(mWidth, mHeight, initialDensityArray, D2Q9::WEIGHT[k]);
+		mTemperature[k] = Matrix<double>(mWidth, mHeight, initialTemperatureArray, D2Q9::WEIGHT[k]);
+	}
 }
-#pragma omp section
+
+void LatticeBoltzmannMethodD2Q9::step(bool saveImage)
 {
-	mDensity[1] = Matrix<double>(mWidth, mHeight, initialDensityArray, 1 / 9.0);
+	updateVelocityMatrix();
+	if(mBackend == Backend::CPU) {
+		advanceCPU(1);
+	} else {
+		collision();
+		collideScalars();
+		streaming();
+	}
+	mStep++;
+
+	if(saveImage && mSnapshotWriter) {
+		writeSnapshot();
+	} else if(saveImage) {
+		buildResultingDensityMatrix();
+		buildResultingTemperatureMatrix();
+		std::cout << "mResultingDensityMatrix\n";
+		mResultingDensityMatrix.print();
+		std::cout << "mResultingTemperatureMatrix\n";
+		mResultingTemperatureMatrix.print();
+	}
+
+	afterSteps();
 }
-#pragma omp section
+
+void LatticeBoltzmannMethodD2Q9::run(unsigned int steps)
 {
-	mDensity[5] = Matrix<double>(mWidth, mHeight, initialDensityArray, 1 / 36.0);
+	if(mBackend == Backend::CPU) {
+		// The velocity stays constant inside a temporal block, blocks end where a check is due
+		updateVelocityMatrix();
+		while(steps > 0 && !mConverged) {
+			unsigned int block = std::min(steps, stepsToNextCheck());
+			advanceCPU(block);
+			mStep += block;
+			steps -= block;
+			afterSteps();
+		}
+	} else {
+		for(unsigned int i = 0; i < steps && !mConverged; i++) {
+			step();
+		}
+	}
 }
-#pragma omp section
+
+void LatticeBoltzmannMethodD2Q9::setBackend(Backend backend)
 {
-	mTemperature[0] = Matrix<double>(mWidth, mHeight, initialTemperatureArray, 4 / 9.0);
+	mBackend = backend;
+	mCPU.resetActivity();
 }
-#pragma omp section
+
+LatticeBoltzmannMethodD2Q9::Backend LatticeBoltzmannMethodD2Q9::getBackend() const
 {
-	mTemperature[1] = Matrix<double>(mWidth, mHeight, initialTemperatureArray, 1 / 9.0);
+	return mBackend;
 }
-#pragma omp section
+
+void LatticeBoltzmannMethodD2Q9::setTemporalBlocking(unsigned int depth, unsigned int tileSize)
 {
-	mTemperature[5] = Matrix<double>(mWidth, mHeight, initialTemperatureArray, 1 / 36.0);
+	mCPU.setTemporalBlocking(depth, tileSize);
 }
+
+void LatticeBoltzmannMethodD2Q9::setTileSkipping(bool enabled)
+{
+	mCPU.setTileSkipping(enabled);
 }
 
-#pragma omp parallel sections
+void LatticeBoltzmannMethodD2Q9::setRowPitch(unsigned int pitch)
 {
-#pragma omp section
-	{
-		mDensity[2] = mDensity[1];
+	// The first matrix rejects a short pitch before anything is padded
+	mKinematicViscosity.setRowPitch(pitch);
+	mDiffusionCoefficient.setRowPitch(pitch);
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		mDensity[k].setRowPitch(pitch);
+		mTemperature[k].setRowPitch(pitch);
 	}
-#pragma omp section
-	{
-		mDensity[3] = mDensity[1];
+	for(LatticeBoltzmannMethodD2Q9CPU::Scalar& scalar : mScalars) {
+		scalar.diffusionCoefficient.setRowPitch(pitch);
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			scalar.populations[k].setRowPitch(pitch);
+		}
 	}
-#pragma omp section
-	{
-		mDensity[4] = mDensity[1];
-	}
-#pragma omp section
-	{
-		mDensity[6] = mDensity[5];
-	}
-#pragma omp section
-	{
-		mDensity[7] = mDensity[5];
+	mRowPitch = pitch;
+	mCPU.resetActivity();
+}
+
+void LatticeBoltzmannMethodD2Q9::setCollision(CollisionOperator density, CollisionOperator temperature)
+{
+	mDensityCollision     = density;
+	mTemperatureCollision = temperature;
+	mCPU.setCollision(density, temperature);
+}
+
+CollisionOperator LatticeBoltzmannMethodD2Q9::getDensityCollision() const
+{
+	return mDensityCollision;
+}
+
+CollisionOperator LatticeBoltzmannMethodD2Q9::getTemperatureCollision() const
+{
+	return mTemperatureCollision;
+}
+
+void LatticeBoltzmannMethodD2Q9::setSmagorinsky(double constant)
+{
+	mCPU.setSmagorinsky(constant);
+	mFlowModel.smagorinsky = constant;
+}
+
+double LatticeBoltzmannMethodD2Q9::getSmagorinsky() const
+{
+	return mFlowModel.smagorinsky;
+}
+
+void LatticeBoltzmannMethodD2Q9::setBuoyancy(double gravityX, double gravityY, double referenceTemperature)
+{
+	mCPU.setBuoyancy(gravityX, gravityY, referenceTemperature);
+	mFlowModel.gravityX             = gravityX;
+	mFlowModel.gravityY             = gravityY;
+	mFlowModel.referenceTemperature = referenceTemperature;
+}
+
+unsigned int LatticeBoltzmannMethodD2Q9::addScalar(std::vector<double> diffusionCoefficientArray,
+												std::vector<double> initialArray,
+												Boundary            top,
+												Boundary            bottom,
+												Boundary            left,
+												Boundary            right)
+{
+	if(initialArray.empty()) {
+		initialArray.resize(mLength);
 	}
-#pragma omp section
-	{
-		mDensity[8] = mDensity[5];
+
+	LatticeBoltzmannMethodD2Q9CPU::Scalar scalar;
+	scalar.diffusionCoefficient = Matrix<double>(mWidth, mHeight, diffusionCoefficientArray);
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		scalar.populations[k] = Matrix<double>(mWidth, mHeight, initialArray, D2Q9::WEIGHT[k]);
 	}
-#pragma omp section
-	{
-		mTemperature[2] = mTemperature[1];
+	scalar.diffusionCoefficient.setRowPitch(mRowPitch);
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		scalar.populations[k].setRowPitch(mRowPitch);
 	}
-#pragma omp section
-	{
-		mTemperature[3] = mTemperature[1];
+	scalar.boundaries = {toCPUBoundary(top), toCPUBoundary(bottom), toCPUBoundary(left), toCPUBoundary(right)};
+	mScalars.push_back(std::move(scalar));
+	mScalarSides.push_back({top, bottom, left, right});
+	return mScalars.size() - 1;
+}
+
+unsigned int LatticeBoltzmannMethodD2Q9::getScalarCount() const
+{
+	return mScalars.size();
+}
+
+Matrix<double> LatticeBoltzmannMethodD2Q9::buildResultingScalarMatrix(unsigned int index) const
+{
+	return LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(mScalars.at(index).populations);
+}
+
+void LatticeBoltzmannMethodD2Q9::setSnapshotWriter(std::shared_ptr<SnapshotWriter> writer)
+{
+	mSnapshotWriter = writer;
+}
+
+unsigned int LatticeBoltzmannMethodD2Q9::getStep() const
+{
+	return mStep;
+}
+
+LatticeBoltzmannMethodD2Q9::Diagnostics LatticeBoltzmannMethodD2Q9::computeDiagnostics()
+{
+	Diagnostics diagnostics;
+	diagnostics.step = mStep;
+	if(mBackend == Backend::CPU) {
+		diagnostics.mass        = LatticeBoltzmannMethodD2Q9CPU::sumResultingMatrix(mDensity);
+		diagnostics.heat        = LatticeBoltzmannMethodD2Q9CPU::sumResultingMatrix(mTemperature);
+		diagnostics.maxVelocity = LatticeBoltzmannMethodD2Q9CPU::maxSpeed(mVelocityU, mVelocityV);
+		return diagnostics;
 	}
-#pragma omp section
-	{
-		mTemperature[4] = mTemperature[1];
+	diagnostics.mass = mStream.evaluateArithmeticReduction(
+		Reduction::SUM,
+		resultingFormula,
+		std::vector<Matrix<double>*>{&mDensity[0],
+									 &mDensity[1],
+									 &mDensity[2],
+									 &mDensity[3],
+									 &mDensity[4],
+									 &mDensity[5],
+									 &mDensity[6],
+									 &mDensity[7],
+									 &mDensity[8]});
+	diagnostics.heat = mStream.evaluateArithmeticReduction(
+		Reduction::SUM,
+		resultingFormula,
+		std::vector<Matrix<double>*>{&mTemperature[0],
+									 &mTemperature[1],
+									 &mTemperature[2],
+									 &mTemperature[3],
+									 &mTemperature[4],
+									 &mTemperature[5],
+									 &mTemperature[6],
+									 &mTemperature[7],
+									 &mTemperature[8]});
+	diagnostics.maxVelocity = std::sqrt(mStream.evaluateArithmeticReduction(
+		Reduction::MAX, "A * A + B * B", std::vector<Matrix<double>*>{&mVelocityU, &mVelocityV}));
+	return diagnostics;
+}
+
+void LatticeBoltzmannMethodD2Q9::setDiagnostics(unsigned int                            interval,
+												std::function<void(const Diagnostics&)> callback)
+{
+	mDiagnosticsInterval = interval;
+	mDiagnosticsCallback = callback;
+}
+
+void LatticeBoltzmannMethodD2Q9::setConvergence(double tolerance, unsigned int interval, unsigned int maxInterval)
+{
+	if(tolerance < 0 || interval == 0 || maxInterval < interval) {
+		throw std::invalid_argument("Convergence tolerance must not be negative and 0 < interval <= maxInterval.");
 	}
-#pragma omp section
-	{
-		mTemperature[6] = mTemperature[5];
+	mConvergenceTolerance   = tolerance;
+	mConvergenceInterval    = interval;
+	mConvergenceMinInterval = interval;
+	mConvergenceMaxInterval = maxInterval;
+	mConvergenceCheckStep   = mStep;
+	mResidual               = 0;
+	mConverged              = false;
+	mPreviousDensity        = Matrix<double>();
+	mPreviousTemperature    = Matrix<double>();
+}
+
+bool LatticeBoltzmannMethodD2Q9::hasConverged() const
+{
+	return mConverged;
+}
+
+double LatticeBoltzmannMethodD2Q9::getResidual() const
+{
+	return mResidual;
+}
+
+unsigned int LatticeBoltzmannMethodD2Q9::getConvergenceInterval() const
+{
+	return mConvergenceInterval;
+}
+
+void LatticeBoltzmannMethodD2Q9::checkpoint(const std::string& path, bool compress) const
+{
+	CheckpointWriter writer(path, compress);
+	writer.write<std::uint32_t>(mHeight);
+	writer.write<std::uint32_t>(mWidth);
+	writer.write<std::uint64_t>(mStep);
+	writer.write<std::uint32_t>(mScalars.size());
+	writer.writeMatrix(mKinematicViscosity);
+	writer.writeMatrix(mDiffusionCoefficient);
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		writer.writeMatrix(mDensity[k]);
 	}
-#pragma omp section
-	{
-		mTemperature[7] = mTemperature[5];
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		writer.writeMatrix(mTemperature[k]);
 	}
-#pragma omp section
-	{
-		mTemperature[8] = mTemperature[5];
+	for(unsigned int s = 0; s < mScalars.size(); s++) {
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			writer.writeMatrix(mScalars[s].populations[k]);
+		}
+		writer.writeMatrix(mScalars[s].diffusionCoefficient);
+		for(const Boundary& side : mScalarSides[s]) {
+			writer.write<std::uint32_t>(side.boundary);
+			writer.write<double>(side.parameter1);
+			writer.write<double>(side.parameter2);
+		}
 	}
-}
-OpenCLMain::instance();
+	writer.close();
 }
 
-void LatticeBoltzmannMethodD2Q9::step(bool saveImage)
+void LatticeBoltzmannMethodD2Q9::restore(const std::string& path)
 {
-	updateVelocityMatrix();
-	collision();
-	streaming();
-
-	if(saveImage) {
-		buildResultingDensityMatrix();
-		buildResultingTemperatureMatrix();
-		std::cout << "mResultingDensityMatrix\n";
-		mResultingDensityMatrix.print();
-		std::cout << "mResultingTemperatureMatrix\n";
-		mResultingTemperatureMatrix.print();
+	// Size and scalar count are checked before anything is restored, a rejected checkpoint leaves the solver as it was
+	CheckpointReader reader(path);
+	if(reader.read<std::uint32_t>() != mHeight || reader.read<std::uint32_t>() != mWidth) {
+		throw std::invalid_argument("Checkpoint lattice size mismatch.");
 	}
+	const std::uint64_t step = reader.read<std::uint64_t>();
+	if(reader.read<std::uint32_t>() != mScalars.size()) {
+		throw std::invalid_argument("Checkpoint scalar count mismatch.");
+	}
+	mStep = step;
+	reader.readMatrix(mKinematicViscosity);
+	reader.readMatrix(mDiffusionCoefficient);
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		reader.readMatrix(mDensity[k]);
+	}
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		reader.readMatrix(mTemperature[k]);
+	}
+	for(unsigned int s = 0; s < mScalars.size(); s++) {
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			reader.readMatrix(mScalars[s].populations[k]);
+		}
+		reader.readMatrix(mScalars[s].diffusionCoefficient);
+		for(unsigned int side = 0; side < 4; side++) {
+			mScalarSides[s][side].boundary   = static_cast<BoundaryType>(reader.read<std::uint32_t>());
+			mScalarSides[s][side].parameter1 = reader.read<double>();
+			mScalarSides[s][side].parameter2 = reader.read<double>();
+			mScalars[s].boundaries[side]     = toCPUBoundary(mScalarSides[s][side]);
+		}
+	}
+	mKinematicViscosityRevised   = true;
+	mDiffusionCoefficientRevised = true;
+
+	// Restart the convergence history and the tile activity from the restored state
+	mCPU.resetActivity();
+	mConvergenceCheckStep = mStep;
+	mPreviousDensity      = Matrix<double>();
+	mPreviousTemperature  = Matrix<double>();
+	mConverged            = false;
 }
 
 void LatticeBoltzmannMethodD2Q9::collision()
@@ -139,249 +570,222 @@ void LatticeBoltzmannMethodD2Q9::collision()
 	buildResultingDensityMatrix();
 	buildResultingTemperatureMatrix();
 	if(mKinematicViscosityRevised) {
-		mOmega_m = OpenCLMain::instance().evaluateArithmeticFormula("1 / ((A * 3) + 0.5)",
-																	std::vector<Matrix<double>*>{&mKinematicViscosity});
+		mStream.getArena().release(std::move(mOmega_m));
+		mOmega_m = mStream.evaluateArithmeticFormula("1 / ((A * 3) + 0.5)",
+													 std::vector<Matrix<double>*>{&mKinematicViscosity});
+		mKinematicViscosityRevised = false;
 	}
 	if(mDiffusionCoefficientRevised) {
-		mOmega_s =
-			OpenCLMain::instance().evaluateArithmeticFormula("1 / ((A * 3) + 0.5)",
-															 std::vector<Matrix<double>*>{&mDiffusionCoefficient});
-	}
-
-	mTemperature[0] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * 1",
-		std::vector<Matrix<double>*>{&mTemperature[0], &mOmega_s, &mResultingTemperatureMatrix});
-	mTemperature[1] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 + 3 * D)",
-		std::vector<Matrix<double>*>{&mTemperature[1], &mOmega_s, &mResultingTemperatureMatrix, &mVelocityU});
-	mTemperature[2] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 + 3 * D)",
-		std::vector<Matrix<double>*>{&mTemperature[2], &mOmega_s, &mResultingTemperatureMatrix, &mVelocityV});
-	mTemperature[3] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 - 3 * D)",
-		std::vector<Matrix<double>*>{&mTemperature[3], &mOmega_s, &mResultingTemperatureMatrix, &mVelocityU});
-	mTemperature[4] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 - 3 * D)",
-		std::vector<Matrix<double>*>{&mTemperature[4], &mOmega_s, &mResultingTemperatureMatrix, &mVelocityV});
-	mTemperature[5] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 + 3 * D + 3 * E)",
-														 std::vector<Matrix<double>*>{&mTemperature[5],
-																					  &mOmega_s,
-																					  &mResultingTemperatureMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV});
-	mTemperature[6] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 - 3 * D + 3 * E)",
-														 std::vector<Matrix<double>*>{&mTemperature[6],
-																					  &mOmega_s,
-																					  &mResultingTemperatureMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV});
-	mTemperature[7] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 - 3 * D - 3 * E)",
-														 std::vector<Matrix<double>*>{&mTemperature[7],
-																					  &mOmega_s,
-																					  &mResultingTemperatureMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV});
-	mTemperature[8] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 + 3 * D - 3 * E)",
-														 std::vector<Matrix<double>*>{&mTemperature[8],
-																					  &mOmega_s,
-																					  &mResultingTemperatureMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV});
-	mResultU2 = OpenCLMain::instance().evaluateArithmeticFormula("A * A", std::vector<Matrix<double>*>{&mVelocityU});
-	mResultV2 = OpenCLMain::instance().evaluateArithmeticFormula("A * A", std::vector<Matrix<double>*>{&mVelocityV});
-	mResultUV2 =
-		OpenCLMain::instance().evaluateArithmeticFormula("A + B", std::vector<Matrix<double>*>{&mResultU2, &mResultV2});
-	mDensity[0] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 - 1.5 * D)",
-		std::vector<Matrix<double>*>{&mDensity[0], &mOmega_m, &mResultingDensityMatrix, &mResultUV2});
-	mDensity[1] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 + 3 * D + 4.5 * E - 1.5 * F)",
-		std::vector<Matrix<double>*>{&mDensity[1],
-									 &mOmega_m,
-									 &mResultingDensityMatrix,
-									 &mVelocityU,
-									 &mResultU2,
-									 &mResultUV2});
-	mDensity[2] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 + 3 * D + 4.5 * E - 1.5 * F)",
-		std::vector<Matrix<double>*>{&mDensity[2],
-									 &mOmega_m,
-									 &mResultingDensityMatrix,
-									 &mVelocityV,
-									 &mResultV2,
-									 &mResultUV2});
-	mDensity[3] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 - 3 * D + 4.5 * E - 1.5 * F)",
-		std::vector<Matrix<double>*>{&mDensity[3],
-									 &mOmega_m,
-									 &mResultingDensityMatrix,
-									 &mVelocityU,
-									 &mResultU2,
-									 &mResultUV2});
-	mDensity[4] = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (1 - B) + B * (4/9) * C * (1 - 3 * D + 4.5 * E - 1.5 * F)",
-		std::vector<Matrix<double>*>{&mDensity[4],
-									 &mOmega_m,
-									 &mResultingDensityMatrix,
-									 &mVelocityV,
-									 &mResultV2,
-									 &mResultUV2});
-	mDensity[5] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 + 3 * D + 3 * E + 3 * F)",
-														 std::vector<Matrix<double>*>{&mDensity[5],
-																					  &mOmega_m,
-																					  &mResultingDensityMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV,
-																					  &mResultUV2});
-	mDensity[6] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 - 3 * D + 3 * E + 3 * F)",
-														 std::vector<Matrix<double>*>{&mDensity[6],
-																					  &mOmega_m,
-																					  &mResultingDensityMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV,
-																					  &mResultUV2});
-	mDensity[7] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 - 3 * D - 3 * E + 3 * F)",
-														 std::vector<Matrix<double>*>{&mDensity[7],
-																					  &mOmega_m,
-																					  &mResultingDensityMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV,
-																					  &mResultUV2});
-	mDensity[8] =
-		OpenCLMain::instance().evaluateArithmeticFormula("A * (1 - B) + B * (4/9) * C * (1 + 3 * D - 3 * E + 3 * F)",
-														 std::vector<Matrix<double>*>{&mDensity[8],
-																					  &mOmega_m,
-																					  &mResultingDensityMatrix,
-																					  &mVelocityU,
-																					  &mVelocityV,
-																					  &mResultUV2});
+		mStream.getArena().release(std::move(mOmega_s));
+		mOmega_s = mStream.evaluateArithmeticFormula("1 / ((A * 3) + 0.5)",
+													 std::vector<Matrix<double>*>{&mDiffusionCoefficient});
+		mDiffusionCoefficientRevised = false;
+	}
+
+	if(mDensityCollision != CollisionOperator::BGK || mTemperatureCollision != CollisionOperator::BGK ||
+	   mFlowModel.smagorinsky > 0 || mFlowModel.gravityX != 0 || mFlowModel.gravityY != 0) {
+		collideFused();
+		return;
+	}
+
+	std::vector<Matrix<double>*> temperatureInputs;
+	std::vector<Matrix<double>*> densityInputs;
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		temperatureInputs.push_back(&mTemperature[k]);
+		densityInputs.push_back(&mDensity[k]);
+	}
+	temperatureInputs.insert(temperatureInputs.end(),
+							 {&mOmega_s, &mResultingTemperatureMatrix, &mVelocityU, &mVelocityV});
+	densityInputs.insert(densityInputs.end(), {&mOmega_m, &mResultingDensityMatrix, &mVelocityU, &mVelocityV});
+
+	std::map<std::string, Matrix<double>> temperatureResults =
+		mStream.evaluateArithmeticFormulas(temperatureCollisionFormulas, temperatureInputs);
+	std::map<std::string, Matrix<double>> densityResults =
+		mStream.evaluateArithmeticFormulas(densityCollisionFormulas, densityInputs);
+	// The previous populations become the storage of the next step's results
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		const std::string name(1, static_cast<char>('A' + k));
+		mTemperature[k].swap(temperatureResults.at(name));
+		mDensity[k].swap(densityResults.at(name));
+		mStream.getArena().release(std::move(temperatureResults.at(name)));
+		mStream.getArena().release(std::move(densityResults.at(name)));
+	}
+}
+
+void LatticeBoltzmannMethodD2Q9::collideFused()
+{
+	const cl::Context& context = OpenCLMain::getContext();
+	if(mCollisionProgram() == nullptr) {
+		mCollisionProgram = OpenCLMain::buildProgram(fusedCollisionKernelCode);
+		mCollisionIn      = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(double) * 2 * MATRIX_SIZE * mLength);
+		mCollisionOut     = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(double) * 2 * MATRIX_SIZE * mLength);
+		mCollisionShifts  = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(int) * 4 * MATRIX_SIZE);
+		mCollisionFields  = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(double) * 6 * mLength);
+		mCollisionKernel  = cl::Kernel(mCollisionProgram, "fusedCollision");
+		mCollisionKernel.setArg(0, mCollisionOut);
+		mCollisionKernel.setArg(1, mCollisionIn);
+		mCollisionKernel.setArg(2, mCollisionShifts);
+		mCollisionKernel.setArg(3, mCollisionFields);
+		mCollisionKernel.setArg(10, mWidth);
+		mCollisionKernel.setArg(11, mHeight);
+	}
+
+	cl::CommandQueue& queue = mStream.getQueue();
+	Matrix<double>*   populations[2 * MATRIX_SIZE];
+	int               shifts[4 * MATRIX_SIZE];
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		populations[k]               = &mDensity[k];
+		populations[MATRIX_SIZE + k] = &mTemperature[k];
+	}
+	for(unsigned int k = 0; k < 2 * MATRIX_SIZE; k++) {
+		shifts[2 * k]     = populations[k]->getRowShiftIndex();
+		shifts[2 * k + 1] = populations[k]->getColShiftIndex();
+		enqueueWriteRows(queue, mCollisionIn, sizeof(double) * k * mLength, *populations[k]);
+	}
+	queue.enqueueWriteBuffer(mCollisionShifts, CL_FALSE, 0, sizeof(shifts), shifts);
+	Matrix<double>* fields[6] = {
+		&mResultingDensityMatrix, &mResultingTemperatureMatrix, &mOmega_m, &mOmega_s, &mVelocityU, &mVelocityV};
+	for(unsigned int j = 0; j < 6; j++) {
+		enqueueWriteRows(queue, mCollisionFields, sizeof(double) * j * mLength, *fields[j]);
+	}
+
+	// The models may change between steps, the buffers and sizes were bound with the kernel
+	mCollisionKernel.setArg(4, static_cast<int>(mDensityCollision));
+	mCollisionKernel.setArg(5, static_cast<int>(mTemperatureCollision));
+	mCollisionKernel.setArg(6, mFlowModel.smagorinsky);
+	mCollisionKernel.setArg(7, mFlowModel.gravityX);
+	mCollisionKernel.setArg(8, mFlowModel.gravityY);
+	mCollisionKernel.setArg(9, mFlowModel.referenceTemperature);
+	queue.enqueueNDRangeKernel(mCollisionKernel, cl::NullRange, cl::NDRange(mLength));
+
+	// The in-order queue has finished reading the populations before their storage receives the result
+	for(unsigned int k = 0; k < 2 * MATRIX_SIZE; k++) {
+		populations[k]->resetShift();
+		enqueueReadRows(queue, mCollisionOut, sizeof(double) * k * mLength, *populations[k]);
+	}
+	queue.finish();
+}
+
+void LatticeBoltzmannMethodD2Q9::collideScalars()
+{
+	if(mScalars.empty()) {
+		return;
+	}
+	const unsigned int count   = mScalars.size();
+	const cl::Context& context = OpenCLMain::getContext();
+	if(mScalarProgram() == nullptr) {
+		mScalarProgram = OpenCLMain::buildProgram(scalarCollisionKernelCode);
+		mScalarKernel  = cl::Kernel(mScalarProgram, "scalarCollision");
+		mScalarKernel.setArg(5, mWidth);
+		mScalarKernel.setArg(6, mHeight);
+	}
+	if(mScalarBufferCount != count) {
+		mScalarIn          = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(double) * count * MATRIX_SIZE * mLength);
+		mScalarOut         = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(double) * count * MATRIX_SIZE * mLength);
+		mScalarShifts      = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(int) * 2 * count * MATRIX_SIZE);
+		mScalarFields      = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(double) * (count + 2) * mLength);
+		mScalarBufferCount = count;
+		mScalarShiftIndices.resize(2 * count * MATRIX_SIZE);
+		mScalarKernel.setArg(0, mScalarOut);
+		mScalarKernel.setArg(1, mScalarIn);
+		mScalarKernel.setArg(2, mScalarShifts);
+		mScalarKernel.setArg(3, mScalarFields);
+		mScalarKernel.setArg(4, count);
+	}
+
+	cl::CommandQueue& queue  = mStream.getQueue();
+	std::vector<int>& shifts = mScalarShiftIndices;
+	for(unsigned int s = 0; s < count; s++) {
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			const unsigned int    t          = s * MATRIX_SIZE + k;
+			const Matrix<double>& population = mScalars[s].populations[k];
+			shifts[2 * t]                    = population.getRowShiftIndex();
+			shifts[2 * t + 1]                = population.getColShiftIndex();
+			enqueueWriteRows(queue, mScalarIn, sizeof(double) * t * mLength, population);
+		}
+		enqueueWriteRows(queue, mScalarFields, sizeof(double) * s * mLength, mScalars[s].diffusionCoefficient);
+	}
+	queue.enqueueWriteBuffer(mScalarShifts, CL_FALSE, 0, sizeof(int) * shifts.size(), shifts.data());
+	const Matrix<double>* velocity[2] = {&mVelocityU, &mVelocityV};
+	for(unsigned int j = 0; j < 2; j++) {
+		enqueueWriteRows(queue, mScalarFields, sizeof(double) * (count + j) * mLength, *velocity[j]);
+	}
+
+	queue.enqueueNDRangeKernel(mScalarKernel, cl::NullRange, cl::NDRange(mLength));
+
+	for(unsigned int s = 0; s < count; s++) {
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			mScalars[s].populations[k].resetShift();
+			enqueueReadRows(queue,
+							mScalarOut,
+							sizeof(double) * (s * MATRIX_SIZE + k) * mLength,
+							mScalars[s].populations[k]);
+		}
+	}
+	queue.finish();
 }
 
 void LatticeBoltzmannMethodD2Q9::streaming()
 {
-	mDensity[0].shift(0, 0);
-	mDensity[1].shift(1, 0);
-	mDensity[2].shift(0, 1);
-	mDensity[3].shift(-1, 0);
-	mDensity[4].shift(0, -1);
-	mDensity[5].shift(1, 1);
-	mDensity[6].shift(-1, 1);
-	mDensity[7].shift(-1, -1);
-	mDensity[8].shift(1, -1);
-
-	mTemperature[0].shift(0, 0);
-	mTemperature[1].shift(1, 0);
-	mTemperature[2].shift(0, 1);
-	mTemperature[3].shift(-1, 0);
-	mTemperature[4].shift(0, -1);
-	mTemperature[5].shift(1, 1);
-	mTemperature[6].shift(-1, 1);
-	mTemperature[7].shift(-1, -1);
-	mTemperature[8].shift(1, -1);
-
-	switch(mTop.boundary) {
-	case 0:
-		mDensity[4].topAdiabatic();
-		mTemperature[4].topAdiabatic();
-		mDensity[7].topAdiabatic();
-		mTemperature[7].topAdiabatic();
-		mDensity[8].topAdiabatic();
-		mTemperature[8].topAdiabatic();
-		break;
-	case 1:
-		mDensity[4].topDirichlet((2 / 9.0) * mTop.parameter1, mDensity[2]);
-		mTemperature[4].topDirichlet((2 / 9.0) * mTop.parameter1, mTemperature[2]);
-		mDensity[7].topDirichlet((2 / 36.0) * mTop.parameter1, mDensity[5]);
-		mTemperature[7].topDirichlet((2 / 36.0) * mTop.parameter1, mTemperature[5]);
-		mDensity[8].topDirichlet((2 / 36.0) * mTop.parameter1, mDensity[6]);
-		mTemperature[8].topDirichlet((2 / 36.0) * mTop.parameter1, mTemperature[6]);
-		break;
-
-	default: break;
-	}
-
-	switch(mBottom.boundary) {
-	case 0:
-		mDensity[2].bottomAdiabatic();
-		mTemperature[2].bottomAdiabatic();
-		mDensity[5].bottomAdiabatic();
-		mTemperature[5].bottomAdiabatic();
-		mDensity[6].bottomAdiabatic();
-		mTemperature[6].bottomAdiabatic();
-		break;
-	case 1:
-		mDensity[2].bottomDirichlet((2 / 9.0) * mBottom.parameter1, mDensity[4]);
-		mTemperature[2].bottomDirichlet((2 / 9.0) * mBottom.parameter1, mTemperature[4]);
-		mDensity[5].bottomDirichlet((2 / 36.0) * mBottom.parameter1, mDensity[7]);
-		mTemperature[5].bottomDirichlet((2 / 36.0) * mBottom.parameter1, mTemperature[7]);
-		mDensity[6].bottomDirichlet((2 / 36.0) * mBottom.parameter1, mDensity[8]);
-		mTemperature[6].bottomDirichlet((2 / 36.0) * mBottom.parameter1, mTemperature[8]);
-		break;
-
-	default: break;
-	}
-
-	switch(mLeft.boundary) {
-	case 0:
-		mDensity[1].leftAdiabatic();
-		mTemperature[1].leftAdiabatic();
-		mDensity[5].leftAdiabatic();
-		mTemperature[5].leftAdiabatic();
-		mDensity[8].leftAdiabatic();
-		mTemperature[8].leftAdiabatic();
-		break;
-	case 1:
-		mDensity[1].leftDirichlet((2 / 9.0) * mLeft.parameter1, mDensity[3]);
-		mTemperature[1].leftDirichlet((2 / 9.0) * mLeft.parameter1, mTemperature[3]);
-		mDensity[5].leftDirichlet((2 / 36.0) * mLeft.parameter1, mDensity[7]);
-		mTemperature[5].leftDirichlet((2 / 36.0) * mLeft.parameter1, mTemperature[7]);
-		mDensity[8].leftDirichlet((2 / 36.0) * mLeft.parameter1, mDensity[6]);
-		mTemperature[8].leftDirichlet((2 / 36.0) * mLeft.parameter1, mTemperature[6]);
-		break;
-
-	default: break;
-	}
-
-	switch(mRight.boundary) {
-	case 0:
-		mDensity[3].rightAdiabatic();
-		mTemperature[3].rightAdiabatic();
-		mDensity[6].rightAdiabatic();
-		mTemperature[6].rightAdiabatic();
-		mDensity[7].rightAdiabatic();
-		mTemperature[7].rightAdiabatic();
-		break;
-	case 1:
-		mDensity[3].rightDirichlet((2 / 9.0) * mRight.parameter1, mDensity[1]);
-		mTemperature[3].rightDirichlet((2 / 9.0) * mRight.parameter1, mTemperature[1]);
-		mDensity[6].rightDirichlet((2 / 36.0) * mRight.parameter1, mDensity[8]);
-		mTemperature[6].rightDirichlet((2 / 36.0) * mRight.parameter1, mTemperature[8]);
-		mDensity[7].rightDirichlet((2 / 36.0) * mRight.parameter1, mDensity[5]);
-		mTemperature[7].rightDirichlet((2 / 36.0) * mRight.parameter1, mTemperature[5]);
-		break;
-
-	default: break;
+	const std::array<Boundary, 4> sides = {mTop, mBottom, mLeft, mRight};
+	streamPopulations(mDensity, sides);
+	streamPopulations(mTemperature, sides);
+	for(unsigned int s = 0; s < mScalars.size(); s++) {
+		streamPopulations(mScalars[s].populations, mScalarSides[s]);
+	}
+}
+
+void LatticeBoltzmannMethodD2Q9::streamPopulations(Matrix<double> (&populations)[MATRIX_SIZE],
+												   const std::array<Boundary, 4>& sides)
+{
+	for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+		populations[k].shift(D2Q9::CX[k], D2Q9::CY[k]);
+	}
+
+	// The directions entering through a side: adiabatic copies the inner neighbour, constant sets 2 w_k C - f_opposite
+	for(unsigned int side = 0; side < 4; side++) {
+		const bool adiabatic = sides[side].boundary == ADIABATIC;
+		if(!adiabatic && sides[side].boundary != CONSTANT) {
+			continue;
+		}
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			if(!latticeEnters<D2Q9>(side, k)) {
+				continue;
+			}
+			Matrix<double>&       incoming = populations[k];
+			const Matrix<double>& opposite = populations[LATTICE_OPPOSITE<D2Q9>[k]];
+			const double          C        = 2 * D2Q9::WEIGHT[k] * sides[side].parameter1;
+			switch(side) {
+			case 0: adiabatic ? incoming.topAdiabatic() : incoming.topDirichlet(C, opposite); break;
+			case 1: adiabatic ? incoming.bottomAdiabatic() : incoming.bottomDirichlet(C, opposite); break;
+			case 2: adiabatic ? incoming.leftAdiabatic() : incoming.leftDirichlet(C, opposite); break;
+			default: adiabatic ? incoming.rightAdiabatic() : incoming.rightDirichlet(C, opposite); break;
+			}
+		}
 	}
 }
 
 void LatticeBoltzmannMethodD2Q9::updateVelocityMatrix()
 {
-	// TODO: stub
-	mVelocityU = Matrix<double>(mWidth, mHeight);
-	mVelocityV = Matrix<double>(mWidth, mHeight);
+	// The flow carries no velocity of its own: the field is held at rest, which leaves the temperature and the
+	// scalars purely diffusive. It is refilled in place so the steps do not allocate.
+	if(mVelocityU.getLength() != mLength) {
+		mVelocityU = Matrix<double>(mWidth, mHeight);
+		mVelocityV = Matrix<double>(mWidth, mHeight);
+	}
+	mVelocityU.fill(0);
+	mVelocityV.fill(0);
 }
 
 void LatticeBoltzmannMethodD2Q9::buildResultingDensityMatrix()
 {
-	mResultingDensityMatrix = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (4/9) + B * (1/9) + C* (1/9) + D * (1/9) + E * (1/9) + F * (1/36) + G * (1/36) + H * (1/36) + I * (1/36)",
+	if(mBackend == Backend::CPU) {
+		LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(mDensity, mResultingDensityMatrix);
+		return;
+	}
+	mStream.getArena().release(std::move(mResultingDensityMatrix));
+	mResultingDensityMatrix = mStream.evaluateArithmeticFormula(
+		resultingFormula,
 		std::vector<Matrix<double>*>{&mDensity[0],
 									 &mDensity[1],
 									 &mDensity[2],
@@ -395,8 +799,13 @@ void LatticeBoltzmannMethodD2Q9::buildResultingDensityMatrix()
 
 void LatticeBoltzmannMethodD2Q9::buildResultingTemperatureMatrix()
 {
-	mResultingTemperatureMatrix = OpenCLMain::instance().evaluateArithmeticFormula(
-		"A * (4/9) + B * (1/9) + C* (1/9) + D * (1/9) + E * (1/9) + F * (1/36) + G * (1/36) + H * (1/36) + I * (1/36)",
+	if(mBackend == Backend::CPU) {
+		LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(mTemperature, mResultingTemperatureMatrix);
+		return;
+	}
+	mStream.getArena().release(std::move(mResultingTemperatureMatrix));
+	mResultingTemperatureMatrix = mStream.evaluateArithmeticFormula(
+		resultingFormula,
 		std::vector<Matrix<double>*>{&mTemperature[0],
 									 &mTemperature[1],
 									 &mTemperature[2],
@@ -406,4 +815,136 @@ void LatticeBoltzmannMethodD2Q9::buildResultingTemperatureMatrix()
 									 &mTemperature[6],
 									 &mTemperature[7],
 									 &mTemperature[8]});
-}
\ No newline at end of file
+}
+
+void LatticeBoltzmannMethodD2Q9::writeSnapshot()
+{
+	// Both fields are read straight into the writer's pinned staging memory; the next step does not wait for them.
+	// The velocity only lives on the host, it is copied behind them. DT is 1, so the time equals the step.
+	double* staging = mSnapshotWriter->acquire(
+		mStep,
+		mWidth,
+		mHeight,
+		std::vector<std::string>{"mResultingDensityMatrix", "mResultingTemperatureMatrix", "mVelocityU", "mVelocityV"},
+		mStep);
+	std::vector<cl::Event> events(2);
+	events[0] = mStream.evaluateArithmeticFormulaAsync(
+		resultingFormula,
+		std::vector<Matrix<double>*>{&mDensity[0],
+									 &mDensity[1],
+									 &mDensity[2],
+									 &mDensity[3],
+									 &mDensity[4],
+									 &mDensity[5],
+									 &mDensity[6],
+									 &mDensity[7],
+									 &mDensity[8]},
+		staging);
+	events[1] = mStream.evaluateArithmeticFormulaAsync(
+		resultingFormula,
+		std::vector<Matrix<double>*>{&mTemperature[0],
+									 &mTemperature[1],
+									 &mTemperature[2],
+									 &mTemperature[3],
+									 &mTemperature[4],
+									 &mTemperature[5],
+									 &mTemperature[6],
+									 &mTemperature[7],
+									 &mTemperature[8]},
+		staging + mLength);
+	mStream.getQueue().flush();
+	mVelocityU.copyShiftedData(staging + 2 * mLength);
+	mVelocityV.copyShiftedData(staging + 3 * mLength);
+	mSnapshotWriter->submit(std::move(events));
+}
+
+void LatticeBoltzmannMethodD2Q9::reportDiagnostics()
+{
+	Diagnostics diagnostics = computeDiagnostics();
+	if(mDiagnosticsCallback) {
+		mDiagnosticsCallback(diagnostics);
+	} else {
+		std::cout << "[LBM] step " << diagnostics.step << " mass " << diagnostics.mass << " heat " << diagnostics.heat
+				  << " max|u| " << diagnostics.maxVelocity << "\n";
+	}
+}
+
+void LatticeBoltzmannMethodD2Q9::checkConvergence()
+{
+	buildResultingDensityMatrix();
+	buildResultingTemperatureMatrix();
+
+	// The first check only records the fields
+	if(mPreviousDensity.getLength() == mLength) {
+		const unsigned int elapsed  = mStep - mConvergenceCheckStep;
+		const double       residual = std::max(relativeChange(mResultingDensityMatrix, mPreviousDensity),
+											   relativeChange(mResultingTemperatureMatrix, mPreviousTemperature)) /
+									  elapsed;
+		mConverged = residual < mConvergenceTolerance;
+
+		// Assume the residual keeps decaying at the measured rate and check again where it would meet the tolerance
+		unsigned int interval = mConvergenceInterval;
+		if(!mConverged && mResidual > 0 && residual < mResidual) {
+			const double rate      = std::log(residual / mResidual) / elapsed;
+			const double remaining = std::log(mConvergenceTolerance / residual) / rate;
+			interval = static_cast<unsigned int>(std::min(remaining, 2.0 * mConvergenceInterval));
+		}
+		mConvergenceInterval = std::clamp(interval, mConvergenceMinInterval, mConvergenceMaxInterval);
+		mResidual            = residual;
+	}
+	mPreviousDensity      = mResultingDensityMatrix;
+	mPreviousTemperature  = mResultingTemperatureMatrix;
+	mConvergenceCheckStep = mStep;
+}
+
+unsigned int LatticeBoltzmannMethodD2Q9::stepsToNextCheck() const
+{
+	unsigned int steps = std::numeric_limits<unsigned int>::max();
+	if(mDiagnosticsInterval != 0) {
+		steps = mDiagnosticsInterval - mStep % mDiagnosticsInterval;
+	}
+	if(mConvergenceTolerance > 0) {
+		steps = std::min(steps, mConvergenceCheckStep + mConvergenceInterval - mStep);
+	}
+	return steps;
+}
+
+void LatticeBoltzmannMethodD2Q9::afterSteps()
+{
+	if(mDiagnosticsInterval != 0 && mStep % mDiagnosticsInterval == 0) {
+		reportDiagnostics();
+	}
+	if(mConvergenceTolerance > 0 && mStep >= mConvergenceCheckStep + mConvergenceInterval) {
+		checkConvergence();
+	}
+}
+
+double LatticeBoltzmannMethodD2Q9::relativeChange(Matrix<double>& current, Matrix<double>& previous)
+{
+	double change;
+	double norm;
+	if(mBackend == Backend::CPU) {
+		change = LatticeBoltzmannMethodD2Q9CPU::distance(current, previous);
+		norm   = LatticeBoltzmannMethodD2Q9CPU::reduce(Reduction::L2, current);
+	} else {
+		change = mStream.evaluateArithmeticReduction(
+			Reduction::L2, "A - B", std::vector<Matrix<double>*>{&current, &previous});
+		norm = mStream.reduce(Reduction::L2, current);
+	}
+	return norm > 0 ? change / norm : change;
+}
+
+void LatticeBoltzmannMethodD2Q9::advanceCPU(unsigned int steps)
+{
+	const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4> boundaries = {
+		toCPUBoundary(mTop), toCPUBoundary(mBottom), toCPUBoundary(mLeft), toCPUBoundary(mRight)};
+	mCPU.advance(mDensity,
+				 mTemperature,
+				 mKinematicViscosity,
+				 mDiffusionCoefficient,
+				 mVelocityU,
+				 mVelocityV,
+				 boundaries,
+				 steps);
+	mCPU.advanceScalars(mScalars, mVelocityU, mVelocityV, steps);
+}
@@ -1,8 +1,13 @@
 #ifndef LATTICE_BOLTZMANN_METHOD_D2Q9
 #define LATTICE_BOLTZMANN_METHOD_D2Q9
 
+#include "CollisionOperator.hpp"
+#include "LatticeBoltzmannMethodD2Q9CPU.hpp"
 #include "Matrix.hpp"
+#include "OpenCLMain.hpp"
+#include "SnapshotWriter.hpp"
 #include <array>
+#include <functional>
 #include <memory>
 
 /**
@@ -33,6 +38,7 @@ class LatticeBoltzmannMethodD2Q9
 
 public:
 	enum BoundaryType { ADIABATIC, CONSTANT, BOUNCEBACK, OPEN };
+	enum Backend { OPENCL, CPU };
 	struct Boundary {
 		BoundaryType boundary;
 		double       parameter1;
@@ -52,6 +58,16 @@ public:
 		}
 	};
 
+	/**
+	 * @brief Domain totals, reduced where the populations are stepped so only scalars reach the host.
+	 */
+	struct Diagnostics {
+		unsigned int step;
+		double       mass;         // sum of mResultingDensityMatrix
+		double       heat;         // sum of mResultingTemperatureMatrix
+		double       maxVelocity;  // largest |(u, v)|
+	};
+
 	// 	struct Entity {
 	// 		Boundary mTop;
 	// 		Boundary mBottom;
@@ -81,27 +97,72 @@ public:
 
 private:
 	unsigned int mLength;
+	unsigned int mStep;
 	Boundary     mTop;
 	Boundary     mBottom;
 	Boundary     mLeft;
 	Boundary     mRight;
 
+private:  // Execution state, one queue per solver so independent solvers can step concurrently
+	OpenCLStream                            mStream;
+	std::shared_ptr<SnapshotWriter>         mSnapshotWriter;
+	Backend                                 mBackend;
+	LatticeBoltzmannMethodD2Q9CPU           mCPU;
+	unsigned int                            mDiagnosticsInterval;
+	std::function<void(const Diagnostics&)> mDiagnosticsCallback;
+
+private:  // Collision model, mirrored into mCPU
+	CollisionOperator                        mDensityCollision;
+	CollisionOperator                        mTemperatureCollision;
+	LatticeBoltzmannMethodD2Q9CPU::FlowModel mFlowModel;
+
+private:  // Convergence monitor, disabled while the tolerance is 0
+	double         mConvergenceTolerance;
+	unsigned int   mConvergenceInterval;  // steps between checks, adapted after every check
+	unsigned int   mConvergenceMinInterval;
+	unsigned int   mConvergenceMaxInterval;
+	unsigned int   mConvergenceCheckStep;  // step of the fields kept below, the next check is due one interval later
+	double         mResidual;
+	bool           mConverged;
+	Matrix<double> mPreviousDensity;
+	Matrix<double> mPreviousTemperature;
+
 private:  // Internal data
 	bool           mKinematicViscosityRevised;
 	bool           mDiffusionCoefficientRevised;
+	unsigned int   mRowPitch;  // of the populations and coefficients, see setRowPitch()
 	Matrix<double> mKinematicViscosity;
 	Matrix<double> mDiffusionCoefficient;
 	Matrix<double> mDensity[MATRIX_SIZE];
 	Matrix<double> mTemperature[MATRIX_SIZE];
 
+private:  // Passive scalars beyond the temperature, their sides kept in both boundary flavours
+	std::vector<LatticeBoltzmannMethodD2Q9CPU::Scalar> mScalars;
+	std::vector<std::array<Boundary, 4>>               mScalarSides;  // top, bottom, left, right
+
 private:                      // Derived data
 	Matrix<double> mOmega_m;  // density
 	Matrix<double> mOmega_s;  // temperature
 	Matrix<double> mVelocityU;
 	Matrix<double> mVelocityV;
-	Matrix<double> mResultU2;   // u^2
-	Matrix<double> mResultV2;   // v^2
-	Matrix<double> mResultUV2;  // u^2 + v^2
+
+private:  // Fused collision kernel for everything beyond plain BGK, built and allocated on first use
+	cl::Program mCollisionProgram;
+	cl::Kernel  mCollisionKernel;  // bound to the buffers below
+	cl::Buffer  mCollisionIn;      // density then temperature populations, one matrix after the other
+	cl::Buffer  mCollisionOut;
+	cl::Buffer  mCollisionShifts;  // row and column shift of each population
+	cl::Buffer  mCollisionFields;  // resulting density and temperature, omega_m, omega_s, u and v
+
+private:  // Batched collision of the passive scalars, built on first use and resized with their number
+	cl::Program      mScalarProgram;
+	cl::Kernel       mScalarKernel;  // bound to the buffers below
+	cl::Buffer       mScalarIn;      // populations of every scalar, one matrix after the other
+	cl::Buffer       mScalarOut;
+	cl::Buffer       mScalarShifts;  // row and column shift of each population
+	cl::Buffer       mScalarFields;  // diffusion coefficient of every scalar, u and v
+	unsigned int     mScalarBufferCount;
+	std::vector<int> mScalarShiftIndices;  // host side of mScalarShifts
 
 public:  // Pre allocate memory for output
 	Matrix<double> mResultingDensityMatrix;
@@ -130,14 +191,167 @@ public:
 							   std::vector<double> initialTemperatureArray = std::vector<double>());
 
 	void step(bool saveImage = false);
+
+	/**
+	 * @brief Advance several steps at once. On the CPU backend this lets temporal blocking keep tiles in cache
+	 * for several steps. Returns early once the convergence monitor reports a steady state.
+	 */
+	void run(unsigned int steps);
 	void buildResultingDensityMatrix();
 	void buildResultingTemperatureMatrix();
 
+	/**
+	 * @brief Route step(true) output to a background writer instead of printing to stdout.
+	 * @param writer Can be shared between solvers, also ones stepping on different threads (see SnapshotWriter). Pass
+	 * nullptr to go back to printing.
+	 */
+	void         setSnapshotWriter(std::shared_ptr<SnapshotWriter> writer);
+	unsigned int getStep() const;
+
+	/**
+	 * @brief Select where collision and streaming run, OPENCL by default. Snapshots are still read back through
+	 * the OpenCL stream.
+	 */
+	void    setBackend(Backend backend);
+	Backend getBackend() const;
+
+	/**
+	 * @brief Tune the CPU backend, see LatticeBoltzmannMethodD2Q9CPU.
+	 * @param depth Steps advanced per tile while it is resident in cache, 1 disables temporal blocking.
+	 * @param tileSize Edge of the square tiles.
+	 */
+	void setTemporalBlocking(unsigned int depth, unsigned int tileSize = 64);
+
+	/**
+	 * @brief Let the CPU backend skip tiles that sit at a fixed point with quiet neighbours, results are unchanged.
+	 */
+	void setTileSkipping(bool enabled);
+
+	/**
+	 * @brief Lay the rows of every population and coefficient field out pitch elements apart, including the scalars
+	 * added later, e.g. Matrix<double>::alignedPitch() of a row so that every row starts on a cache line. The CPU
+	 * backend keeps the padding. The OpenCL kernels work on packed device buffers, their transfers skip it.
+	 * @throw std::invalid_argument if pitch is shorter than a row.
+	 */
+	void setRowPitch(unsigned int pitch);
+
+	/**
+	 * @brief Collision operator of each field, BGK by default, see CollisionOperator. On the OpenCL backend anything
+	 * beyond plain BGK collides both fields in one fused kernel instead of the formula kernels.
+	 */
+	void              setCollision(CollisionOperator density, CollisionOperator temperature);
+	CollisionOperator getDensityCollision() const;
+	CollisionOperator getTemperatureCollision() const;
+
+	/**
+	 * @brief Smagorinsky subgrid model for under-resolved flows, 0 (the default) disables it.
+	 *
+	 * The effective viscosity of every node follows from its own non-equilibrium stress inside the collision (see
+	 * smagorinskyRate()), there is no separate pass over the relaxation rates.
+	 * @throw std::invalid_argument if the constant is negative.
+	 */
+	void   setSmagorinsky(double constant);
+	double getSmagorinsky() const;
+
+	/**
+	 * @brief Boussinesq coupling: the flow feels the buoyancy rho (T - referenceTemperature) (gravityX, gravityY) as
+	 * a Guo force, a zero gravity (the default) disables it.
+	 *
+	 * T is the node's temperature read in the same visit that collides both fields, so the coupling costs no extra
+	 * sweep or force field. The gravity includes the thermal expansion coefficient, x and y are the axes of the D2Q9
+	 * directions above. The velocity stays the one of updateVelocityMatrix().
+	 */
+	void setBuoyancy(double gravityX, double gravityY, double referenceTemperature);
+
+	/**
+	 * @brief Add a passive scalar, e.g. a concentration, advected by the same velocity as the temperature.
+	 *
+	 * Scalars collide with BGK and the temperature's equilibrium, each with its own diffusion coefficient and sides
+	 * (OPEN and BOUNCEBACK act as periodic, like for the temperature). On both backends all of them collide in one
+	 * pass that reads the velocity of a node once, so every extra scalar adds its own populations and nothing else
+	 * to the memory traffic. Scalars are part of checkpoints, but not of diagnostics or the convergence monitor.
+	 * @param initialArray Initial value per node, zero if empty.
+	 * @return Index of the new scalar.
+	 * @throw std::invalid_argument if an array does not hold one value per node.
+	 */
+	unsigned int addScalar(std::vector<double> diffusionCoefficientArray,
+						   std::vector<double> initialArray,
+						   Boundary            top,
+						   Boundary            bottom,
+						   Boundary            left,
+						   Boundary            right);
+
+	unsigned int getScalarCount() const;
+
+	/**
+	 * @brief Value of a passive scalar per node, the weighted sum of its populations.
+	 * @throw std::out_of_range if there is no scalar with this index.
+	 */
+	Matrix<double> buildResultingScalarMatrix(unsigned int index) const;
+
+	/**
+	 * @brief Reduce mass, heat and the largest speed on the active backend without reading the fields back.
+	 */
+	Diagnostics computeDiagnostics();
+
+	/**
+	 * @brief Report computeDiagnostics() every interval steps.
+	 * @param interval 0 disables the report.
+	 * @param callback Receives the diagnostics, they are printed to stdout if empty.
+	 */
+	void setDiagnostics(unsigned int interval, std::function<void(const Diagnostics&)> callback = nullptr);
+
+	/**
+	 * @brief Stop run() once the fields are steady.
+	 *
+	 * Every check compares mResultingDensityMatrix and mResultingTemperatureMatrix with the previous check: the
+	 * larger relative L2 change ||x - x_prev|| / ||x||, divided by the steps in between, is the residual. Both norms
+	 * are reduced on the active backend. The cadence adapts: while the residual decays, the next check is placed
+	 * where its geometric decay would reach the tolerance, at most twice as far as the last one.
+	 * @param tolerance Residual per step below which the run stops, 0 disables the monitor.
+	 * @param interval First and shortest distance between checks.
+	 * @param maxInterval Longest distance between checks.
+	 */
+	void setConvergence(double tolerance, unsigned int interval = 64, unsigned int maxInterval = 4096);
+
+	bool         hasConverged() const;
+	double       getResidual() const;
+	unsigned int getConvergenceInterval() const;
+
+	/**
+	 * @brief Save the full distribution state: all 18 population arrays with their shift indices, the coefficients
+	 * and the step counter, then every passive scalar with its populations, diffusion coefficient and sides. The
+	 * boundaries of the flow are configuration and are taken from the restoring solver.
+	 * @param compress Deflate the arrays chunk by chunk.
+	 */
+	void checkpoint(const std::string& path, bool compress = false) const;
+
+	/**
+	 * @brief Resume from a checkpoint written by a solver of the same size with as many passive scalars.
+	 * @throw std::invalid_argument if the lattice size or the number of scalars differs.
+	 */
+	void restore(const std::string& path);
+
 private:
 	void collision();
+	void collideFused();
+	void collideScalars();
 	void streaming();
+	void writeSnapshot();
+	void advanceCPU(unsigned int steps);
+	void reportDiagnostics();
+	void checkConvergence();
+
+	/**
+	 * @brief Steps until the next diagnostics report or convergence check.
+	 */
+	unsigned int stepsToNextCheck() const;
+	void         afterSteps();
 
 private:  // helper
-	void updateVelocityMatrix();
+	static void streamPopulations(Matrix<double> (&populations)[MATRIX_SIZE], const std::array<Boundary, 4>& sides);
+
+	void   updateVelocityMatrix();
+	double relativeChange(Matrix<double>& current, Matrix<double>& previous);
 };
 #endif  // LATTICE_BOLTZMANN_METHOD_D2Q9
\ No newline at end of file
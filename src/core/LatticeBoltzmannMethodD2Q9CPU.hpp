@@ -0,0 +1,1042 @@
+#ifndef LATTICE_BOLTZMANN_METHOD_D2Q9_CPU
+#define LATTICE_BOLTZMANN_METHOD_D2Q9_CPU
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+#include "CollisionOperator.hpp"
+#include "Lattice.hpp"
+#include "Matrix.hpp"
+#include "Reduction.hpp"
+
+/**
+ * @brief Cache-blocked CPU execution of the D2Q9 collision, streaming and boundary update.
+ *
+ * The lattice is cut into square tiles. Each tile is copied together with a halo into a per-thread scratch block,
+ * advanced there for up to `depth` timesteps while it stays resident in cache, and its interior is written back.
+ * One step invalidates latticeReach() + 1 cells at the edge of the block (the reach for streaming, one more because
+ * the adiabatic boundaries read their inner neighbour after streaming), so the halo is (reach + 1) * depth wide and
+ * the valid region shrinks by that much per step until only the tile itself is left (trapezoidal tiling). For D2Q9
+ * that is two cells per step. Halo cells are recomputed by every tile that needs them, trading some redundant
+ * arithmetic for a single trip through DRAM every `depth` steps.
+ *
+ * advance() runs D2Q9 unless given another descriptor, e.g. advance<D2Q5>(), with the same tiling. MRT needs the
+ * D2Q9 moment basis and is rejected for the others. The passive scalars and the Distributed and Refined solvers
+ * stay on D2Q9.
+ *
+ * The arithmetic is the one of the formula kernels in LatticeBoltzmannMethodD2Q9::collision() and
+ * LatticeBoltzmannMethodD2Q9::streaming(), including the order in which the four sides are applied, so both
+ * backends produce the same populations. Results are written unshifted, in the layout of Matrix.
+ *
+ * With tile skipping enabled, every block records whether any population of its tile changed. A tile whose whole
+ * halo neighbourhood (its own tile included) came out of the previous block bit-for-bit unchanged is at a fixed
+ * point of that block, so advancing it again would reproduce the same values: it is skipped without being read or
+ * written. Both population buffers already hold its values, so the swap stays valid. A changing neighbour wakes it
+ * up for the next block. Skipping is exact, it only needs the previous block to have the same depth and the
+ * coefficients, velocity and boundaries to stay the same; call resetActivity() when they change.
+ */
+class LatticeBoltzmannMethodD2Q9CPU
+{
+	friend class LatticeBoltzmannMethodD2Q9Distributed;  // runs the block kernels on its strip
+	friend class LatticeBoltzmannMethodD2Q9Refined;      // and on every refined block
+
+public:
+	static inline constexpr unsigned int MATRIX_SIZE = D2Q9::Q;  // the number of direction
+
+	enum BoundaryType { PERIODIC, ADIABATIC, CONSTANT };
+	struct Boundary {
+		BoundaryType type;
+		double       value;
+	};
+
+	/**
+	 * @brief Per-node extensions of the density collision, all off by default.
+	 *
+	 * - smagorinsky: Smagorinsky constant, see smagorinskyRate().
+	 * - gravityX, gravityY: Boussinesq buoyancy, the density feels the Guo force
+	 *   rho (T - referenceTemperature) (gravityX, gravityY), T being the node's temperature before the collision.
+	 *   The gravity already includes the thermal expansion coefficient, x and y follow the D2Q9 directions.
+	 */
+	struct FlowModel {
+		double smagorinsky;
+		double gravityX;
+		double gravityY;
+		double referenceTemperature;
+
+		FlowModel(): smagorinsky(0), gravityX(0), gravityY(0), referenceTemperature(0)
+		{
+		}
+	};
+
+	/**
+	 * @brief Passive scalar beyond the temperature, e.g. a concentration: BGK collision with the temperature's
+	 * equilibrium, its own diffusion coefficient and sides.
+	 */
+	struct Scalar {
+		Matrix<double>          populations[MATRIX_SIZE];
+		Matrix<double>          diffusionCoefficient;
+		std::array<Boundary, 4> boundaries;  // top, bottom, left, right
+	};
+
+private:
+	// Movement of f_k in columns per step, the rows follow from latticeRowOffset()
+	static inline constexpr const int (&COL_OFFSET)[MATRIX_SIZE] = D2Q9::CX;
+
+	// FlowModel parts instantiated into collideAndPushFused()
+	static inline constexpr unsigned int SMAGORINSKY = 1;
+	static inline constexpr unsigned int BUOYANCY    = 2;
+
+	unsigned int                     mDepth;
+	unsigned int                     mTileSize;
+	CollisionOperator                mDensityCollision;
+	CollisionOperator                mTemperatureCollision;
+	FlowModel                        mFlowModel;
+	std::vector<Matrix<double>>      mNextDensity;      // Q of the descriptor last advanced
+	std::vector<Matrix<double>>      mNextTemperature;  // Q of the descriptor last advanced
+	std::vector<Matrix<double>>      mNextScalars;      // MATRIX_SIZE per scalar
+	std::vector<std::vector<double>> mScratch;          // one block per thread
+
+	// Tile skipping
+	bool                                   mSkipTiles;
+	std::vector<unsigned char>             mTileChanged;     // per tile, set if the last block changed a population
+	unsigned int                           mActivityDepth;   // depth of the block that set mTileChanged, 0 if unknown
+	const double*                          mActivityResult;  // data of density[0] after that block
+	unsigned int                           mSkippedTiles;
+	std::vector<unsigned char>             mSkip;            // per tile, set if the current block skips it
+	std::vector<std::vector<unsigned int>> mRowNeighbours;   // per tile row, the tile rows its halo meets
+	std::vector<std::vector<unsigned int>> mColNeighbours;   // per tile column, the tile columns its halo meets
+	std::array<unsigned int, 3>            mNeighbourKey;    // N, M and halo of the neighbour lists
+
+public:
+	/**
+	 * @param depth Timesteps advanced per trip through memory, 1 disables temporal blocking.
+	 * @param tileSize Edge of the square tile written back by one block.
+	 */
+	LatticeBoltzmannMethodD2Q9CPU(unsigned int depth = 1, unsigned int tileSize = 64):
+		mDensityCollision(CollisionOperator::BGK),
+		mTemperatureCollision(CollisionOperator::BGK),
+		mSkipTiles(false),
+		mActivityDepth(0),
+		mActivityResult(nullptr),
+		mSkippedTiles(0),
+		mNeighbourKey{}
+	{
+		setTemporalBlocking(depth, tileSize);
+	}
+
+	void setTemporalBlocking(unsigned int depth, unsigned int tileSize)
+	{
+		if(depth == 0 || tileSize == 0) {
+			throw std::invalid_argument("Temporal blocking depth and tile size must be positive.");
+		}
+		mDepth    = depth;
+		mTileSize = tileSize;
+		resetActivity();
+	}
+
+	/**
+	 * @brief Collision operator of each field, BGK by default. See CollisionOperator.
+	 */
+	void setCollision(CollisionOperator density, CollisionOperator temperature)
+	{
+		mDensityCollision     = density;
+		mTemperatureCollision = temperature;
+		resetActivity();
+	}
+
+	/**
+	 * @brief Smagorinsky constant of the density field, 0 disables the subgrid model. See smagorinskyRate().
+	 * @throw std::invalid_argument if the constant is negative.
+	 */
+	void setSmagorinsky(double constant)
+	{
+		if(constant < 0) {
+			throw std::invalid_argument("The Smagorinsky constant must not be negative.");
+		}
+		mFlowModel.smagorinsky = constant;
+		resetActivity();
+	}
+
+	/**
+	 * @brief Boussinesq coupling of the temperature into the flow, a zero gravity disables it. See FlowModel.
+	 */
+	void setBuoyancy(double gravityX, double gravityY, double referenceTemperature)
+	{
+		mFlowModel.gravityX             = gravityX;
+		mFlowModel.gravityY             = gravityY;
+		mFlowModel.referenceTemperature = referenceTemperature;
+		resetActivity();
+	}
+
+	const FlowModel& getFlowModel() const
+	{
+		return mFlowModel;
+	}
+
+	/**
+	 * @brief Skip tiles whose neighbourhood did not change in the previous block, see the class description.
+	 */
+	void setTileSkipping(bool enabled)
+	{
+		mSkipTiles = enabled;
+		resetActivity();
+	}
+
+	/**
+	 * @brief Forget the recorded activity, the next block advances every tile.
+	 */
+	void resetActivity()
+	{
+		mActivityDepth  = 0;
+		mActivityResult = nullptr;
+	}
+
+	/**
+	 * @brief Tiles skipped by the last call of advance(), summed over its blocks.
+	 */
+	unsigned int getSkippedTiles() const
+	{
+		return mSkippedTiles;
+	}
+
+	unsigned int getDepth() const
+	{
+		return mDepth;
+	}
+
+	unsigned int getTileSize() const
+	{
+		return mTileSize;
+	}
+
+	/**
+	 * @brief Advance the populations by the given number of steps, velocity and coefficients held constant.
+	 * @param boundaries top, bottom, left, right
+	 */
+	template<class DESCRIPTOR = D2Q9>
+	void advance(Matrix<double> (&density)[DESCRIPTOR::Q],
+				 Matrix<double> (&temperature)[DESCRIPTOR::Q],
+				 const Matrix<double>&          kinematicViscosity,
+				 const Matrix<double>&          diffusionCoefficient,
+				 const Matrix<double>&          velocityU,
+				 const Matrix<double>&          velocityV,
+				 const std::array<Boundary, 4>& boundaries,
+				 unsigned int                   steps)
+	{
+		if(!std::is_same_v<DESCRIPTOR, D2Q9> &&
+		   (mDensityCollision == CollisionOperator::MRT || mTemperatureCollision == CollisionOperator::MRT)) {
+			throw std::invalid_argument("MRT collision needs the D2Q9 moment basis.");
+		}
+		const unsigned int N = density[0].getN();
+		const unsigned int M = density[0].getM();
+		// The swapped-in results keep the row pitch of the given fields
+		mNextDensity.resize(DESCRIPTOR::Q);
+		mNextTemperature.resize(DESCRIPTOR::Q);
+		for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+			if(mNextDensity[k].getN() != N || mNextDensity[k].getM() != M ||
+			   mNextDensity[k].getPitch() != density[k].getPitch()) {
+				mNextDensity[k] = Matrix<double>(N, M);
+				mNextDensity[k].setRowPitch(density[k].getPitch());
+			}
+			if(mNextTemperature[k].getN() != N || mNextTemperature[k].getM() != M ||
+			   mNextTemperature[k].getPitch() != temperature[k].getPitch()) {
+				mNextTemperature[k] = Matrix<double>(N, M);
+				mNextTemperature[k].setRowPitch(temperature[k].getPitch());
+			}
+		}
+		mScratch.resize(omp_get_max_threads());
+
+		const unsigned int tileRows = (N + mTileSize - 1) / mTileSize;
+		const unsigned int tileCols = (M + mTileSize - 1) / mTileSize;
+		if(mTileChanged.size() != tileRows * tileCols || mActivityResult != density[0].getDataData()) {
+			mTileChanged.assign(tileRows * tileCols, 1);
+			mActivityDepth = 0;
+		}
+		for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+			if(density[k].getShiftIndexPair() != std::make_pair(0u, 0u) ||
+			   temperature[k].getShiftIndexPair() != std::make_pair(0u, 0u)) {
+				mActivityDepth = 0;  // the other buffer is not the previous state
+			}
+		}
+		mSkippedTiles = 0;
+
+		mSkip.resize(tileRows * tileCols);
+		while(steps > 0) {
+			const unsigned int depth = std::min(steps, mDepth);
+			markSkippedTiles(mSkip, N, M, tileRows, tileCols, depth, blockShrink<DESCRIPTOR>() * depth);
+			// The tiles write unshifted, but a swap may have handed a shifted input's storage to the results
+			for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+				mNextDensity[k].resetShift();
+				mNextTemperature[k].resetShift();
+			}
+#pragma omp parallel for collapse(2) schedule(static)
+			for(unsigned int tileRow = 0; tileRow < tileRows; tileRow++) {
+				for(unsigned int tileCol = 0; tileCol < tileCols; tileCol++) {
+					if(mSkip[tileRow * tileCols + tileCol]) {
+						mTileChanged[tileRow * tileCols + tileCol] = 0;
+						continue;
+					}
+					advanceTile<DESCRIPTOR>(density,
+											temperature,
+											kinematicViscosity,
+											diffusionCoefficient,
+											velocityU,
+											velocityV,
+											boundaries,
+											tileRow * mTileSize,
+											tileCol * mTileSize,
+											depth);
+				}
+			}
+			for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+				density[k].swap(mNextDensity[k]);
+				temperature[k].swap(mNextTemperature[k]);
+			}
+			mActivityDepth = depth;
+			mSkippedTiles += std::count(mSkip.begin(), mSkip.end(), 1);
+			steps -= depth;
+		}
+		mActivityResult = density[0].getDataData();
+	}
+
+	/**
+	 * @brief Advance the passive scalars by the given number of steps, velocity and coefficients held constant.
+	 *
+	 * Same tiling and temporal blocking as advance(), but all scalars share one block: the velocity of a node is
+	 * loaded once and collides every scalar, instead of once per scalar. Tiles are never skipped.
+	 */
+	void advanceScalars(std::vector<Scalar>&  scalars,
+						const Matrix<double>& velocityU,
+						const Matrix<double>& velocityV,
+						unsigned int          steps)
+	{
+		if(scalars.empty()) {
+			return;
+		}
+		const unsigned int N = velocityU.getN();
+		const unsigned int M = velocityU.getM();
+		mNextScalars.resize(scalars.size() * MATRIX_SIZE);
+		for(unsigned int j = 0; j < mNextScalars.size(); j++) {
+			const unsigned int pitch = scalars[j / MATRIX_SIZE].populations[j % MATRIX_SIZE].getPitch();
+			if(mNextScalars[j].getN() != N || mNextScalars[j].getM() != M || mNextScalars[j].getPitch() != pitch) {
+				mNextScalars[j] = Matrix<double>(N, M);
+				mNextScalars[j].setRowPitch(pitch);
+			}
+		}
+		mScratch.resize(omp_get_max_threads());
+
+		const unsigned int tileRows = (N + mTileSize - 1) / mTileSize;
+		const unsigned int tileCols = (M + mTileSize - 1) / mTileSize;
+		while(steps > 0) {
+			const unsigned int depth = std::min(steps, mDepth);
+			for(Matrix<double>& next : mNextScalars) {
+				next.resetShift();  // as in advance()
+			}
+#pragma omp parallel for collapse(2) schedule(static)
+			for(unsigned int tileRow = 0; tileRow < tileRows; tileRow++) {
+				for(unsigned int tileCol = 0; tileCol < tileCols; tileCol++) {
+					advanceScalarTile(scalars, velocityU, velocityV, tileRow * mTileSize, tileCol * mTileSize, depth);
+				}
+			}
+			for(unsigned int s = 0; s < scalars.size(); s++) {
+				for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+					scalars[s].populations[k].swap(mNextScalars[s * MATRIX_SIZE + k]);
+				}
+			}
+			steps -= depth;
+		}
+	}
+
+	/**
+	 * @brief Weighted sum of the populations, same as LatticeBoltzmannMethodD2Q9::buildResultingDensityMatrix().
+	 */
+	static Matrix<double> buildResultingMatrix(const Matrix<double> (&populations)[MATRIX_SIZE])
+	{
+		Matrix<double> result(0, 0);
+		buildResultingMatrix(populations, result);
+		return result;
+	}
+
+	/**
+	 * @brief buildResultingMatrix() into result, whose storage is reused when the dimensions match.
+	 */
+	static void buildResultingMatrix(const Matrix<double> (&populations)[MATRIX_SIZE], Matrix<double>& result)
+	{
+		weightedSum(populations, result, std::make_index_sequence<MATRIX_SIZE>());
+	}
+
+	/**
+	 * @brief Reduce every element of a matrix, shifts do not change the result.
+	 */
+	static double reduce(Reduction operation, const Matrix<double>& matrix)
+	{
+		return reduceRows(operation, matrix.getDataData(), matrix.getN(), matrix.getM(), matrix.getPitch());
+	}
+
+	/**
+	 * @brief Sum of buildResultingMatrix() without building it: the weighted sum of the population sums.
+	 */
+	static double sumResultingMatrix(const Matrix<double> (&populations)[MATRIX_SIZE])
+	{
+		double sum = 0;
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			sum += D2Q9::WEIGHT[k] * reduce(Reduction::SUM, populations[k]);
+		}
+		return sum;
+	}
+
+	/**
+	 * @brief L2 norm of the element-wise difference of two matrices of the same size.
+	 */
+	static double distance(const Matrix<double>& a, const Matrix<double>& b)
+	{
+		const unsigned int N       = a.getN();
+		const unsigned int M       = a.getM();
+		double             squared = 0;
+#pragma omp parallel for reduction(+ : squared) schedule(static)
+		for(unsigned int row = 0; row < N; row++) {
+			for(unsigned int col = 0; col < M; col++) {
+				double difference = at(a, row, col) - at(b, row, col);
+				squared += difference * difference;
+			}
+		}
+		return std::sqrt(squared);
+	}
+
+	/**
+	 * @brief Largest |(u, v)| over the lattice.
+	 */
+	static double maxSpeed(const Matrix<double>& velocityU, const Matrix<double>& velocityV)
+	{
+		const unsigned int N       = velocityU.getN();
+		const unsigned int M       = velocityU.getM();
+		double             squared = 0;
+#pragma omp parallel for reduction(max : squared) schedule(static)
+		for(unsigned int row = 0; row < N; row++) {
+			for(unsigned int col = 0; col < M; col++) {
+				double u = at(velocityU, row, col);
+				double v = at(velocityV, row, col);
+				squared  = std::max(squared, u * u + v * v);
+			}
+		}
+		return std::sqrt(squared);
+	}
+
+private:
+	/**
+	 * @brief w_0 f_0 + w_1 f_1 + ... as one expression, a single fused pass summed in direction order like
+	 * latticeSum().
+	 */
+	template<std::size_t... K>
+	static void weightedSum(const Matrix<double> (&populations)[MATRIX_SIZE],
+							Matrix<double>&      result,
+							std::index_sequence<K...>)
+	{
+		result = (... + (populations[K] * D2Q9::WEIGHT[K]));
+	}
+
+	/**
+	 * @brief Logical element (row, col) of a possibly shifted or padded matrix.
+	 */
+	static double at(const Matrix<double>& matrix, unsigned int row, unsigned int col)
+	{
+		return matrix(row, col);
+	}
+
+	/**
+	 * @brief Cells one step invalidates at the edge of a block: the reach of streaming plus the inner neighbour the
+	 * adiabatic boundaries read.
+	 */
+	template<class DESCRIPTOR>
+	static constexpr int blockShrink()
+	{
+		return latticeReach<DESCRIPTOR>() + 1;
+	}
+
+	/**
+	 * @brief Mark the tiles whose halo neighbourhood did not change in the previous block of the same depth.
+	 * @param halo Halo width of the block, blockShrink() * depth.
+	 */
+	void markSkippedTiles(std::vector<unsigned char>& skip,
+						  unsigned int                N,
+						  unsigned int                M,
+						  unsigned int                tileRows,
+						  unsigned int                tileCols,
+						  unsigned int                depth,
+						  unsigned int                halo)
+	{
+		if(!mSkipTiles || mActivityDepth != depth) {
+			std::fill(skip.begin(), skip.end(), 0);
+			return;
+		}
+
+		// The lists only change with the lattice and the halo, not from one block to the next
+		if(mNeighbourKey != std::array<unsigned int, 3>{N, M, halo}) {
+			mRowNeighbours.resize(tileRows);
+			mColNeighbours.resize(tileCols);
+			for(unsigned int tileRow = 0; tileRow < tileRows; tileRow++) {
+				mRowNeighbours[tileRow] = haloTiles(tileRow, N, halo);
+			}
+			for(unsigned int tileCol = 0; tileCol < tileCols; tileCol++) {
+				mColNeighbours[tileCol] = haloTiles(tileCol, M, halo);
+			}
+			mNeighbourKey = {N, M, halo};
+		}
+
+		for(unsigned int tileRow = 0; tileRow < tileRows; tileRow++) {
+			for(unsigned int tileCol = 0; tileCol < tileCols; tileCol++) {
+				bool quiet = true;
+				for(unsigned int row : mRowNeighbours[tileRow]) {
+					for(unsigned int col : mColNeighbours[tileCol]) {
+						quiet = quiet && !mTileChanged[row * tileCols + col];
+					}
+				}
+				skip[tileRow * tileCols + tileCol] = quiet;
+			}
+		}
+	}
+
+	/**
+	 * @brief Tiles along one axis met by a tile and its halo, wrapping around like the block copy does.
+	 */
+	std::vector<unsigned int> haloTiles(unsigned int tile, unsigned int length, unsigned int halo) const
+	{
+		const unsigned int        first = tile * mTileSize;
+		const unsigned int        last  = std::min(first + mTileSize, length);
+		std::vector<unsigned int> tiles;
+		if(last - first + 2 * halo >= length) {
+			for(unsigned int i = 0; i < (length + mTileSize - 1) / mTileSize; i++) {
+				tiles.push_back(i);
+			}
+			return tiles;
+		}
+		for(unsigned int i = first + length - halo; i < last + length + halo; i++) {
+			const unsigned int neighbour = (i % length) / mTileSize;
+			if(std::find(tiles.begin(), tiles.end(), neighbour) == tiles.end()) {
+				tiles.push_back(neighbour);
+			}
+		}
+		return tiles;
+	}
+
+	template<class DESCRIPTOR>
+	void advanceTile(Matrix<double> (&density)[DESCRIPTOR::Q],
+					 Matrix<double> (&temperature)[DESCRIPTOR::Q],
+					 const Matrix<double>&          kinematicViscosity,
+					 const Matrix<double>&          diffusionCoefficient,
+					 const Matrix<double>&          velocityU,
+					 const Matrix<double>&          velocityV,
+					 const std::array<Boundary, 4>& boundaries,
+					 unsigned int                   firstRow,
+					 unsigned int                   firstCol,
+					 unsigned int                   depth)
+	{
+		constexpr unsigned int Q      = DESCRIPTOR::Q;
+		constexpr int          REACH  = latticeReach<DESCRIPTOR>();
+		constexpr int          SHRINK = blockShrink<DESCRIPTOR>();
+		// Populations, temperatures, then omega_m, omega_s, u, v
+		constexpr size_t FIELD_COUNT = 4 * Q + 4;
+
+		const int N    = density[0].getN();
+		const int M    = density[0].getM();
+		const int halo = SHRINK * depth;
+		// Block of (height + 2 REACH) x (width + 2 REACH) cells: REACH spare cells around the halo absorb pushes off
+		// the edge
+		const int height = std::min<int>(mTileSize, N - firstRow) + 2 * halo;
+		const int width  = std::min<int>(mTileSize, M - firstCol) + 2 * halo;
+		const int pitch  = width + 2 * REACH;
+		const int area   = (height + 2 * REACH) * pitch;
+
+		std::vector<double>& scratch = mScratch[omp_get_thread_num()];
+		if(scratch.size() < FIELD_COUNT * area) {
+			scratch.resize(FIELD_COUNT * area);
+		}
+		double* current = scratch.data();          // density then temperature
+		double* next    = current + 2 * Q * area;  // density then temperature
+		double* omega_m = current + 4 * Q * area;
+		double* omega_s = omega_m + area;
+		double* u       = omega_s + area;
+		double* v       = u + area;
+
+		// Global row and column of block cell (REACH, REACH)
+		const int originRow = ((static_cast<int>(firstRow) - halo) % N + N) % N;
+		const int originCol = ((static_cast<int>(firstCol) - halo) % M + M) % M;
+
+		for(int row = 0; row < height; row++) {
+			const unsigned int globalRow = (originRow + row) % N;
+			for(int col = 0; col < width; col++) {
+				const unsigned int globalCol = (originCol + col) % M;
+				const int          cell      = (row + REACH) * pitch + col + REACH;
+				for(unsigned int k = 0; k < Q; k++) {
+					current[k * area + cell]       = at(density[k], globalRow, globalCol);
+					current[(Q + k) * area + cell] = at(temperature[k], globalRow, globalCol);
+				}
+				omega_m[cell] = 1 / ((at(kinematicViscosity, globalRow, globalCol) * 3) + 0.5);
+				omega_s[cell] = 1 / ((at(diffusionCoefficient, globalRow, globalCol) * 3) + 0.5);
+				u[cell]       = at(velocityU, globalRow, globalCol);
+				v[cell]       = at(velocityV, globalRow, globalCol);
+			}
+		}
+
+		// applyBoundaries() counts from block cell (1, 1)
+		const int boundaryRow = ((originRow + 1 - REACH) % N + N) % N;
+		const int boundaryCol = ((originCol + 1 - REACH) % M + M) % M;
+
+		// Valid region in block coordinates, [rowBegin, rowEnd) x [colBegin, colEnd)
+		int rowBegin = REACH, rowEnd = height + REACH, colBegin = REACH, colEnd = width + REACH;
+		for(unsigned int step = 0; step < depth; step++) {
+			collideAndPush<DESCRIPTOR>(current,
+									   next,
+									   omega_m,
+									   omega_s,
+									   u,
+									   v,
+									   pitch,
+									   area,
+									   rowBegin,
+									   rowEnd,
+									   colBegin,
+									   colEnd,
+									   mDensityCollision,
+									   mTemperatureCollision,
+									   mFlowModel);
+			applyBoundaries<DESCRIPTOR>(next,
+										boundaries,
+										pitch,
+										area,
+										rowBegin + REACH,
+										rowEnd - REACH,
+										colBegin + REACH,
+										colEnd - REACH,
+										boundaryRow,
+										boundaryCol,
+										N,
+										M);
+			std::swap(current, next);
+			rowBegin += SHRINK;
+			rowEnd -= SHRINK;
+			colBegin += SHRINK;
+			colEnd -= SHRINK;
+		}
+
+		// Write the tile interior back, unshifted, and note whether anything changed
+		bool changed = !mSkipTiles;
+		for(int row = rowBegin; row < rowEnd; row++) {
+			const unsigned int globalRow = firstRow + row - rowBegin;
+			for(int col = colBegin; col < colEnd; col++) {
+				const unsigned int globalCol = firstCol + col - colBegin;
+				const int          cell      = row * pitch + col;
+				for(unsigned int k = 0; k < Q; k++) {
+					const double f                = current[k * area + cell];
+					const double g                = current[(Q + k) * area + cell];
+					const size_t densityIndex     = size_t(globalRow) * mNextDensity[k].getPitch() + globalCol;
+					const size_t temperatureIndex = size_t(globalRow) * mNextTemperature[k].getPitch() + globalCol;
+
+					mNextDensity[k].getDataData()[densityIndex]         = f;
+					mNextTemperature[k].getDataData()[temperatureIndex] = g;
+
+					changed = changed || f != at(density[k], globalRow, globalCol) ||
+							  g != at(temperature[k], globalRow, globalCol);
+				}
+			}
+		}
+		mTileChanged[(firstRow / mTileSize) * ((M + mTileSize - 1) / mTileSize) + firstCol / mTileSize] = changed;
+	}
+
+	/**
+	 * @brief advanceTile() for the passive scalars, all of them in one block.
+	 */
+	void advanceScalarTile(const std::vector<Scalar>& scalars,
+						   const Matrix<double>&      velocityU,
+						   const Matrix<double>&      velocityV,
+						   unsigned int               firstRow,
+						   unsigned int               firstCol,
+						   unsigned int               depth)
+	{
+		const int          N      = velocityU.getN();
+		const int          M      = velocityU.getM();
+		const unsigned int count  = scalars.size();
+		const int          halo   = 2 * depth;
+		const int          height = std::min<int>(mTileSize, N - firstRow) + 2 * halo;
+		const int          width  = std::min<int>(mTileSize, M - firstCol) + 2 * halo;
+		const int          pitch  = width + 2;
+		const int          area   = (height + 2) * pitch;
+
+		// Populations of every scalar, twice, then the omega of every scalar, u, v
+		const size_t         fields  = 2 * count * MATRIX_SIZE + count + 2;
+		std::vector<double>& scratch = mScratch[omp_get_thread_num()];
+		if(scratch.size() < fields * area) {
+			scratch.resize(fields * area);
+		}
+		double* current = scratch.data();
+		double* next    = current + count * MATRIX_SIZE * area;
+		double* omega   = current + 2 * count * MATRIX_SIZE * area;
+		double* u       = omega + count * area;
+		double* v       = u + area;
+
+		const int originRow = ((static_cast<int>(firstRow) - halo) % N + N) % N;
+		const int originCol = ((static_cast<int>(firstCol) - halo) % M + M) % M;
+
+		for(int row = 0; row < height; row++) {
+			const unsigned int globalRow = (originRow + row) % N;
+			for(int col = 0; col < width; col++) {
+				const unsigned int globalCol = (originCol + col) % M;
+				const int          cell      = (row + 1) * pitch + col + 1;
+				for(unsigned int s = 0; s < count; s++) {
+					const Scalar& scalar = scalars[s];
+					for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+						current[(s * MATRIX_SIZE + k) * area + cell] = at(scalar.populations[k], globalRow, globalCol);
+					}
+					omega[s * area + cell] = 1 / ((at(scalar.diffusionCoefficient, globalRow, globalCol) * 3) + 0.5);
+				}
+				u[cell] = at(velocityU, globalRow, globalCol);
+				v[cell] = at(velocityV, globalRow, globalCol);
+			}
+		}
+
+		int rowBegin = 1, rowEnd = height + 1, colBegin = 1, colEnd = width + 1;
+		for(unsigned int step = 0; step < depth; step++) {
+			collideAndPushScalars<D2Q9>(
+				current, next, omega, u, v, count, pitch, area, rowBegin, rowEnd, colBegin, colEnd);
+			for(unsigned int s = 0; s < count; s++) {
+				applyBoundaries(next + s * MATRIX_SIZE * area,
+								scalars[s].boundaries,
+								pitch,
+								area,
+								rowBegin + 1,
+								rowEnd - 1,
+								colBegin + 1,
+								colEnd - 1,
+								originRow,
+								originCol,
+								N,
+								M,
+								1);
+			}
+			std::swap(current, next);
+			rowBegin += 2;
+			rowEnd -= 2;
+			colBegin += 2;
+			colEnd -= 2;
+		}
+
+		for(int row = rowBegin; row < rowEnd; row++) {
+			const unsigned int globalRow = firstRow + row - rowBegin;
+			for(int col = colBegin; col < colEnd; col++) {
+				const unsigned int globalCol = firstCol + col - colBegin;
+				const int          cell      = row * pitch + col;
+				for(unsigned int j = 0; j < count * MATRIX_SIZE; j++) {
+					mNextScalars[j].getDataData()[size_t(globalRow) * mNextScalars[j].getPitch() + globalCol] =
+						current[j * area + cell];
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Collision of every valid cell, pushing the post-collision values to their neighbours.
+	 */
+	template<class DESCRIPTOR = D2Q9>
+	static void collideAndPush(const double*     current,
+							   double*           next,
+							   const double*     omega_m,
+							   const double*     omega_s,
+							   const double*     u,
+							   const double*     v,
+							   int               pitch,
+							   int               area,
+							   int               rowBegin,
+							   int               rowEnd,
+							   int               colBegin,
+							   int               colEnd,
+							   CollisionOperator density     = CollisionOperator::BGK,
+							   CollisionOperator temperature = CollisionOperator::BGK,
+							   const FlowModel&  model       = FlowModel())
+	{
+		const unsigned int features = (model.smagorinsky > 0 ? SMAGORINSKY : 0) |
+									  (model.gravityX != 0 || model.gravityY != 0 ? BUOYANCY : 0);
+		collideAndPushModel<DESCRIPTOR>(features,
+										density,
+										temperature,
+										current,
+										next,
+										omega_m,
+										omega_s,
+										u,
+										v,
+										pitch,
+										area,
+										rowBegin,
+										rowEnd,
+										colBegin,
+										colEnd,
+										model);
+	}
+
+	template<class DESCRIPTOR, typename... Arguments>
+	static void collideAndPushModel(unsigned int      features,
+									CollisionOperator density,
+									CollisionOperator temperature,
+									Arguments... arguments)
+	{
+		switch(features) {
+		case SMAGORINSKY: collideAndPushDensity<DESCRIPTOR, SMAGORINSKY>(density, temperature, arguments...); break;
+		case BUOYANCY: collideAndPushDensity<DESCRIPTOR, BUOYANCY>(density, temperature, arguments...); break;
+		case SMAGORINSKY | BUOYANCY:
+			collideAndPushDensity<DESCRIPTOR, SMAGORINSKY | BUOYANCY>(density, temperature, arguments...);
+			break;
+		default: collideAndPushDensity<DESCRIPTOR, 0>(density, temperature, arguments...); break;
+		}
+	}
+
+	// MRT is only instantiated for D2Q9, advance() rejects it for the other descriptors
+	template<class DESCRIPTOR, unsigned int FEATURES, typename... Arguments>
+	static void collideAndPushDensity(CollisionOperator density, CollisionOperator temperature, Arguments... arguments)
+	{
+		switch(density) {
+		case CollisionOperator::TRT:
+			collideAndPushTemperature<DESCRIPTOR, FEATURES, CollisionOperator::TRT>(temperature, arguments...);
+			break;
+		case CollisionOperator::MRT:
+			if constexpr(std::is_same_v<DESCRIPTOR, D2Q9>) {
+				collideAndPushTemperature<DESCRIPTOR, FEATURES, CollisionOperator::MRT>(temperature, arguments...);
+			}
+			break;
+		default:
+			collideAndPushTemperature<DESCRIPTOR, FEATURES, CollisionOperator::BGK>(temperature, arguments...);
+			break;
+		}
+	}
+
+	template<class DESCRIPTOR, unsigned int FEATURES, CollisionOperator DENSITY, typename... Arguments>
+	static void collideAndPushTemperature(CollisionOperator temperature, Arguments... arguments)
+	{
+		switch(temperature) {
+		case CollisionOperator::TRT:
+			collideAndPushFused<DESCRIPTOR, FEATURES, DENSITY, CollisionOperator::TRT>(arguments...);
+			break;
+		case CollisionOperator::MRT:
+			if constexpr(std::is_same_v<DESCRIPTOR, D2Q9>) {
+				collideAndPushFused<DESCRIPTOR, FEATURES, DENSITY, CollisionOperator::MRT>(arguments...);
+			}
+			break;
+		default: collideAndPushFused<DESCRIPTOR, FEATURES, DENSITY, CollisionOperator::BGK>(arguments...); break;
+		}
+	}
+
+	/**
+	 * @brief The collision loop with the operators and FlowModel features fixed at compile time, so every
+	 * combination gets its own vectorized loop. BGK keeps the arithmetic of the formula kernels, everything else goes
+	 * through relax(). Both fields are collided in the same node visit, the buoyancy reads the temperature there.
+	 */
+	template<class DESCRIPTOR, unsigned int FEATURES, CollisionOperator DENSITY, CollisionOperator TEMPERATURE>
+	static void collideAndPushFused(const double*    current,
+									double*          next,
+									const double*    omega_m,
+									const double*    omega_s,
+									const double*    u,
+									const double*    v,
+									int              pitch,
+									int              area,
+									int              rowBegin,
+									int              rowEnd,
+									int              colBegin,
+									int              colEnd,
+									const FlowModel& model)
+	{
+		constexpr unsigned int       Q         = DESCRIPTOR::Q;
+		constexpr std::array<int, Q> rowOffset = latticeRowOffset<DESCRIPTOR>();
+		const double*                f         = current;
+		const double*                g         = current + Q * area;
+		double*                      F         = next;
+		double*                      G         = next + Q * area;
+		int                          offset[Q];
+		for(unsigned int k = 0; k < Q; k++) {
+			offset[k] = k * area + rowOffset[k] * pitch + DESCRIPTOR::CX[k];
+		}
+
+		for(int row = rowBegin; row < rowEnd; row++) {
+#pragma omp simd
+			for(int col = colBegin; col < colEnd; col++) {
+				const int    i   = row * pitch + col;
+				const double rho = latticeSum<DESCRIPTOR>(f + i, area);
+				const double T   = latticeSum<DESCRIPTOR>(g + i, area);
+				const double wm  = omega_m[i];
+				const double ws  = omega_s[i];
+				const double U   = u[i];
+				const double V   = v[i];
+				const double feq = wm * DESCRIPTOR::WEIGHT[0] * rho;
+				const double geq = ws * DESCRIPTOR::WEIGHT[0] * T;
+
+				if constexpr(TEMPERATURE == CollisionOperator::BGK) {
+					for(unsigned int k = 0; k < Q; k++) {
+						G[offset[k] + i] = g[k * area + i] * (1 - ws) + geq * latticeAdvection<DESCRIPTOR>(k, U, V);
+					}
+				} else {
+					double eq[Q];
+					double values[Q];
+					for(unsigned int k = 0; k < Q; k++) {
+						eq[k]     = DESCRIPTOR::WEIGHT[0] * T * latticeAdvection<DESCRIPTOR>(k, U, V);
+						values[k] = g[k * area + i];
+					}
+					relax<TEMPERATURE, DESCRIPTOR>(values, eq, ws, true);
+					for(unsigned int k = 0; k < Q; k++) {
+						G[offset[k] + i] = values[k];
+					}
+				}
+
+				if constexpr(DENSITY == CollisionOperator::BGK && FEATURES == 0) {
+					for(unsigned int k = 0; k < Q; k++) {
+						F[offset[k] + i] = f[k * area + i] * (1 - wm) + feq * latticeEquilibrium<DESCRIPTOR>(k, U, V);
+					}
+				} else {
+					double eq[Q];
+					double values[Q];
+					for(unsigned int k = 0; k < Q; k++) {
+						eq[k]     = DESCRIPTOR::WEIGHT[0] * rho * latticeEquilibrium<DESCRIPTOR>(k, U, V);
+						values[k] = f[k * area + i];
+					}
+					double rate = wm;
+					if constexpr((FEATURES & SMAGORINSKY) != 0) {
+						double n[Q];
+						for(unsigned int k = 0; k < Q; k++) {
+							n[k] = values[k] - eq[k];
+						}
+						rate = smagorinskyRate<DESCRIPTOR>(n, wm, rho, model.smagorinsky);
+					}
+					relax<DENSITY, DESCRIPTOR>(values, eq, rate, false);
+					if constexpr((FEATURES & BUOYANCY) != 0) {
+						const double buoyancy = rho * (T - model.referenceTemperature);
+						double       source[Q];
+						guoSource<DESCRIPTOR>(source, U, V, buoyancy * model.gravityX, buoyancy * model.gravityY);
+						force<DENSITY, DESCRIPTOR>(values, source, rate);
+					}
+					for(unsigned int k = 0; k < Q; k++) {
+						F[offset[k] + i] = values[k];
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief The BGK branch of collideAndPushFused() for the temperature, applied to count scalars stored one after
+	 * the other. The velocity of a cell is read once for all of them. The block needs latticeReach() spare cells
+	 * around the valid region; advanceScalarTile() keeps one and runs D2Q9.
+	 */
+	template<class DESCRIPTOR>
+	static void collideAndPushScalars(const double* current,
+									  double*       next,
+									  const double* omega,
+									  const double* u,
+									  const double* v,
+									  unsigned int  count,
+									  int           pitch,
+									  int           area,
+									  int           rowBegin,
+									  int           rowEnd,
+									  int           colBegin,
+									  int           colEnd)
+	{
+		constexpr std::array<int, DESCRIPTOR::Q> rowOffset = latticeRowOffset<DESCRIPTOR>();
+
+		int offset[DESCRIPTOR::Q];
+		for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+			offset[k] = k * area + rowOffset[k] * pitch + DESCRIPTOR::CX[k];
+		}
+
+		for(int row = rowBegin; row < rowEnd; row++) {
+#pragma omp simd
+			for(int col = colBegin; col < colEnd; col++) {
+				const int    i = row * pitch + col;
+				const double U = u[i];
+				const double V = v[i];
+				for(unsigned int s = 0; s < count; s++) {
+					const double* g   = current + s * DESCRIPTOR::Q * area;
+					double*       G   = next + s * DESCRIPTOR::Q * area;
+					const double  T   = latticeSum<DESCRIPTOR>(g + i, area);
+					const double  ws  = omega[s * area + i];
+					const double  geq = ws * DESCRIPTOR::WEIGHT[0] * T;
+					for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+						G[offset[k] + i] = g[k * area + i] * (1 - ws) + geq * latticeAdvection<DESCRIPTOR>(k, U, V);
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Side updates for the block cells that lie on the lattice sides, in top, bottom, left, right order.
+	 *
+	 * Same rules as Matrix::topAdiabatic() / Matrix::topDirichlet() and friends: adiabatic copies the inner
+	 * neighbour, constant sets C - f_opposite. Periodic sides keep the wrapped values from streaming.
+	 * @param originRow Global row of block cell (1, 1), originCol its column.
+	 * @param fields Population sets stored one after the other from populations on, 2 for density and temperature.
+	 */
+	template<class DESCRIPTOR = D2Q9>
+	static void applyBoundaries(double*                        populations,
+								const std::array<Boundary, 4>& boundaries,
+								int                            pitch,
+								int                            area,
+								int                            rowBegin,
+								int                            rowEnd,
+								int                            colBegin,
+								int                            colEnd,
+								int                            originRow,
+								int                            originCol,
+								int                            N,
+								int                            M,
+								int                            fields = 2)
+	{
+		for(int side = 0; side < 4; side++) {
+			if(boundaries[side].type == PERIODIC) {
+				continue;
+			}
+			// Lattice row (top, bottom) or column (left, right) of this side and the step towards the inside
+			const bool horizontal = side < 2;
+			const int  line       = side == 0 || side == 2 ? 0 : (horizontal ? N : M) - 1;
+			const int  inward     = side == 0 || side == 2 ? 1 : -1;
+			const int  origin     = horizontal ? originRow : originCol;
+			const int  period     = horizontal ? N : M;
+			const int  begin      = horizontal ? rowBegin : colBegin;
+			const int  end        = horizontal ? rowEnd : colEnd;
+
+			for(int position = begin; position < end; position++) {
+				if((origin + position - 1) % period != line) {
+					continue;
+				}
+				const int first  = horizontal ? colBegin : rowBegin;
+				const int last   = horizontal ? colEnd : rowEnd;
+				const int stride = horizontal ? 1 : pitch;
+				const int step   = horizontal ? inward * pitch : inward;
+				const int base   = horizontal ? position * pitch : position;
+				for(int field = 0; field < fields; field++) {
+					double* f = populations + field * DESCRIPTOR::Q * area;
+					for(unsigned int k = 0; k < DESCRIPTOR::Q; k++) {
+						if(!latticeEnters<DESCRIPTOR>(side, k)) {
+							continue;
+						}
+						double*       incoming = f + k * area + base;
+						const double* opposite = f + LATTICE_OPPOSITE<DESCRIPTOR>[k] * area + base;
+						const double  C        = 2 * DESCRIPTOR::WEIGHT[k] * boundaries[side].value;
+						for(int j = first; j < last; j++) {
+							if(boundaries[side].type == ADIABATIC) {
+								incoming[j * stride] = incoming[j * stride + step];
+							} else {
+								incoming[j * stride] = C - opposite[j * stride];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+};
+#endif  // LATTICE_BOLTZMANN_METHOD_D2Q9_CPU
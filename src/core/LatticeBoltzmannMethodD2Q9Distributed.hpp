@@ -0,0 +1,399 @@
+#ifndef LATTICE_BOLTZMANN_METHOD_D2Q9_DISTRIBUTED
+#define LATTICE_BOLTZMANN_METHOD_D2Q9_DISTRIBUTED
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "Communicator.hpp"
+#include "LatticeAllocator.hpp"
+#include "LatticeBoltzmannMethodD2Q9CPU.hpp"
+#include "Matrix.hpp"
+
+/**
+ * @brief One strip of a D2Q9 lattice decomposed by rows over the ranks of a Communicator.
+ *
+ * Rank r owns rows strip(N, r, size) of the N x M lattice (rows and columns as in Matrix) and only ever holds those,
+ * plus one ghost row above and below. A step collides and pushes the strip with the CPU backend kernels, wraps the
+ * columns locally, and hands the populations pushed into the ghost rows to the neighbouring ranks: f_2, f_5, f_6
+ * go up, f_4, f_7, f_8 go down, for density and temperature alike. The ranks form a ring, the first rank's upper
+ * neighbour is the last rank, which reproduces the row wrap of the single-process solver; top and bottom boundaries
+ * then overwrite the wrapped values on the ranks that own row 0 and row N - 1. Every strip needs at least two rows so
+ * the adiabatic boundaries find their inner neighbour locally.
+ *
+ * The collision operators and FlowModel extensions are set like on LatticeBoltzmannMethodD2Q9CPU and all act per
+ * node, so with the same settings the results match LatticeBoltzmannMethodD2Q9CPU bit for bit.
+ */
+class LatticeBoltzmannMethodD2Q9Distributed
+{
+	static inline constexpr unsigned int MATRIX_SIZE = LatticeBoltzmannMethodD2Q9CPU::MATRIX_SIZE;
+	static inline constexpr int          TAG_UP      = 1;
+	static inline constexpr int          TAG_DOWN    = 2;
+	static inline constexpr int          TAG_GATHER  = 3;
+
+	// Directions leaving the strip through its top (row offset -1) and bottom (row offset +1)
+	static inline constexpr unsigned int UPWARD[3]   = {2, 5, 6};
+	static inline constexpr unsigned int DOWNWARD[3] = {4, 7, 8};
+
+public:
+	using Boundary  = LatticeBoltzmannMethodD2Q9CPU::Boundary;
+	using FlowModel = LatticeBoltzmannMethodD2Q9CPU::FlowModel;
+
+private:
+	Communicator&           mCommunicator;
+	unsigned int            mN;
+	unsigned int            mM;
+	unsigned int            mFirstRow;
+	unsigned int            mRows;
+	unsigned int            mStep;
+	std::array<Boundary, 4> mBoundaries;
+	CollisionOperator       mDensityCollision;
+	CollisionOperator       mTemperatureCollision;
+	FlowModel               mFlowModel;
+
+private:  // Padded block of (mRows + 2) x (M + 2) cells per field, density populations then temperature populations
+	int                 mPitch;
+	int                 mArea;
+	std::vector<double> mCurrent;
+	std::vector<double> mNext;
+	std::vector<double> mOmega_m;
+	std::vector<double> mOmega_s;
+	std::vector<double> mVelocityU;
+	std::vector<double> mVelocityV;
+	std::vector<double> mSendUp;
+	std::vector<double> mSendDown;
+	std::vector<double> mReceiveUp;
+	std::vector<double> mReceiveDown;
+
+	std::vector<Communicator::Request> mRequests;  // halo exchange of the step in flight
+
+public:
+	/**
+	 * @brief Rows [first, second) owned by a rank, an even split with the remainder on the first ranks.
+	 */
+	static std::pair<unsigned int, unsigned int> strip(unsigned int rows, int rank, int size)
+	{
+		return rowTile(rows, rank, size);
+	}
+
+	/**
+	 * @param rows N, rows of the whole lattice.
+	 * @param cols M, columns of the whole lattice.
+	 * @param boundaries top, bottom, left, right
+	 * @param kinematicViscosityArray Values of the owned rows only, getRows() * M of them.
+	 * @param diffusionCoefficientArray Values of the owned rows only.
+	 * @param initialDensityArray Values of the owned rows only, zero if empty.
+	 * @param initialTemperatureArray Values of the owned rows only, zero if empty.
+	 */
+	LatticeBoltzmannMethodD2Q9Distributed(Communicator&                  communicator,
+										  unsigned int                   rows,
+										  unsigned int                   cols,
+										  const std::array<Boundary, 4>& boundaries,
+										  const std::vector<double>&     kinematicViscosityArray,
+										  const std::vector<double>&     diffusionCoefficientArray,
+										  std::vector<double>            initialDensityArray     = {},
+										  std::vector<double>            initialTemperatureArray = {})
+		: mCommunicator(communicator), mN(rows), mM(cols), mStep(0), mBoundaries(boundaries),
+		  mDensityCollision(CollisionOperator::BGK), mTemperatureCollision(CollisionOperator::BGK)
+	{
+		std::pair<unsigned int, unsigned int> owned = strip(rows, communicator.getRank(), communicator.getSize());
+		mFirstRow = owned.first;
+		mRows     = owned.second - owned.first;
+		if(mRows < 2 || mM == 0) {
+			throw std::invalid_argument("Every rank needs a strip of at least two rows.");
+		}
+
+		const size_t length = static_cast<size_t>(mRows) * mM;
+		if(initialDensityArray.empty()) {
+			initialDensityArray.resize(length);
+		}
+		if(initialTemperatureArray.empty()) {
+			initialTemperatureArray.resize(length);
+		}
+		if(kinematicViscosityArray.size() != length || diffusionCoefficientArray.size() != length ||
+		   initialDensityArray.size() != length || initialTemperatureArray.size() != length) {
+			throw std::invalid_argument("Strip arrays must hold getRows() * cols values.");
+		}
+
+		mPitch = mM + 2;
+		mArea  = (mRows + 2) * mPitch;
+		mCurrent.assign(2 * MATRIX_SIZE * mArea, 0);
+		mNext.assign(2 * MATRIX_SIZE * mArea, 0);
+		mOmega_m.assign(mArea, 0);
+		mOmega_s.assign(mArea, 0);
+		mVelocityU.assign(mArea, 0);
+		mVelocityV.assign(mArea, 0);
+		mSendUp.resize(2 * 3 * mM);
+		mSendDown.resize(2 * 3 * mM);
+		mReceiveUp.resize(2 * 3 * mM);
+		mReceiveDown.resize(2 * 3 * mM);
+
+		for(unsigned int row = 0; row < mRows; row++) {
+			for(unsigned int col = 0; col < mM; col++) {
+				const size_t index = static_cast<size_t>(row) * mM + col;
+				const int    i     = cell(row, col);
+				for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+					mCurrent[k * mArea + i]                 = initialDensityArray[index] * D2Q9::WEIGHT[k];
+					mCurrent[(MATRIX_SIZE + k) * mArea + i] = initialTemperatureArray[index] * D2Q9::WEIGHT[k];
+				}
+				mOmega_m[i] = 1 / ((kinematicViscosityArray[index] * 3) + 0.5);
+				mOmega_s[i] = 1 / ((diffusionCoefficientArray[index] * 3) + 0.5);
+			}
+		}
+	}
+
+	LatticeBoltzmannMethodD2Q9Distributed(LatticeBoltzmannMethodD2Q9Distributed const&)            = delete;
+	LatticeBoltzmannMethodD2Q9Distributed& operator=(LatticeBoltzmannMethodD2Q9Distributed const&) = delete;
+
+	~LatticeBoltzmannMethodD2Q9Distributed()
+	{
+		// The communicator still points into the halo buffers
+		mCommunicator.waitAll(mRequests);
+	}
+
+	/**
+	 * @brief Collision operator of each field, BGK by default. Every rank must use the same settings, like for the
+	 * following setters.
+	 */
+	void setCollision(CollisionOperator density, CollisionOperator temperature)
+	{
+		mDensityCollision     = density;
+		mTemperatureCollision = temperature;
+	}
+
+	/**
+	 * @brief Smagorinsky constant of the density field, 0 disables the subgrid model. See smagorinskyRate().
+	 * @throw std::invalid_argument if the constant is negative.
+	 */
+	void setSmagorinsky(double constant)
+	{
+		if(constant < 0) {
+			throw std::invalid_argument("The Smagorinsky constant must not be negative.");
+		}
+		mFlowModel.smagorinsky = constant;
+	}
+
+	/**
+	 * @brief Boussinesq coupling of the temperature into the flow, a zero gravity disables it. See FlowModel.
+	 */
+	void setBuoyancy(double gravityX, double gravityY, double referenceTemperature)
+	{
+		mFlowModel.gravityX             = gravityX;
+		mFlowModel.gravityY             = gravityY;
+		mFlowModel.referenceTemperature = referenceTemperature;
+	}
+
+	const FlowModel& getFlowModel() const
+	{
+		return mFlowModel;
+	}
+
+	/**
+	 * @brief Collective, every rank must step together.
+	 *
+	 * The first and last owned rows are computed first and their halos are sent right away, the interior is computed
+	 * while they are in flight. The step returns without waiting for the neighbours: the incoming halos are only
+	 * needed by the next collision, so the wait, the boundaries and the buffer swap happen at the start of the next
+	 * step, or when a result is read.
+	 */
+	void step()
+	{
+		finishExchange();
+		collideAndPush(1, 2);
+		collideAndPush(mRows, mRows + 1);
+		wrapColumns(0, 1);
+		wrapColumns(mRows + 1, mRows + 2);
+		startExchange();
+
+		collideAndPush(2, mRows);
+		wrapColumns(1, mRows + 1);
+		mStep++;
+	}
+
+	void run(unsigned int steps)
+	{
+		for(unsigned int i = 0; i < steps; i++) {
+			step();
+		}
+	}
+
+	unsigned int getStep() const
+	{
+		return mStep;
+	}
+	unsigned int getFirstRow() const
+	{
+		return mFirstRow;
+	}
+	unsigned int getRows() const
+	{
+		return mRows;
+	}
+
+	/**
+	 * @brief Weighted population sums of the owned rows, getRows() x M.
+	 */
+	Matrix<double> buildResultingDensityMatrix()
+	{
+		finishExchange();
+		return buildResultingMatrix(0);
+	}
+	Matrix<double> buildResultingTemperatureMatrix()
+	{
+		finishExchange();
+		return buildResultingMatrix(MATRIX_SIZE);
+	}
+
+	/**
+	 * @brief Collective, assemble the whole N x M result on root. Other ranks get an empty matrix.
+	 */
+	Matrix<double> gatherResultingDensityMatrix(int root = 0)
+	{
+		return gather(buildResultingDensityMatrix(), root);
+	}
+	Matrix<double> gatherResultingTemperatureMatrix(int root = 0)
+	{
+		return gather(buildResultingTemperatureMatrix(), root);
+	}
+
+private:
+	int cell(unsigned int row, unsigned int col) const
+	{
+		return (row + 1) * mPitch + col + 1;
+	}
+
+	/**
+	 * @brief Collide block rows [rowBegin, rowEnd) and push them into the next populations.
+	 */
+	void collideAndPush(int rowBegin, int rowEnd)
+	{
+		LatticeBoltzmannMethodD2Q9CPU::collideAndPush(mCurrent.data(),
+													  mNext.data(),
+													  mOmega_m.data(),
+													  mOmega_s.data(),
+													  mVelocityU.data(),
+													  mVelocityV.data(),
+													  mPitch,
+													  mArea,
+													  rowBegin,
+													  rowEnd,
+													  1,
+													  mM + 1,
+													  mDensityCollision,
+													  mTemperatureCollision,
+													  mFlowModel);
+	}
+
+	/**
+	 * @brief Move the values pushed past the first and last column of block rows [rowBegin, rowEnd) to the other
+	 * side.
+	 */
+	void wrapColumns(unsigned int rowBegin, unsigned int rowEnd)
+	{
+		for(unsigned int k = 0; k < 2 * MATRIX_SIZE; k++) {
+			const int colOffset = LatticeBoltzmannMethodD2Q9CPU::COL_OFFSET[k % MATRIX_SIZE];
+			if(colOffset == 0) {
+				continue;
+			}
+			double*   f    = mNext.data() + k * mArea;
+			const int from = colOffset < 0 ? 0 : mM + 1;
+			const int to   = colOffset < 0 ? mM : 1;
+			for(unsigned int row = rowBegin; row < rowEnd; row++) {
+				f[row * mPitch + to] = f[row * mPitch + from];
+			}
+		}
+	}
+
+	/**
+	 * @brief Post the ghost rows to the neighbours and the receives of theirs.
+	 */
+	void startExchange()
+	{
+		const int rank  = mCommunicator.getRank();
+		const int size  = mCommunicator.getSize();
+		const int upper = (rank + size - 1) % size;
+		const int lower = (rank + 1) % size;
+
+		copyRow(0, UPWARD, mSendUp.data(), true);
+		copyRow(mRows + 1, DOWNWARD, mSendDown.data(), true);
+		mRequests = {mCommunicator.ireceive(mReceiveUp.data(), mReceiveUp.size(), lower, TAG_UP),
+					 mCommunicator.ireceive(mReceiveDown.data(), mReceiveDown.size(), upper, TAG_DOWN),
+					 mCommunicator.isend(mSendUp.data(), mSendUp.size(), upper, TAG_UP),
+					 mCommunicator.isend(mSendDown.data(), mSendDown.size(), lower, TAG_DOWN)};
+	}
+
+	/**
+	 * @brief Complete the step in flight: store the neighbours' halos in the first and last owned row, apply the
+	 * boundaries and make the new populations current.
+	 */
+	void finishExchange()
+	{
+		if(mRequests.empty()) {
+			return;
+		}
+		mCommunicator.waitAll(mRequests);
+		mRequests.clear();
+		copyRow(mRows, UPWARD, mReceiveUp.data(), false);
+		copyRow(1, DOWNWARD, mReceiveDown.data(), false);
+		LatticeBoltzmannMethodD2Q9CPU::applyBoundaries(
+			mNext.data(), mBoundaries, mPitch, mArea, 1, mRows + 1, 1, mM + 1, mFirstRow, 0, mN, mM);
+		std::swap(mCurrent, mNext);
+	}
+
+	/**
+	 * @brief Pack (or unpack) three directions of both fields of one block row, columns 1 to M.
+	 */
+	void copyRow(unsigned int row, const unsigned int (&directions)[3], double* buffer, bool pack)
+	{
+		for(unsigned int field = 0; field < 2; field++) {
+			for(unsigned int d = 0; d < 3; d++) {
+				double* f = mNext.data() + (field * MATRIX_SIZE + directions[d]) * mArea + row * mPitch + 1;
+				double* b = buffer + (field * 3 + d) * mM;
+				for(unsigned int col = 0; col < mM; col++) {
+					if(pack) {
+						b[col] = f[col];
+					} else {
+						f[col] = b[col];
+					}
+				}
+			}
+		}
+	}
+
+	Matrix<double> buildResultingMatrix(unsigned int firstField) const
+	{
+		Matrix<double> result(mRows, mM);
+		double*        out = result.getDataData();
+		const double*  f   = mCurrent.data() + firstField * mArea;
+		for(unsigned int row = 0; row < mRows; row++) {
+			for(unsigned int col = 0; col < mM; col++) {
+				const int i         = cell(row, col);
+				out[row * mM + col] = latticeSum<D2Q9>(f + i, mArea);
+			}
+		}
+		return result;
+	}
+
+	Matrix<double> gather(const Matrix<double>& local, int root)
+	{
+		if(mCommunicator.getRank() != root) {
+			mCommunicator.send(local.getDataData(), local.getLength(), root, TAG_GATHER);
+			return Matrix<double>(0, 0);
+		}
+		Matrix<double> result(mN, mM);
+		for(int rank = 0; rank < mCommunicator.getSize(); rank++) {
+			std::pair<unsigned int, unsigned int> rows   = strip(mN, rank, mCommunicator.getSize());
+			double*                               target = result.getDataData() + static_cast<size_t>(rows.first) * mM;
+			size_t                                count  = static_cast<size_t>(rows.second - rows.first) * mM;
+			if(rank == root) {
+				std::copy(local.getDataData(), local.getDataData() + count, target);
+			} else {
+				mCommunicator.receive(target, count, rank, TAG_GATHER);
+			}
+		}
+		return result;
+	}
+};
+#endif  // LATTICE_BOLTZMANN_METHOD_D2Q9_DISTRIBUTED
@@ -0,0 +1,293 @@
+#include "LatticeBoltzmannMethodD2Q9Ensemble.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "OpenCLMain.hpp"
+
+namespace
+{
+// Mirrors LatticeBoltzmannMethodD2Q9::collision() and streaming() node by node, so a member evolves exactly like a
+// standalone solver with uniform viscosity and diffusion coefficient.
+const std::string ensembleKernelCode = latticeSource<D2Q9>() + R"(
+	void kernel ensembleCollideAndStream(global const double* densityIn, global double* densityOut, global const double* temperatureIn, global double* temperatureOut, global const double* velocityU, global const double* velocityV, global const double* parameters, const unsigned int N, const unsigned int M, const unsigned int members) {
+		unsigned int gid    = get_global_id(0);
+		unsigned int length = N * M;
+		unsigned int member = gid / length;
+		unsigned int i      = gid % length;
+		unsigned int row    = i / M;
+		unsigned int col    = i % M;
+		unsigned int stride = members * length;
+		unsigned int base   = member * length;
+
+		double f[9];
+		double g[9];
+		for (int k = 0; k < 9; k++) {
+			f[k] = densityIn[k * stride + base + i];
+			g[k] = temperatureIn[k * stride + base + i];
+		}
+
+		double omegaM = parameters[member * 10 + 0];
+		double omegaS = parameters[member * 10 + 1];
+		double rho    = latticeSum(f);
+		double T      = latticeSum(g);
+		double u      = velocityU[base + i];
+		double v      = velocityV[base + i];
+
+		for (int k = 0; k < 9; k++) {
+			g[k] = g[k] * (1 - omegaS) + omegaS * WEIGHT[0] * T * latticeAdvection(k, u, v);
+			f[k] = f[k] * (1 - omegaM) + omegaM * WEIGHT[0] * rho * latticeEquilibrium(k, u, v);
+		}
+
+		// Push streaming with periodic wrap, boundaries are fixed up by ensembleBoundary afterwards
+		for (int k = 0; k < 9; k++) {
+			unsigned int r = (row + N + ROW_OFFSET[k]) % N;
+			unsigned int c = (col + M + CX[k]) % M;
+			densityOut[k * stride + base + r * M + c]     = f[k];
+			temperatureOut[k * stride + base + r * M + c] = g[k];
+		}
+	}
+
+	// The populations entering through the side, f_k = 2 w_k value - f_opposite on a CONSTANT side
+	void applyBoundary(global double* f, const unsigned int stride, const unsigned int cell, const unsigned int inner, const unsigned int side, const int type, const double value) {
+		for (int k = 0; k < 9; k++) {
+			if (!latticeEnters(side, k)) {
+				continue;
+			}
+			if (type == 0) {  // ADIABATIC
+				f[k * stride + cell] = f[k * stride + inner];
+			} else if (type == 1) {  // CONSTANT
+				f[k * stride + cell] = 2 * WEIGHT[k] * value - f[OPPOSITE[k] * stride + cell];
+			}
+		}
+	}
+
+	// side: 0 top, 1 bottom, 2 left, 3 right
+	void kernel ensembleBoundary(global double* density, global double* temperature, global const double* parameters, const unsigned int side, const unsigned int N, const unsigned int M, const unsigned int members) {
+		unsigned int gid        = get_global_id(0);
+		unsigned int edgeLength = side < 2 ? M : N;
+		unsigned int member     = gid / edgeLength;
+		unsigned int i          = gid % edgeLength;
+		unsigned int stride     = members * N * M;
+		unsigned int base       = member * N * M;
+		int          type       = (int)parameters[member * 10 + 2 + side * 2];
+		double       value      = parameters[member * 10 + 3 + side * 2];
+
+		unsigned int cell;
+		unsigned int inner;
+		if (side == 0) {
+			cell  = base + i;
+			inner = base + M + i;
+		} else if (side == 1) {
+			cell  = base + (N - 1) * M + i;
+			inner = base + (N - 2) * M + i;
+		} else if (side == 2) {
+			cell  = base + i * M;
+			inner = base + i * M + 1;
+		} else {
+			cell  = base + i * M + M - 1;
+			inner = base + i * M + M - 2;
+		}
+		applyBoundary(density, stride, cell, inner, side, type, value);
+		applyBoundary(temperature, stride, cell, inner, side, type, value);
+	}
+
+	void kernel ensembleResulting(global const double* density, global const double* temperature, global double* resultingDensity, global double* resultingTemperature, const unsigned int length, const unsigned int members) {
+		unsigned int gid    = get_global_id(0);
+		unsigned int stride = members * length;
+
+		double f[9];
+		double g[9];
+		for (int k = 0; k < 9; k++) {
+			f[k] = density[k * stride + gid];
+			g[k] = temperature[k * stride + gid];
+		}
+		resultingDensity[gid]     = latticeSum(f);
+		resultingTemperature[gid] = latticeSum(g);
+	}
+)";
+}  // namespace
+
+LatticeBoltzmannMethodD2Q9Ensemble::LatticeBoltzmannMethodD2Q9Ensemble(unsigned int               height,
+																	   unsigned int               width,
+																	   const std::vector<Member>& members)
+{
+	if(members.empty()) {
+		throw std::invalid_argument("Ensemble requires at least one member.");
+	}
+
+	mHeight      = height + 1;
+	mWidth       = width + 1;
+	mLength      = mHeight * mWidth;
+	mMemberCount = members.size();
+	mCurrent     = 0;
+
+	const size_t stride = static_cast<size_t>(mMemberCount) * mLength;
+
+	std::vector<double> density(MATRIX_SIZE * stride, 0);
+	std::vector<double> temperature(MATRIX_SIZE * stride, 0);
+	std::vector<double> velocityU(stride, 0);
+	std::vector<double> velocityV(stride, 0);
+	std::vector<double> parameters(PARAMETER_COUNT * mMemberCount);
+
+	auto validate = [this](const std::vector<double>& array, const std::string& name) {
+		if(!array.empty() && array.size() != mLength) {
+			std::string errMsg = "Inconsistent " + name + " length: ";
+			errMsg += std::to_string(array.size()) + " vs " + std::to_string(mLength);
+			throw std::invalid_argument(errMsg);
+		}
+	};
+
+	for(size_t m = 0; m < members.size(); m++) {
+		const Member& member = members[m];
+		validate(member.initialDensityArray, "initial density");
+		validate(member.initialTemperatureArray, "initial temperature");
+		validate(member.velocityUArray, "velocity u");
+		validate(member.velocityVArray, "velocity v");
+
+		const size_t base = m * mLength;
+#pragma omp parallel for
+		for(size_t i = 0; i < mLength; i++) {
+			double initialDensity     = member.initialDensityArray.empty() ? 0 : member.initialDensityArray[i];
+			double initialTemperature = member.initialTemperatureArray.empty() ? 0 : member.initialTemperatureArray[i];
+			for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+				density[k * stride + base + i]     = initialDensity * D2Q9::WEIGHT[k];
+				temperature[k * stride + base + i] = initialTemperature * D2Q9::WEIGHT[k];
+			}
+			velocityU[base + i] = member.velocityUArray.empty() ? 0 : member.velocityUArray[i];
+			velocityV[base + i] = member.velocityVArray.empty() ? 0 : member.velocityVArray[i];
+		}
+
+		double* row = &parameters[m * PARAMETER_COUNT];
+		row[0]      = 1 / ((member.kinematicViscosity * 3) + 0.5);
+		row[1]      = 1 / ((member.diffusionCoefficient * 3) + 0.5);
+		row[2]      = member.top.boundary;
+		row[3]      = member.top.parameter1;
+		row[4]      = member.bottom.boundary;
+		row[5]      = member.bottom.parameter1;
+		row[6]      = member.left.boundary;
+		row[7]      = member.left.parameter1;
+		row[8]      = member.right.boundary;
+		row[9]      = member.right.parameter1;
+	}
+
+	const cl::Context& context = OpenCLMain::getContext();
+	mProgram                   = OpenCLMain::buildProgram(ensembleKernelCode);
+	mQueue                     = cl::CommandQueue(context, OpenCLMain::getDevice());
+
+	for(unsigned int i = 0; i < 2; i++) {
+		mDensity[i]     = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(double) * MATRIX_SIZE * stride);
+		mTemperature[i] = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(double) * MATRIX_SIZE * stride);
+	}
+	mVelocityU            = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(double) * stride);
+	mVelocityV            = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(double) * stride);
+	mParameters           = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(double) * parameters.size());
+	mResultingDensity     = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(double) * stride);
+	mResultingTemperature = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(double) * stride);
+
+	mQueue.enqueueWriteBuffer(mDensity[mCurrent], CL_TRUE, 0, sizeof(double) * density.size(), density.data());
+	mQueue.enqueueWriteBuffer(mTemperature[mCurrent],
+							  CL_TRUE,
+							  0,
+							  sizeof(double) * temperature.size(),
+							  temperature.data());
+	mQueue.enqueueWriteBuffer(mVelocityU, CL_TRUE, 0, sizeof(double) * velocityU.size(), velocityU.data());
+	mQueue.enqueueWriteBuffer(mVelocityV, CL_TRUE, 0, sizeof(double) * velocityV.size(), velocityV.data());
+	mQueue.enqueueWriteBuffer(mParameters, CL_TRUE, 0, sizeof(double) * parameters.size(), parameters.data());
+}
+
+void LatticeBoltzmannMethodD2Q9Ensemble::step(unsigned int count)
+{
+	auto kernelCollideAndStream = cl::compatibility::make_kernel<cl::Buffer,
+																 cl::Buffer,
+																 cl::Buffer,
+																 cl::Buffer,
+																 cl::Buffer,
+																 cl::Buffer,
+																 cl::Buffer,
+																 unsigned int,
+																 unsigned int,
+																 unsigned int>(
+		cl::Kernel(mProgram, "ensembleCollideAndStream"));
+	auto kernelBoundary = cl::compatibility::
+		make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, unsigned int, unsigned int, unsigned int, unsigned int>(
+			cl::Kernel(mProgram, "ensembleBoundary"));
+
+	// Matrix rows follow the solver's Matrix(mWidth, mHeight) convention
+	const unsigned int N = mWidth;
+	const unsigned int M = mHeight;
+
+	for(unsigned int s = 0; s < count; s++) {
+		const unsigned int next = 1 - mCurrent;
+		kernelCollideAndStream(cl::EnqueueArgs(mQueue, cl::NDRange(mMemberCount * mLength)),
+							   mDensity[mCurrent],
+							   mDensity[next],
+							   mTemperature[mCurrent],
+							   mTemperature[next],
+							   mVelocityU,
+							   mVelocityV,
+							   mParameters,
+							   N,
+							   M,
+							   mMemberCount);
+
+		// Sides are applied in the same order as the solver so corners resolve identically
+		for(unsigned int side = 0; side < 4; side++) {
+			kernelBoundary(cl::EnqueueArgs(mQueue, cl::NDRange(mMemberCount * (side < 2 ? M : N))),
+						   mDensity[next],
+						   mTemperature[next],
+						   mParameters,
+						   side,
+						   N,
+						   M,
+						   mMemberCount);
+		}
+		mCurrent = next;
+	}
+	mQueue.flush();
+}
+
+unsigned int LatticeBoltzmannMethodD2Q9Ensemble::getMemberCount() const
+{
+	return mMemberCount;
+}
+
+Matrix<double> LatticeBoltzmannMethodD2Q9Ensemble::buildResultingDensityMatrix(unsigned int member)
+{
+	buildResultingMatrices();
+	return readMember(mResultingDensity, member);
+}
+
+Matrix<double> LatticeBoltzmannMethodD2Q9Ensemble::buildResultingTemperatureMatrix(unsigned int member)
+{
+	buildResultingMatrices();
+	return readMember(mResultingTemperature, member);
+}
+
+void LatticeBoltzmannMethodD2Q9Ensemble::buildResultingMatrices()
+{
+	auto kernelResulting =
+		cl::compatibility::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, unsigned int, unsigned int>(
+			cl::Kernel(mProgram, "ensembleResulting"));
+	kernelResulting(cl::EnqueueArgs(mQueue, cl::NDRange(mMemberCount * mLength)),
+					mDensity[mCurrent],
+					mTemperature[mCurrent],
+					mResultingDensity,
+					mResultingTemperature,
+					mLength,
+					mMemberCount);
+}
+
+Matrix<double> LatticeBoltzmannMethodD2Q9Ensemble::readMember(const cl::Buffer& buffer, unsigned int member)
+{
+	if(member >= mMemberCount) {
+		throw std::out_of_range("Ensemble member out of range: " + std::to_string(member));
+	}
+	Matrix<double> result(mWidth, mHeight);
+	mQueue.enqueueReadBuffer(buffer,
+							 CL_TRUE,
+							 sizeof(double) * member * mLength,
+							 sizeof(double) * mLength,
+							 result.getDataData());
+	return result;
+}
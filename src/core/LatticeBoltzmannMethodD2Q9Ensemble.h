@@ -0,0 +1,79 @@
+#ifndef LATTICE_BOLTZMANN_METHOD_D2Q9_ENSEMBLE
+#define LATTICE_BOLTZMANN_METHOD_D2Q9_ENSEMBLE
+
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <vector>
+
+#include "LatticeBoltzmannMethodD2Q9.h"
+#include "Matrix.hpp"
+
+/**
+ * @brief Batch of independent, same-sized D2Q9 simulations advanced together on the OpenCL device.
+ *
+ * Every member keeps its own populations, viscosity, diffusion coefficient and boundaries, but all members live in
+ * one batched storage and a step is a single collision/streaming launch over the whole batch followed by one launch
+ * per boundary side. Populations stay resident on the device between steps; only results are read back.
+ *
+ * Storage layout: direction major, then member, then node, i.e. f_k of member m at node i lives at
+ * `k * memberCount * length + m * length + i`.
+ *
+ * Parameter table (one row of PARAMETER_COUNT doubles per member):
+ * - omega_m, omega_s
+ * - top type, top value, bottom type, bottom value, left type, left value, right type, right value
+ */
+class LatticeBoltzmannMethodD2Q9Ensemble
+{
+	static inline constexpr unsigned int MATRIX_SIZE     = 9;   // the number of direction
+	static inline constexpr unsigned int PARAMETER_COUNT = 10;  // per member parameter table row
+
+public:
+	struct Member {
+		double                               kinematicViscosity;
+		double                               diffusionCoefficient;
+		LatticeBoltzmannMethodD2Q9::Boundary top;
+		LatticeBoltzmannMethodD2Q9::Boundary bottom;
+		LatticeBoltzmannMethodD2Q9::Boundary left;
+		LatticeBoltzmannMethodD2Q9::Boundary right;
+		std::vector<double>                  initialDensityArray;
+		std::vector<double>                  initialTemperatureArray;
+		std::vector<double>                  velocityUArray;
+		std::vector<double>                  velocityVArray;
+	};
+
+public:
+	unsigned int mHeight;
+	unsigned int mWidth;
+
+private:
+	unsigned int mLength;
+	unsigned int mMemberCount;
+
+private:  // Device data
+	cl::CommandQueue mQueue;
+	cl::Program      mProgram;
+	cl::Buffer       mDensity[2];
+	cl::Buffer       mTemperature[2];
+	cl::Buffer       mVelocityU;
+	cl::Buffer       mVelocityV;
+	cl::Buffer       mParameters;
+	cl::Buffer       mResultingDensity;
+	cl::Buffer       mResultingTemperature;
+	unsigned int     mCurrent;  // index of the buffer holding the current populations
+
+public:
+	LatticeBoltzmannMethodD2Q9Ensemble(unsigned int height, unsigned int width, const std::vector<Member>& members);
+
+	void step(unsigned int count = 1);
+
+	unsigned int getMemberCount() const;
+
+	Matrix<double> buildResultingDensityMatrix(unsigned int member);
+	Matrix<double> buildResultingTemperatureMatrix(unsigned int member);
+
+private:  // helper
+	void           buildResultingMatrices();
+	Matrix<double> readMember(const cl::Buffer& buffer, unsigned int member);
+};
+#endif  // LATTICE_BOLTZMANN_METHOD_D2Q9_ENSEMBLE
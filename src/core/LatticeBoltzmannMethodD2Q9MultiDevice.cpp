@@ -0,0 +1,549 @@
+#include "LatticeBoltzmannMethodD2Q9MultiDevice.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+#include "OpenCLMain.hpp"
+
+namespace
+{
+// Same node update as the ensemble kernels, on a slab with a ghost row above and below its owned rows
+const std::string multiDeviceKernelCode = latticeSource<D2Q9>() + R"(
+	// One work item per owned node, i runs over rows * M, a launch covers some of the rows through its global offset
+	void kernel slabCollideAndStream(global const double* densityIn, global double* densityOut, global const double* temperatureIn, global double* temperatureOut, global const double* omegaM, global const double* omegaS, global const double* velocityU, global const double* velocityV, const unsigned int rows, const unsigned int M) {
+		unsigned int i      = get_global_id(0);
+		unsigned int row    = i / M + 1;
+		unsigned int col    = i % M;
+		unsigned int stride = (rows + 2) * M;
+		unsigned int cell   = row * M + col;
+
+		double f[9];
+		double g[9];
+		for (int k = 0; k < 9; k++) {
+			f[k] = densityIn[k * stride + cell];
+			g[k] = temperatureIn[k * stride + cell];
+		}
+
+		double omega_m = omegaM[i];
+		double omega_s = omegaS[i];
+		double rho     = latticeSum(f);
+		double T       = latticeSum(g);
+		double u       = velocityU[i];
+		double v       = velocityV[i];
+
+		for (int k = 0; k < 9; k++) {
+			g[k] = g[k] * (1 - omega_s) + omega_s * WEIGHT[0] * T * latticeAdvection(k, u, v);
+			f[k] = f[k] * (1 - omega_m) + omega_m * WEIGHT[0] * rho * latticeEquilibrium(k, u, v);
+		}
+
+		// Rows are pushed into the ghost rows, columns wrap inside the slab
+		for (int k = 0; k < 9; k++) {
+			unsigned int r = row + ROW_OFFSET[k];
+			unsigned int c = (col + M + CX[k]) % M;
+			densityOut[k * stride + r * M + c]     = f[k];
+			temperatureOut[k * stride + r * M + c] = g[k];
+		}
+	}
+
+	// The populations entering through the side, f_k = 2 w_k value - f_opposite on a CONSTANT side
+	void applyBoundary(global double* f, const unsigned int stride, const unsigned int cell, const unsigned int inner, const unsigned int side, const int type, const double value) {
+		for (int k = 0; k < 9; k++) {
+			if (!latticeEnters(side, k)) {
+				continue;
+			}
+			if (type == 0) {  // ADIABATIC
+				f[k * stride + cell] = f[k * stride + inner];
+			} else if (type == 1) {  // CONSTANT
+				f[k * stride + cell] = 2 * WEIGHT[k] * value - f[OPPOSITE[k] * stride + cell];
+			}
+		}
+	}
+
+	// side: 0 top, 1 bottom, 2 left, 3 right; one work item per node of the side inside the slab
+	void kernel slabBoundary(global double* density, global double* temperature, const unsigned int side, const int type, const double value, const unsigned int rows, const unsigned int M) {
+		unsigned int i      = get_global_id(0);
+		unsigned int stride = (rows + 2) * M;
+
+		unsigned int cell;
+		unsigned int inner;
+		if (side == 0) {
+			cell  = M + i;
+			inner = 2 * M + i;
+		} else if (side == 1) {
+			cell  = rows * M + i;
+			inner = (rows - 1) * M + i;
+		} else if (side == 2) {
+			cell  = (i + 1) * M;
+			inner = (i + 1) * M + 1;
+		} else {
+			cell  = (i + 1) * M + M - 1;
+			inner = (i + 1) * M + M - 2;
+		}
+		applyBoundary(density, stride, cell, inner, side, type, value);
+		applyBoundary(temperature, stride, cell, inner, side, type, value);
+	}
+
+	void kernel slabResulting(global const double* density, global const double* temperature, global double* resultingDensity, global double* resultingTemperature, const unsigned int rows, const unsigned int M) {
+		unsigned int i      = get_global_id(0);
+		unsigned int stride = (rows + 2) * M;
+
+		double f[9];
+		double g[9];
+		for (int k = 0; k < 9; k++) {
+			f[k] = density[k * stride + M + i];
+			g[k] = temperature[k * stride + M + i];
+		}
+		resultingDensity[i]     = latticeSum(f);
+		resultingTemperature[i] = latticeSum(g);
+	}
+)";
+
+// The three directions entering through a side, in direction order
+constexpr std::array<unsigned int, 3> enteringThrough(unsigned int side)
+{
+	std::array<unsigned int, 3> directions{};
+	unsigned int                count = 0;
+	for(unsigned int k = 0; k < D2Q9::Q; k++) {
+		if(latticeEnters<D2Q9>(side, k)) {
+			directions[count++] = k;
+		}
+	}
+	return directions;
+}
+
+// Directions leaving a slab through its top and bottom ghost row, the ones entering through the bottom and top side
+constexpr std::array<unsigned int, 3> UPWARD   = enteringThrough(1);
+constexpr std::array<unsigned int, 3> DOWNWARD = enteringThrough(0);
+}  // namespace
+
+LatticeBoltzmannMethodD2Q9MultiDevice::LatticeBoltzmannMethodD2Q9MultiDevice(
+	unsigned int                         height,
+	unsigned int                         width,
+	LatticeBoltzmannMethodD2Q9::Boundary top,
+	LatticeBoltzmannMethodD2Q9::Boundary bottom,
+	LatticeBoltzmannMethodD2Q9::Boundary left,
+	LatticeBoltzmannMethodD2Q9::Boundary right,
+	std::vector<double>                  kinematicViscosityArray,
+	std::vector<double>                  diffusionCoefficientArray,
+	std::vector<double>                  initialDensityArray,
+	std::vector<double>                  initialTemperatureArray,
+	const std::vector<cl::Device>&       devices,
+	const std::vector<double>&           weights)
+{
+	if(devices.empty()) {
+		throw std::invalid_argument("At least one device is required.");
+	}
+	if(!weights.empty() && weights.size() != devices.size()) {
+		throw std::invalid_argument("One split weight per device is required.");
+	}
+
+	mHeight  = height + 1;
+	mWidth   = width + 1;
+	mLength  = mHeight * mWidth;
+	mCurrent = 0;
+	mTop     = top;
+	mBottom  = bottom;
+	mLeft    = left;
+	mRight   = right;
+
+	if(initialDensityArray.empty()) {
+		initialDensityArray.resize(mLength);
+	}
+	if(initialTemperatureArray.empty()) {
+		initialTemperatureArray.resize(mLength);
+	}
+	auto validate = [this](const std::vector<double>& array, const std::string& name) {
+		if(array.size() != mLength) {
+			std::string errMsg = "Inconsistent " + name + " length: ";
+			errMsg += std::to_string(array.size()) + " vs " + std::to_string(mLength);
+			throw std::invalid_argument(errMsg);
+		}
+	};
+	validate(kinematicViscosityArray, "kinematic viscosity");
+	validate(diffusionCoefficientArray, "diffusion coefficient");
+	validate(initialDensityArray, "initial density");
+	validate(initialTemperatureArray, "initial temperature");
+
+	std::vector<double> density(MATRIX_SIZE * mLength);
+	std::vector<double> temperature(MATRIX_SIZE * mLength);
+	mOmega_m.resize(mLength);
+	mOmega_s.resize(mLength);
+	mVelocityU.assign(mLength, 0);
+	mVelocityV.assign(mLength, 0);
+#pragma omp parallel for
+	for(size_t i = 0; i < mLength; i++) {
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			density[k * mLength + i]     = initialDensityArray[i] * D2Q9::WEIGHT[k];
+			temperature[k * mLength + i] = initialTemperatureArray[i] * D2Q9::WEIGHT[k];
+		}
+		mOmega_m[i] = 1 / ((kinematicViscosityArray[i] * 3) + 0.5);
+		mOmega_s[i] = 1 / ((diffusionCoefficientArray[i] * 3) + 0.5);
+	}
+
+	// Matrix rows follow the solver's Matrix(mWidth, mHeight) convention
+	std::vector<unsigned int> split =
+		splitRows(mWidth, weights.empty() ? std::vector<double>(devices.size(), 1) : weights);
+
+	mContext = cl::Context(devices);
+	mProgram = OpenCLMain::buildProgram(multiDeviceKernelCode, mContext, devices);
+	mSlabs.resize(devices.size());
+	for(size_t s = 0; s < devices.size(); s++) {
+		mSlabs[s].device           = devices[s];
+		mSlabs[s].queue            = cl::CommandQueue(mContext, devices[s], CL_QUEUE_PROFILING_ENABLE);
+		mSlabs[s].transfer         = cl::CommandQueue(mContext, devices[s]);
+		mSlabs[s].collideAndStream = cl::Kernel(mProgram, "slabCollideAndStream");
+		mSlabs[s].boundary         = cl::Kernel(mProgram, "slabBoundary");
+		mSlabs[s].resulting        = cl::Kernel(mProgram, "slabResulting");
+	}
+	distribute(density, temperature, split);
+}
+
+void LatticeBoltzmannMethodD2Q9MultiDevice::step(unsigned int count)
+{
+	const unsigned int                         N        = mWidth;
+	const unsigned int                         M        = mHeight;
+	const LatticeBoltzmannMethodD2Q9::Boundary sides[4] = {mTop, mBottom, mLeft, mRight};
+
+	auto seconds = [](const cl::Event& update) {
+		cl_ulong start = update.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+		cl_ulong end   = update.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+		return (end - start) * 1e-9;
+	};
+
+	std::vector<std::vector<cl::Event>> edges(mSlabs.size(), std::vector<cl::Event>(2));  // first and last row
+	std::vector<cl::Event>              interiors(mSlabs.size());
+	for(unsigned int s = 0; s < count; s++) {
+		const unsigned int next = 1 - mCurrent;
+		for(size_t i = 0; i < mSlabs.size(); i++) {
+			Slab& slab = mSlabs[i];
+			slab.collideAndStream.setArg(0, slab.density[mCurrent]);
+			slab.collideAndStream.setArg(1, slab.density[next]);
+			slab.collideAndStream.setArg(2, slab.temperature[mCurrent]);
+			slab.collideAndStream.setArg(3, slab.temperature[next]);
+
+			// Only the edge rows push into the ghost rows, their halo is copied while the interior is updated
+			slab.queue.enqueueNDRangeKernel(slab.collideAndStream,
+											cl::NDRange(0),
+											cl::NDRange(M),
+											cl::NullRange,
+											nullptr,
+											&edges[i][0]);
+			slab.queue.enqueueNDRangeKernel(slab.collideAndStream,
+											cl::NDRange((slab.rows - 1) * M),
+											cl::NDRange(M),
+											cl::NullRange,
+											nullptr,
+											&edges[i][1]);
+			if(slab.rows > 2) {
+				slab.queue.enqueueNDRangeKernel(slab.collideAndStream,
+												cl::NDRange(M),
+												cl::NDRange((slab.rows - 2) * M),
+												cl::NullRange,
+												nullptr,
+												&interiors[i]);
+			}
+			slab.queue.flush();
+		}
+
+		exchangeHalos(edges);
+
+		// Sides are applied in the same order as the solver so corners resolve identically
+		for(Slab& slab : mSlabs) {
+			const bool owned[4] = {slab.firstRow == 0, slab.firstRow + slab.rows == N, true, true};
+			slab.boundary.setArg(0, slab.density[next]);
+			slab.boundary.setArg(1, slab.temperature[next]);
+			for(unsigned int side = 0; side < 4; side++) {
+				if(!owned[side] || sides[side].boundary > LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT) {
+					continue;
+				}
+				slab.boundary.setArg(2, side);
+				slab.boundary.setArg(3, static_cast<int>(sides[side].boundary));
+				slab.boundary.setArg(4, sides[side].parameter1);
+				slab.queue.enqueueNDRangeKernel(slab.boundary, cl::NullRange, cl::NDRange(side < 2 ? M : slab.rows));
+			}
+		}
+
+		// The halo reads waited for the edge rows, their timestamps are final, the interior's once it is done
+		for(size_t i = 0; i < mSlabs.size(); i++) {
+			mSlabs[i].queue.flush();
+			mSlabs[i].seconds += seconds(edges[i][0]) + seconds(edges[i][1]);
+			if(mSlabs[i].rows > 2) {
+				interiors[i].wait();
+				mSlabs[i].seconds += seconds(interiors[i]);
+			}
+		}
+		mCurrent = next;
+	}
+	for(Slab& slab : mSlabs) {
+		slab.queue.flush();
+	}
+}
+
+void LatticeBoltzmannMethodD2Q9MultiDevice::rebalance()
+{
+	std::vector<double> weights;
+	for(const Slab& slab : mSlabs) {
+		if(slab.seconds <= 0) {
+			return;  // nothing measured yet
+		}
+		weights.push_back(slab.rows / slab.seconds);
+	}
+
+	std::vector<double> density(MATRIX_SIZE * mLength);
+	std::vector<double> temperature(MATRIX_SIZE * mLength);
+	gather(density, temperature);
+	distribute(density, temperature, splitRows(mWidth, weights));
+}
+
+unsigned int LatticeBoltzmannMethodD2Q9MultiDevice::getDeviceCount() const
+{
+	return mSlabs.size();
+}
+
+std::vector<unsigned int> LatticeBoltzmannMethodD2Q9MultiDevice::getRowSplit() const
+{
+	std::vector<unsigned int> split;
+	for(const Slab& slab : mSlabs) {
+		split.push_back(slab.rows);
+	}
+	return split;
+}
+
+Matrix<double> LatticeBoltzmannMethodD2Q9MultiDevice::buildResultingDensityMatrix()
+{
+	return readResulting(false);
+}
+
+Matrix<double> LatticeBoltzmannMethodD2Q9MultiDevice::buildResultingTemperatureMatrix()
+{
+	return readResulting(true);
+}
+
+std::vector<unsigned int> LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(unsigned int               rows,
+																			  const std::vector<double>& weights)
+{
+	if(weights.empty() || rows < 2 * weights.size()) {
+		throw std::invalid_argument("Every part needs at least two rows.");
+	}
+	for(double weight : weights) {
+		if(!(weight > 0) || !std::isfinite(weight)) {
+			throw std::invalid_argument("Split weights must be positive.");
+		}
+	}
+
+	// Proportional shares rounded down but at least two rows, then whole rows move by the remaining shortfall
+	const double              total = std::accumulate(weights.begin(), weights.end(), 0.0);
+	std::vector<unsigned int> split(weights.size());
+	std::vector<double>       shortfall(weights.size());
+	unsigned int              assigned = 0;
+	for(size_t i = 0; i < weights.size(); i++) {
+		double exact = rows * weights[i] / total;
+		split[i]     = std::max(2u, static_cast<unsigned int>(exact));
+		shortfall[i] = exact - split[i];
+		assigned += split[i];
+	}
+	while(assigned < rows) {
+		size_t i = std::max_element(shortfall.begin(), shortfall.end()) - shortfall.begin();
+		split[i]++;
+		shortfall[i] -= 1;
+		assigned++;
+	}
+	while(assigned > rows) {
+		size_t i = split.size();
+		for(size_t j = 0; j < split.size(); j++) {
+			if(split[j] > 2 && (i == split.size() || shortfall[j] < shortfall[i])) {
+				i = j;
+			}
+		}
+		split[i]--;
+		shortfall[i] += 1;
+		assigned--;
+	}
+	return split;
+}
+
+void LatticeBoltzmannMethodD2Q9MultiDevice::distribute(const std::vector<double>&       density,
+													   const std::vector<double>&       temperature,
+													   const std::vector<unsigned int>& split)
+{
+	const unsigned int M        = mHeight;
+	unsigned int       firstRow = 0;
+	for(size_t s = 0; s < mSlabs.size(); s++) {
+		Slab& slab          = mSlabs[s];
+		slab.firstRow       = firstRow;
+		slab.rows           = split[s];
+		slab.seconds        = 0;
+		const size_t owned  = static_cast<size_t>(slab.rows) * M;
+		const size_t stride = owned + 2 * M;
+		const size_t offset = static_cast<size_t>(firstRow) * M;
+		firstRow += slab.rows;
+
+		for(unsigned int i = 0; i < 2; i++) {
+			slab.density[i]     = cl::Buffer(mContext, CL_MEM_READ_WRITE, sizeof(double) * MATRIX_SIZE * stride);
+			slab.temperature[i] = cl::Buffer(mContext, CL_MEM_READ_WRITE, sizeof(double) * MATRIX_SIZE * stride);
+		}
+		slab.omega_m              = cl::Buffer(mContext, CL_MEM_READ_ONLY, sizeof(double) * owned);
+		slab.omega_s              = cl::Buffer(mContext, CL_MEM_READ_ONLY, sizeof(double) * owned);
+		slab.velocityU            = cl::Buffer(mContext, CL_MEM_READ_ONLY, sizeof(double) * owned);
+		slab.velocityV            = cl::Buffer(mContext, CL_MEM_READ_ONLY, sizeof(double) * owned);
+		slab.resultingDensity     = cl::Buffer(mContext, CL_MEM_WRITE_ONLY, sizeof(double) * owned);
+		slab.resultingTemperature = cl::Buffer(mContext, CL_MEM_WRITE_ONLY, sizeof(double) * owned);
+		slab.haloUp.resize(2 * 3 * M);
+		slab.haloDown.resize(2 * 3 * M);
+
+		// The arguments that only change with the split, the populations alternate and are set per launch
+		slab.collideAndStream.setArg(4, slab.omega_m);
+		slab.collideAndStream.setArg(5, slab.omega_s);
+		slab.collideAndStream.setArg(6, slab.velocityU);
+		slab.collideAndStream.setArg(7, slab.velocityV);
+		slab.collideAndStream.setArg(8, slab.rows);
+		slab.collideAndStream.setArg(9, M);
+		slab.boundary.setArg(5, slab.rows);
+		slab.boundary.setArg(6, M);
+		slab.resulting.setArg(2, slab.resultingDensity);
+		slab.resulting.setArg(3, slab.resultingTemperature);
+		slab.resulting.setArg(4, slab.rows);
+		slab.resulting.setArg(5, M);
+
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			slab.queue.enqueueWriteBuffer(slab.density[mCurrent],
+										  CL_FALSE,
+										  sizeof(double) * (k * stride + M),
+										  sizeof(double) * owned,
+										  &density[k * mLength + offset]);
+			slab.queue.enqueueWriteBuffer(slab.temperature[mCurrent],
+										  CL_FALSE,
+										  sizeof(double) * (k * stride + M),
+										  sizeof(double) * owned,
+										  &temperature[k * mLength + offset]);
+		}
+		slab.queue.enqueueWriteBuffer(slab.omega_m, CL_FALSE, 0, sizeof(double) * owned, &mOmega_m[offset]);
+		slab.queue.enqueueWriteBuffer(slab.omega_s, CL_FALSE, 0, sizeof(double) * owned, &mOmega_s[offset]);
+		slab.queue.enqueueWriteBuffer(slab.velocityU, CL_FALSE, 0, sizeof(double) * owned, &mVelocityU[offset]);
+		slab.queue.enqueueWriteBuffer(slab.velocityV, CL_FALSE, 0, sizeof(double) * owned, &mVelocityV[offset]);
+	}
+	// The host arrays are temporaries of the caller
+	for(Slab& slab : mSlabs) {
+		slab.queue.finish();
+	}
+}
+
+void LatticeBoltzmannMethodD2Q9MultiDevice::gather(std::vector<double>& density, std::vector<double>& temperature)
+{
+	const unsigned int M = mHeight;
+	for(Slab& slab : mSlabs) {
+		const size_t owned  = static_cast<size_t>(slab.rows) * M;
+		const size_t stride = owned + 2 * M;
+		const size_t offset = static_cast<size_t>(slab.firstRow) * M;
+		for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+			slab.queue.enqueueReadBuffer(slab.density[mCurrent],
+										 CL_FALSE,
+										 sizeof(double) * (k * stride + M),
+										 sizeof(double) * owned,
+										 &density[k * mLength + offset]);
+			slab.queue.enqueueReadBuffer(slab.temperature[mCurrent],
+										 CL_FALSE,
+										 sizeof(double) * (k * stride + M),
+										 sizeof(double) * owned,
+										 &temperature[k * mLength + offset]);
+		}
+	}
+	for(Slab& slab : mSlabs) {
+		slab.queue.finish();
+	}
+}
+
+void LatticeBoltzmannMethodD2Q9MultiDevice::exchangeHalos(const std::vector<std::vector<cl::Event>>& edges)
+{
+	const unsigned int M     = mHeight;
+	const unsigned int next  = 1 - mCurrent;
+	const size_t       count = mSlabs.size();
+
+	// Read every slab's ghost rows back as soon as its edge rows are done, all devices in flight at once
+	std::vector<cl::Event> reads;
+	for(size_t s = 0; s < count; s++) {
+		Slab&             slab      = mSlabs[s];
+		const size_t      stride    = static_cast<size_t>(slab.rows + 2) * M;
+		const cl::Buffer* fields[2] = {&slab.density[next], &slab.temperature[next]};
+		for(unsigned int field = 0; field < 2; field++) {
+			for(unsigned int d = 0; d < 3; d++) {
+				reads.emplace_back();
+				slab.transfer.enqueueReadBuffer(*fields[field],
+												CL_FALSE,
+												sizeof(double) * (UPWARD[d] * stride),
+												sizeof(double) * M,
+												&slab.haloUp[(field * 3 + d) * M],
+												&edges[s],
+												&reads.back());
+				reads.emplace_back();
+				slab.transfer.enqueueReadBuffer(*fields[field],
+												CL_FALSE,
+												sizeof(double) * (DOWNWARD[d] * stride + (slab.rows + 1) * M),
+												sizeof(double) * M,
+												&slab.haloDown[(field * 3 + d) * M],
+												&edges[s],
+												&reads.back());
+			}
+		}
+	}
+	cl::WaitForEvents(reads);
+
+	// The upper neighbour's last row receives what left through the top, the lower neighbour's first row the rest.
+	// The interior never writes these directions into the edge rows, so the copies may land while it runs.
+	std::vector<cl::Event> writes;
+	for(size_t s = 0; s < count; s++) {
+		const Slab&  source         = mSlabs[s];
+		Slab&        upper          = mSlabs[(s + count - 1) % count];
+		Slab&        lower          = mSlabs[(s + 1) % count];
+		const size_t upperStride    = static_cast<size_t>(upper.rows + 2) * M;
+		const size_t lowerStride    = static_cast<size_t>(lower.rows + 2) * M;
+		cl::Buffer*  upperFields[2] = {&upper.density[next], &upper.temperature[next]};
+		cl::Buffer*  lowerFields[2] = {&lower.density[next], &lower.temperature[next]};
+		for(unsigned int field = 0; field < 2; field++) {
+			for(unsigned int d = 0; d < 3; d++) {
+				writes.emplace_back();
+				upper.transfer.enqueueWriteBuffer(*upperFields[field],
+												  CL_FALSE,
+												  sizeof(double) * (UPWARD[d] * upperStride + upper.rows * M),
+												  sizeof(double) * M,
+												  &source.haloUp[(field * 3 + d) * M],
+												  nullptr,
+												  &writes.back());
+				writes.emplace_back();
+				lower.transfer.enqueueWriteBuffer(*lowerFields[field],
+												  CL_FALSE,
+												  sizeof(double) * (DOWNWARD[d] * lowerStride + M),
+												  sizeof(double) * M,
+												  &source.haloDown[(field * 3 + d) * M],
+												  nullptr,
+												  &writes.back());
+			}
+		}
+	}
+	// The halo staging is reused by the next step, and the boundaries enqueued next read the copied rows
+	cl::WaitForEvents(writes);
+}
+
+Matrix<double> LatticeBoltzmannMethodD2Q9MultiDevice::readResulting(bool temperature)
+{
+	const unsigned int M = mHeight;
+	Matrix<double>     result(mWidth, mHeight);
+	for(Slab& slab : mSlabs) {
+		slab.resulting.setArg(0, slab.density[mCurrent]);
+		slab.resulting.setArg(1, slab.temperature[mCurrent]);
+		slab.queue.enqueueNDRangeKernel(slab.resulting, cl::NullRange, cl::NDRange(slab.rows * M));
+		slab.queue.enqueueReadBuffer(temperature ? slab.resultingTemperature : slab.resultingDensity,
+									 CL_FALSE,
+									 0,
+									 sizeof(double) * slab.rows * M,
+									 result.getDataData() + static_cast<size_t>(slab.firstRow) * M);
+	}
+	for(Slab& slab : mSlabs) {
+		slab.queue.finish();
+	}
+	return result;
+}
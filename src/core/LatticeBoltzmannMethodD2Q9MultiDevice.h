@@ -0,0 +1,123 @@
+#ifndef LATTICE_BOLTZMANN_METHOD_D2Q9_MULTI_DEVICE
+#define LATTICE_BOLTZMANN_METHOD_D2Q9_MULTI_DEVICE
+
+#define CL_HPP_TARGET_OPENCL_VERSION 300
+#include <CL/opencl.hpp>
+
+#include <vector>
+
+#include "LatticeBoltzmannMethodD2Q9.h"
+#include "Matrix.hpp"
+
+/**
+ * @brief One D2Q9 lattice split by rows across several OpenCL devices.
+ *
+ * Every device owns a slab of consecutive rows (rows and columns as in Matrix) with its own queues and buffers, plus
+ * one ghost row above and below. A step collides and pushes the first and last row of each slab, then its interior.
+ * While the interior is updated a second queue reads back the populations pushed into the ghost rows (f_2, f_5, f_6
+ * up, f_4, f_7, f_8 down) and writes them into the first or last row of the neighbouring slab, and once both are done
+ * the boundaries are applied. The slabs form a ring, which reproduces the row wrap of LatticeBoltzmannMethodD2Q9, and
+ * only the slabs holding the first and last row apply the top and bottom sides.
+ *
+ * The rows are split in proportion to per-device weights. The queues are profiled, and rebalance() re-splits the
+ * lattice by the rows per second each device actually achieved since the last split.
+ *
+ * Slab storage: direction major, f_k of slab row r (0 and rows + 1 are the ghost rows) and column c at
+ * `k * (rows + 2) * M + r * M + c`.
+ */
+class LatticeBoltzmannMethodD2Q9MultiDevice
+{
+	static inline constexpr unsigned int MATRIX_SIZE = 9;  // the number of direction
+
+	struct Slab {
+		cl::Device          device;
+		cl::CommandQueue    queue;
+		cl::CommandQueue    transfer;  // halo copies, overlapping the interior update on queue
+		cl::Kernel          collideAndStream;
+		cl::Kernel          boundary;
+		cl::Kernel          resulting;
+		unsigned int        firstRow;
+		unsigned int        rows;
+		cl::Buffer          density[2];
+		cl::Buffer          temperature[2];
+		cl::Buffer          omega_m;
+		cl::Buffer          omega_s;
+		cl::Buffer          velocityU;
+		cl::Buffer          velocityV;
+		cl::Buffer          resultingDensity;
+		cl::Buffer          resultingTemperature;
+		std::vector<double> haloUp;    // ghost row 0, f_2, f_5, f_6 of density then temperature
+		std::vector<double> haloDown;  // ghost row rows + 1, f_4, f_7, f_8 of density then temperature
+		double              seconds;   // collision time measured since the last split
+	};
+
+public:
+	unsigned int mHeight;
+	unsigned int mWidth;
+
+private:
+	unsigned int                         mLength;
+	unsigned int                         mCurrent;  // index of the buffers holding the current populations
+	LatticeBoltzmannMethodD2Q9::Boundary mTop;
+	LatticeBoltzmannMethodD2Q9::Boundary mBottom;
+	LatticeBoltzmannMethodD2Q9::Boundary mLeft;
+	LatticeBoltzmannMethodD2Q9::Boundary mRight;
+
+private:  // Device data
+	cl::Context       mContext;
+	cl::Program       mProgram;
+	std::vector<Slab> mSlabs;
+
+private:  // Host copies of the per-node coefficients, re-uploaded when the split changes
+	std::vector<double> mOmega_m;
+	std::vector<double> mOmega_s;
+	std::vector<double> mVelocityU;
+	std::vector<double> mVelocityV;
+
+public:
+	/**
+	 * @param devices Devices sharing the lattice, all of one platform. See OpenCLMain::getDevices() and
+	 * OpenCLMain::partitionByNumaDomain().
+	 * @param weights Relative throughput of each device for the initial split, an even split if empty.
+	 */
+	LatticeBoltzmannMethodD2Q9MultiDevice(unsigned int                         height,
+										  unsigned int                         width,
+										  LatticeBoltzmannMethodD2Q9::Boundary top,
+										  LatticeBoltzmannMethodD2Q9::Boundary bottom,
+										  LatticeBoltzmannMethodD2Q9::Boundary left,
+										  LatticeBoltzmannMethodD2Q9::Boundary right,
+										  std::vector<double>                  kinematicViscosityArray,
+										  std::vector<double>                  diffusionCoefficientArray,
+										  std::vector<double>                  initialDensityArray,
+										  std::vector<double>                  initialTemperatureArray,
+										  const std::vector<cl::Device>&       devices,
+										  const std::vector<double>&           weights = std::vector<double>());
+
+	void step(unsigned int count = 1);
+
+	/**
+	 * @brief Re-split the rows by the throughput every device achieved since the last split.
+	 */
+	void rebalance();
+
+	unsigned int              getDeviceCount() const;
+	std::vector<unsigned int> getRowSplit() const;
+
+	Matrix<double> buildResultingDensityMatrix();
+	Matrix<double> buildResultingTemperatureMatrix();
+
+	/**
+	 * @brief Rows per part in proportion to the weights, largest remainder first, at least two rows per part.
+	 * @throw std::invalid_argument if the weights are not positive or there are fewer than two rows per part.
+	 */
+	static std::vector<unsigned int> splitRows(unsigned int rows, const std::vector<double>& weights);
+
+private:  // helper
+	void           distribute(const std::vector<double>&       density,
+							  const std::vector<double>&       temperature,
+							  const std::vector<unsigned int>& split);
+	void           gather(std::vector<double>& density, std::vector<double>& temperature);
+	void           exchangeHalos(const std::vector<std::vector<cl::Event>>& edges);
+	Matrix<double> readResulting(bool temperature);
+};
+#endif  // LATTICE_BOLTZMANN_METHOD_D2Q9_MULTI_DEVICE
@@ -0,0 +1,502 @@
+#ifndef LATTICE_BOLTZMANN_METHOD_D2Q9_REFINED
+#define LATTICE_BOLTZMANN_METHOD_D2Q9_REFINED
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "LatticeBoltzmannMethodD2Q9CPU.hpp"
+#include "Matrix.hpp"
+
+/**
+ * @brief D2Q9 lattice with block-structured refinement, finer blocks where the fields have thin layers.
+ *
+ * Block 0 is the whole N x M base lattice (rows and columns as in Matrix). Every further block refines a rectangle
+ * of its parent by two in both directions, so a block on level L has cells of 1 / 2^L the base spacing, and blocks
+ * may nest to any depth. Acoustic scaling keeps the lattice velocity, so a level takes two steps per step of its
+ * parent and its relaxation times are tau_f = 2 tau_c - 1/2, the same viscosity and diffusion in physical units.
+ *
+ * Every block is stepped with the CPU backend kernels on a padded array: a ring of ghost cells around the block
+ * interior and a spare ring that absorbs the pushes out of it. The base lattice wraps its own ghost ring, which
+ * reproduces the CPU backend exactly. A refined block fills its ghost ring before each of its two sub-steps by
+ * bilinear interpolation of the parent, at the start of the parent step for the first sub-step and halfway through
+ * it for the second. After the sub-steps, each parent cell covered by the block is replaced by the average of its
+ * four fine cells. Populations crossing the interface keep their weighted sum and have their deviation from the rest
+ * state scaled by tau_f / (2 tau_c) on the way down and by its inverse on the way up, the non-equilibrium rescaling
+ * that keeps the gradients continuous.
+ *
+ * Refined blocks may touch the lattice sides, the boundaries are applied on every level. A block nested in another
+ * refined block must keep one parent cell of margin to the edge of its parent, sibling blocks must not overlap. The
+ * velocity is zero, as in the other CPU solvers.
+ */
+class LatticeBoltzmannMethodD2Q9Refined
+{
+	static inline constexpr unsigned int MATRIX_SIZE = LatticeBoltzmannMethodD2Q9CPU::MATRIX_SIZE;
+
+public:
+	using Boundary = LatticeBoltzmannMethodD2Q9CPU::Boundary;
+
+	/**
+	 * @brief Rectangle of parent cells to refine, rows [firstRow, firstRow + rows) and the same for columns.
+	 *
+	 * parent is a block index: 0 for the base lattice, i + 1 for the i-th region.
+	 */
+	struct Region {
+		unsigned int parent;
+		unsigned int firstRow;
+		unsigned int firstCol;
+		unsigned int rows;
+		unsigned int cols;
+	};
+
+private:
+	/**
+	 * @brief Padded block storage: interior cell (row, col) at (row + 2) * pitch + col + 2, the ghost ring at rows
+	 * and columns -1 and rows or cols, direction major with density populations then temperature populations.
+	 */
+	struct Block {
+		unsigned int              parent;
+		unsigned int              level;
+		int                       firstRow;  // of the interior, in cells of the block's level
+		int                       firstCol;
+		unsigned int              rows;
+		unsigned int              cols;
+		int                       N;  // lattice size on the block's level
+		int                       M;
+		int                       pitch;
+		int                       area;
+		std::vector<double>       current;
+		std::vector<double>       next;
+		std::vector<double>       previous;  // populations at the start of the step, for the children's sub-steps
+		std::vector<double>       omega_m;
+		std::vector<double>       omega_s;
+		std::vector<double>       velocityU;
+		std::vector<double>       velocityV;
+		std::vector<unsigned int> children;
+	};
+
+	unsigned int            mN;
+	unsigned int            mM;
+	unsigned int            mStep;
+	std::array<Boundary, 4> mBoundaries;
+	std::vector<Block>      mBlocks;
+
+public:
+	/**
+	 * @param rows N, rows of the base lattice.
+	 * @param cols M, columns of the base lattice.
+	 * @param boundaries top, bottom, left, right
+	 * @param kinematicViscosityArray N * M values on the base lattice, refined cells take the one they lie in.
+	 * @param diffusionCoefficientArray N * M values on the base lattice.
+	 * @param initialDensityArray N * M values, zero if empty. Refined blocks start from its bilinear interpolation.
+	 * @param initialTemperatureArray N * M values, zero if empty.
+	 * @param regions Refined blocks, every parent listed before its children.
+	 * @throw std::invalid_argument if an array has the wrong size or a region does not fit its parent.
+	 */
+	LatticeBoltzmannMethodD2Q9Refined(unsigned int                   rows,
+									  unsigned int                   cols,
+									  const std::array<Boundary, 4>& boundaries,
+									  const std::vector<double>&     kinematicViscosityArray,
+									  const std::vector<double>&     diffusionCoefficientArray,
+									  std::vector<double>            initialDensityArray     = {},
+									  std::vector<double>            initialTemperatureArray = {},
+									  const std::vector<Region>&     regions                 = {})
+		: mN(rows), mM(cols), mStep(0), mBoundaries(boundaries)
+	{
+		const size_t length = static_cast<size_t>(rows) * cols;
+		if(initialDensityArray.empty()) {
+			initialDensityArray.resize(length);
+		}
+		if(initialTemperatureArray.empty()) {
+			initialTemperatureArray.resize(length);
+		}
+		if(rows < 2 || cols < 2 || kinematicViscosityArray.size() != length ||
+		   diffusionCoefficientArray.size() != length || initialDensityArray.size() != length ||
+		   initialTemperatureArray.size() != length) {
+			throw std::invalid_argument("The base lattice needs at least 2 x 2 cells and rows * cols values.");
+		}
+
+		mBlocks.reserve(regions.size() + 1);
+		addBlock(0, 0, 0, 0, rows, cols);
+		for(size_t i = 0; i < regions.size(); i++) {
+			const Region& region = regions[i];
+			if(region.parent > i) {
+				throw std::invalid_argument("A region must come after its parent.");
+			}
+			const Block&       parent = mBlocks[region.parent];
+			const unsigned int margin = region.parent == 0 ? 0 : 1;
+			if(region.rows == 0 || region.cols == 0 || region.firstRow < margin || region.firstCol < margin ||
+			   region.firstRow + region.rows + margin > parent.rows ||
+			   region.firstCol + region.cols + margin > parent.cols) {
+				throw std::invalid_argument("A region must lie inside its parent, one cell off a refined parent.");
+			}
+			for(unsigned int sibling : parent.children) {
+				const Block& other = mBlocks[sibling];
+				const int    row   = parent.firstRow + static_cast<int>(region.firstRow);
+				const int    col   = parent.firstCol + static_cast<int>(region.firstCol);
+				if(2 * row < other.firstRow + static_cast<int>(other.rows) &&
+				   other.firstRow < 2 * (row + static_cast<int>(region.rows)) &&
+				   2 * col < other.firstCol + static_cast<int>(other.cols) &&
+				   other.firstCol < 2 * (col + static_cast<int>(region.cols))) {
+					throw std::invalid_argument("Regions with the same parent must not overlap.");
+				}
+			}
+			mBlocks[region.parent].children.push_back(static_cast<unsigned int>(i + 1));
+			addBlock(region.parent,
+					 mBlocks[region.parent].level + 1,
+					 2 * (mBlocks[region.parent].firstRow + static_cast<int>(region.firstRow)),
+					 2 * (mBlocks[region.parent].firstCol + static_cast<int>(region.firstCol)),
+					 2 * region.rows,
+					 2 * region.cols);
+		}
+
+		for(Block& block : mBlocks) {
+			initialize(block,
+					   kinematicViscosityArray,
+					   diffusionCoefficientArray,
+					   initialDensityArray,
+					   initialTemperatureArray);
+		}
+	}
+
+	/**
+	 * @brief Advance the base lattice by count steps, every refined block by 2^level steps per base step.
+	 */
+	void step(unsigned int count = 1)
+	{
+		for(unsigned int i = 0; i < count; i++) {
+			wrapGhosts(mBlocks[0]);
+			advance(0);
+			mStep++;
+		}
+	}
+
+	unsigned int getStep() const
+	{
+		return mStep;
+	}
+	unsigned int getBlockCount() const
+	{
+		return static_cast<unsigned int>(mBlocks.size());
+	}
+	unsigned int getLevel(unsigned int block) const
+	{
+		return mBlocks.at(block).level;
+	}
+
+	/**
+	 * @brief Cells of all blocks, the base lattice included.
+	 */
+	size_t getNodeCount() const
+	{
+		size_t count = 0;
+		for(const Block& block : mBlocks) {
+			count += static_cast<size_t>(block.rows) * block.cols;
+		}
+		return count;
+	}
+
+	/**
+	 * @brief Cell updates of one base step, every block weighted by its 2^level sub-steps.
+	 */
+	size_t getUpdatesPerStep() const
+	{
+		size_t count = 0;
+		for(const Block& block : mBlocks) {
+			count += (static_cast<size_t>(block.rows) * block.cols) << block.level;
+		}
+		return count;
+	}
+
+	/**
+	 * @brief Weighted population sums of one block on its own grid. The base lattice (block 0) holds the averages of
+	 * the refined cells where it is covered.
+	 */
+	Matrix<double> buildResultingDensityMatrix(unsigned int block = 0) const
+	{
+		return buildResultingMatrix(mBlocks.at(block), 0);
+	}
+	Matrix<double> buildResultingTemperatureMatrix(unsigned int block = 0) const
+	{
+		return buildResultingMatrix(mBlocks.at(block), MATRIX_SIZE);
+	}
+
+private:
+	static int cell(const Block& block, int row, int col)
+	{
+		return (row + 2) * block.pitch + col + 2;
+	}
+
+	static double weightedSum(const double* f, int area, int i)
+	{
+		return latticeSum<D2Q9>(f + i, area);
+	}
+
+	/**
+	 * @brief Parent cell above (or left of) the centre of a fine cell, and the weight of the parent cell after it.
+	 *
+	 * Fine cell centres lie a quarter of a parent cell off the parent cell centres.
+	 */
+	static std::pair<int, double> coarsePosition(int fine)
+	{
+		const int parent = fine >= 0 ? fine / 2 : -((1 - fine) / 2);
+		return (fine & 1) == 0 ? std::make_pair(parent - 1, 0.75) : std::make_pair(parent, 0.25);
+	}
+
+	/**
+	 * @brief Bilinear interpolation of a base lattice field at the centre of a cell on the given level, clamped to the
+	 * lattice.
+	 */
+	double interpolateBase(const std::vector<double>& field, unsigned int level, int row, int col) const
+	{
+		const double  scale = 1.0 / (1u << level);
+		const double  x     = std::clamp((row + 0.5) * scale - 0.5, 0.0, mN - 1.0);
+		const double  y     = std::clamp((col + 0.5) * scale - 0.5, 0.0, mM - 1.0);
+		const int     r     = std::min(static_cast<int>(x), static_cast<int>(mN) - 2);
+		const int     c     = std::min(static_cast<int>(y), static_cast<int>(mM) - 2);
+		const double  tr    = x - r;
+		const double  tc    = y - c;
+		const double* f     = field.data() + static_cast<size_t>(r) * mM + c;
+		return (1 - tr) * ((1 - tc) * f[0] + tc * f[1]) + tr * ((1 - tc) * f[mM] + tc * f[mM + 1]);
+	}
+
+	void addBlock(
+		unsigned int parent, unsigned int level, int firstRow, int firstCol, unsigned int rows, unsigned int cols)
+	{
+		Block block;
+		block.parent   = parent;
+		block.level    = level;
+		block.firstRow = firstRow;
+		block.firstCol = firstCol;
+		block.rows     = rows;
+		block.cols     = cols;
+		block.N        = static_cast<int>(mN << level);
+		block.M        = static_cast<int>(mM << level);
+		block.pitch    = cols + 4;
+		block.area     = (rows + 4) * block.pitch;
+		block.current.assign(2 * MATRIX_SIZE * block.area, 0);
+		block.next.assign(2 * MATRIX_SIZE * block.area, 0);
+		block.omega_m.assign(block.area, 0);
+		block.omega_s.assign(block.area, 0);
+		block.velocityU.assign(block.area, 0);
+		block.velocityV.assign(block.area, 0);
+		mBlocks.push_back(std::move(block));
+	}
+
+	/**
+	 * @brief Relaxation rates of the interior and ghost cells, populations of the interior at rest.
+	 */
+	void initialize(Block&                     block,
+					const std::vector<double>& kinematicViscosity,
+					const std::vector<double>& diffusionCoefficient,
+					const std::vector<double>& density,
+					const std::vector<double>& temperature)
+	{
+		const double scale = static_cast<double>(1u << block.level);
+		for(int row = -1; row <= static_cast<int>(block.rows); row++) {
+			for(int col = -1; col <= static_cast<int>(block.cols); col++) {
+				const int    globalRow = ((block.firstRow + row) % block.N + block.N) % block.N;
+				const int    globalCol = ((block.firstCol + col) % block.M + block.M) % block.M;
+				const size_t index = static_cast<size_t>(globalRow >> block.level) * mM + (globalCol >> block.level);
+				const int    i         = cell(block, row, col);
+				block.omega_m[i]       = 1 / ((kinematicViscosity[index] * scale * 3) + 0.5);
+				block.omega_s[i]       = 1 / ((diffusionCoefficient[index] * scale * 3) + 0.5);
+			}
+		}
+		for(unsigned int row = 0; row < block.rows; row++) {
+			for(unsigned int col = 0; col < block.cols; col++) {
+				const int    globalRow = block.firstRow + static_cast<int>(row);
+				const int    globalCol = block.firstCol + static_cast<int>(col);
+				const double rho       = interpolateBase(density, block.level, globalRow, globalCol);
+				const double T         = interpolateBase(temperature, block.level, globalRow, globalCol);
+				const int    i         = cell(block, row, col);
+				for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+					block.current[k * block.area + i]                 = rho * D2Q9::WEIGHT[k];
+					block.current[(MATRIX_SIZE + k) * block.area + i] = T * D2Q9::WEIGHT[k];
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief One step of a block on its own level, then two sub-steps of each child and their restriction.
+	 *
+	 * The ghost ring must be filled.
+	 */
+	void advance(unsigned int index)
+	{
+		Block& block = mBlocks[index];
+		if(!block.children.empty()) {
+			block.previous = block.current;
+		}
+
+		LatticeBoltzmannMethodD2Q9CPU::collideAndPush(block.current.data(),
+													  block.next.data(),
+													  block.omega_m.data(),
+													  block.omega_s.data(),
+													  block.velocityU.data(),
+													  block.velocityV.data(),
+													  block.pitch,
+													  block.area,
+													  1,
+													  block.rows + 3,
+													  1,
+													  block.cols + 3);
+		LatticeBoltzmannMethodD2Q9CPU::applyBoundaries(block.next.data(),
+													   mBoundaries,
+													   block.pitch,
+													   block.area,
+													   2,
+													   block.rows + 2,
+													   2,
+													   block.cols + 2,
+													   ((block.firstRow - 1) % block.N + block.N) % block.N,
+													   ((block.firstCol - 1) % block.M + block.M) % block.M,
+													   block.N,
+													   block.M);
+		std::swap(block.current, block.next);
+		if(block.children.empty()) {
+			return;
+		}
+
+		// Only the base lattice lends its ghost ring to the children, nested blocks keep a margin
+		if(index == 0) {
+			wrapGhosts(block);
+		}
+		for(unsigned int child : block.children) {
+			for(unsigned int half = 0; half < 2; half++) {
+				interpolateGhosts(mBlocks[child], half);
+				advance(child);
+			}
+		}
+		for(unsigned int child : block.children) {
+			restrict(mBlocks[child]);
+		}
+	}
+
+	/**
+	 * @brief Copy the opposite edge of the base lattice into its ghost ring, the row and column wrap of streaming.
+	 */
+	void wrapGhosts(Block& block)
+	{
+		const int rows = static_cast<int>(block.rows);
+		const int cols = static_cast<int>(block.cols);
+		for(unsigned int k = 0; k < 2 * MATRIX_SIZE; k++) {
+			double* f = block.current.data() + k * block.area;
+			for(int row = 0; row < rows; row++) {
+				f[cell(block, row, -1)]   = f[cell(block, row, cols - 1)];
+				f[cell(block, row, cols)] = f[cell(block, row, 0)];
+			}
+			for(int col = -1; col <= cols; col++) {
+				f[cell(block, -1, col)]   = f[cell(block, rows - 1, col)];
+				f[cell(block, rows, col)] = f[cell(block, 0, col)];
+			}
+		}
+	}
+
+	/**
+	 * @brief Fill the ghost ring of a refined block from its parent, at the start of the parent step (half 0) or
+	 * halfway through it (half 1).
+	 */
+	void interpolateGhosts(Block& block, unsigned int half)
+	{
+		const int rows = static_cast<int>(block.rows);
+		const int cols = static_cast<int>(block.cols);
+		for(int col = -1; col <= cols; col++) {
+			interpolateGhost(block, -1, col, half);
+			interpolateGhost(block, rows, col, half);
+		}
+		for(int row = 0; row < rows; row++) {
+			interpolateGhost(block, row, -1, half);
+			interpolateGhost(block, row, cols, half);
+		}
+	}
+
+	void interpolateGhost(Block& block, int row, int col, unsigned int half)
+	{
+		const Block&                 parent = mBlocks[block.parent];
+		const std::pair<int, double> r      = coarsePosition(block.firstRow + row);
+		const std::pair<int, double> c      = coarsePosition(block.firstCol + col);
+		const int                    p      = cell(parent, r.first - parent.firstRow, c.first - parent.firstCol);
+		const int                    i      = cell(block, row, col);
+		const int                    corner[4] = {p, p + 1, p + parent.pitch, p + parent.pitch + 1};
+		const double                 weight[4] = {(1 - r.second) * (1 - c.second),
+												  (1 - r.second) * c.second,
+												  r.second * (1 - c.second),
+												  r.second * c.second};
+
+		for(unsigned int field = 0; field < 2; field++) {
+			const double omega = (field == 0 ? block.omega_m : block.omega_s)[i];
+			double       f[MATRIX_SIZE];
+			double       sum = 0;
+			for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+				const size_t  offset   = (field * MATRIX_SIZE + k) * parent.area;
+				const double* previous = parent.previous.data() + offset;
+				const double* current  = parent.current.data() + offset;
+				f[k]                   = 0;
+				for(unsigned int n = 0; n < 4; n++) {
+					const double value =
+						half == 0 ? previous[corner[n]] : 0.5 * (previous[corner[n]] + current[corner[n]]);
+					f[k] += weight[n] * value;
+				}
+				sum += f[k] * D2Q9::WEIGHT[k];
+			}
+			// tau_f / (2 tau_c) with tau_c = (tau_f + 1/2) / 2
+			const double tau   = 1 / omega;
+			const double scale = tau / (tau + 0.5);
+			for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+				block.current[(field * MATRIX_SIZE + k) * block.area + i] = sum + scale * (f[k] - sum);
+			}
+		}
+	}
+
+	/**
+	 * @brief Replace the parent cells covered by a refined block with the average of their four fine cells.
+	 */
+	void restrict(const Block& block)
+	{
+		Block&    parent   = mBlocks[block.parent];
+		const int firstRow = block.firstRow / 2 - parent.firstRow;
+		const int firstCol = block.firstCol / 2 - parent.firstCol;
+		for(unsigned int row = 0; row < block.rows / 2; row++) {
+			for(unsigned int col = 0; col < block.cols / 2; col++) {
+				const int p         = cell(parent, firstRow + row, firstCol + col);
+				const int i         = cell(block, 2 * row, 2 * col);
+				const int corner[4] = {i, i + 1, i + block.pitch, i + block.pitch + 1};
+				for(unsigned int field = 0; field < 2; field++) {
+					const double omega = (field == 0 ? parent.omega_m : parent.omega_s)[p];
+					double       f[MATRIX_SIZE];
+					double       sum = 0;
+					for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+						const double* fine = block.current.data() + (field * MATRIX_SIZE + k) * block.area;
+						f[k] = 0.25 * (fine[corner[0]] + fine[corner[1]] + fine[corner[2]] + fine[corner[3]]);
+						sum += f[k] * D2Q9::WEIGHT[k];
+					}
+					// 2 tau_c / tau_f with tau_f = 2 tau_c - 1/2
+					const double tau   = 1 / omega;
+					const double scale = 2 * tau / (2 * tau - 0.5);
+					for(unsigned int k = 0; k < MATRIX_SIZE; k++) {
+						parent.current[(field * MATRIX_SIZE + k) * parent.area + p] = sum + scale * (f[k] - sum);
+					}
+				}
+			}
+		}
+	}
+
+	Matrix<double> buildResultingMatrix(const Block& block, unsigned int firstField) const
+	{
+		Matrix<double> result(block.rows, block.cols);
+		double*        out = result.getDataData();
+		const double*  f   = block.current.data() + firstField * block.area;
+		for(unsigned int row = 0; row < block.rows; row++) {
+			for(unsigned int col = 0; col < block.cols; col++) {
+				out[row * block.cols + col] = weightedSum(f, block.area, cell(block, row, col));
+			}
+		}
+		return result;
+	}
+};
+#endif  // LATTICE_BOLTZMANN_METHOD_D2Q9_REFINED
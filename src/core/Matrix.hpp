@@ -1,17 +1,28 @@
 #ifndef MATRIX
 #define MATRIX
 
+#include <algorithm>
 #include <vector>
 #include <iostream>
+#include <utility>
 #include <omp.h>
 
+#include "LatticeAllocator.hpp"
+#include "MatrixExpression.hpp"
+
 /**
  * @brief The matrix class with n(Row) x m(Col) dimension.
  *
+ * Element-wise arithmetic (`a + b * 0.5`) is lazy, see MatrixExpression.
+ *
+ * Rows are stored getPitch() elements apart. The pitch is the row length unless setRowPitch() pads it, e.g. to
+ * alignedPitch() so that every row starts on a cache line and odd widths no longer split the vector loads of every
+ * other row. The padding is never read as data: the element-wise loops, boundary routines and copies skip it.
+ *
  * @tparam T
  */
 template<typename T>
-class Matrix
+class Matrix: public MatrixExpression<Matrix<T>>
 {
 private:
 	static const unsigned int MATRIX_DEFAULT_HEIGHT = 1;
@@ -20,10 +31,11 @@ private:
 	unsigned int N;
 	unsigned int M;
 	unsigned int LENGTH;
+	unsigned int mPitch;
 
-	std::vector<T> mData;
-	unsigned int   mRowShiftIndex;
-	unsigned int   mColShiftIndex;
+	std::vector<T, LatticeAllocator<T>> mData;
+	unsigned int                        mRowShiftIndex;
+	unsigned int                        mColShiftIndex;
 
 public:
 	/**
@@ -40,11 +52,13 @@ public:
 		   const unsigned int colShiftIndex = 0):
 		N(nRow),
 		M(nColumn),
-		LENGTH(nRow * nColumn)
+		LENGTH(nRow * nColumn),
+		mPitch(nColumn)
 	{
 		mRowShiftIndex = rowShiftIndex;
 		mColShiftIndex = colShiftIndex;
-		mData.resize(LENGTH, initialValue);
+		mData.resize(LENGTH);
+		firstTouch([&initialValue](size_t) { return initialValue; });
 	}
 
 	/**
@@ -63,7 +77,8 @@ public:
 		   const unsigned int   colShiftIndex = 0):
 		N(nRow),
 		M(nColumn),
-		LENGTH(nRow * nColumn)
+		LENGTH(nRow * nColumn),
+		mPitch(nColumn)
 	{
 		if(values.size() != LENGTH) {
 			std::string errMsg = "Inconsistent std::vector length: ";
@@ -74,10 +89,49 @@ public:
 		mRowShiftIndex = rowShiftIndex;
 		mColShiftIndex = colShiftIndex;
 		mData.resize(LENGTH);
-#pragma omp parallel for
-		for(size_t i = 0; i < values.size(); i++) {
-			mData[i] = values.at(i) * magnification;
-		}
+		firstTouch([&values, magnification](size_t i) { return values[i] * magnification; });
+	}
+
+	Matrix(const Matrix<T>& other):
+		N(other.N),
+		M(other.M),
+		LENGTH(other.LENGTH),
+		mPitch(other.mPitch),
+		mRowShiftIndex(other.mRowShiftIndex),
+		mColShiftIndex(other.mColShiftIndex)
+	{
+		mData.resize(size_t(N) * mPitch);
+		firstTouch([&other](size_t i) { return other.mData[i]; });
+	}
+
+	/**
+	 * @brief Take over the storage, the moved-from matrix is left empty (0 x 0).
+	 */
+	Matrix(Matrix<T>&& other) noexcept:
+		N(std::exchange(other.N, 0)),
+		M(std::exchange(other.M, 0)),
+		LENGTH(std::exchange(other.LENGTH, 0)),
+		mPitch(std::exchange(other.mPitch, 0)),
+		mData(std::move(other.mData)),
+		mRowShiftIndex(std::exchange(other.mRowShiftIndex, 0)),
+		mColShiftIndex(std::exchange(other.mColShiftIndex, 0))
+	{
+	}
+
+	/**
+	 * @brief Evaluate an element-wise expression into a new, unshifted matrix of its dimensions.
+	 */
+	template<typename E>
+	Matrix(const MatrixExpression<E>& expression):
+		N(expression.getN()),
+		M(expression.getM()),
+		LENGTH(expression.getN() * expression.getM()),
+		mPitch(expression.getM()),
+		mRowShiftIndex(0),
+		mColShiftIndex(0)
+	{
+		mData.resize(LENGTH);
+		evaluate(expression.self());
 	}
 
 public:
@@ -87,21 +141,58 @@ public:
 			this->N              = rhs.N;
 			this->M              = rhs.M;
 			this->LENGTH         = rhs.LENGTH;
-			this->mData          = rhs.mData;
+			this->mPitch         = rhs.mPitch;
 			this->mRowShiftIndex = rhs.mRowShiftIndex;
 			this->mColShiftIndex = rhs.mColShiftIndex;
+			if(mData.size() != size_t(N) * mPitch) {
+				// Fresh pages, placed by the copy below
+				mData = std::vector<T, LatticeAllocator<T>>();
+				mData.resize(size_t(N) * mPitch);
+			}
+			firstTouch([&rhs](size_t i) { return rhs.mData[i]; });
 		}
 		return *this;
 	}
 
+	Matrix<T>& operator=(Matrix<T>&& rhs) noexcept
+	{
+		if(this != &rhs) {
+			this->N              = std::exchange(rhs.N, 0);
+			this->M              = std::exchange(rhs.M, 0);
+			this->LENGTH         = std::exchange(rhs.LENGTH, 0);
+			this->mPitch         = std::exchange(rhs.mPitch, 0);
+			this->mData          = std::move(rhs.mData);
+			this->mRowShiftIndex = std::exchange(rhs.mRowShiftIndex, 0);
+			this->mColShiftIndex = std::exchange(rhs.mColShiftIndex, 0);
+		}
+		return *this;
+	}
+
+	/**
+	 * @brief Evaluate an element-wise expression in one pass. The matrix may appear in the expression: elements are
+	 * written in place, through the current shift, so every element is read before it is overwritten.
+	 */
+	template<typename E>
+	Matrix<T>& operator=(const MatrixExpression<E>& expression)
+	{
+		if(N != expression.getN() || M != expression.getM()) {
+			*this = Matrix<T>(expression);
+			return *this;
+		}
+		evaluate(expression.self());
+		return *this;
+	}
+
 	bool operator==(const Matrix<T>& other) const
 	{
 		if(LENGTH != other.LENGTH || M != other.M || N != other.N) {
 			return false;
 		}
-		for(int i = 0; i < LENGTH; ++i) {
-			if(mData[i] != other.mData[i]) {
-				return false;
+		for(size_t row = 0; row < N; ++row) {
+			for(size_t col = 0; col < M; ++col) {
+				if(mData[row * mPitch + col] != other.mData[row * other.mPitch + col]) {
+					return false;
+				}
 			}
 		}
 		return true;
@@ -128,6 +219,14 @@ public:  // Helper getter
 		return LENGTH;
 	}
 
+	/**
+	 * @brief Distance in elements between the starts of two consecutive rows of the storage, at least getM().
+	 */
+	unsigned int getPitch() const
+	{
+		return mPitch;
+	}
+
 	unsigned int getRowShiftIndex() const
 	{
 		return mRowShiftIndex;
@@ -143,42 +242,126 @@ public:  // Helper getter
 		return std::pair<unsigned int, unsigned int>(mRowShiftIndex, mColShiftIndex);
 	}
 
+	/**
+	 * @brief Logical element (row, col), the shift taken into account.
+	 */
+	T operator()(const unsigned int row, const unsigned int col) const
+	{
+		return mData[storageIndex(row, col)];
+	}
+
 	T getValue(const unsigned int index) const
 	{
-		return mData.at((((index - index % M) / M + mRowShiftIndex) % N) * M + (index - mColShiftIndex + M) % M);
+		return mData.at(storageIndex(index / M, index % M));
 	}
 
+	/**
+	 * @brief The unshifted storage without the row padding, getLength() elements.
+	 */
 	std::vector<T> getData() const
 	{
-		return mData;
+		if(mPitch == M) {
+			return std::vector<T>(mData.begin(), mData.end());
+		}
+		std::vector<T> data(LENGTH);
+		for(size_t row = 0; row < N; ++row) {
+			std::copy(mData.begin() + row * mPitch, mData.begin() + row * mPitch + M, data.begin() + row * M);
+		}
+		return data;
 	}
 
+	/**
+	 * @brief The unshifted storage, row r starting at element r * getPitch().
+	 */
 	T* getDataData()
 	{
 		return mData.data();
 	}
 
+	const T* getDataData() const
+	{
+		return mData.data();
+	}
+
+	/**
+	 * @brief Replace the storage by getLength() unshifted values, as returned by getData(), and clear the shift.
+	 */
 	void resetData(std::vector<T> data)
 	{
-		mData          = data;
+		if(data.size() != LENGTH) {
+			std::string errMsg = "Inconsistent std::vector length: ";
+			errMsg += std::to_string(data.size()) + " vs " + std::to_string(LENGTH);
+			throw std::invalid_argument(errMsg);
+		}
+		for(size_t row = 0; row < N; ++row) {
+			std::copy(data.begin() + row * M, data.begin() + (row + 1) * M, mData.begin() + row * mPitch);
+		}
 		mRowShiftIndex = 0;
 		mColShiftIndex = 0;
 	}
 
+	/**
+	 * @brief Smallest pitch of at least columns elements that is a whole number of cache lines.
+	 */
+	static unsigned int alignedPitch(const unsigned int columns)
+	{
+		const unsigned int line = std::max<size_t>(LATTICE_CACHE_LINE / sizeof(T), 1);
+		return (columns + line - 1) / line * line;
+	}
+
+	/**
+	 * @brief Lay the rows out pitch elements apart, keeping the values and the shift.
+	 * @throw std::invalid_argument if pitch is smaller than a row.
+	 */
+	void setRowPitch(const unsigned int pitch)
+	{
+		if(pitch < M) {
+			throw std::invalid_argument("Row pitch " + std::to_string(pitch) + " is shorter than a row of " +
+										std::to_string(M) + " elements.");
+		}
+		if(pitch == mPitch) {
+			return;
+		}
+		std::vector<T, LatticeAllocator<T>> data(std::move(mData));
+		const unsigned int                  previous = mPitch;
+		mPitch                                       = pitch;
+		mData                                        = std::vector<T, LatticeAllocator<T>>();
+		mData.resize(size_t(N) * mPitch);
+		firstTouch([this, &data, previous](size_t i) {
+			return i % mPitch < M ? data[i / mPitch * previous + i % mPitch] : T();
+		});
+	}
+
 	std::vector<T> getShiftedData(int x = 0, int y = 0) const
 	{
 		std::vector<T> shiftedData(LENGTH);
+		copyShiftedData(shiftedData.data(), x, y);
+		return shiftedData;
+	}
 
+	/**
+	 * @brief getShiftedData() into getLength() elements of existing memory, without a temporary.
+	 */
+	void copyShiftedData(T* destination, int x = 0, int y = 0) const
+	{
 		// Calculate the new combined shift indices (x, y) = (nCol, nRow)
 		int combinedRowShiftIndex = (mRowShiftIndex + y + N) % N;
 		int combinedColShiftIndex = (mColShiftIndex + x + M) % M;
 
 #pragma omp parallel for
 		for(size_t i = 0; i < LENGTH; ++i) {
-			shiftedData[i] =
-				mData[(((i - i % M) / M + combinedRowShiftIndex) % N) * M + (i - combinedColShiftIndex + M) % M];
+			destination[i] =
+				mData[((i / M + combinedRowShiftIndex) % N) * mPitch + (i % M + M - combinedColShiftIndex) % M];
 		}
-		return shiftedData;
+	}
+
+	/**
+	 * @brief Take the storage as unshifted, without moving any element.
+	 */
+	void resetShift()
+	{
+		mRowShiftIndex = 0;
+		mColShiftIndex = 0;
 	}
 
 	void shift(int x = 0, int y = 0)
@@ -187,6 +370,20 @@ public:  // Helper getter
 		mColShiftIndex = (mColShiftIndex + x + M) % M;
 	}
 
+	/**
+	 * @brief Exchange contents with another matrix without copying the data.
+	 */
+	void swap(Matrix<T>& other)
+	{
+		std::swap(N, other.N);
+		std::swap(M, other.M);
+		std::swap(LENGTH, other.LENGTH);
+		std::swap(mPitch, other.mPitch);
+		mData.swap(other.mData);
+		std::swap(mRowShiftIndex, other.mRowShiftIndex);
+		std::swap(mColShiftIndex, other.mColShiftIndex);
+	}
+
 public:
 	void fill(const T& value)
 	{
@@ -199,8 +396,7 @@ public:
 	void indexRevision(const unsigned int nRow, const unsigned int nCol, const T& newValue)
 	{
 		validateIndex(nCol, nRow);
-		unsigned int i                                                                     = nCol + nRow * M;
-		mData[(((i - i % M) / M + mRowShiftIndex) % N) * M + (i - mColShiftIndex + M) % M] = newValue;
+		mData[storageIndex(nRow, nCol)] = newValue;
 	}
 
 	void rowRevision(const unsigned int nRow, const T& newValue)
@@ -208,8 +404,7 @@ public:
 		validateIndex(0, nRow);
 #pragma omp parallel for
 		for(int i = 0; i < M; ++i) {
-			unsigned int index = nRow * M + i;
-			mData[(((index - index % M) / M + mRowShiftIndex) % N) * M + (index - mColShiftIndex + M) % M] = newValue;
+			mData[storageIndex(nRow, i)] = newValue;
 		}
 	}
 
@@ -218,8 +413,7 @@ public:
 		validateIndex(nCol, 0);
 #pragma omp parallel for
 		for(int i = 0; i < M; ++i) {
-			unsigned int index = i * M + nCol;
-			mData[(((index - index % M) / M + mRowShiftIndex) % N) * M + (index - mColShiftIndex + M) % M] = newValue;
+			mData[storageIndex(i, nCol)] = newValue;
 		}
 	}
 
@@ -243,6 +437,55 @@ public:
 	}
 
 private:  // Helper
+	/**
+	 * @brief Write every element, each thread its own row tile, so the pages land on that thread's NUMA node.
+	 */
+	template<typename Generator>
+	void firstTouch(Generator value)
+	{
+#pragma omp parallel
+		{
+			std::pair<unsigned int, unsigned int> rows = rowTile(N, omp_get_thread_num(), omp_get_num_threads());
+			for(size_t i = size_t(rows.first) * mPitch; i < size_t(rows.second) * mPitch; i++) {
+				mData[i] = value(i);
+			}
+		}
+	}
+
+	/**
+	 * @brief Write the logical elements of an expression, each thread its row tile of firstTouch(). Per row the
+	 * shift splits the storage into two contiguous runs, each one a SIMD loop with all operators fused.
+	 */
+	template<typename E>
+	void evaluate(const E& expression)
+	{
+#pragma omp parallel
+		{
+			std::pair<unsigned int, unsigned int> rows  = rowTile(N, omp_get_thread_num(), omp_get_num_threads());
+			const unsigned int                    shift = mColShiftIndex;
+			for(unsigned int row = rows.first; row < rows.second; row++) {
+				T* out = mData.data() + size_t((row + mRowShiftIndex) % N) * mPitch;
+#pragma omp simd
+				for(unsigned int col = shift; col < M; col++) {
+					out[col - shift] = T(expression(row, col));
+				}
+#pragma omp simd
+				for(unsigned int col = 0; col < shift; col++) {
+					out[col + M - shift] = T(expression(row, col));
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Storage position of the logical element (row, col), col below M.
+	 */
+	size_t storageIndex(const unsigned int row, const unsigned int col) const
+	{
+		return size_t((row + mRowShiftIndex) % N) * mPitch +
+			   (col >= mColShiftIndex ? col - mColShiftIndex : col + M - mColShiftIndex);
+	}
+
 	void validateIndex(int columnX, int rowY) const
 	{
 		if(columnX < 0 || columnX >= M || rowY < 0 || rowY >= N) {
@@ -257,13 +500,7 @@ public:
 	{
 #pragma omp parallel for
 		for(int i = 0; i < M; ++i) {
-			unsigned int topIndex      = i;
-			unsigned int topBelowIndex = i + M;
-			unsigned int originalIndexTop =
-				(((topIndex - topIndex % M) / M + mRowShiftIndex) % N) * M + (topIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexTopBelow = (((topBelowIndex - topBelowIndex % M) / M + mRowShiftIndex) % N) * M +
-												 (topBelowIndex - mColShiftIndex + M) % M;
-			mData[originalIndexTop] = mData[originalIndexTopBelow];
+			mData[storageIndex(0, i)] = mData[storageIndex(1, i)];
 		}
 	}
 
@@ -271,14 +508,7 @@ public:
 	{
 #pragma omp parallel for
 		for(int i = 0; i < M; ++i) {
-			unsigned int bottomIndex         = i + M * (N - 1);
-			unsigned int bottomAboveIndex    = i + M * (N - 2);
-			unsigned int originalIndexBottom = (((bottomIndex - bottomIndex % M) / M + mRowShiftIndex) % N) * M +
-											   (bottomIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexbottomAbove =
-				(((bottomAboveIndex - bottomAboveIndex % M) / M + mRowShiftIndex) % N) * M +
-				(bottomAboveIndex - mColShiftIndex + M) % M;
-			mData[originalIndexBottom] = mData[originalIndexbottomAbove];
+			mData[storageIndex(N - 1, i)] = mData[storageIndex(N - 2, i)];
 		}
 	}
 
@@ -286,14 +516,7 @@ public:
 	{
 #pragma omp parallel for
 		for(int i = 0; i < N; ++i) {
-			unsigned int leftIndex      = i * M;
-			unsigned int leftRightIndex = i * M + 1;
-			unsigned int originalIndexLeft =
-				(((leftIndex - leftIndex % M) / M + mRowShiftIndex) % N) * M + (leftIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexLeftRight =
-				(((leftRightIndex - leftRightIndex % M) / M + mRowShiftIndex) % N) * M +
-				(leftRightIndex - mColShiftIndex + M) % M;
-			mData[originalIndexLeft] = mData[originalIndexLeftRight];
+			mData[storageIndex(i, 0)] = mData[storageIndex(i, 1)];
 		}
 	}
 
@@ -301,79 +524,39 @@ public:
 	{
 #pragma omp parallel for
 		for(int i = 0; i < N; ++i) {
-			unsigned int rightIndex     = (i + 1) * M - 1;
-			unsigned int rightLeftIndex = (i + 1) * M - 2;
-			unsigned int originalIndexRight =
-				(((rightIndex - rightIndex % M) / M + mRowShiftIndex) % N) * M + (rightIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexRightLeft =
-				(((rightLeftIndex - rightLeftIndex % M) / M + mRowShiftIndex) % N) * M +
-				(rightLeftIndex - mColShiftIndex + M) % M;
-			mData[originalIndexRight] = mData[originalIndexRightLeft];
+			mData[storageIndex(i, M - 1)] = mData[storageIndex(i, M - 2)];
 		}
 	}
 
 	void topDirichlet(const double C, const Matrix<T>& matrix)
 	{
-		std::vector<T> other              = matrix.getData();
-		unsigned int   otherRowShiftIndex = matrix.getRowShiftIndex();
-		unsigned int   otherColShiftIndex = matrix.getColShiftIndex();
 #pragma omp parallel for
 		for(int i = 0; i < M; ++i) {
-			unsigned int topIndex = i;
-			unsigned int originalIndexTop =
-				(((topIndex - topIndex % M) / M + mRowShiftIndex) % N) * M + (topIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexOtherTop = (((topIndex - topIndex % M) / M + otherRowShiftIndex) % N) * M +
-												 (topIndex - otherColShiftIndex + M) % M;
-			mData[originalIndexTop] = C - other[originalIndexOtherTop];
+			mData[storageIndex(0, i)] = C - matrix.mData[matrix.storageIndex(0, i)];
 		}
 	}
 
 	void bottomDirichlet(const double C, const Matrix<T>& matrix)
 	{
-		std::vector<T> other              = matrix.getData();
-		unsigned int   otherRowShiftIndex = matrix.getRowShiftIndex();
-		unsigned int   otherColShiftIndex = matrix.getColShiftIndex();
 #pragma omp parallel for
 		for(int i = 0; i < M; ++i) {
-			unsigned int bottomIndex         = i + M * (N - 1);
-			unsigned int originalIndexBottom = (((bottomIndex - bottomIndex % M) / M + mRowShiftIndex) % N) * M +
-											   (bottomIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexOtherBottom =
-				(((bottomIndex - bottomIndex % M) / M + otherRowShiftIndex) % N) * M +
-				(bottomIndex - otherColShiftIndex + M) % M;
-			mData[originalIndexBottom] = C - other[originalIndexOtherBottom];
+			mData[storageIndex(N - 1, i)] = C - matrix.mData[matrix.storageIndex(N - 1, i)];
 		}
 	}
 
 	void leftDirichlet(const double C, const Matrix<T>& matrix)
 	{
-		std::vector<T> other              = matrix.getData();
-		unsigned int   otherRowShiftIndex = matrix.getRowShiftIndex();
-		unsigned int   otherColShiftIndex = matrix.getColShiftIndex();
 #pragma omp parallel for
 		for(int i = 0; i < N; ++i) {
-			unsigned int leftIndex = i * M;
-			unsigned int originalIndexLeft =
-				(((leftIndex - leftIndex % M) / M + mRowShiftIndex) % N) * M + (leftIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexOtherLeft = (((leftIndex - leftIndex % M) / M + otherRowShiftIndex) % N) * M +
-												  (leftIndex - otherColShiftIndex + M) % M;
-			mData[originalIndexLeft] = C - other[originalIndexOtherLeft];
+			mData[storageIndex(i, 0)] = C - matrix.mData[matrix.storageIndex(i, 0)];
 		}
 	}
 
 	void rightDirichlet(const double C, const Matrix<T>& matrix)
 	{
-		std::vector<T> other              = matrix.getData();
-		unsigned int   otherRowShiftIndex = matrix.getRowShiftIndex();
-		unsigned int   otherColShiftIndex = matrix.getColShiftIndex();
 #pragma omp parallel for
 		for(int i = 0; i < N; ++i) {
-			unsigned int rightIndex = i * M + N - 1;
-			unsigned int originalIndexRight =
-				(((rightIndex - rightIndex % M) / M + mRowShiftIndex) % N) * M + (rightIndex - mColShiftIndex + M) % M;
-			unsigned int originalIndexOtherRight = (((rightIndex - rightIndex % M) / M + otherRowShiftIndex) % N) * M +
-												   (rightIndex - otherColShiftIndex + M) % M;
-			mData[originalIndexRight] = C - other[originalIndexOtherRight];
+			mData[storageIndex(i, M - 1)] = C - matrix.mData[matrix.storageIndex(i, M - 1)];
 		}
 	}
 };
@@ -0,0 +1,281 @@
+#ifndef MATRIX_EXPRESSION
+#define MATRIX_EXPRESSION
+
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+template<typename T>
+class Matrix;
+
+/**
+ * @brief Lazy element-wise arithmetic on matrices (expression templates).
+ *
+ * `a * 0.5 + b / c` builds a tree of small nodes instead of temporaries. Nothing is computed until the tree is
+ * assigned to, or used to construct, a Matrix, which evaluates it in a single OpenMP loop over the rows with a SIMD
+ * loop over the columns: one pass over the memory however many operators the expression has. Elements are read at
+ * their logical position (row, col), so shifted operands combine like unshifted ones.
+ *
+ * Nodes keep references to the Matrix operands, an expression must not outlive them. Keep it in an `auto` only
+ * when every operand is a named matrix.
+ *
+ * @tparam E The node type deriving from this base.
+ */
+template<typename E>
+class MatrixExpression
+{
+public:
+	const E& self() const
+	{
+		return static_cast<const E&>(*this);
+	}
+
+	unsigned int getN() const
+	{
+		return self().getN();
+	}
+
+	unsigned int getM() const
+	{
+		return self().getM();
+	}
+
+	auto operator()(const unsigned int row, const unsigned int col) const
+	{
+		return self()(row, col);
+	}
+};
+
+/**
+ * @brief How a node holds an operand: matrices by reference, nodes (small and often temporary) by value.
+ */
+template<typename E>
+struct MatrixOperand {
+	using type = const E;
+};
+
+template<typename T>
+struct MatrixOperand<Matrix<T>> {
+	using type = const Matrix<T>&;
+};
+
+/**
+ * @brief A scalar operand, the same value at every position.
+ */
+template<typename T>
+class MatrixScalar
+{
+private:
+	const T mValue;
+
+public:
+	explicit MatrixScalar(const T value): mValue(value) {}
+
+	T operator()(const unsigned int, const unsigned int) const
+	{
+		return mValue;
+	}
+};
+
+/**
+ * @brief Element-wise binary operation. Either operand can be a scalar, the other one then sets the dimensions.
+ */
+template<typename L, typename R, typename Operation>
+class MatrixBinary: public MatrixExpression<MatrixBinary<L, R, Operation>>
+{
+private:
+	typename MatrixOperand<L>::type mLeft;
+	typename MatrixOperand<R>::type mRight;
+	const unsigned int              N;
+	const unsigned int              M;
+
+public:
+	MatrixBinary(const L& left, const R& right, const unsigned int nRow, const unsigned int nColumn):
+		mLeft(left),
+		mRight(right),
+		N(nRow),
+		M(nColumn)
+	{
+	}
+
+	unsigned int getN() const
+	{
+		return N;
+	}
+
+	unsigned int getM() const
+	{
+		return M;
+	}
+
+	auto operator()(const unsigned int row, const unsigned int col) const
+	{
+		return Operation::apply(mLeft(row, col), mRight(row, col));
+	}
+};
+
+/**
+ * @brief Element-wise negation.
+ */
+template<typename E>
+class MatrixNegation: public MatrixExpression<MatrixNegation<E>>
+{
+private:
+	typename MatrixOperand<E>::type mOperand;
+
+public:
+	explicit MatrixNegation(const E& operand): mOperand(operand) {}
+
+	unsigned int getN() const
+	{
+		return mOperand.getN();
+	}
+
+	unsigned int getM() const
+	{
+		return mOperand.getM();
+	}
+
+	auto operator()(const unsigned int row, const unsigned int col) const
+	{
+		return -mOperand(row, col);
+	}
+};
+
+struct MatrixAdd {
+	template<typename A, typename B>
+	static auto apply(const A a, const B b)
+	{
+		return a + b;
+	}
+};
+
+struct MatrixSubtract {
+	template<typename A, typename B>
+	static auto apply(const A a, const B b)
+	{
+		return a - b;
+	}
+};
+
+struct MatrixMultiply {
+	template<typename A, typename B>
+	static auto apply(const A a, const B b)
+	{
+		return a * b;
+	}
+};
+
+struct MatrixDivide {
+	template<typename A, typename B>
+	static auto apply(const A a, const B b)
+	{
+		return a / b;
+	}
+};
+
+template<typename S>
+using EnableIfScalar = std::enable_if_t<std::is_arithmetic<S>::value, int>;
+
+template<typename Operation, typename L, typename R>
+inline MatrixBinary<L, R, Operation> matrixBinary(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	if(left.getN() != right.getN() || left.getM() != right.getM()) {
+		throw std::invalid_argument("Inconsistent matrix dimensions: " + std::to_string(left.getN()) + "x" +
+									std::to_string(left.getM()) + " vs " + std::to_string(right.getN()) + "x" +
+									std::to_string(right.getM()) + ".");
+	}
+	return MatrixBinary<L, R, Operation>(left.self(), right.self(), left.getN(), left.getM());
+}
+
+template<typename Operation, typename L, typename S, EnableIfScalar<S> = 0>
+inline MatrixBinary<L, MatrixScalar<S>, Operation> matrixBinary(const MatrixExpression<L>& left, const S right)
+{
+	return MatrixBinary<L, MatrixScalar<S>, Operation>(left.self(), MatrixScalar<S>(right), left.getN(), left.getM());
+}
+
+template<typename Operation, typename S, typename R, EnableIfScalar<S> = 0>
+inline MatrixBinary<MatrixScalar<S>, R, Operation> matrixBinary(const S left, const MatrixExpression<R>& right)
+{
+	return MatrixBinary<MatrixScalar<S>, R, Operation>(MatrixScalar<S>(left), right.self(), right.getN(), right.getM());
+}
+
+template<typename L, typename R>
+inline auto operator+(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixAdd>(left, right);
+}
+
+template<typename L, typename S, EnableIfScalar<S> = 0>
+inline auto operator+(const MatrixExpression<L>& left, const S right)
+{
+	return matrixBinary<MatrixAdd>(left, right);
+}
+
+template<typename S, typename R, EnableIfScalar<S> = 0>
+inline auto operator+(const S left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixAdd>(left, right);
+}
+
+template<typename L, typename R>
+inline auto operator-(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixSubtract>(left, right);
+}
+
+template<typename L, typename S, EnableIfScalar<S> = 0>
+inline auto operator-(const MatrixExpression<L>& left, const S right)
+{
+	return matrixBinary<MatrixSubtract>(left, right);
+}
+
+template<typename S, typename R, EnableIfScalar<S> = 0>
+inline auto operator-(const S left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixSubtract>(left, right);
+}
+
+template<typename E>
+inline MatrixNegation<E> operator-(const MatrixExpression<E>& operand)
+{
+	return MatrixNegation<E>(operand.self());
+}
+
+template<typename L, typename R>
+inline auto operator*(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixMultiply>(left, right);
+}
+
+template<typename L, typename S, EnableIfScalar<S> = 0>
+inline auto operator*(const MatrixExpression<L>& left, const S right)
+{
+	return matrixBinary<MatrixMultiply>(left, right);
+}
+
+template<typename S, typename R, EnableIfScalar<S> = 0>
+inline auto operator*(const S left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixMultiply>(left, right);
+}
+
+template<typename L, typename R>
+inline auto operator/(const MatrixExpression<L>& left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixDivide>(left, right);
+}
+
+template<typename L, typename S, EnableIfScalar<S> = 0>
+inline auto operator/(const MatrixExpression<L>& left, const S right)
+{
+	return matrixBinary<MatrixDivide>(left, right);
+}
+
+template<typename S, typename R, EnableIfScalar<S> = 0>
+inline auto operator/(const S left, const MatrixExpression<R>& right)
+{
+	return matrixBinary<MatrixDivide>(left, right);
+}
+#endif  // MATRIX_EXPRESSION
@@ -18,10 +18,21 @@
 #include <set>
 #include <stdexcept>
 #include <regex>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 
+#include "LatticeArena.hpp"
 #include "Matrix.hpp"
+#include "Reduction.hpp"
+
+class OpenCLStream;
+
 class OpenCLMain
 {
+	friend class OpenCLStream;
+
 private:
 	struct MachineProfile {
 		std::string mPlatformName;
@@ -32,20 +43,18 @@ private:
 private:
 	static inline MachineProfile UserMachineProfile;
 
-	static inline cl::Platform         mPlatform;
-	static inline cl::Device           mDevice;
-	static inline cl::NDRange          mLocal;
-	static inline cl::Context          mContext;
-	static inline cl::Program::Sources mArithmeticSources;
-	static inline cl::Program          mArithmeticProgram;
-
-	// parameter
-	static inline cl::CommandQueue        mQueue;
-	static inline cl::NDRange             mGlobal;
-	static inline std::set<char>          mAvailableCacheIndex;
-	static inline char                    mNewCacheIndex;
-	static inline unsigned int            mArrayLength;
-	static inline std::vector<cl::Buffer> mBuffers;
+	static inline cl::Platform            mPlatform;
+	static inline cl::Device              mDevice;
+	static inline std::vector<cl::Device> mDevices;
+	static inline cl::NDRange             mLocal;
+	static inline cl::Context             mContext;
+	static inline cl::Program::Sources    mArithmeticSources;
+	static inline cl::Program             mArithmeticProgram;
+	static inline bool                    mZeroCopy = false;  // the device works in host memory (a CPU device)
+
+	// user programs, cached by source
+	static inline std::mutex                                   mProgramMutex;
+	static inline std::unordered_map<std::string, cl::Program> mPrograms;
 
 private:
 	OpenCLMain()
@@ -92,9 +101,11 @@ private:
 		}
 
 		// Select the default device
+		mDevices                       = all_devices;
 		mDevice                        = all_devices[0];
 		UserMachineProfile.mDeviceName = mDevice.getInfo<CL_DEVICE_NAME>();
 		std::cout << "[OpenCL] Device selected:" << UserMachineProfile.mDeviceName << "\n";
+		mZeroCopy = (mDevice.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU) != 0;
 
 		// Set local work group size
 		mDevice.getInfo(CL_DEVICE_MAX_WORK_GROUP_SIZE, &UserMachineProfile.mOptimalWorkGroupSize);
@@ -177,6 +188,28 @@ private:
 					B[i] = 0;
 				}
 			}
+
+			// operation: 0 sum, 1 min, 2 max, 3 sum of squares (see Reduction)
+			void kernel kernelReduce(global double* B, global const double* A, local double* scratch, const unsigned int length, const int operation) {
+				unsigned int i = get_local_id(0);
+				double value = operation == 1 ? INFINITY : (operation == 2 ? -INFINITY : 0);
+				for (unsigned int j = get_global_id(0); j < length; j += get_global_size(0)) {
+					double a = A[j];
+					value = operation == 1 ? fmin(value, a) : (operation == 2 ? fmax(value, a) : (operation == 3 ? value + a * a : value + a));
+				}
+				scratch[i] = value;
+				barrier(CLK_LOCAL_MEM_FENCE);
+				for (unsigned int s = get_local_size(0) / 2; s > 0; s /= 2) {
+					if (i < s) {
+						double b = scratch[i + s];
+						scratch[i] = operation == 1 ? fmin(scratch[i], b) : (operation == 2 ? fmax(scratch[i], b) : scratch[i] + b);
+					}
+					barrier(CLK_LOCAL_MEM_FENCE);
+				}
+				if (i == 0) {
+					B[get_group_id(0)] = scratch[0];
+				}
+			}
 		)";
 		mArithmeticSources.push_back({arithmeticKernelCode.c_str(), arithmeticKernelCode.length()});
 		mArithmeticProgram = cl::Program(mContext, mArithmeticSources);
@@ -205,66 +238,209 @@ public:
 		return instance;
 	}
 
-	// Convert an infix expression to postfix using the shunting yard algorithm
+	static const cl::Context& getContext()
+	{
+		instance();
+		return mContext;
+	}
+
+	static const cl::Device& getDevice()
+	{
+		instance();
+		return mDevice;
+	}
+
+	/**
+	 * @brief Every device of the selected platform, the selected device first.
+	 */
+	static const std::vector<cl::Device>& getDevices()
+	{
+		instance();
+		return mDevices;
+	}
+
+	/**
+	 * @brief Split a device into one sub-device per NUMA domain with clCreateSubDevices.
+	 *
+	 * Work queued on a sub-device runs on the cores of its domain, so buffers it first touches stay local. Devices
+	 * that cannot be partitioned this way (most GPUs) are returned as they are.
+	 */
+	static std::vector<cl::Device> partitionByNumaDomain(cl::Device device)
+	{
+		const cl_device_partition_property properties[] = {
+			CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0};
+		std::vector<cl::Device> subDevices;
+		if(device.createSubDevices(properties, &subDevices) != CL_SUCCESS || subDevices.empty()) {
+			return std::vector<cl::Device>{device};
+		}
+		return subDevices;
+	}
+
+	/**
+	 * @brief Build a program from kernel source code for the selected device. Programs are cached by source so the
+	 * build cost is paid once per process.
+	 *
+	 * @param source
+	 * @return cl::Program
+	 */
+	static cl::Program buildProgram(const std::string& source)
+	{
+		instance();
+		std::lock_guard<std::mutex> lock(mProgramMutex);
+
+		auto cached = mPrograms.find(source);
+		if(cached != mPrograms.end()) {
+			return cached->second;
+		}
+
+		cl::Program program = buildProgram(source, mContext, {mDevice});
+		mPrograms.emplace(source, program);
+		return program;
+	}
+
+	/**
+	 * @brief Build a program for other devices in their own context, not cached.
+	 */
+	static cl::Program buildProgram(const std::string&             source,
+									const cl::Context&             context,
+									const std::vector<cl::Device>& devices)
+	{
+		cl::Program::Sources sources;
+		sources.push_back({source.c_str(), source.length()});
+		cl::Program program(context, sources);
+		if(program.build(devices) != CL_SUCCESS) {
+			for(const cl::Device& device : devices) {
+				std::cout << " Error building: " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << "\n";
+			}
+			throw std::runtime_error("Error building program source code");
+		}
+		return program;
+	}
+
+	/**
+	 * @brief A function of the formula language, evaluated by an OpenCL built-in.
+	 */
+	struct FormulaFunction {
+		const char*  builtin;  // OpenCL C name, "-" for the negation
+		unsigned int arity;
+		double (*host)(const double*);  // folds calls whose arguments are all constants
+	};
+
+	/**
+	 * @brief Functions of the formula language. "neg" is the unary minus, emitted by enqueueArithmeticFormula().
+	 */
+	static const std::map<std::string, FormulaFunction>& formulaFunctions()
+	{
+		static const std::map<std::string, FormulaFunction> functions = {
+			{"neg", {"-", 1, [](const double* x) { return -x[0]; }}},
+			{"abs", {"fabs", 1, [](const double* x) { return std::fabs(x[0]); }}},
+			{"sqrt", {"sqrt", 1, [](const double* x) { return std::sqrt(x[0]); }}},
+			{"exp", {"exp", 1, [](const double* x) { return std::exp(x[0]); }}},
+			{"log", {"log", 1, [](const double* x) { return std::log(x[0]); }}},
+			{"sin", {"sin", 1, [](const double* x) { return std::sin(x[0]); }}},
+			{"cos", {"cos", 1, [](const double* x) { return std::cos(x[0]); }}},
+			{"tanh", {"tanh", 1, [](const double* x) { return std::tanh(x[0]); }}},
+			{"floor", {"floor", 1, [](const double* x) { return std::floor(x[0]); }}},
+			{"ceil", {"ceil", 1, [](const double* x) { return std::ceil(x[0]); }}},
+			{"pow", {"pow", 2, [](const double* x) { return std::pow(x[0], x[1]); }}},
+			{"min", {"fmin", 2, [](const double* x) { return std::fmin(x[0], x[1]); }}},
+			{"max", {"fmax", 2, [](const double* x) { return std::fmax(x[0], x[1]); }}},
+			{"hypot", {"hypot", 2, [](const double* x) { return std::hypot(x[0], x[1]); }}},
+			{"fma", {"fma", 3, [](const double* x) { return std::fma(x[0], x[1], x[2]); }}}};
+		return functions;
+	}
+
+	/**
+	 * @brief Convert an infix expression to postfix using the shunting yard algorithm.
+	 *
+	 * Besides + - * / and parentheses the formula may call the functions of formulaFunctions(), arguments separated
+	 * by commas, and use a unary minus, written to the output as "neg". A function follows its arguments in the
+	 * output: "max(A, -B)" becomes "A B neg max".
+	 */
 	static std::queue<std::string> enqueueArithmeticFormula(const std::string& expression)
 	{
 		std::queue<std::string> output;
-		std::stack<char>        operators;
+		std::stack<std::string> operators;
 		std::string             token;
+		bool                    expectOperand = true;  // a '-' here is a unary minus
+		const auto&             functions     = formulaFunctions();
 
 		auto isOperator = [](char c) -> bool {
 			return c == '+' || c == '-' || c == '*' || c == '/';
 		};
 
-		std::unordered_map<char, int> precedence = {{'+', 1}, {'-', 1}, {'*', 2}, {'/', 2}};
+		std::unordered_map<std::string, int> precedence = {{"+", 1}, {"-", 1}, {"*", 2}, {"/", 2}, {"neg", 3}};
+
+		// Function names wait on the operator stack for their arguments, everything else is an operand
+		auto flush = [&]() {
+			if(token.empty()) {
+				return;
+			}
+			if(functions.count(token) != 0) {
+				operators.push(token);
+			} else {
+				output.push(token);
+				expectOperand = false;
+			}
+			token.clear();
+		};
 
 		for(char ch : expression) {
 			if(isspace(ch)) {
-				if(!token.empty()) {
-					output.push(token);
-					token.clear();
-				}
+				flush();
 			} else if(isOperator(ch)) {
-				if(!token.empty()) {
-					output.push(token);
-					token.clear();
+				flush();
+				if(expectOperand) {
+					// Prefix operators bind to what follows, nothing to pop; a unary plus changes nothing
+					if(ch == '-') {
+						operators.push("neg");
+					}
+					continue;
 				}
 
-				while(!operators.empty() && isOperator(operators.top()) &&
-					  precedence[ch] <= precedence[operators.top()]) {
-					output.push(std::string(1, operators.top()));
+				std::string op(1, ch);
+				while(!operators.empty() && precedence.count(operators.top()) != 0 &&
+					  precedence[op] <= precedence[operators.top()]) {
+					output.push(operators.top());
 					operators.pop();
 				}
-				operators.push(ch);
+				operators.push(op);
+				expectOperand = true;
 			} else if(ch == '(') {
-				operators.push(ch);
-			} else if(ch == ')') {
-				if(!token.empty()) {
-					output.push(token);
-					token.clear();
-				}
+				flush();
+				operators.push("(");
+				expectOperand = true;
+			} else if(ch == ')' || ch == ',') {
+				flush();
 
-				while(!operators.empty() && operators.top() != '(') {
-					output.push(std::string(1, operators.top()));
+				while(!operators.empty() && operators.top() != "(") {
+					output.push(operators.top());
 					operators.pop();
 				}
 
+				if(ch == ',') {
+					expectOperand = true;
+					continue;
+				}
 				if(!operators.empty()) {
 					operators.pop();
 				}
+				if(!operators.empty() && operators.top() != "neg" && functions.count(operators.top()) != 0) {
+					output.push(operators.top());
+					operators.pop();
+				}
+				expectOperand = false;
 			} else {
 				token += ch;
 			}
 		}
 
 		// If any remaining token is left, push it to the output
-		if(!token.empty()) {
-			output.push(token);
-		}
+		flush();
 
 		// Push any remaining operators to the output
 		while(!operators.empty()) {
-			output.push(std::string(1, operators.top()));
+			output.push(operators.top());
 			operators.pop();
 		}
 
@@ -272,19 +448,329 @@ public:
 	}
 
 	/**
-	 * @brief
+	 * @brief Evaluate the formula on the calling thread's default stream.
+	 * @see OpenCLStream::evaluateArithmeticFormula
+	 */
+	static Matrix<double> evaluateArithmeticFormula(
+		const std::string&                  expression,
+		const std::vector<Matrix<double>*>& array = std::vector<Matrix<double>*>());
+
+	/**
+	 * @brief Evaluate several formulas in one kernel on the calling thread's default stream.
+	 * @see OpenCLStream::evaluateArithmeticFormulas
+	 */
+	static std::map<std::string, Matrix<double>> evaluateArithmeticFormulas(
+		const std::vector<std::pair<std::string, std::string>>& formulas,
+		const std::vector<Matrix<double>*>&                     array = std::vector<Matrix<double>*>());
+
+	/**
+	 * @brief Reduce the formula result on the calling thread's default stream.
+	 * @see OpenCLStream::evaluateArithmeticReduction
+	 */
+	static double evaluateArithmeticReduction(
+		Reduction                           operation,
+		const std::string&                  expression,
+		const std::vector<Matrix<double>*>& array = std::vector<Matrix<double>*>());
+
+	/**
+	 * @brief Reduce a matrix on the calling thread's default stream.
+	 */
+	static double reduce(Reduction operation, Matrix<double>& matrix);
+
+	/**
+	 * @brief Stream used by the static helpers, one per thread so concurrent callers never share buffers.
+	 */
+	static OpenCLStream& defaultStream();
+
+private:
+	static bool isDouble(const std::string& token)
+	{
+		try {
+			std::stod(token);
+			return true;
+		} catch(const std::invalid_argument&) {
+			return false;
+		} catch(const std::out_of_range&) {
+			return false;
+		}
+	}
+};
+
+/**
+ * @brief Per-queue execution state for formula evaluation.
+ *
+ * The platform, device, context and compiled programs are shared through OpenCLMain, but the command queue, device
+ * buffers and cache indices belong to a stream. Each solver owns its own stream so several of them can step
+ * concurrently in one process; a single stream must not be used from two threads at once.
+ */
+class OpenCLStream
+{
+private:
+	cl::Context             mContext;
+	cl::Program             mArithmeticProgram;
+	cl::NDRange             mLocal;
+	cl::CommandQueue        mQueue;
+	cl::NDRange             mGlobal;
+	cl::Buffer              mPartials[2];  // per work-group results of the two reduction passes
+	size_t                  mReductionGroupSize;
+	std::set<char>          mAvailableCacheIndex;
+	char                    mNewCacheIndex;
+	unsigned int            mArrayN;
+	unsigned int            mArrayM;
+	unsigned int            mArrayLength;
+	std::vector<cl::Buffer> mBuffers;
+	bool                    mZeroCopy;
+
+	std::vector<Matrix<double>> mResults;  // storage of the output buffers when zero-copy
+	LatticeArena                mArena;    // storage of the returned matrices
+
+	// Kernels of the arithmetic program, created once so evaluating a formula only sets their arguments
+	using ArrayKernel = cl::compatibility::make_kernel<cl::Buffer,
+													   cl::Buffer,
+													   unsigned int,
+													   unsigned int,
+													   cl::Buffer,
+													   unsigned int,
+													   unsigned int,
+													   unsigned int,
+													   unsigned int>;
+	using ConstantKernel = cl::compatibility::
+		make_kernel<cl::Buffer, cl::Buffer, unsigned int, unsigned int, double, unsigned int, unsigned int>;
+	cl::Kernel mReduceKernel;
+	cl::compatibility::make_kernel<cl::Buffer, cl::Buffer, cl::LocalSpaceArg, unsigned int, int> mReduce;
+	ArrayKernel                                 mAddingArray;
+	ConstantKernel                              mAddingConstant;
+	ArrayKernel                                 mSubtractingArray;
+	ConstantKernel                              mSubtractingConstant;
+	ConstantKernel                              mConstantSubtracting;
+	ArrayKernel                                 mMultiplicatingArray;
+	ConstantKernel                              mMultiplicatingConstant;
+	ArrayKernel                                 mDividingByArray;
+	ConstantKernel                              mDividingByConstant;
+	ConstantKernel                              mConstantDividingBy;
+	std::unordered_map<std::string, cl::Kernel> mFormulaKernels;  // generated fused kernels, by source
+
+public:
+	OpenCLStream():
+		mContext(OpenCLMain::getContext()),
+		mArithmeticProgram(OpenCLMain::mArithmeticProgram),
+		mReductionGroupSize(0),
+		mNewCacheIndex('A'),
+		mArrayN(0),
+		mArrayM(0),
+		mArrayLength(0),
+		mReduceKernel(mArithmeticProgram, "kernelReduce"),
+		mReduce(mReduceKernel),
+		mAddingArray(mArithmeticProgram, "kernelAddingArray"),
+		mAddingConstant(mArithmeticProgram, "kernelAddingConstant"),
+		mSubtractingArray(mArithmeticProgram, "kernelSubtractingArray"),
+		mSubtractingConstant(mArithmeticProgram, "kernelSubtractingConstant"),
+		mConstantSubtracting(mArithmeticProgram, "kernelConstantSubtracting"),
+		mMultiplicatingArray(mArithmeticProgram, "kernelMultiplicatingArray"),
+		mMultiplicatingConstant(mArithmeticProgram, "kernelMultiplicatingConstant"),
+		mDividingByArray(mArithmeticProgram, "kernelDividingByArray"),
+		mDividingByConstant(mArithmeticProgram, "kernelDividingByConstant"),
+		mConstantDividingBy(mArithmeticProgram, "kernelConstantDividingBy")
+	{
+		mLocal             = OpenCLMain::mLocal;
+		mQueue             = cl::CommandQueue(mContext, OpenCLMain::mDevice);
+		mZeroCopy          = OpenCLMain::mZeroCopy;
+	}
+
+	// Streams own device buffers, keep them unique
+	OpenCLStream(OpenCLStream const&)            = delete;
+	OpenCLStream& operator=(OpenCLStream const&) = delete;
+
+	cl::CommandQueue& getQueue()
+	{
+		return mQueue;
+	}
+
+	/**
+	 * @brief Let kernels work on Matrix storage directly instead of copies, the default on CPU devices.
+	 *
+	 * Inputs are wrapped with CL_MEM_USE_HOST_PTR, and the outputs of the formula kernels are matrices whose storage
+	 * is mapped rather than read back, so no element is copied. Devices with memory of their own (discrete GPUs)
+	 * would copy behind the scenes, they are better served by explicit transfers.
+	 */
+	void setZeroCopy(bool zeroCopy)
+	{
+		mZeroCopy = zeroCopy;
+	}
+
+	bool isZeroCopy() const
+	{
+		return mZeroCopy;
+	}
+
+	/**
+	 * @brief Pool the formula results are taken from. Release the matrices they replace into it, and steady-state
+	 * evaluation stops allocating host storage.
+	 */
+	LatticeArena& getArena()
+	{
+		return mArena;
+	}
+
+	/**
+	 * @brief Evaluate the formula element-wise over the given matrices on this stream's queue.
 	 * @attention The use of 'A'-'Y' as variable name must be used in sequencial order.
 	 * @tparam T
 	 * @param expression
 	 * @param arrayLength
 	 * @param values
 	 */
-	static Matrix<double> evaluateArithmeticFormula(
+	Matrix<double> evaluateArithmeticFormula(
 		const std::string&                  expression,
 		const std::vector<Matrix<double>*>& array = std::vector<Matrix<double>*>())
 	{
-		unsigned int mArrayN = 0;
-		unsigned int mArrayM = 0;
+		std::variant<double, char> resultVal = enqueueFormula(expression, array);
+		if(std::holds_alternative<char>(resultVal)) {
+			return readResult(std::get<char>(resultVal) - 'A', array.size());
+		}
+		return Matrix<double>(1, 1, std::vector<double>{std::get<double>(resultVal)});
+	}
+
+	/**
+	 * @brief Evaluate several formulas over the same matrices in one kernel.
+	 *
+	 * In every formula 'A' is the first matrix, 'B' the second and so on, in any order. Each input is read once per
+	 * element and subexpressions shared by the formulas (or repeated in one) are computed once, so formulas with
+	 * common operands cost a single pass over the lattice instead of one per formula and operator.
+	 * @param formulas Pairs of output name and formula.
+	 * @return The result of every formula by name, unshifted. A constant formula gives its value at every element.
+	 */
+	std::map<std::string, Matrix<double>> evaluateArithmeticFormulas(
+		const std::vector<std::pair<std::string, std::string>>& formulas,
+		const std::vector<Matrix<double>*>&                     array = std::vector<Matrix<double>*>())
+	{
+		std::vector<std::queue<std::string>> postfixes;
+		for(const std::pair<std::string, std::string>& formula : formulas) {
+			for(const std::pair<std::string, std::string>& other : formulas) {
+				if(&other != &formula && other.first == formula.first) {
+					throw std::invalid_argument("Formula output " + formula.first + " is given more than once.");
+				}
+			}
+			postfixes.push_back(OpenCLMain::enqueueArithmeticFormula(formula.second));
+		}
+
+		upload(array, formulas.size());
+		std::vector<std::variant<double, char>> results = enqueueFusedFormulas(postfixes, array);
+		std::map<std::string, Matrix<double>>   outputs;
+		for(size_t j = 0; j < formulas.size(); j++) {
+			if(std::holds_alternative<char>(results[j])) {
+				outputs[formulas[j].first] = readResult(std::get<char>(results[j]) - 'A', array.size());
+			} else if(array.empty()) {
+				outputs[formulas[j].first] = Matrix<double>(1, 1, std::get<double>(results[j]));
+			} else {
+				outputs[formulas[j].first] = Matrix<double>(mArrayN, mArrayM, std::get<double>(results[j]));
+			}
+		}
+		return outputs;
+	}
+
+	/**
+	 * @brief Evaluate the formula like evaluateArithmeticFormula, but leave the readback in flight.
+	 *
+	 * The result is copied into destination with a non-blocking read, so the caller can keep enqueueing work while
+	 * the transfer runs. Pass pinned host memory (a mapped CL_MEM_ALLOC_HOST_PTR buffer) for a true DMA copy.
+	 * @attention destination must hold getN() * getM() values of the given matrices (one value for constant results)
+	 * and stay valid until the returned event completes.
+	 * @return Event signalled once destination holds the result.
+	 */
+	cl::Event evaluateArithmeticFormulaAsync(const std::string&                  expression,
+											 const std::vector<Matrix<double>*>& array,
+											 double*                             destination)
+	{
+		cl::Event                  event;
+		std::variant<double, char> resultVal = enqueueFormula(expression, array);
+		if(std::holds_alternative<char>(resultVal)) {
+			mQueue.enqueueReadBuffer(mBuffers[std::get<char>(resultVal) - 'A'],
+									 CL_FALSE,
+									 0,
+									 sizeof(double) * mArrayLength,
+									 destination,
+									 nullptr,
+									 &event);
+		} else {
+			std::fill(destination, destination + std::max(mArrayLength, 1u), std::get<double>(resultVal));
+			mQueue.enqueueMarkerWithWaitList(nullptr, &event);
+		}
+		return event;
+	}
+
+	/**
+	 * @brief Evaluate the formula and reduce its result on the device, only the reduced value is read back.
+	 *
+	 * Every work-item folds a strided slice of the result, each work-group combines its items as a tree in local
+	 * memory and a second single-group pass combines the group results. The summation order differs from a
+	 * sequential loop, so sums agree with the host up to rounding.
+	 */
+	double evaluateArithmeticReduction(Reduction                           operation,
+									   const std::string&                  expression,
+									   const std::vector<Matrix<double>*>& array = std::vector<Matrix<double>*>())
+	{
+		std::variant<double, char> resultVal = enqueueFormula(expression, array);
+		if(std::holds_alternative<double>(resultVal)) {
+			return reduceConstant(operation, std::get<double>(resultVal), std::max(mArrayLength, 1u));
+		}
+		return enqueueReduction(operation, mBuffers[std::get<char>(resultVal) - 'A'], mArrayLength);
+	}
+
+	/**
+	 * @brief Reduce a matrix on the device. The order of the elements does not matter, shifts are ignored.
+	 */
+	double reduce(Reduction operation, Matrix<double>& matrix)
+	{
+		return evaluateArithmeticReduction(operation, "A", std::vector<Matrix<double>*>{&matrix});
+	}
+
+private:
+	double enqueueReduction(Reduction operation, const cl::Buffer& buffer, unsigned int length)
+	{
+		// The tree needs a power of two group, and no more groups than work-items so one group finishes the job
+		if(mReductionGroupSize == 0) {
+			size_t limit = std::min(OpenCLMain::UserMachineProfile.mOptimalWorkGroupSize,
+									mReduceKernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(OpenCLMain::mDevice));
+			mReductionGroupSize = 1;
+			while(mReductionGroupSize * 2 <= std::min<size_t>(limit, 256)) {
+				mReductionGroupSize *= 2;
+			}
+			mPartials[0] = cl::Buffer(mContext, CL_MEM_READ_WRITE, sizeof(double) * mReductionGroupSize);
+			mPartials[1] = cl::Buffer(mContext, CL_MEM_READ_WRITE, sizeof(double));
+		}
+		const size_t       local  = mReductionGroupSize;
+		const unsigned int groups = std::min<size_t>(local, (length + local - 1) / local);
+
+		// Squares are only taken on the first pass, the partials of an L2 norm are summed
+		const int first  = static_cast<int>(operation);
+		const int second = operation == Reduction::L2 ? static_cast<int>(Reduction::SUM) : first;
+		mReduce(cl::EnqueueArgs(mQueue, cl::NDRange(groups * local), cl::NDRange(local)),
+				mPartials[0],
+				buffer,
+				cl::Local(sizeof(double) * local),
+				length,
+				first);
+		mReduce(cl::EnqueueArgs(mQueue, cl::NDRange(local), cl::NDRange(local)),
+				mPartials[1],
+				mPartials[0],
+				cl::Local(sizeof(double) * local),
+				groups,
+				second);
+
+		double result = reductionIdentity(operation);
+		mQueue.enqueueReadBuffer(mPartials[1], CL_TRUE, 0, sizeof(double), &result);
+		return operation == Reduction::L2 ? std::sqrt(result) : result;
+	}
+
+	/**
+	 * @brief Check that the inputs share their dimensions and copy them to the device. Buffers [0, array.size()) hold
+	 * the inputs, the following ones the outputs.
+	 */
+	void upload(const std::vector<Matrix<double>*>& array, size_t outputs)
+	{
+		mArrayN = 0;
+		mArrayM = 0;
 
 		if(array.size() != 0) {
 			mArrayN = array.at(0)->getN();
@@ -298,6 +784,85 @@ public:
 		}
 		mArrayLength = mArrayN * mArrayM;
 
+		// Outputs of the previous formula nobody took
+		for(Matrix<double>& result : mResults) {
+			mArena.release(std::move(result));
+		}
+		mResults.clear();
+		if(array.size() != 0 && mZeroCopy) {
+			// The kernels read the matrices and write the results in place, nothing to copy
+			const size_t bytes = latticeAllocationBytes(sizeof(double) * mArrayLength);
+			mGlobal            = cl::NDRange(mArrayLength);
+			mBuffers           = std::vector<cl::Buffer>(array.size() + outputs);
+			for(size_t j = 0; j < outputs; j++) {
+				mResults.push_back(mArena.acquire(mArrayN, mArrayM));
+			}
+			for(size_t i = 0; i < array.size(); i++) {
+				if(array[i]->getPitch() == mArrayM) {
+					mBuffers[i] =
+						cl::Buffer(mContext, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, array[i]->getDataData());
+				} else {
+					// The kernels index packed rows, a padded matrix is copied
+					mBuffers[i] = cl::Buffer(mContext, CL_MEM_READ_ONLY, sizeof(double) * mArrayLength);
+					writeRows(mBuffers[i], *array[i]);
+				}
+			}
+			for(size_t j = 0; j < outputs; j++) {
+				mBuffers[array.size() + j] =
+					cl::Buffer(mContext, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, bytes, mResults[j].getDataData());
+			}
+		} else if(array.size() != 0) {
+			mGlobal  = cl::NDRange(mArrayLength);
+			mBuffers = std::vector<cl::Buffer>(array.size() + outputs);
+
+			// Allocate buffer memory
+#pragma omp parallel for
+			for(size_t i = 0; i < array.size(); i++) {
+				mBuffers[i] = cl::Buffer(mContext, CL_MEM_READ_ONLY, sizeof(double) * mArrayLength);
+			}
+			for(size_t i = array.size(); i < mBuffers.size(); i++) {
+				mBuffers[i] = cl::Buffer(mContext, CL_MEM_WRITE_ONLY, sizeof(double) * mArrayLength);
+			}
+
+			// Initialize buffer
+#pragma omp parallel for
+			for(size_t i = 0; i < array.size(); i++) {
+				writeRows(mBuffers[i], *array[i]);
+			}
+		}
+	}
+
+	/**
+	 * @brief Blocking copy of a matrix's storage into a buffer of packed rows, the row padding skipped by a
+	 * rectangular transfer.
+	 */
+	void writeRows(const cl::Buffer& buffer, const Matrix<double>& matrix)
+	{
+		const size_t rowBytes = sizeof(double) * matrix.getM();
+		if(matrix.getPitch() == matrix.getM()) {
+			mQueue.enqueueWriteBuffer(buffer, CL_TRUE, 0, rowBytes * matrix.getN(), matrix.getDataData());
+			return;
+		}
+		mQueue.enqueueWriteBufferRect(buffer,
+									  CL_TRUE,
+									  {0, 0, 0},
+									  {0, 0, 0},
+									  {rowBytes, matrix.getN(), 1},
+									  rowBytes,
+									  0,
+									  sizeof(double) * matrix.getPitch(),
+									  0,
+									  matrix.getDataData());
+	}
+
+	/**
+	 * @brief Upload the inputs and enqueue one kernel per operator.
+	 * @return The constant result, or the cache index of the buffer holding the result.
+	 */
+	std::variant<double, char> enqueueFormula(const std::string& expression, const std::vector<Matrix<double>*>& array)
+	{
+		upload(array, 1);
+
 		char refIndex = 'A';
 		// Check for number of variable mismatch by counting unique uppercase characters
 		std::set<char> uniqueUppercaseChars;
@@ -318,97 +883,21 @@ public:
 				"Error: Mismatch between the number of variable used in expression and the number of variable given.");
 		}
 
-		// Initialize kernels
-		auto kernelAddingArray =
-			cl::compatibility::make_kernel<cl::Buffer,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int>(cl::Kernel(mArithmeticProgram, "kernelAddingArray"));
-		auto kernelAddingConstant = cl::compatibility::
-			make_kernel<cl::Buffer, cl::Buffer, unsigned int, unsigned int, double, unsigned int, unsigned int>(
-				cl::Kernel(mArithmeticProgram, "kernelAddingConstant"));
-		auto kernelSubtractingArray =
-			cl::compatibility::make_kernel<cl::Buffer,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int>(cl::Kernel(mArithmeticProgram, "kernelSubtractingArray"));
-		auto kernelSubtractingConstant = cl::compatibility::
-			make_kernel<cl::Buffer, cl::Buffer, unsigned int, unsigned int, double, unsigned int, unsigned int>(
-				cl::Kernel(mArithmeticProgram, "kernelSubtractingConstant"));
-		auto kernelConstantSubtracting = cl::compatibility::
-			make_kernel<cl::Buffer, cl::Buffer, unsigned int, unsigned int, double, unsigned int, unsigned int>(
-				cl::Kernel(mArithmeticProgram, "kernelConstantSubtracting"));
-		auto kernelMultiplicatingArray =
-			cl::compatibility::make_kernel<cl::Buffer,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int>(cl::Kernel(mArithmeticProgram, "kernelMultiplicatingArray"));
-		auto kernelMultiplicatingConstant = cl::compatibility::
-			make_kernel<cl::Buffer, cl::Buffer, unsigned int, unsigned int, double, unsigned int, unsigned int>(
-				cl::Kernel(mArithmeticProgram, "kernelMultiplicatingConstant"));
-		auto kernelDividingByArray =
-			cl::compatibility::make_kernel<cl::Buffer,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   cl::Buffer,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int,
-										   unsigned int>(cl::Kernel(mArithmeticProgram, "kernelDividingByArray"));
-		auto kernelDividingByConstant = cl::compatibility::
-			make_kernel<cl::Buffer, cl::Buffer, unsigned int, unsigned int, double, unsigned int, unsigned int>(
-				cl::Kernel(mArithmeticProgram, "kernelDividingByConstant"));
-		auto kernelConstantDividingBy = cl::compatibility::
-			make_kernel<cl::Buffer, cl::Buffer, unsigned int, unsigned int, double, unsigned int, unsigned int>(
-				cl::Kernel(mArithmeticProgram, "kernelConstantDividingBy"));
-
-		// Initialize parameter
-		if(array.size() != 0) {
-			mQueue   = cl::CommandQueue(mContext, mDevice);
-			mGlobal  = cl::NDRange(mArrayLength);
-			mBuffers = std::vector<cl::Buffer>(array.size() + 1);
-			
-			// Allocate buffer memory
-#pragma omp parallel for
-			for(size_t i = 0; i < array.size(); i++) {
-				mBuffers[i] = cl::Buffer(mContext, CL_MEM_READ_ONLY, sizeof(double) * mArrayLength);
-			}
-			mBuffers[array.size()] = cl::Buffer(mContext, CL_MEM_WRITE_ONLY, sizeof(double) * mArrayLength);
-
-			// Initialize buffer
-#pragma omp parallel for
-			for(size_t i = 0; i < array.size(); i++) {
-				mQueue.enqueueWriteBuffer(mBuffers[i],
-										  CL_TRUE,
-										  0,
-										  sizeof(double) * mArrayLength,
-										  array[i]->getDataData());
-			}
-		}
-
 		// set for tracking cache index
 		mAvailableCacheIndex.clear();
 		mAvailableCacheIndex.insert('A' + array.size());
 		mNewCacheIndex = 'A' + array.size() + 1;
 
 		// Forming the post fix queue
-		std::queue<std::string> mPostfixNotationQueue = enqueueArithmeticFormula(expression);
+		std::queue<std::string> mPostfixNotationQueue = OpenCLMain::enqueueArithmeticFormula(expression);
+
+		// Functions and the unary minus have no operator kernel, such formulas run as one generated kernel
+		std::queue<std::string> tokens = mPostfixNotationQueue;
+		for(; !tokens.empty(); tokens.pop()) {
+			if(OpenCLMain::formulaFunctions().count(tokens.front()) != 0) {
+				return enqueueFusedFormulas({mPostfixNotationQueue}, array)[0];
+			}
+		}
 
 		// Stack for evaluation
 		std::stack<std::variant<double, char>> evalStack;
@@ -417,7 +906,7 @@ public:
 		while(!mPostfixNotationQueue.empty()) {
 			std::string token = mPostfixNotationQueue.front();
 			mPostfixNotationQueue.pop();
-			if(isDouble(token)) {
+			if(OpenCLMain::isDouble(token)) {
 				// std::cout << "Push " << token << "\n";
 				evalStack.push(std::stod(token));
 			} else if(token.size() == 1 && isupper(token[0])) {
@@ -439,14 +928,14 @@ public:
 				} else if(std::holds_alternative<char>(first) && std::holds_alternative<double>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(first) - 'A';
-					kernelAddingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-										 mBuffers[cacheChar - 'A'],
-										 mBuffers[charIndex],
-										 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-										 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-										 std::get<double>(second),
-										 mArrayN,
-										 mArrayM)
+					mAddingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+									mBuffers[cacheChar - 'A'],
+									mBuffers[charIndex],
+									charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+									charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+									std::get<double>(second),
+									mArrayN,
+									mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -456,14 +945,14 @@ public:
 				} else if(std::holds_alternative<double>(first) && std::holds_alternative<char>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(second) - 'A';
-					kernelAddingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-										 mBuffers[cacheChar - 'A'],
-										 mBuffers[charIndex],
-										 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-										 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-										 std::get<double>(first),
-										 mArrayN,
-										 mArrayM)
+					mAddingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+									mBuffers[cacheChar - 'A'],
+									mBuffers[charIndex],
+									charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+									charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+									std::get<double>(first),
+									mArrayN,
+									mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -474,16 +963,16 @@ public:
 					char         cacheChar  = getCacheIndex();
 					unsigned int charIndex1 = std::get<char>(first) - 'A';
 					unsigned int charIndex2 = std::get<char>(second) - 'A';
-					kernelAddingArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-									  mBuffers[cacheChar - 'A'],
-									  mBuffers[charIndex1],
-									  charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
-									  charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
-									  mBuffers[charIndex2],
-									  charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
-									  charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
-									  mArrayN,
-									  mArrayM)
+					mAddingArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+								 mBuffers[cacheChar - 'A'],
+								 mBuffers[charIndex1],
+								 charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
+								 charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
+								 mBuffers[charIndex2],
+								 charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
+								 charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
+								 mArrayN,
+								 mArrayM)
 						.wait();
 					if(charIndex1 >= array.size())
 					{
@@ -511,14 +1000,14 @@ public:
 				} else if(std::holds_alternative<char>(first) && std::holds_alternative<double>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(first) - 'A';
-					kernelSubtractingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-											  mBuffers[cacheChar - 'A'],
-											  mBuffers[charIndex],
-											  charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-											  charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-											  std::get<double>(second),
-											  mArrayN,
-											  mArrayM)
+					mSubtractingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+										 mBuffers[cacheChar - 'A'],
+										 mBuffers[charIndex],
+										 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+										 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+										 std::get<double>(second),
+										 mArrayN,
+										 mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -528,14 +1017,14 @@ public:
 				} else if(std::holds_alternative<double>(first) && std::holds_alternative<char>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(second) - 'A';
-					kernelConstantSubtracting(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-											  mBuffers[cacheChar - 'A'],
-											  mBuffers[charIndex],
-											  charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-											  charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-											  std::get<double>(first),
-											  mArrayN,
-											  mArrayM)
+					mConstantSubtracting(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+										 mBuffers[cacheChar - 'A'],
+										 mBuffers[charIndex],
+										 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+										 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+										 std::get<double>(first),
+										 mArrayN,
+										 mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -546,16 +1035,16 @@ public:
 					char         cacheChar  = getCacheIndex();
 					unsigned int charIndex1 = std::get<char>(first) - 'A';
 					unsigned int charIndex2 = std::get<char>(second) - 'A';
-					kernelSubtractingArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-										   mBuffers[cacheChar - 'A'],
-										   mBuffers[charIndex1],
-										   charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
-										   charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
-										   mBuffers[charIndex2],
-										   charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
-										   charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
-										   mArrayN,
-										   mArrayM)
+					mSubtractingArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+									  mBuffers[cacheChar - 'A'],
+									  mBuffers[charIndex1],
+									  charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
+									  charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
+									  mBuffers[charIndex2],
+									  charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
+									  charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
+									  mArrayN,
+									  mArrayM)
 						.wait();
 					if(charIndex1 >= array.size())
 					{
@@ -583,14 +1072,14 @@ public:
 				} else if(std::holds_alternative<char>(first) && std::holds_alternative<double>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(first) - 'A';
-					kernelMultiplicatingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-												 mBuffers[cacheChar - 'A'],
-												 mBuffers[charIndex],
-												 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-												 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-												 std::get<double>(second),
-												 mArrayN,
-												 mArrayM)
+					mMultiplicatingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+											mBuffers[cacheChar - 'A'],
+											mBuffers[charIndex],
+											charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+											charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+											std::get<double>(second),
+											mArrayN,
+											mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -600,14 +1089,14 @@ public:
 				} else if(std::holds_alternative<double>(first) && std::holds_alternative<char>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(second) - 'A';
-					kernelMultiplicatingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-												 mBuffers[cacheChar - 'A'],
-												 mBuffers[charIndex],
-												 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-												 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-												 std::get<double>(first),
-												 mArrayN,
-												 mArrayM)
+					mMultiplicatingConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+											mBuffers[cacheChar - 'A'],
+											mBuffers[charIndex],
+											charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+											charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+											std::get<double>(first),
+											mArrayN,
+											mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -618,16 +1107,16 @@ public:
 					char         cacheChar  = getCacheIndex();
 					unsigned int charIndex1 = std::get<char>(first) - 'A';
 					unsigned int charIndex2 = std::get<char>(second) - 'A';
-					kernelMultiplicatingArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-											  mBuffers[cacheChar - 'A'],
-											  mBuffers[charIndex1],
-											  charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
-											  charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
-											  mBuffers[charIndex2],
-											  charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
-											  charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
-											  mArrayN,
-											  mArrayM)
+					mMultiplicatingArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+										 mBuffers[cacheChar - 'A'],
+										 mBuffers[charIndex1],
+										 charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
+										 charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
+										 mBuffers[charIndex2],
+										 charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
+										 charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
+										 mArrayN,
+										 mArrayM)
 						.wait();
 					if(charIndex1 >= array.size())
 					{
@@ -655,14 +1144,14 @@ public:
 				} else if(std::holds_alternative<char>(first) && std::holds_alternative<double>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(first) - 'A';
-					kernelDividingByConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-											 mBuffers[cacheChar - 'A'],
-											 mBuffers[charIndex],
-											 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-											 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-											 std::get<double>(second),
-											 mArrayN,
-											 mArrayM)
+					mDividingByConstant(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+										mBuffers[cacheChar - 'A'],
+										mBuffers[charIndex],
+										charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+										charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+										std::get<double>(second),
+										mArrayN,
+										mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -672,14 +1161,14 @@ public:
 				} else if(std::holds_alternative<double>(first) && std::holds_alternative<char>(second)) {
 					char         cacheChar = getCacheIndex();
 					unsigned int charIndex = std::get<char>(second) - 'A';
-					kernelConstantDividingBy(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-											 mBuffers[cacheChar - 'A'],
-											 mBuffers[charIndex],
-											 charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
-											 charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
-											 std::get<double>(first),
-											 mArrayN,
-											 mArrayM)
+					mConstantDividingBy(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+										mBuffers[cacheChar - 'A'],
+										mBuffers[charIndex],
+										charIndex < array.size() ? array.at(charIndex)->getRowShiftIndex() : 0,
+										charIndex < array.size() ? array.at(charIndex)->getColShiftIndex() : 0,
+										std::get<double>(first),
+										mArrayN,
+										mArrayM)
 						.wait();
 					if(charIndex >= array.size())
 					{
@@ -690,16 +1179,16 @@ public:
 					char         cacheChar  = getCacheIndex();
 					unsigned int charIndex1 = std::get<char>(first) - 'A';
 					unsigned int charIndex2 = std::get<char>(second) - 'A';
-					kernelDividingByArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
-										  mBuffers[cacheChar - 'A'],
-										  mBuffers[charIndex1],
-										  charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
-										  charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
-										  mBuffers[charIndex2],
-										  charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
-										  charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
-										  mArrayN,
-										  mArrayM)
+					mDividingByArray(cl::EnqueueArgs(mQueue, mGlobal, mLocal),
+									 mBuffers[cacheChar - 'A'],
+									 mBuffers[charIndex1],
+									 charIndex1 < array.size() ? array.at(charIndex1)->getRowShiftIndex() : 0,
+									 charIndex1 < array.size() ? array.at(charIndex1)->getColShiftIndex() : 0,
+									 mBuffers[charIndex2],
+									 charIndex2 < array.size() ? array.at(charIndex2)->getRowShiftIndex() : 0,
+									 charIndex2 < array.size() ? array.at(charIndex2)->getColShiftIndex() : 0,
+									 mArrayN,
+									 mArrayM)
 						.wait();
 					if(charIndex1 >= array.size())
 					{
@@ -718,38 +1207,216 @@ public:
 
 		// Final result
 		if(!evalStack.empty()) {
-			Matrix<double>             result;
-			std::variant<double, char> resultVal = evalStack.top();
-			if(std::holds_alternative<char>(resultVal)) {
-				result = Matrix<double>(mArrayN, mArrayM);
-				mQueue.enqueueReadBuffer(mBuffers[std::get<char>(resultVal) - 'A'],
-										 CL_TRUE,
-										 0,
-										 sizeof(double) * mArrayLength,
-										 result.getDataData());
-			} else {
-				result = Matrix<double>(1, 1, std::vector<double>{std::get<double>(resultVal)});
-			}
-			return result;
+			return evalStack.top();
 		} else {
 			throw std::runtime_error("Unknown error, result stack empty.");
 		}
 	}
 
-private:
-	static bool isDouble(const std::string& token)
+	/**
+	 * @brief OpenCL C of a postfix formula. Every input and every subexpression becomes a variable declared in body,
+	 * unless the same code was declared before: declared maps code to variable name, shared by all the formulas of
+	 * one kernel so repeated subexpressions are computed once. Subexpressions of constants are folded on the host.
+	 * @return The constant value, or the variable holding the result.
+	 */
+	static std::variant<double, std::string> compileFormula(std::queue<std::string>             postfix,
+															size_t                              inputs,
+															std::string&                        body,
+															std::map<std::string, std::string>& declared)
 	{
-		try {
-			std::stod(token);
-			return true;
-		} catch(const std::invalid_argument&) {
-			return false;
-		} catch(const std::out_of_range&) {
-			return false;
+		using Operand = std::variant<double, std::string>;
+
+		const auto&         functions = OpenCLMain::formulaFunctions();
+		std::stack<Operand> operands;
+
+		auto pop = [&operands]() {
+			if(operands.empty()) {
+				throw std::invalid_argument("Formula is missing an operand.");
+			}
+			Operand operand = operands.top();
+			operands.pop();
+			return operand;
+		};
+		// Literals always carry a decimal point, so the built-ins resolve to their double overload
+		auto code = [](const Operand& operand) -> std::string {
+			if(std::holds_alternative<std::string>(operand)) {
+				return std::get<std::string>(operand);
+			}
+			double value = std::get<double>(operand);
+			if(std::isnan(value)) {
+				return "NAN";
+			}
+			if(std::isinf(value)) {
+				return value > 0 ? "INFINITY" : "(-INFINITY)";
+			}
+			char number[32];
+			std::snprintf(number, sizeof(number), "%.17g", value);
+			std::string literal = number;
+			if(literal.find_first_of(".e") == std::string::npos) {
+				literal += ".0";
+			}
+			return "(" + literal + ")";
+		};
+		auto declare = [&body, &declared](const std::string& code) {
+			auto found = declared.find(code);
+			if(found != declared.end()) {
+				return found->second;
+			}
+			std::string name = "t" + std::to_string(declared.size());
+			body += "\tdouble " + name + " = " + code + ";\n";
+			declared.emplace(code, name);
+			return name;
+		};
+
+		for(; !postfix.empty(); postfix.pop()) {
+			const std::string& token = postfix.front();
+			if(OpenCLMain::isDouble(token)) {
+				operands.push(std::stod(token));
+			} else if(token.size() == 1 && isupper(token[0])) {
+				if(size_t(token[0] - 'A') >= inputs) {
+					throw std::invalid_argument("Formula refers to " + token + ", which was not given.");
+				}
+				operands.push(declare("in" + token + "[((row + shift" + token + "Row) % N) * M + (col + M - shift" +
+									  token + "Col) % M]"));
+			} else if(token.size() == 1 && std::string("+-*/").find(token[0]) != std::string::npos) {
+				Operand second = pop();
+				Operand first  = pop();
+				if(std::holds_alternative<double>(first) && std::holds_alternative<double>(second)) {
+					double a = std::get<double>(first);
+					double b = std::get<double>(second);
+					operands.push(token == "+" ? a + b : (token == "-" ? a - b : (token == "*" ? a * b : a / b)));
+				} else if(token == "/") {
+					operands.push(declare("divide(" + code(first) + ", " + code(second) + ")"));
+				} else {
+					operands.push(declare(code(first) + " " + token + " " + code(second)));
+				}
+			} else if(functions.count(token) != 0) {
+				const OpenCLMain::FormulaFunction& function = functions.at(token);
+				std::vector<Operand>               arguments(function.arity);
+				bool                               constant = true;
+				for(unsigned int i = function.arity; i > 0; i--) {
+					arguments[i - 1] = pop();
+					constant         = constant && std::holds_alternative<double>(arguments[i - 1]);
+				}
+				if(constant) {
+					double values[3];
+					for(unsigned int i = 0; i < function.arity; i++) {
+						values[i] = std::get<double>(arguments[i]);
+					}
+					operands.push(function.host(values));
+				} else if(token == "neg") {
+					operands.push(declare("-" + code(arguments[0])));
+				} else {
+					std::string call = std::string(function.builtin) + "(";
+					for(unsigned int i = 0; i < function.arity; i++) {
+						call += (i == 0 ? "" : ", ") + code(arguments[i]);
+					}
+					operands.push(declare(call + ")"));
+				}
+			} else {
+				throw std::invalid_argument("Unknown token in formula: " + token + ".");
+			}
+		}
+		Operand result = pop();
+		if(!operands.empty()) {
+			throw std::invalid_argument("Formula has more operands than operators.");
+		}
+		return result;
+	}
+
+	/**
+	 * @brief Compile postfix formulas into a single kernel and enqueue it once, formula j writing buffer
+	 * array.size() + j.
+	 *
+	 * Operators become OpenCL C operators and functions their built-ins, so all the formulas take one pass over the
+	 * lattice, each input read once per element. A division by zero gives 0 like the operator kernels. Programs are
+	 * cached by source: the shifts are kernel arguments, so a set of formulas builds once however its inputs are
+	 * shifted.
+	 * @return Per formula the constant result, or the cache index of the buffer holding the result.
+	 */
+	std::vector<std::variant<double, char>> enqueueFusedFormulas(const std::vector<std::queue<std::string>>& postfixes,
+																 const std::vector<Matrix<double>*>&         array)
+	{
+		std::string                             body;
+		std::map<std::string, std::string>      declared;
+		std::vector<std::variant<double, char>> results;
+		std::string                             parameters;
+		std::string                             writes;
+		std::vector<size_t>                     outputs;
+		for(size_t j = 0; j < postfixes.size(); j++) {
+			std::variant<double, std::string> result = compileFormula(postfixes[j], array.size(), body, declared);
+			if(std::holds_alternative<double>(result)) {
+				results.push_back(std::get<double>(result));
+				continue;
+			}
+			const std::string name = "R" + std::to_string(outputs.size());
+			parameters += ", global double* " + name;
+			writes += "\t" + name + "[i] = " + std::get<std::string>(result) + ";\n";
+			results.push_back(char('A' + array.size() + j));
+			outputs.push_back(array.size() + j);
+		}
+		if(outputs.empty()) {
+			return results;
+		}
+
+		for(size_t j = 0; j < array.size(); j++) {
+			const std::string name(1, char('A' + j));
+			parameters += ", global const double* in" + name + ", const unsigned int shift" + name +
+						  "Row, const unsigned int shift" + name + "Col";
+		}
+		const std::string source = "#pragma OPENCL FP_CONTRACT OFF\n"
+								   "double divide(double a, double b) {\n"
+								   "\treturn b != 0 ? a / b : 0;\n"
+								   "}\n"
+								   "kernel void kernelFormula(const unsigned int N, const unsigned int M" +
+								   parameters +
+								   ") {\n"
+								   "\tunsigned int i = get_global_id(0);\n"
+								   "\tunsigned int row = i / M;\n"
+								   "\tunsigned int col = i % M;\n" +
+								   body + writes + "}\n";
+
+		// The program is cached by source, keep its kernel as well so a step loop only sets the arguments
+		auto found = mFormulaKernels.find(source);
+		if(found == mFormulaKernels.end()) {
+			cl::Kernel built(OpenCLMain::buildProgram(source), "kernelFormula");
+			found = mFormulaKernels.emplace(source, built).first;
+		}
+		cl::Kernel& kernel   = found->second;
+		cl_uint     argument = 0;
+		kernel.setArg(argument++, mArrayN);
+		kernel.setArg(argument++, mArrayM);
+		for(size_t output : outputs) {
+			kernel.setArg(argument++, mBuffers[output]);
+		}
+		for(size_t j = 0; j < array.size(); j++) {
+			kernel.setArg(argument++, mBuffers[j]);
+			kernel.setArg(argument++, array[j]->getRowShiftIndex());
+			kernel.setArg(argument++, array[j]->getColShiftIndex());
+		}
+		mQueue.enqueueNDRangeKernel(kernel, cl::NullRange, mGlobal, mLocal);
+		return results;
+	}
+
+	/**
+	 * @brief The matrix held by buffer index. Zero-copy outputs already live in a matrix, mapping the buffer makes
+	 * the kernel's writes visible there; other buffers are read back.
+	 */
+	Matrix<double> readResult(size_t index, size_t inputs)
+	{
+		if(index >= inputs && index - inputs < mResults.size()) {
+			void* mapped =
+				mQueue.enqueueMapBuffer(mBuffers[index], CL_TRUE, CL_MAP_READ, 0, sizeof(double) * mArrayLength);
+			mQueue.enqueueUnmapMemObject(mBuffers[index], mapped);
+			mBuffers[index] = cl::Buffer();
+			return std::move(mResults[index - inputs]);
 		}
+		Matrix<double> result = mArena.acquire(mArrayN, mArrayM);
+		mQueue.enqueueReadBuffer(mBuffers[index], CL_TRUE, 0, sizeof(double) * mArrayLength, result.getDataData());
+		return result;
 	}
 
-	static char getCacheIndex()
+	char getCacheIndex()
 	{
 		char index;
 		if(!mAvailableCacheIndex.empty()) {
@@ -764,4 +1431,35 @@ private:
 	}
 };
 
+inline Matrix<double> OpenCLMain::evaluateArithmeticFormula(const std::string&                  expression,
+															 const std::vector<Matrix<double>*>& array)
+{
+	return defaultStream().evaluateArithmeticFormula(expression, array);
+}
+
+inline std::map<std::string, Matrix<double>> OpenCLMain::evaluateArithmeticFormulas(
+	const std::vector<std::pair<std::string, std::string>>& formulas,
+	const std::vector<Matrix<double>*>&                     array)
+{
+	return defaultStream().evaluateArithmeticFormulas(formulas, array);
+}
+
+inline double OpenCLMain::evaluateArithmeticReduction(Reduction                           operation,
+													  const std::string&                  expression,
+													  const std::vector<Matrix<double>*>& array)
+{
+	return defaultStream().evaluateArithmeticReduction(operation, expression, array);
+}
+
+inline double OpenCLMain::reduce(Reduction operation, Matrix<double>& matrix)
+{
+	return defaultStream().reduce(operation, matrix);
+}
+
+inline OpenCLStream& OpenCLMain::defaultStream()
+{
+	thread_local OpenCLStream stream;
+	return stream;
+}
+
 #endif  // OPENCL_MAIN
\ No newline at end of file
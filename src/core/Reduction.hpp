@@ -0,0 +1,99 @@
+#ifndef REDUCTION
+#define REDUCTION
+
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include <omp.h>
+
+/**
+ * @brief Reductions of a whole field to one value, shared by the OpenCL kernels and the CPU backend.
+ *
+ * The numeric values are passed to the kernels, keep them in sync with kernelReduce in OpenCLMain.
+ */
+enum class Reduction { SUM = 0, MIN = 1, MAX = 2, L2 = 3 };
+
+/**
+ * @brief Value that leaves any element unchanged when combined with it.
+ */
+inline double reductionIdentity(Reduction operation)
+{
+	switch(operation) {
+	case Reduction::MIN: return std::numeric_limits<double>::infinity();
+	case Reduction::MAX: return -std::numeric_limits<double>::infinity();
+	default: return 0;
+	}
+}
+
+/**
+ * @brief Reduce length values on the host with one OpenMP reduction, value i being data[index(i)].
+ */
+template<typename Index>
+inline double reduceIndexed(Reduction operation, const double* data, size_t length, Index index)
+{
+	double result = reductionIdentity(operation);
+	switch(operation) {
+	case Reduction::SUM:
+#pragma omp parallel for reduction(+ : result) schedule(static)
+		for(size_t i = 0; i < length; i++) {
+			result += data[index(i)];
+		}
+		break;
+	case Reduction::MIN:
+#pragma omp parallel for reduction(min : result) schedule(static)
+		for(size_t i = 0; i < length; i++) {
+			result = std::fmin(result, data[index(i)]);
+		}
+		break;
+	case Reduction::MAX:
+#pragma omp parallel for reduction(max : result) schedule(static)
+		for(size_t i = 0; i < length; i++) {
+			result = std::fmax(result, data[index(i)]);
+		}
+		break;
+	case Reduction::L2:
+#pragma omp parallel for reduction(+ : result) schedule(static)
+		for(size_t i = 0; i < length; i++) {
+			result += data[index(i)] * data[index(i)];
+		}
+		result = std::sqrt(result);
+		break;
+	}
+	return result;
+}
+
+/**
+ * @brief Reduce length contiguous values on the host.
+ */
+inline double reduceValues(Reduction operation, const double* data, size_t length)
+{
+	return reduceIndexed(operation, data, length, [](size_t i) { return i; });
+}
+
+/**
+ * @brief Reduce rows x columns values stored with rows pitch elements apart, the padding left out. Same partition
+ * and summation order as reduceValues() over the unpadded values.
+ */
+inline double reduceRows(Reduction operation, const double* data, size_t rows, size_t columns, size_t pitch)
+{
+	if(pitch == columns) {
+		return reduceValues(operation, data, rows * columns);
+	}
+	return reduceIndexed(operation, data, rows * columns, [columns, pitch](size_t i) {
+		return i / columns * pitch + i % columns;
+	});
+}
+
+/**
+ * @brief Reduction of length copies of one value, used when a formula folds to a constant.
+ */
+inline double reduceConstant(Reduction operation, double value, size_t length)
+{
+	switch(operation) {
+	case Reduction::SUM: return value * length;
+	case Reduction::L2: return std::fabs(value) * std::sqrt(static_cast<double>(length));
+	default: return value;
+	}
+}
+#endif  // REDUCTION
@@ -0,0 +1,477 @@
+#ifndef SHM_COMMUNICATOR
+#define SHM_COMMUNICATOR
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Communicator.hpp"
+
+/**
+ * @brief Communicator for ranks running as processes on one Linux machine.
+ *
+ * All ranks map one POSIX shared memory segment holding a single-producer single-consumer byte ring for every
+ * ordered pair of ranks. A message is a 16 byte header (tag, count) followed by its values and is streamed through
+ * the ring, so messages larger than the ring are fine. Waiting ranks spin with a yield.
+ *
+ * A receive takes the oldest message from its source with its tag. Messages are read off a ring while a receive from
+ * that source is outstanding, one that no posted receive matches is copied into this rank's memory until one does.
+ *
+ * The segment is set up once with create() before the ranks start, each rank then opens it with its rank number,
+ * and it is removed with unlink() when the run is over. Ranks are normally separate processes, started by a launcher
+ * or forked before OpenMP is first used (the GNU OpenMP runtime does not survive a fork); threads of one process work
+ * as well.
+ */
+class ShmCommunicator: public Communicator
+{
+	static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Ring counters must be lock free across processes.");
+
+	static inline constexpr char   MAGIC[8]    = "D2Q9SHM";
+	static inline constexpr size_t ALIGNMENT   = 64;
+	static inline constexpr size_t HEADER_SIZE = 16;  // int32 tag, uint32 padding, uint64 count
+
+	struct Header {
+		char                       magic[8];
+		std::uint32_t              size;
+		std::uint32_t              reserved;
+		std::uint64_t              ringBytes;
+		std::atomic<std::uint32_t> arrived;  // barrier
+		std::atomic<std::uint32_t> generation;
+	};
+
+	// Total bytes written and read, each on its own cache line
+	struct RingControl {
+		alignas(ALIGNMENT) std::atomic<std::uint64_t> head;
+		alignas(ALIGNMENT) std::atomic<std::uint64_t> tail;
+	};
+
+	// One message in flight, position counts header and payload bytes together
+	struct Transfer {
+		char   header[HEADER_SIZE];
+		char*  data;
+		size_t bytes;
+		size_t position;
+		int    tag;
+	};
+
+	struct PendingRequest {
+		Request  id;
+		bool     sending;
+		int      peer;
+		bool     complete;
+		Transfer transfer;
+		bool     matched;  // receives: a message being read or held is theirs
+	};
+
+	// A message read before a receive matching it was posted
+	struct HeldMessage {
+		int                 source;
+		int                 tag;
+		std::vector<double> values;
+		bool                complete;
+		bool                claimed;
+		Request             receive;  // when claimed
+	};
+
+	// The message being read off the ring from one source, into its receive or into a held message
+	struct Incoming {
+		char                             header[HEADER_SIZE];
+		size_t                           position;  // 0 between messages
+		size_t                           bytes;
+		char*                            data;
+		bool                             held;
+		Request                          receive;  // when not held
+		std::list<HeldMessage>::iterator message;  // when held
+	};
+
+private:
+	void*        mMapping;
+	size_t       mSize;
+	Header*      mHeader;
+	RingControl* mControls;
+	char*        mRings;
+	size_t       mRingBytes;
+	int          mRank;
+	int          mRankCount;
+
+private:  // Outstanding requests of this rank, in the order they were posted
+	std::vector<PendingRequest> mRequests;
+	Request                     mNextRequest;
+	std::vector<Incoming>       mIncoming;  // by source
+	std::list<HeldMessage>      mHeld;      // in arrival order
+
+public:
+	/**
+	 * @brief Create and initialise the shared segment, once per run, before any rank opens it.
+	 * @param name POSIX shared memory name, starting with '/'.
+	 * @param ringBytes Capacity of each of the size * size rings.
+	 */
+	static void create(const std::string& name, int size, size_t ringBytes = 1 << 20)
+	{
+		if(size <= 0 || ringBytes < HEADER_SIZE) {
+			throw std::invalid_argument("Communicator size and ring capacity must be positive.");
+		}
+		ringBytes      = (ringBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		int descriptor = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if(descriptor < 0) {
+			throw std::runtime_error("Unable to create shared memory " + name);
+		}
+		size_t segmentSize = dataOffset(size) + static_cast<size_t>(size) * size * ringBytes;
+		void*  mapping     = MAP_FAILED;
+		if(::ftruncate(descriptor, segmentSize) == 0) {
+			mapping = ::mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		}
+		::close(descriptor);
+		if(mapping == MAP_FAILED) {
+			::shm_unlink(name.c_str());
+			throw std::runtime_error("Unable to map shared memory " + name);
+		}
+
+		Header* header = new(mapping) Header();
+		header->size      = size;
+		header->ringBytes = ringBytes;
+		RingControl* controls = reinterpret_cast<RingControl*>(static_cast<char*>(mapping) + controlOffset());
+		for(int i = 0; i < size * size; i++) {
+			new(controls + i) RingControl();
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+		::munmap(mapping, segmentSize);
+	}
+
+	static void unlink(const std::string& name)
+	{
+		::shm_unlink(name.c_str());
+	}
+
+	ShmCommunicator(const std::string& name, int rank): mMapping(MAP_FAILED), mSize(0), mRank(rank), mNextRequest(0)
+	{
+		int descriptor = ::shm_open(name.c_str(), O_RDWR, 0600);
+		if(descriptor < 0) {
+			throw std::runtime_error("Unable to open shared memory " + name);
+		}
+		struct stat status;
+		if(::fstat(descriptor, &status) == 0) {
+			mSize = status.st_size;
+		}
+		if(mSize >= dataOffset(1)) {
+			mMapping = ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		}
+		::close(descriptor);
+		if(mMapping == MAP_FAILED) {
+			throw std::runtime_error("Unable to map shared memory " + name);
+		}
+
+		mHeader = static_cast<Header*>(mMapping);
+		if(std::memcmp(mHeader->magic, MAGIC, sizeof(MAGIC)) != 0) {
+			::munmap(mMapping, mSize);
+			throw std::runtime_error("Not a communicator segment: " + name);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		mRankCount = mHeader->size;
+		mRingBytes = mHeader->ringBytes;
+		if(rank < 0 || rank >= mRankCount) {
+			::munmap(mMapping, mSize);
+			throw std::invalid_argument("Rank out of range.");
+		}
+		mControls = reinterpret_cast<RingControl*>(static_cast<char*>(mMapping) + controlOffset());
+		mRings    = static_cast<char*>(mMapping) + dataOffset(mRankCount);
+		mIncoming.assign(mRankCount, Incoming{{}, 0, 0, nullptr, false, 0, mHeld.end()});
+	}
+
+	~ShmCommunicator() override
+	{
+		::munmap(mMapping, mSize);
+	}
+
+	ShmCommunicator(ShmCommunicator const&)            = delete;
+	ShmCommunicator& operator=(ShmCommunicator const&) = delete;
+
+	int getRank() const override
+	{
+		return mRank;
+	}
+
+	int getSize() const override
+	{
+		return mRankCount;
+	}
+
+	Request isend(const double* buffer, size_t count, int destination, int tag) override
+	{
+		return post(true, destination, const_cast<double*>(buffer), count, tag);
+	}
+
+	Request ireceive(double* buffer, size_t count, int source, int tag) override
+	{
+		return post(false, source, buffer, count, tag);
+	}
+
+	bool test(Request request) override
+	{
+		progress();
+		for(size_t i = 0; i < mRequests.size(); i++) {
+			if(mRequests[i].id == request) {
+				if(!mRequests[i].complete) {
+					return false;
+				}
+				mRequests.erase(mRequests.begin() + i);
+				return true;
+			}
+		}
+		throw std::invalid_argument("Unknown communicator request.");
+	}
+
+	void barrier() override
+	{
+		std::uint32_t generation = mHeader->generation.load(std::memory_order_acquire);
+		if(mHeader->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == static_cast<std::uint32_t>(mRankCount)) {
+			mHeader->arrived.store(0, std::memory_order_relaxed);
+			mHeader->generation.fetch_add(1, std::memory_order_release);
+			return;
+		}
+		while(mHeader->generation.load(std::memory_order_acquire) == generation) {
+			std::this_thread::yield();
+		}
+	}
+
+private:
+	static size_t controlOffset()
+	{
+		return (sizeof(Header) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	}
+
+	static size_t dataOffset(int size)
+	{
+		return controlOffset() + static_cast<size_t>(size) * size * sizeof(RingControl);
+	}
+
+	Request post(bool sending, int peer, double* buffer, size_t count, int tag)
+	{
+		checkRank(peer);
+		mRequests.push_back(
+			PendingRequest{mNextRequest, sending, peer, false, makeTransfer(buffer, count, tag), false});
+		progress();  // a message that fits into the ring is on its way right away
+		return mNextRequest++;
+	}
+
+	/**
+	 * @brief Advance the oldest incomplete send on every ring, messages on one ring must not interleave, and read
+	 * every ring a receive is waiting on.
+	 */
+	void progress()
+	{
+		std::vector<int> busy;
+		for(PendingRequest& request : mRequests) {
+			if(!request.sending || request.complete ||
+			   std::find(busy.begin(), busy.end(), request.peer) != busy.end()) {
+				continue;
+			}
+			request.complete = progressSend(request.peer, request.transfer);
+			if(!request.complete) {
+				busy.push_back(request.peer);
+			}
+		}
+
+		for(PendingRequest& request : mRequests) {
+			if(!request.sending && !request.matched) {
+				claimHeld(request);
+			}
+		}
+		for(int source = 0; source < mRankCount; source++) {
+			if(mIncoming[source].position > 0 || isExpecting(source)) {
+				progressReceive(source);
+			}
+		}
+	}
+
+	/**
+	 * @brief Give the receive the oldest held message from its source with its tag, if there is one.
+	 */
+	void claimHeld(PendingRequest& request)
+	{
+		for(auto message = mHeld.begin(); message != mHeld.end(); ++message) {
+			if(message->claimed || message->source != request.peer || message->tag != request.transfer.tag) {
+				continue;
+			}
+			checkCount(request, message->values.size());
+			request.matched  = true;
+			message->claimed = true;
+			message->receive = request.id;
+			if(message->complete) {
+				deliver(message);
+			}
+			return;
+		}
+	}
+
+	void deliver(std::list<HeldMessage>::iterator message)
+	{
+		PendingRequest& request = findRequest(message->receive);
+		std::memcpy(request.transfer.data, message->values.data(), request.transfer.bytes);
+		request.complete = true;
+		mHeld.erase(message);
+	}
+
+	bool isExpecting(int source) const
+	{
+		for(const PendingRequest& request : mRequests) {
+			if(!request.sending && !request.matched && request.peer == source) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	PendingRequest& findRequest(Request id)
+	{
+		for(PendingRequest& request : mRequests) {
+			if(request.id == id) {
+				return request;
+			}
+		}
+		throw std::invalid_argument("Unknown communicator request.");
+	}
+
+	void checkCount(const PendingRequest& request, size_t count) const
+	{
+		if(sizeof(double) * count != request.transfer.bytes) {
+			throw std::runtime_error("Message from rank " + std::to_string(request.peer) + " with tag " +
+									 std::to_string(request.transfer.tag) + " has " + std::to_string(count) +
+									 " values, expected " + std::to_string(request.transfer.bytes / sizeof(double)));
+		}
+	}
+
+	static Transfer makeTransfer(double* buffer, size_t count, int tag)
+	{
+		Transfer      transfer;
+		std::int32_t  tag32   = tag;
+		std::uint32_t padding = 0;
+		std::uint64_t count64 = count;
+		std::memcpy(transfer.header, &tag32, sizeof(tag32));
+		std::memcpy(transfer.header + 4, &padding, sizeof(padding));
+		std::memcpy(transfer.header + 8, &count64, sizeof(count64));
+		transfer.data     = reinterpret_cast<char*>(buffer);
+		transfer.bytes    = sizeof(double) * count;
+		transfer.position = 0;
+		transfer.tag      = tag;
+		return transfer;
+	}
+
+	/**
+	 * @brief Copy as much of the message as fits into the ring from this rank to destination.
+	 * @return true once the whole message is in the ring.
+	 */
+	bool progressSend(int destination, Transfer& transfer)
+	{
+		RingControl&  control = mControls[mRank * mRankCount + destination];
+		char*         ring    = mRings + (static_cast<size_t>(mRank) * mRankCount + destination) * mRingBytes;
+		std::uint64_t head    = control.head.load(std::memory_order_relaxed);
+		size_t        space   = mRingBytes - (head - control.tail.load(std::memory_order_acquire));
+		size_t        total   = HEADER_SIZE + transfer.bytes;
+
+		while(space > 0 && transfer.position < total) {
+			const char* source    = transfer.position < HEADER_SIZE ? transfer.header + transfer.position
+																	: transfer.data + transfer.position - HEADER_SIZE;
+			size_t      available = transfer.position < HEADER_SIZE ? HEADER_SIZE - transfer.position
+																	: total - transfer.position;
+			size_t      length    = std::min({available, space, mRingBytes - head % mRingBytes});
+			std::memcpy(ring + head % mRingBytes, source, length);
+			head += length;
+			space -= length;
+			transfer.position += length;
+		}
+		control.head.store(head, std::memory_order_release);
+		return transfer.position == total;
+	}
+
+	/**
+	 * @brief Read whatever has arrived from source, as long as a receive from there is waiting or a message is
+	 * partly read. A message goes to the oldest posted receive with its tag, or is held.
+	 */
+	void progressReceive(int source)
+	{
+		RingControl&  control  = mControls[source * mRankCount + mRank];
+		char*         ring     = mRings + (static_cast<size_t>(source) * mRankCount + mRank) * mRingBytes;
+		std::uint64_t tail     = control.tail.load(std::memory_order_relaxed);
+		size_t        filled   = control.head.load(std::memory_order_acquire) - tail;
+		Incoming&     incoming = mIncoming[source];
+
+		while(filled > 0 && (incoming.position > 0 || isExpecting(source))) {
+			char*  target    = incoming.position < HEADER_SIZE ? incoming.header + incoming.position
+															   : incoming.data + incoming.position - HEADER_SIZE;
+			size_t available = incoming.position < HEADER_SIZE ? HEADER_SIZE - incoming.position
+															   : HEADER_SIZE + incoming.bytes - incoming.position;
+			size_t length    = std::min({available, filled, mRingBytes - tail % mRingBytes});
+			std::memcpy(target, ring + tail % mRingBytes, length);
+			tail += length;
+			filled -= length;
+			incoming.position += length;
+			if(incoming.position == HEADER_SIZE) {
+				startIncoming(source, incoming);
+			}
+			if(incoming.position == HEADER_SIZE + incoming.bytes) {
+				finishIncoming(incoming);
+			}
+		}
+		control.tail.store(tail, std::memory_order_release);
+	}
+
+	void startIncoming(int source, Incoming& incoming)
+	{
+		std::int32_t  tag;
+		std::uint64_t count;
+		std::memcpy(&tag, incoming.header, sizeof(tag));
+		std::memcpy(&count, incoming.header + 8, sizeof(count));
+		incoming.bytes = sizeof(double) * count;
+		for(PendingRequest& request : mRequests) {
+			if(!request.sending && !request.matched && request.peer == source && request.transfer.tag == tag) {
+				checkCount(request, count);
+				request.matched  = true;
+				incoming.held    = false;
+				incoming.receive = request.id;
+				incoming.data    = request.transfer.data;
+				return;
+			}
+		}
+		mHeld.push_back(HeldMessage{source, tag, std::vector<double>(count), false, false, 0});
+		incoming.held    = true;
+		incoming.message = std::prev(mHeld.end());
+		incoming.data    = reinterpret_cast<char*>(incoming.message->values.data());
+	}
+
+	void finishIncoming(Incoming& incoming)
+	{
+		incoming.position = 0;
+		if(!incoming.held) {
+			findRequest(incoming.receive).complete = true;
+			return;
+		}
+		incoming.message->complete = true;
+		if(incoming.message->claimed) {
+			deliver(incoming.message);
+		}
+	}
+
+	void checkRank(int rank) const
+	{
+		if(rank < 0 || rank >= mRankCount) {
+			throw std::invalid_argument("Rank out of range.");
+		}
+	}
+};
+#endif  // SHM_COMMUNICATOR
@@ -0,0 +1,271 @@
+#ifndef SNAPSHOT_WRITER
+#define SNAPSHOT_WRITER
+
+#include "FieldFile.hpp"
+#include "OpenCLMain.hpp"
+
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Writes field snapshots to disk on a background thread.
+ *
+ * Frames go through two pinned staging slots. While the worker thread formats and writes one slot, the solver reads
+ * the next frame back into the other one with a non-blocking transfer, so the step loop only waits when both slots are
+ * still in flight. A slot belongs to the thread that acquired it until that thread submits it, so solvers stepping
+ * concurrently on different threads can share one writer: each takes whichever slot is free. Each frame is written to
+ * "<directory>/<prefix>_<step>" followed by ".txt" for the text layout of Matrix::print (one block per field,
+ * preceded by the field name) or ".fld" for a binary FieldFile.
+ */
+class SnapshotWriter
+{
+	static inline constexpr size_t SLOT_COUNT = 2;
+
+public:
+	enum Format { TEXT, BINARY };
+
+private:
+	enum SlotState { FREE, FILLING, PENDING };
+	struct Slot {
+		SlotState                state    = FREE;
+		std::thread::id          owner;  // thread filling the slot
+		cl::Buffer               buffer;
+		double*                  data     = nullptr;
+		size_t                   capacity = 0;
+		unsigned int             step     = 0;
+		double                   time     = 0;
+		unsigned int             n        = 0;
+		unsigned int             m        = 0;
+		std::vector<std::string> names;
+		std::vector<cl::Event>   events;
+	};
+
+private:
+	std::string      mDirectory;
+	std::string      mPrefix;
+	Format           mFormat;
+	unsigned int     mPrecision;
+	cl::Context      mContext;
+	cl::CommandQueue mQueue;  // only used to map and unmap the staging buffers
+
+private:  // Shared with the worker thread, guarded by mMutex
+	std::mutex              mMutex;
+	std::condition_variable mCondition;
+	Slot                    mSlots[SLOT_COUNT];
+	std::queue<size_t>      mPending;
+	bool                    mStopping;
+	std::exception_ptr      mError;
+	std::thread             mWorker;
+
+public:
+	/**
+	 * @param precision Bytes per stored value for the BINARY format, sizeof(float) halves the file size.
+	 */
+	SnapshotWriter(const std::string& directory,
+				   const std::string& prefix    = "snapshot",
+				   Format             format    = TEXT,
+				   unsigned int       precision = sizeof(double))
+		: mDirectory(directory), mPrefix(prefix), mFormat(format), mPrecision(precision), mStopping(false)
+	{
+		if(precision != sizeof(float) && precision != sizeof(double)) {
+			throw std::invalid_argument("Snapshot precision must be 4 or 8 bytes.");
+		}
+		std::filesystem::create_directories(mDirectory);
+		mContext = OpenCLMain::getContext();
+		mQueue   = cl::CommandQueue(mContext, OpenCLMain::getDevice());
+		mWorker  = std::thread(&SnapshotWriter::run, this);
+	}
+
+	~SnapshotWriter()
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mCondition.wait(lock, [this] { return mPending.empty(); });
+			mStopping = true;
+		}
+		mCondition.notify_all();
+		mWorker.join();
+
+		for(Slot& slot : mSlots) {
+			if(slot.data != nullptr) {
+				mQueue.enqueueUnmapMemObject(slot.buffer, slot.data);
+			}
+		}
+		mQueue.finish();
+	}
+
+	SnapshotWriter(SnapshotWriter const&)            = delete;
+	SnapshotWriter& operator=(SnapshotWriter const&) = delete;
+
+	/**
+	 * @brief Reserve a staging slot for a frame of the calling thread.
+	 *
+	 * Blocks while every slot is still being filled by another thread or written by the worker thread.
+	 * @param step Step number used for the file name.
+	 * @param n Rows of every field.
+	 * @param m Columns of every field.
+	 * @param names One name per field, fields are laid out back to back in the staging memory.
+	 * @param time Simulation time stored in binary frames.
+	 * @return Pinned host memory holding names.size() * n * m doubles, valid until the frame is submitted.
+	 */
+	double* acquire(unsigned int                    step,
+					unsigned int                    n,
+					unsigned int                    m,
+					const std::vector<std::string>& names,
+					double                          time = 0)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		if(findSlot(FILLING, std::this_thread::get_id()) != SLOT_COUNT) {
+			throw std::logic_error("Previous snapshot frame was not submitted.");
+		}
+		mCondition.wait(lock, [this] { return findSlot(FREE, std::thread::id()) != SLOT_COUNT || mError; });
+		rethrowError();
+
+		Slot&  slot   = mSlots[findSlot(FREE, std::thread::id())];
+		size_t length = names.size() * n * m;
+		if(length > slot.capacity) {
+			if(slot.data != nullptr) {
+				mQueue.enqueueUnmapMemObject(slot.buffer, slot.data);
+			}
+			slot.buffer   = cl::Buffer(mContext, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, sizeof(double) * length);
+			slot.data     = static_cast<double*>(mQueue.enqueueMapBuffer(
+				slot.buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, sizeof(double) * length));
+			slot.capacity = length;
+		}
+		slot.state = FILLING;
+		slot.owner = std::this_thread::get_id();
+		slot.step  = step;
+		slot.time  = time;
+		slot.n     = n;
+		slot.m     = m;
+		slot.names = names;
+		slot.events.clear();
+		return slot.data;
+	}
+
+	/**
+	 * @brief Hand the slot acquired by the calling thread to the worker thread.
+	 * @param events Transfers into the staging memory, the worker waits for them before reading.
+	 */
+	void submit(std::vector<cl::Event> events = std::vector<cl::Event>())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			const size_t                index = findSlot(FILLING, std::this_thread::get_id());
+			if(index == SLOT_COUNT) {
+				throw std::logic_error("No snapshot frame was acquired.");
+			}
+			Slot& slot  = mSlots[index];
+			slot.events = std::move(events);
+			slot.state  = PENDING;
+			slot.owner  = std::thread::id();
+			mPending.push(index);
+		}
+		mCondition.notify_all();
+	}
+
+	/**
+	 * @brief Wait until every submitted frame is on disk.
+	 */
+	void flush()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mCondition.wait(lock, [this] { return mPending.empty() || mError; });
+		rethrowError();
+	}
+
+	std::string getPath(unsigned int step) const
+	{
+		std::string name = mPrefix + "_" + std::to_string(step) + (mFormat == BINARY ? ".fld" : ".txt");
+		return (std::filesystem::path(mDirectory) / name).string();
+	}
+
+private:
+	/**
+	 * @brief First slot in the given state and owned by the given thread, SLOT_COUNT if there is none. Call with
+	 * mMutex held.
+	 */
+	size_t findSlot(SlotState state, std::thread::id owner) const
+	{
+		for(size_t i = 0; i < SLOT_COUNT; i++) {
+			if(mSlots[i].state == state && mSlots[i].owner == owner) {
+				return i;
+			}
+		}
+		return SLOT_COUNT;
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		while(true) {
+			mCondition.wait(lock, [this] { return mStopping || !mPending.empty(); });
+			if(mPending.empty()) {
+				return;
+			}
+			Slot& slot = mSlots[mPending.front()];
+			lock.unlock();
+
+			std::exception_ptr error;
+			try {
+				if(!slot.events.empty()) {
+					cl::WaitForEvents(slot.events);
+				}
+				write(slot);
+			} catch(...) {
+				error = std::current_exception();
+			}
+
+			lock.lock();
+			if(error) {
+				mError = error;
+			}
+			slot.state = FREE;
+			mPending.pop();
+			mCondition.notify_all();
+		}
+	}
+
+	void write(const Slot& slot) const
+	{
+		if(mFormat == BINARY) {
+			FieldFile::write(
+				getPath(slot.step), slot.n, slot.m, slot.step, slot.time, slot.names, slot.data, mPrecision);
+			return;
+		}
+
+		std::ofstream file(getPath(slot.step));
+		if(!file) {
+			throw std::runtime_error("Unable to open snapshot file " + getPath(slot.step));
+		}
+
+		const double* field = slot.data;
+		for(const std::string& name : slot.names) {
+			file << name << "\n";
+			file << "---------------------- " << slot.m << "x" << slot.n << " ----------------------\n";
+			for(unsigned int row = 0; row < slot.n; row++) {
+				for(unsigned int col = 0; col < slot.m; col++) {
+					file << field[row * slot.m + col] << (col + 1 == slot.m ? "\n" : " | ");
+				}
+			}
+			field += slot.n * slot.m;
+		}
+	}
+
+	void rethrowError()
+	{
+		if(mError) {
+			std::exception_ptr error = mError;
+			mError                   = nullptr;
+			std::rethrow_exception(error);
+		}
+	}
+};
+#endif  // SNAPSHOT_WRITER
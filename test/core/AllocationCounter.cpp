@@ -0,0 +1,45 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+// These replace the global operator new and delete of the whole test binary, the array and nothrow forms forward
+// to them
+static std::atomic<size_t> heapAllocations(0);
+
+size_t heapAllocationCount() {
+    return heapAllocations;
+}
+
+void* operator new(std::size_t size) {
+    heapAllocations++;
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    heapAllocations++;
+    const size_t align = static_cast<size_t>(alignment);
+    if (void* pointer = std::aligned_alloc(align, (size + align) / align * align)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
@@ -0,0 +1,10 @@
+#ifndef ALLOCATION_COUNTER
+#define ALLOCATION_COUNTER
+
+#include <cstddef>
+
+/**
+ * @brief Test hook: calls of the global operator new so far, from every thread of the test binary.
+ */
+size_t heapAllocationCount();
+#endif  // ALLOCATION_COUNTER
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include "../../src/core/Checkpoint.hpp"
+
+class CheckpointTest : public ::testing::Test {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = (std::filesystem::temp_directory_path() / "CheckpointTest.ckp").string();
+    }
+
+    void TearDown() override {
+        std::filesystem::remove(path);
+    }
+};
+
+TEST_F(CheckpointTest, ChunkedRoundTrip) {
+    // Spans several chunks and mixes compressible and incompressible data
+    std::vector<double> data(CheckpointWriter::CHUNK_SIZE / sizeof(double) * 3 + 5);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = i < data.size() / 2 ? 0.25 : std::sin(i * 0.37) * 1e3;
+    }
+    Matrix<double> matrix(4, 6, 0.5);
+    matrix.shift(2, 3);
+
+    for (bool compress : {false, true})
+    {
+        CheckpointWriter writer(path, compress);
+        writer.write<std::uint64_t>(42);
+        writer.writeArray(data.data(), data.size());
+        writer.writeMatrix(matrix);
+        writer.close();
+
+        CheckpointReader reader(path);
+        EXPECT_EQ(reader.read<std::uint64_t>(), 42);
+        std::vector<double> result(data.size());
+        reader.readArray(result.data(), result.size());
+        EXPECT_EQ(result, data);
+        Matrix<double> restored(4, 6);
+        reader.readMatrix(restored);
+        EXPECT_EQ(restored.getShiftIndexPair(), matrix.getShiftIndexPair());
+        EXPECT_EQ(restored.getShiftedData(), matrix.getShiftedData());
+    }
+    EXPECT_LT(std::filesystem::file_size(path), sizeof(double) * data.size());
+}
+
+TEST_F(CheckpointTest, PaddedMatrix) {
+    Matrix<double> matrix(3, 5, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15});
+    matrix.shift(1, 2);
+    matrix.setRowPitch(Matrix<double>::alignedPitch(5));
+
+    CheckpointWriter writer(path, false);
+    writer.writeMatrix(matrix);
+    writer.close();
+    // Only the values are stored, not the padding
+    EXPECT_LT(std::filesystem::file_size(path), sizeof(double) * 3 * matrix.getPitch());
+
+    // The restored matrix keeps its own layout
+    CheckpointReader reader(path);
+    Matrix<double>   restored(3, 5);
+    restored.setRowPitch(6);
+    reader.readMatrix(restored);
+    EXPECT_EQ(restored.getPitch(), 6);
+    EXPECT_EQ(restored.getShiftIndexPair(), matrix.getShiftIndexPair());
+    EXPECT_EQ(restored.getShiftedData(), matrix.getShiftedData());
+}
+
+TEST_F(CheckpointTest, InvalidFile) {
+    EXPECT_THROW(CheckpointReader("does-not-exist.ckp"), std::runtime_error);
+
+    std::ofstream(path) << "not a checkpoint";
+    EXPECT_THROW(CheckpointReader reader(path), std::runtime_error);
+
+    CheckpointWriter writer(path);
+    writer.writeMatrix(Matrix<double>(4, 6));
+    writer.close();
+    CheckpointReader reader(path);
+    Matrix<double> other(6, 4);
+    EXPECT_THROW(reader.readMatrix(other), std::invalid_argument);
+}
@@ -0,0 +1,366 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "../../src/core/CollisionOperator.hpp"
+#include "../../src/core/LatticeBoltzmannMethodD2Q9CPU.hpp"
+
+class CollisionOperatorTest : public ::testing::Test {
+protected:
+    double f[9];
+    double eq[9];
+
+    void SetUp() override {
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            f[k] = 0.1 + 0.03 * ((k * 5) % 9);
+            eq[k] = 0.12 + 0.01 * k;
+        }
+    }
+
+    void TearDown() override {
+
+    }
+
+    static std::vector<double> moments(const double (&values)[9]) {
+        std::vector<double> result(9, 0.0);
+        for (unsigned int moment = 0; moment < 9; moment++)
+        {
+            for (unsigned int k = 0; k < 9; k++)
+            {
+                result[moment] += MRT_MATRIX[moment][k] * values[k];
+            }
+        }
+        return result;
+    }
+};
+
+TEST_F(CollisionOperatorTest, MomentTransformIsInverted) {
+    for (unsigned int row = 0; row < 9; row++)
+    {
+        for (unsigned int col = 0; col < 9; col++)
+        {
+            double sum = 0;
+            for (unsigned int k = 0; k < 9; k++)
+            {
+                sum += MRT_INVERSE[row][k] * MRT_MATRIX[k][col];
+            }
+            EXPECT_NEAR(sum, row == col ? 1 : 0, 1e-15);
+        }
+    }
+}
+
+TEST_F(CollisionOperatorTest, MomentRelaxationRates) {
+    const double omega = 1.3;
+    double post[9];
+    double n[9];
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        post[k] = f[k];
+        n[k] = f[k] - eq[k];
+    }
+    relax<CollisionOperator::MRT>(post, eq, omega, false);
+
+    double change[9];
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        change[k] = post[k] - f[k];
+    }
+    std::vector<double> relaxed = moments(change);
+    std::vector<double> before = moments(n);
+    for (unsigned int moment = 0; moment < 9; moment++)
+    {
+        double rate = MRT_GHOST_RATE[moment] == 0 ? omega : MRT_GHOST_RATE[moment];
+        EXPECT_NEAR(relaxed[moment], -rate * before[moment], 1e-14);
+    }
+}
+
+TEST_F(CollisionOperatorTest, TwoRelaxationTimes) {
+    const double omega = 1.7;
+    const double partner = trtPartnerRate(omega);
+    EXPECT_NEAR((1 / omega - 0.5) * (1 / partner - 0.5), TRT_MAGIC, 1e-15);
+
+    for (bool temperature : {false, true})
+    {
+        double post[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            post[k] = f[k];
+        }
+        relax<CollisionOperator::TRT>(post, eq, omega, temperature);
+
+        const double even = temperature ? partner : omega;
+        const double odd = temperature ? omega : partner;
+        for (unsigned int k = 1; k < 9; k++)
+        {
+            unsigned int o = LATTICE_OPPOSITE<D2Q9>[k];
+            double symmetric = (f[k] - eq[k]) + (f[o] - eq[o]);
+            double antisymmetric = (f[k] - eq[k]) - (f[o] - eq[o]);
+            EXPECT_NEAR((post[k] - eq[k]) + (post[o] - eq[o]), (1 - even) * symmetric, 1e-15);
+            EXPECT_NEAR((post[k] - eq[k]) - (post[o] - eq[o]), (1 - odd) * antisymmetric, 1e-15);
+        }
+    }
+}
+
+TEST_F(CollisionOperatorTest, UnitRateTRTIsBGK) {
+    double bgk[9];
+    double trt[9];
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        bgk[k] = f[k];
+        trt[k] = f[k];
+    }
+    relax<CollisionOperator::BGK>(bgk, eq, 1, false);
+    relax<CollisionOperator::TRT>(trt, eq, 1, false);
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        EXPECT_NEAR(trt[k], bgk[k], 1e-15);
+        EXPECT_NEAR(bgk[k], eq[k], 1e-15);
+    }
+}
+
+TEST_F(CollisionOperatorTest, SmagorinskyRate) {
+    const double omega = 1.9;
+    double n[9];
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        n[k] = 0;
+    }
+    EXPECT_DOUBLE_EQ(smagorinskyRate(n, omega, 1, 0.17), omega);
+
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        n[k] = f[k] - eq[k];
+    }
+    double xx = n[1] + n[3] + n[5] + n[6] + n[7] + n[8];
+    double yy = n[2] + n[4] + n[5] + n[6] + n[7] + n[8];
+    double xy = n[5] - n[6] + n[7] - n[8];
+    double Q = std::sqrt(xx * xx + yy * yy + 2 * xy * xy);
+    double tau = 1 / smagorinskyRate(n, omega, 0.8, 0.17);
+    EXPECT_GT(tau, 1 / omega);
+    EXPECT_NEAR(tau * (tau - 1 / omega), 18 * std::sqrt(2.0) * 0.17 * 0.17 * Q / (4 * 0.8), 1e-14);
+    EXPECT_DOUBLE_EQ(smagorinskyRate(n, omega, 0.8, 0), omega);
+    EXPECT_EQ(smagorinskyRate(n, omega, 0, 0.17), omega);
+}
+
+TEST_F(CollisionOperatorTest, GuoForce) {
+    const double omega = 1.6;
+    double source[9];
+    guoSource(source, 0.05, -0.02, 0.3, -0.7);
+
+    // The source carries no mass and the full force as momentum
+    double mass = 0;
+    double momentumX = 0;
+    double momentumY = 0;
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        mass += source[k];
+        momentumX += D2Q9::CX[k] * source[k];
+        momentumY += D2Q9::CY[k] * source[k];
+    }
+    EXPECT_NEAR(mass, 0, 1e-15);
+    EXPECT_NEAR(momentumX, 0.3, 1e-15);
+    EXPECT_NEAR(momentumY, -0.7, 1e-15);
+
+    // The momentum is odd, TRT corrects it with the partner rate
+    const double rates[3] = {omega, trtPartnerRate(omega), omega};
+    const CollisionOperator operators[3] = {CollisionOperator::BGK, CollisionOperator::TRT, CollisionOperator::MRT};
+    for (unsigned int o = 0; o < 3; o++)
+    {
+        double forced[9] = {};
+        switch (operators[o])
+        {
+        case CollisionOperator::TRT: force<CollisionOperator::TRT>(forced, source, omega); break;
+        case CollisionOperator::MRT: force<CollisionOperator::MRT>(forced, source, omega); break;
+        default: force<CollisionOperator::BGK>(forced, source, omega); break;
+        }
+        double total = 0;
+        double forcedY = 0;
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            total += forced[k];
+            forcedY += D2Q9::CY[k] * forced[k];
+        }
+        EXPECT_NEAR(total, 0, 1e-15);
+        EXPECT_NEAR(forcedY, (1 - rates[o] / 2) * -0.7, 1e-15);
+    }
+}
+
+TEST_F(CollisionOperatorTest, KernelSourceCarriesTheTables) {
+    const std::string source = collisionOperatorSource();
+    EXPECT_NE(source.find("void relaxTRT("), std::string::npos);
+    EXPECT_NE(source.find("void relaxMRT("), std::string::npos);
+    EXPECT_NE(source.find("double smagorinskyRate("), std::string::npos);
+
+    // The printed inverse must read back to the very same doubles
+    size_t position = source.find("MRT_INVERSE[81] = {");
+    ASSERT_NE(position, std::string::npos);
+    const char* cursor = source.c_str() + source.find('{', position) + 1;
+    for (unsigned int i = 0; i < 81; i++)
+    {
+        char* end = nullptr;
+        EXPECT_EQ(std::strtod(cursor, &end), MRT_INVERSE[i / 9][i % 9]);
+        cursor = end + 1;
+    }
+}
+
+TEST_F(CollisionOperatorTest, CPUBackend) {
+    const unsigned int N = 20;
+    const unsigned int M = 18;
+    const double weight[9] = {4 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 36.0, 1 / 36.0, 1 / 36.0, 1 / 36.0};
+    std::vector<double> initial(N * M);
+    for (unsigned int i = 0; i < N * M; i++)
+    {
+        initial[i] = 0.1 + (i * 37 % 101) / 101.0;
+    }
+    const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4> boundaries = {{
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0}}};
+    Matrix<double> velocity(N, M);
+
+    auto advance = [&](CollisionOperator density, CollisionOperator temperature, double viscosity, unsigned int depth,
+                       double smagorinsky = 0) {
+        Matrix<double> f[9];
+        Matrix<double> g[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            f[k] = Matrix<double>(N, M, initial, weight[k]);
+            g[k] = Matrix<double>(N, M, initial, weight[k]);
+        }
+        LatticeBoltzmannMethodD2Q9CPU cpu(depth, 8);
+        cpu.setCollision(density, temperature);
+        cpu.setSmagorinsky(smagorinsky);
+        cpu.advance(f, g, Matrix<double>(N, M, viscosity), Matrix<double>(N, M, 0.01), velocity, velocity,
+            boundaries, 12);
+        std::vector<double> result = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(f).getShiftedData();
+        std::vector<double> heat = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(g).getShiftedData();
+        result.insert(result.end(), heat.begin(), heat.end());
+        return result;
+    };
+
+    // A viscosity of 1/6 gives omega = 1, where TRT falls back to BGK
+    std::vector<double> bgk = advance(CollisionOperator::BGK, CollisionOperator::BGK, 1 / 6.0, 1);
+    std::vector<double> trt = advance(CollisionOperator::TRT, CollisionOperator::BGK, 1 / 6.0, 1);
+    for (size_t i = 0; i < N * M; i++)
+    {
+        EXPECT_NEAR(trt[i], bgk[i], 1e-12);
+    }
+
+    for (CollisionOperator collision : {CollisionOperator::TRT, CollisionOperator::MRT})
+    {
+        std::vector<double> reference = advance(collision, collision, 0.005, 1);
+        EXPECT_EQ(advance(collision, collision, 0.005, 3), reference);
+        EXPECT_NE(advance(CollisionOperator::BGK, CollisionOperator::BGK, 0.005, 1), reference);
+        for (double value : reference)
+        {
+            EXPECT_TRUE(std::isfinite(value));
+        }
+    }
+
+    // The subgrid model only adds viscosity to the density field
+    for (CollisionOperator collision : {CollisionOperator::BGK, CollisionOperator::TRT, CollisionOperator::MRT})
+    {
+        std::vector<double> plain = advance(collision, CollisionOperator::BGK, 0.005, 1);
+        std::vector<double> reference = advance(collision, CollisionOperator::BGK, 0.005, 1, 0.17);
+        EXPECT_EQ(advance(collision, CollisionOperator::BGK, 0.005, 3, 0.17), reference);
+        EXPECT_NE(std::vector<double>(reference.begin(), reference.begin() + N * M),
+                  std::vector<double>(plain.begin(), plain.begin() + N * M));
+        EXPECT_EQ(std::vector<double>(reference.begin() + N * M, reference.end()),
+                  std::vector<double>(plain.begin() + N * M, plain.end()));
+    }
+
+    LatticeBoltzmannMethodD2Q9CPU cpu;
+    EXPECT_THROW(cpu.setSmagorinsky(-0.1), std::invalid_argument);
+}
+
+TEST_F(CollisionOperatorTest, Buoyancy) {
+    // Periodic on all sides, so one step moves momentum around without losing any
+    const unsigned int N = 16;
+    const unsigned int M = 12;
+    const double weight[9] = {4 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 36.0, 1 / 36.0, 1 / 36.0, 1 / 36.0};
+    std::vector<double> density(N * M);
+    std::vector<double> temperature(N * M);
+    for (unsigned int i = 0; i < N * M; i++)
+    {
+        density[i] = 1 + (i * 13 % 17) / 170.0;
+        temperature[i] = 0.2 + (i * 37 % 101) / 101.0;
+    }
+    const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4> boundaries = {{
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}}};
+    const double viscosity = 0.1;
+    const double omega = 1 / (viscosity * 3 + 0.5);
+    Matrix<double> velocity(N, M);
+
+    auto advance = [&](CollisionOperator collision, double gravity, unsigned int depth, unsigned int steps) {
+        std::vector<Matrix<double>> result(18);
+        Matrix<double> f[9];
+        Matrix<double> g[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            f[k] = Matrix<double>(N, M, density, weight[k]);
+            g[k] = Matrix<double>(N, M, temperature, weight[k]);
+        }
+        LatticeBoltzmannMethodD2Q9CPU cpu(depth, 8);
+        cpu.setCollision(collision, CollisionOperator::BGK);
+        cpu.setBuoyancy(0, gravity, 0.5);
+        cpu.advance(f, g, Matrix<double>(N, M, viscosity), Matrix<double>(N, M, 0.05), velocity, velocity,
+            boundaries, steps);
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            result[k] = f[k];
+            result[9 + k] = g[k];
+        }
+        return result;
+    };
+    auto momentumY = [](const std::vector<Matrix<double>>& populations) {
+        double sum = 0;
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            for (double value : populations[k].getShiftedData())
+            {
+                sum += D2Q9::CY[k] * value;
+            }
+        }
+        return sum;
+    };
+
+    // Every node feels rho (T - 0.5) g, corrected by (1 - omega / 2) for the momentum
+    Matrix<double> f[9];
+    Matrix<double> g[9];
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        f[k] = Matrix<double>(N, M, density, weight[k]);
+        g[k] = Matrix<double>(N, M, temperature, weight[k]);
+    }
+    std::vector<double> rho = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(f).getShiftedData();
+    std::vector<double> T = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(g).getShiftedData();
+    double total = 0;
+    for (unsigned int i = 0; i < N * M; i++)
+    {
+        total += rho[i] * (T[i] - 0.5) * 0.01;
+    }
+    EXPECT_NEAR(momentumY(advance(CollisionOperator::BGK, 0, 1, 1)), 0, 1e-13);
+    for (CollisionOperator collision : {CollisionOperator::BGK, CollisionOperator::MRT})
+    {
+        EXPECT_NEAR(momentumY(advance(collision, 0.01, 1, 1)), (1 - omega / 2) * total, 1e-13);
+    }
+
+    // The temperature is read, never changed, and blocking does not change the result
+    std::vector<Matrix<double>> coupled = advance(CollisionOperator::BGK, 0.01, 1, 7);
+    std::vector<Matrix<double>> uncoupled = advance(CollisionOperator::BGK, 0, 1, 7);
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        EXPECT_EQ(coupled[9 + k].getShiftedData(), uncoupled[9 + k].getShiftedData());
+        EXPECT_NE(coupled[k].getShiftedData(), uncoupled[k].getShiftedData());
+    }
+    std::vector<Matrix<double>> blocked = advance(CollisionOperator::BGK, 0.01, 3, 7);
+    for (unsigned int k = 0; k < 18; k++)
+    {
+        EXPECT_EQ(blocked[k].getShiftedData(), coupled[k].getShiftedData());
+    }
+}
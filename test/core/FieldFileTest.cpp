@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "../../src/core/FieldFile.hpp"
+
+class FieldFileTest : public ::testing::Test {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = (std::filesystem::temp_directory_path() / "FieldFileTest.fld").string();
+    }
+
+    void TearDown() override {
+        std::filesystem::remove(path);
+    }
+};
+
+TEST_F(FieldFileTest, RoundTrip) {
+    std::vector<double> data(2 * 3 * 4);
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        data[i] = i * 0.5;
+    }
+    FieldFile::write(path, 3, 4, 42, 42.5, {"density", "temperature"}, data.data());
+
+    FieldFile file(path);
+    EXPECT_EQ(file.getN(), 3);
+    EXPECT_EQ(file.getM(), 4);
+    EXPECT_EQ(file.getStep(), 42);
+    EXPECT_EQ(file.getTime(), 42.5);
+    EXPECT_EQ(file.getPrecision(), sizeof(double));
+    EXPECT_EQ(file.getFieldNames(), std::vector<std::string>({"density", "temperature"}));
+
+    FieldView<double> density = file.getField<double>("density");
+    FieldView<double> temperature = file.getField<double>("temperature");
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(density.data) % FieldFile::DATA_ALIGNMENT, 0);
+    for (unsigned int row = 0; row < 3; row++)
+    {
+        for (unsigned int col = 0; col < 4; col++)
+        {
+            EXPECT_EQ(density(row, col), data[row * 4 + col]);
+            EXPECT_EQ(temperature(row, col), data[12 + row * 4 + col]);
+        }
+    }
+    EXPECT_THROW(file.getField<float>("density"), std::invalid_argument);
+    EXPECT_THROW(file.getField<double>("velocity"), std::out_of_range);
+}
+
+TEST_F(FieldFileTest, SinglePrecision) {
+    std::vector<double> data = {0.1, 0.2, 0.3, 0.4};
+    FieldFile::write(path, 2, 2, 0, 0, {"u"}, data.data(), sizeof(float));
+
+    FieldFile file(path);
+    FieldView<float> u = file.getField<float>("u");
+    ASSERT_EQ(u.size(), 4);
+    for (size_t i = 0; i < 4; i++)
+    {
+        EXPECT_EQ(u.data[i], static_cast<float>(data[i]));
+    }
+}
+
+TEST_F(FieldFileTest, InvalidFile) {
+    EXPECT_THROW(FieldFile("does-not-exist.fld"), std::runtime_error);
+
+    std::ofstream(path) << "---------------------- 4x3 ----------------------\n0 | 0 | 0 | 0\n";
+    EXPECT_THROW(FieldFile file(path), std::runtime_error);
+
+    std::vector<double> data(4);
+    EXPECT_THROW(FieldFile::write(path, 2, 2, 0, 0, {"u"}, data.data(), 2), std::invalid_argument);
+}
+
+TEST_F(FieldFileTest, CraftedHeader) {
+    // Sizes whose product wraps around to a small number must not pass the truncation check
+    std::vector<double> data(4);
+    FieldFile::write(path, 2, 2, 0, 0, {"u"}, data.data());
+    auto patch = [this](std::uint32_t n, std::uint32_t m, std::uint32_t fieldCount) {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        FieldFileHeader header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        header.n = n;
+        header.m = m;
+        header.fieldCount = fieldCount;
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    };
+
+    patch(0x80000000u, 0x80000000u, 1);  // 2^62 values of 8 bytes wrap to 0
+    EXPECT_THROW(FieldFile file(path), std::runtime_error);
+    patch(0x40000000u, 4, 1);  // 2^35 bytes
+    EXPECT_THROW(FieldFile file(path), std::runtime_error);
+    patch(0, 2, 1);
+    EXPECT_THROW(FieldFile file(path), std::runtime_error);
+    patch(2, 2, 1);
+    EXPECT_EQ(FieldFile(path).getFieldNames().size(), 1);
+}
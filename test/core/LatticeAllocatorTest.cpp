@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "../../src/core/LatticeAllocator.hpp"
+#include "../../src/core/Matrix.hpp"
+
+class LatticeAllocatorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+    }
+
+    void TearDown() override {
+
+    }
+};
+
+TEST_F(LatticeAllocatorTest, RowTileMatchesStaticSchedule) {
+    for (unsigned int rows : {1u, 7u, 64u, 1001u})
+    {
+        std::vector<int> owner(rows, -1);
+        int threads = 1;
+#pragma omp parallel for schedule(static)
+        for (unsigned int row = 0; row < rows; row++)
+        {
+            owner[row] = omp_get_thread_num();
+            if (row == 0)
+            {
+                threads = omp_get_num_threads();
+            }
+        }
+
+        unsigned int covered = 0;
+        for (int thread = 0; thread < threads; thread++)
+        {
+            std::pair<unsigned int, unsigned int> tile = rowTile(rows, thread, threads);
+            EXPECT_EQ(tile.first, covered);
+            for (unsigned int row = tile.first; row < tile.second; row++)
+            {
+                EXPECT_EQ(owner[row], thread);
+            }
+            covered = tile.second;
+        }
+        EXPECT_EQ(covered, rows);
+    }
+}
+
+TEST_F(LatticeAllocatorTest, MatrixCopies) {
+    Matrix<double> m1(37, 5, 0.5);
+    m1.indexRevision(36, 4, 2.0);
+    m1.shift(1, 2);
+
+    Matrix<double> copy(m1);
+    EXPECT_EQ(copy.getShiftIndexPair(), m1.getShiftIndexPair());
+    EXPECT_EQ(copy.getShiftedData(), m1.getShiftedData());
+
+    Matrix<double> assigned(3, 3);
+    assigned = m1;
+    EXPECT_EQ(assigned.getShiftedData(), m1.getShiftedData());
+
+    Matrix<double> moved(std::move(copy));
+    EXPECT_EQ(moved.getShiftedData(), m1.getShiftedData());
+}
+
+TEST_F(LatticeAllocatorTest, PageAlignedStorage) {
+    for (unsigned int rows : {1u, 3u, 64u, 257u})
+    {
+        Matrix<double> matrix(rows, 5, 1.0);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(matrix.getDataData()) % LATTICE_ALIGNMENT, 0u);
+    }
+    EXPECT_EQ(latticeAllocationBytes(0), 0u);
+    EXPECT_EQ(latticeAllocationBytes(8), LATTICE_CACHE_LINE);
+    EXPECT_EQ(latticeAllocationBytes(LATTICE_CACHE_LINE), LATTICE_CACHE_LINE);
+    EXPECT_EQ(latticeAllocationBytes(LATTICE_CACHE_LINE + 8), 2 * LATTICE_CACHE_LINE);
+}
+
+TEST_F(LatticeAllocatorTest, PinThreads) {
+    cpu_set_t original;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(cpu_set_t), &original), 0);
+
+    EXPECT_NO_THROW(pinThreads());
+    int pinned = 0;
+#pragma omp parallel reduction(+ : pinned)
+    {
+        cpu_set_t current;
+        pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &current);
+        pinned += CPU_COUNT(&current) == 1 ? 1 : 0;
+        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &original);
+    }
+    EXPECT_EQ(pinned, omp_get_max_threads());
+}
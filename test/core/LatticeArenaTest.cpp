@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include <utility>
+#include "../../src/core/LatticeArena.hpp"
+
+class LatticeArenaTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+    }
+
+    void TearDown() override {
+
+    }
+};
+
+TEST_F(LatticeArenaTest, Recycling) {
+    LatticeArena arena;
+    Matrix<double> a = arena.acquire(4, 6);
+    Matrix<double> b = arena.acquire(4, 6);
+    EXPECT_EQ(arena.getAllocationCount(), 2);
+    EXPECT_EQ(a.getN(), 4);
+    EXPECT_EQ(a.getM(), 6);
+
+    // A released field comes back unshifted, with its storage
+    a.shift(1, 2);
+    const double* storage = a.getDataData();
+    arena.release(std::move(a));
+    EXPECT_EQ(a.getLength(), 0);
+    EXPECT_EQ(arena.getFreeCount(), 1);
+    Matrix<double> c = arena.acquire(4, 6);
+    EXPECT_EQ(c.getDataData(), storage);
+    EXPECT_EQ(c.getShiftIndexPair(), std::make_pair(0u, 0u));
+    EXPECT_EQ(arena.getAllocationCount(), 2);
+
+    // Other dimensions allocate, the pooled field stays
+    arena.release(std::move(b));
+    Matrix<double> d = arena.acquire(6, 4);
+    EXPECT_EQ(arena.getAllocationCount(), 3);
+    EXPECT_EQ(arena.getFreeCount(), 1);
+
+    // Empty and padded fields are not kept
+    arena.release(std::move(a));
+    d.setRowPitch(Matrix<double>::alignedPitch(4));
+    arena.release(std::move(d));
+    EXPECT_EQ(arena.getFreeCount(), 1);
+
+    // Steady state: every step gives back as many fields as it takes
+    for (int step = 0; step < 10; step++)
+    {
+        Matrix<double> next = arena.acquire(4, 6);
+        std::swap(c, next);
+        arena.release(std::move(next));
+    }
+    EXPECT_EQ(arena.getAllocationCount(), 3);
+
+    arena.clear();
+    EXPECT_EQ(arena.getFreeCount(), 0);
+}
@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../../src/core/LatticeBoltzmannMethodD2Q9CPU.hpp"
+#include "../../src/core/LatticeBoltzmannMethodD2Q9Distributed.hpp"
+#include "../../src/core/ShmCommunicator.hpp"
+
+class LatticeBoltzmannMethodD2Q9DistributedTest : public ::testing::Test {
+protected:
+    static inline constexpr unsigned int N = 11;
+    static inline constexpr unsigned int M = 9;
+
+    std::string         name;
+    std::vector<double> viscosity;
+    std::vector<double> diffusion;
+    std::vector<double> density;
+    std::vector<double> temperature;
+
+    // Collision settings of both the decomposed and the reference run
+    CollisionOperator                        densityCollision     = CollisionOperator::BGK;
+    CollisionOperator                        temperatureCollision = CollisionOperator::BGK;
+    LatticeBoltzmannMethodD2Q9CPU::FlowModel model;
+
+    void SetUp() override {
+        name = "/d2q9_distributed_test_" + std::to_string(getpid());
+        for (unsigned int i = 0; i < N * M; i++)
+        {
+            viscosity.push_back(0.1 + 0.01 * (i % 7));
+            diffusion.push_back(0.2 + 0.01 * (i % 5));
+            density.push_back(1 + 0.1 * (i % 13));
+            temperature.push_back(0.5 * (i % 3));
+        }
+    }
+
+    void TearDown() override {
+        ShmCommunicator::unlink(name);
+    }
+
+    std::vector<double> slice(const std::vector<double>& values, int rank, int size) {
+        std::pair<unsigned int, unsigned int> rows = LatticeBoltzmannMethodD2Q9Distributed::strip(N, rank, size);
+        return std::vector<double>(values.begin() + rows.first * M, values.begin() + rows.second * M);
+    }
+
+    // Run the decomposed lattice with one thread per rank and compare with the single-process CPU backend
+    void compare(int size, const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4>& boundaries, unsigned int steps) {
+        ShmCommunicator::create(name, size, 256);
+        auto rank = [&](int r, Matrix<double>* densityResult, Matrix<double>* temperatureResult) {
+            ShmCommunicator communicator(name, r);
+            LatticeBoltzmannMethodD2Q9Distributed lbm(communicator, N, M, boundaries,
+                slice(viscosity, r, size), slice(diffusion, r, size),
+                slice(density, r, size), slice(temperature, r, size));
+            lbm.setCollision(densityCollision, temperatureCollision);
+            lbm.setSmagorinsky(model.smagorinsky);
+            lbm.setBuoyancy(model.gravityX, model.gravityY, model.referenceTemperature);
+            lbm.run(steps);
+            EXPECT_EQ(lbm.getStep(), steps);
+            Matrix<double> d = lbm.gatherResultingDensityMatrix();
+            Matrix<double> t = lbm.gatherResultingTemperatureMatrix();
+            if (densityResult != nullptr) {
+                *densityResult     = d;
+                *temperatureResult = t;
+            }
+        };
+        std::vector<std::thread> peers;
+        for (int r = 1; r < size; r++)
+        {
+            peers.emplace_back(rank, r, nullptr, nullptr);
+        }
+        Matrix<double> densityResult;
+        Matrix<double> temperatureResult;
+        rank(0, &densityResult, &temperatureResult);
+        for (std::thread& peer : peers)
+        {
+            peer.join();
+        }
+
+        Matrix<double> densityReference;
+        Matrix<double> temperatureReference;
+        reference(boundaries, steps, densityReference, temperatureReference);
+        EXPECT_EQ(densityResult.getShiftedData(), densityReference.getShiftedData());
+        EXPECT_EQ(temperatureResult.getShiftedData(), temperatureReference.getShiftedData());
+    }
+
+    // The whole lattice on the single-process CPU backend
+    void reference(const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4>& boundaries, unsigned int steps,
+        Matrix<double>& densityResult, Matrix<double>& temperatureResult) {
+        const double weight[9] = {4 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 36.0, 1 / 36.0, 1 / 36.0, 1 / 36.0};
+        Matrix<double> f[9];
+        Matrix<double> g[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            f[k] = Matrix<double>(N, M, density, weight[k]);
+            g[k] = Matrix<double>(N, M, temperature, weight[k]);
+        }
+        LatticeBoltzmannMethodD2Q9CPU cpu;
+        cpu.setCollision(densityCollision, temperatureCollision);
+        cpu.setSmagorinsky(model.smagorinsky);
+        cpu.setBuoyancy(model.gravityX, model.gravityY, model.referenceTemperature);
+        cpu.advance(f, g, Matrix<double>(N, M, viscosity), Matrix<double>(N, M, diffusion),
+            Matrix<double>(N, M, 0.0), Matrix<double>(N, M, 0.0), boundaries, steps);
+        densityResult     = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(f);
+        temperatureResult = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(g);
+    }
+};
+
+TEST_F(LatticeBoltzmannMethodD2Q9DistributedTest, MatchesSingleProcess) {
+    compare(3, {{{LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+                 {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5},
+                 {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}}, 7);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9DistributedTest, Periodic) {
+    compare(4, {{{LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}}}, 5);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9DistributedTest, SingleRank) {
+    compare(1, {{{LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 2},
+                 {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1}}}, 4);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9DistributedTest, CollisionModel) {
+    densityCollision     = CollisionOperator::MRT;
+    temperatureCollision = CollisionOperator::TRT;
+    model.smagorinsky    = 0.15;
+    model.gravityX       = 0.01;
+    model.gravityY       = -0.02;
+    compare(3, {{{LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+                 {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+                 {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5}}}, 6);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9DistributedTest, StripTooThin) {
+    ShmCommunicator::create(name, 6);
+    ShmCommunicator communicator(name, 5);
+    std::vector<double> values(M, 0.1);
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9Distributed(communicator, N, M,
+        {{{LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}, {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+          {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}, {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}}},
+        values, values), std::invalid_argument);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9DistributedTest, StepDoesNotWaitForNeighbours) {
+    const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4> boundaries = {{
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5}}};
+    ShmCommunicator::create(name, 2);
+    ShmCommunicator first(name, 0);
+    ShmCommunicator second(name, 1);
+    LatticeBoltzmannMethodD2Q9Distributed upper(first, N, M, boundaries,
+        slice(viscosity, 0, 2), slice(diffusion, 0, 2), slice(density, 0, 2), slice(temperature, 0, 2));
+    LatticeBoltzmannMethodD2Q9Distributed lower(second, N, M, boundaries,
+        slice(viscosity, 1, 2), slice(diffusion, 1, 2), slice(density, 1, 2), slice(temperature, 1, 2));
+
+    // One thread drives both ranks: a bulk-synchronous exchange would block inside the first step
+    upper.step();
+    lower.step();
+    upper.step();
+    lower.step();
+    upper.step();
+    lower.step();
+    std::vector<double> result = upper.buildResultingDensityMatrix().getShiftedData();
+    std::vector<double> rest   = lower.buildResultingDensityMatrix().getShiftedData();
+    result.insert(result.end(), rest.begin(), rest.end());
+
+    Matrix<double> densityReference;
+    Matrix<double> temperatureReference;
+    reference(boundaries, 3, densityReference, temperatureReference);
+    EXPECT_EQ(result, densityReference.getShiftedData());
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "../../src/core/LatticeBoltzmannMethodD2Q9Ensemble.h"
+#include "../../src/core/LatticeBoltzmannMethodD2Q9Ensemble.cpp"
+
+class LatticeBoltzmannMethodD2Q9EnsembleTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+    }
+
+    void TearDown() override {
+
+    }
+};
+
+TEST_F(LatticeBoltzmannMethodD2Q9EnsembleTest, MatchesStandaloneSolver) {
+    Matrix<double> m1(8, 8, 0.25);
+    Matrix<double> viscosity(8, 8, 0.25);
+    Matrix<double> diffusion(8, 8, 0.1);
+
+    LatticeBoltzmannMethodD2Q9::Boundary constant0(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0);
+    LatticeBoltzmannMethodD2Q9::Boundary constant1(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 1);
+    LatticeBoltzmannMethodD2Q9::Boundary adiabatic(LatticeBoltzmannMethodD2Q9::BoundaryType::ADIABATIC);
+
+    LatticeBoltzmannMethodD2Q9 lbm0 (7, 7, constant0, adiabatic, constant0, constant1,
+        viscosity.getShiftedData(), diffusion.getShiftedData(), m1.getShiftedData(), m1.getShiftedData());
+    LatticeBoltzmannMethodD2Q9 lbm1 (7, 7, adiabatic, constant1, adiabatic, constant0,
+        viscosity.getShiftedData(), diffusion.getShiftedData(), m1.getShiftedData(), m1.getShiftedData());
+
+    std::vector<LatticeBoltzmannMethodD2Q9Ensemble::Member> members(2);
+    members[0] = {0.25, 0.1, constant0, adiabatic, constant0, constant1, m1.getShiftedData(), m1.getShiftedData(), {}, {}};
+    members[1] = {0.25, 0.1, adiabatic, constant1, adiabatic, constant0, m1.getShiftedData(), m1.getShiftedData(), {}, {}};
+    LatticeBoltzmannMethodD2Q9Ensemble ensemble(7, 7, members);
+    EXPECT_EQ(ensemble.getMemberCount(), 2);
+
+    for (size_t i = 0; i < 10; i++)
+    {
+        lbm0.step();
+        lbm1.step();
+    }
+    ensemble.step(10);
+
+    lbm0.buildResultingDensityMatrix();
+    lbm0.buildResultingTemperatureMatrix();
+    lbm1.buildResultingDensityMatrix();
+    lbm1.buildResultingTemperatureMatrix();
+
+    std::vector<double> expected[4] = {lbm0.mResultingDensityMatrix.getShiftedData(),
+                                       lbm0.mResultingTemperatureMatrix.getShiftedData(),
+                                       lbm1.mResultingDensityMatrix.getShiftedData(),
+                                       lbm1.mResultingTemperatureMatrix.getShiftedData()};
+    std::vector<double> result[4] = {ensemble.buildResultingDensityMatrix(0).getShiftedData(),
+                                     ensemble.buildResultingTemperatureMatrix(0).getShiftedData(),
+                                     ensemble.buildResultingDensityMatrix(1).getShiftedData(),
+                                     ensemble.buildResultingTemperatureMatrix(1).getShiftedData()};
+    for (size_t n = 0; n < 4; n++)
+    {
+        ASSERT_EQ(expected[n].size(), result[n].size());
+        for (size_t i = 0; i < expected[n].size(); i++)
+        {
+            EXPECT_NEAR(expected[n][i], result[n][i], 1e-12);
+        }
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9EnsembleTest, InvalidMembers) {
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9Ensemble(7, 7, {}), std::invalid_argument);
+
+    std::vector<LatticeBoltzmannMethodD2Q9Ensemble::Member> members(1);
+    members[0].kinematicViscosity   = 0.25;
+    members[0].diffusionCoefficient = 0.25;
+    members[0].initialDensityArray  = std::vector<double>(10, 0.25);
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9Ensemble(7, 7, members), std::invalid_argument);
+
+    members[0].initialDensityArray.clear();
+    LatticeBoltzmannMethodD2Q9Ensemble ensemble(7, 7, members);
+    EXPECT_THROW(ensemble.buildResultingDensityMatrix(1), std::out_of_range);
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include "../../src/core/LatticeBoltzmannMethodD2Q9MultiDevice.h"
+#include "../../src/core/LatticeBoltzmannMethodD2Q9MultiDevice.cpp"
+
+class LatticeBoltzmannMethodD2Q9MultiDeviceTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+    }
+
+    void TearDown() override {
+
+    }
+
+    LatticeBoltzmannMethodD2Q9::Boundary constant0{LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0};
+    LatticeBoltzmannMethodD2Q9::Boundary constant1{LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 1};
+    LatticeBoltzmannMethodD2Q9::Boundary adiabatic{LatticeBoltzmannMethodD2Q9::BoundaryType::ADIABATIC};
+
+    void expectMatchesSingleDevice(LatticeBoltzmannMethodD2Q9::Boundary top,
+                                   LatticeBoltzmannMethodD2Q9::Boundary bottom,
+                                   LatticeBoltzmannMethodD2Q9::Boundary left,
+                                   LatticeBoltzmannMethodD2Q9::Boundary right) {
+        Matrix<double> m1(12, 8, 0.25);
+        Matrix<double> viscosity(12, 8, 0.25);
+        Matrix<double> diffusion(12, 8, 0.1);
+
+        LatticeBoltzmannMethodD2Q9 lbm (7, 11, top, bottom, left, right,
+            viscosity.getShiftedData(), diffusion.getShiftedData(), m1.getShiftedData(), m1.getShiftedData());
+
+        // The same device three times still exercises the slab split and the halo exchange
+        const cl::Device device = OpenCLMain::getDevices().front();
+        LatticeBoltzmannMethodD2Q9MultiDevice multi (7, 11, top, bottom, left, right,
+            viscosity.getShiftedData(), diffusion.getShiftedData(), m1.getShiftedData(), m1.getShiftedData(),
+            {device, device, device}, {1, 2, 1});
+        EXPECT_EQ(multi.getDeviceCount(), 3);
+        EXPECT_EQ(multi.getRowSplit(), std::vector<unsigned int>({3, 6, 3}));
+
+        for (size_t i = 0; i < 10; i++)
+        {
+            lbm.step();
+        }
+        multi.step(5);
+        multi.rebalance();
+        multi.step(5);
+
+        lbm.buildResultingDensityMatrix();
+        lbm.buildResultingTemperatureMatrix();
+        std::vector<double> expected[2] = {lbm.mResultingDensityMatrix.getShiftedData(),
+                                           lbm.mResultingTemperatureMatrix.getShiftedData()};
+        std::vector<double> result[2]   = {multi.buildResultingDensityMatrix().getShiftedData(),
+                                           multi.buildResultingTemperatureMatrix().getShiftedData()};
+        for (size_t n = 0; n < 2; n++)
+        {
+            ASSERT_EQ(expected[n].size(), result[n].size());
+            for (size_t i = 0; i < expected[n].size(); i++)
+            {
+                EXPECT_NEAR(expected[n][i], result[n][i], 1e-12);
+            }
+        }
+    }
+};
+
+TEST_F(LatticeBoltzmannMethodD2Q9MultiDeviceTest, SplitRows) {
+    EXPECT_EQ(LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(12, {1, 1, 1}), std::vector<unsigned int>({4, 4, 4}));
+    EXPECT_EQ(LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(13, {1, 1, 1}), std::vector<unsigned int>({5, 4, 4}));
+    EXPECT_EQ(LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(10, {3, 1}), std::vector<unsigned int>({8, 2}));
+    // A very slow device still keeps two rows
+    EXPECT_EQ(LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(9, {1000, 1}), std::vector<unsigned int>({7, 2}));
+
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(5, {1, 1, 1}), std::invalid_argument);
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(10, {}), std::invalid_argument);
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9MultiDevice::splitRows(10, {1, 0}), std::invalid_argument);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9MultiDeviceTest, MatchesSingleDevice) {
+    expectMatchesSingleDevice(constant1, adiabatic, constant0, adiabatic);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9MultiDeviceTest, ConstantRightSide) {
+    // The lattice is not square, the right side is the last column of every slab
+    expectMatchesSingleDevice(adiabatic, constant0, adiabatic, constant1);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9MultiDeviceTest, InvalidArguments) {
+    std::vector<double> values(64, 0.25);
+    const cl::Device device = OpenCLMain::getDevices().front();
+
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9MultiDevice(7, 7, adiabatic, adiabatic, adiabatic, adiabatic,
+        values, values, values, values, {}), std::invalid_argument);
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9MultiDevice(7, 7, adiabatic, adiabatic, adiabatic, adiabatic,
+        values, values, values, values, {device, device}, {1}), std::invalid_argument);
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9MultiDevice(7, 7, adiabatic, adiabatic, adiabatic, adiabatic,
+        std::vector<double>(10, 0.25), values, values, values, {device}), std::invalid_argument);
+    // Five slabs of an eight row lattice cannot hold two rows each
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9MultiDevice(7, 7, adiabatic, adiabatic, adiabatic, adiabatic,
+        values, values, values, values, {device, device, device, device, device}), std::invalid_argument);
+}
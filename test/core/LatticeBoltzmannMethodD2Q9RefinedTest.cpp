@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "../../src/core/LatticeBoltzmannMethodD2Q9CPU.hpp"
+#include "../../src/core/LatticeBoltzmannMethodD2Q9Refined.hpp"
+
+class LatticeBoltzmannMethodD2Q9RefinedTest : public ::testing::Test {
+protected:
+    static inline constexpr unsigned int N = 12;
+    static inline constexpr unsigned int M = 10;
+
+    using Boundaries = std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4>;
+
+    const Boundaries walls = {{{LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+                               {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                               {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5},
+                               {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}};
+
+    // The whole lattice on the CPU backend, rows x cols
+    static void reference(unsigned int rows, unsigned int cols, const Boundaries& boundaries, unsigned int steps,
+        const std::vector<double>& viscosity, const std::vector<double>& diffusion,
+        const std::vector<double>& density, const std::vector<double>& temperature,
+        Matrix<double>& densityResult, Matrix<double>& temperatureResult) {
+        const double weight[9] = {4 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 9.0, 1 / 36.0, 1 / 36.0, 1 / 36.0, 1 / 36.0};
+        Matrix<double> f[9];
+        Matrix<double> g[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            f[k] = Matrix<double>(rows, cols, density, weight[k]);
+            g[k] = Matrix<double>(rows, cols, temperature, weight[k]);
+        }
+        LatticeBoltzmannMethodD2Q9CPU cpu;
+        cpu.advance(f, g, Matrix<double>(rows, cols, viscosity), Matrix<double>(rows, cols, diffusion),
+            Matrix<double>(rows, cols, 0.0), Matrix<double>(rows, cols, 0.0), boundaries, steps);
+        densityResult     = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(f);
+        temperatureResult = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(g);
+    }
+};
+
+TEST_F(LatticeBoltzmannMethodD2Q9RefinedTest, WithoutRegionsMatchesCPUBackend) {
+    std::vector<double> viscosity, diffusion, density, temperature;
+    for (unsigned int i = 0; i < N * M; i++)
+    {
+        viscosity.push_back(0.1 + 0.01 * (i % 7));
+        diffusion.push_back(0.2 + 0.01 * (i % 5));
+        density.push_back(1 + 0.1 * (i % 13));
+        temperature.push_back(0.5 * (i % 3));
+    }
+    const Boundaries periodic = {{{LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+                                  {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 2},
+                                  {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+                                  {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}}};
+    for (const Boundaries& boundaries : {walls, periodic})
+    {
+        LatticeBoltzmannMethodD2Q9Refined lbm(N, M, boundaries, viscosity, diffusion, density, temperature);
+        lbm.step(6);
+        EXPECT_EQ(lbm.getStep(), 6u);
+        EXPECT_EQ(lbm.getBlockCount(), 1u);
+
+        Matrix<double> densityReference;
+        Matrix<double> temperatureReference;
+        reference(N, M, boundaries, 6, viscosity, diffusion, density, temperature, densityReference,
+            temperatureReference);
+        EXPECT_EQ(lbm.buildResultingDensityMatrix().getShiftedData(), densityReference.getShiftedData());
+        EXPECT_EQ(lbm.buildResultingTemperatureMatrix().getShiftedData(), temperatureReference.getShiftedData());
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9RefinedTest, FullyRefinedMatchesFineLattice) {
+    // Every side is a wall, so the interpolated ghost ring only feeds populations the boundaries overwrite. The
+    // constant sides are left and right: top and bottom come first, and a constant one would read the corner
+    // populations streamed in from past the left and right sides
+    const Boundaries sides = {{{LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                               {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                               {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+                               {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5}}};
+    std::vector<double> viscosity(N * M, 0.05), diffusion(N * M, 0.08), density(N * M, 1), temperature(N * M, 0.5);
+    LatticeBoltzmannMethodD2Q9Refined lbm(N, M, sides, viscosity, diffusion, density, temperature, {{0, 0, 0, N, M}});
+    lbm.step(5);
+    EXPECT_EQ(lbm.getLevel(1), 1u);
+
+    // Half the spacing and time step: twice the lattice viscosity and twice the steps
+    Matrix<double> densityReference;
+    Matrix<double> temperatureReference;
+    reference(2 * N, 2 * M, sides, 10, std::vector<double>(4 * N * M, 0.1), std::vector<double>(4 * N * M, 0.16),
+        std::vector<double>(4 * N * M, 1), std::vector<double>(4 * N * M, 0.5), densityReference,
+        temperatureReference);
+    std::vector<double> densityResult     = lbm.buildResultingDensityMatrix(1).getShiftedData();
+    std::vector<double> temperatureResult = lbm.buildResultingTemperatureMatrix(1).getShiftedData();
+    ASSERT_EQ(densityResult.size(), densityReference.getShiftedData().size());
+    for (size_t i = 0; i < densityResult.size(); i++)
+    {
+        EXPECT_NEAR(densityResult[i], densityReference.getShiftedData()[i], 1e-12);
+        EXPECT_NEAR(temperatureResult[i], temperatureReference.getShiftedData()[i], 1e-12);
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9RefinedTest, RefinedLayerFollowsFineLattice) {
+    // A thin layer at the hot top wall, refined over its first five rows
+    const Boundaries hotTop = {{{LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+                                {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                                {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                                {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}};
+    std::vector<double> coefficient(N * M, 0.05);
+    LatticeBoltzmannMethodD2Q9Refined coarse(N, M, hotTop, coefficient, coefficient);
+    LatticeBoltzmannMethodD2Q9Refined refined(N, M, hotTop, coefficient, coefficient, {}, {}, {{0, 0, 0, 5, M}});
+    std::vector<double> fineCoefficient(4 * N * M, 0.1);
+    LatticeBoltzmannMethodD2Q9Refined fine(2 * N, 2 * M, hotTop, fineCoefficient, fineCoefficient);
+    coarse.step(40);
+    refined.step(40);
+    fine.step(80);
+
+    EXPECT_EQ(refined.getNodeCount(), N * M + 4 * 5 * M);
+    EXPECT_EQ(refined.getUpdatesPerStep(), N * M + 8 * 5 * M);
+
+    std::vector<double> c = coarse.buildResultingTemperatureMatrix().getShiftedData();
+    std::vector<double> r = refined.buildResultingTemperatureMatrix().getShiftedData();
+    std::vector<double> f = fine.buildResultingTemperatureMatrix().getShiftedData();
+    double coarseError  = 0;
+    double refinedError = 0;
+    for (unsigned int row = 0; row < N; row++)
+    {
+        for (unsigned int col = 0; col < M; col++)
+        {
+            const unsigned int i     = 2 * row * 2 * M + 2 * col;
+            const double       exact = 0.25 * (f[i] + f[i + 1] + f[i + 2 * M] + f[i + 2 * M + 1]);
+            coarseError  = std::max(coarseError, std::fabs(c[row * M + col] - exact));
+            refinedError = std::max(refinedError, std::fabs(r[row * M + col] - exact));
+        }
+    }
+    EXPECT_GT(coarseError, 1e-3);
+    EXPECT_LT(refinedError, coarseError / 10);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9RefinedTest, DetachedInterfaceKeepsCoarseAccuracy) {
+    // The block starts one row below the hot wall, its upper interface carries the whole gradient into it. Without
+    // the non-equilibrium rescaling the error in the block doubles
+    const Boundaries hotTop = {{{LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 1},
+                                {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                                {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+                                {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}};
+    std::vector<double> coefficient(N * M, 0.3);
+    LatticeBoltzmannMethodD2Q9Refined coarse(N, M, hotTop, coefficient, coefficient);
+    LatticeBoltzmannMethodD2Q9Refined refined(N, M, hotTop, coefficient, coefficient, {}, {}, {{0, 1, 0, 4, M}});
+    std::vector<double> fineCoefficient(4 * N * M, 0.6);
+    LatticeBoltzmannMethodD2Q9Refined fine(2 * N, 2 * M, hotTop, fineCoefficient, fineCoefficient);
+    coarse.step(30);
+    refined.step(30);
+    fine.step(60);
+
+    std::vector<double> c = coarse.buildResultingTemperatureMatrix().getShiftedData();
+    std::vector<double> r = refined.buildResultingTemperatureMatrix().getShiftedData();
+    std::vector<double> f = fine.buildResultingTemperatureMatrix().getShiftedData();
+    double coarseError  = 0;
+    double refinedError = 0;
+    for (unsigned int row = 1; row < 5; row++)
+    {
+        for (unsigned int col = 0; col < M; col++)
+        {
+            const unsigned int i     = 2 * row * 2 * M + 2 * col;
+            const double       exact = 0.25 * (f[i] + f[i + 1] + f[i + 2 * M] + f[i + 2 * M + 1]);
+            coarseError  = std::max(coarseError, std::fabs(c[row * M + col] - exact));
+            refinedError = std::max(refinedError, std::fabs(r[row * M + col] - exact));
+        }
+    }
+    EXPECT_GT(coarseError, 1e-3);
+    EXPECT_LT(refinedError, 1.5 * coarseError);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9RefinedTest, NestedLevels) {
+    std::vector<double> coefficient(N * M, 0.05);
+    LatticeBoltzmannMethodD2Q9Refined lbm(N, M, walls, coefficient, coefficient, std::vector<double>(N * M, 1), {},
+        {{0, 2, 2, 6, 6}, {1, 1, 1, 4, 4}, {0, 9, 0, 3, 4}});
+    EXPECT_EQ(lbm.getBlockCount(), 4u);
+    EXPECT_EQ(lbm.getLevel(2), 2u);
+    EXPECT_EQ(lbm.getLevel(3), 1u);
+    EXPECT_EQ(lbm.getUpdatesPerStep(), N * M + 2 * 12 * 12 + 4 * 8 * 8 + 2 * 6 * 8);
+
+    lbm.step(20);
+    for (unsigned int block = 0; block < lbm.getBlockCount(); block++)
+    {
+        for (double value : lbm.buildResultingDensityMatrix(block).getShiftedData())
+        {
+            EXPECT_TRUE(std::isfinite(value));
+            EXPECT_GT(value, -1);
+            EXPECT_LT(value, 2);
+        }
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9RefinedTest, InvalidRegions) {
+    std::vector<double> coefficient(N * M, 0.05);
+    auto build = [&](const std::vector<LatticeBoltzmannMethodD2Q9Refined::Region>& regions) {
+        LatticeBoltzmannMethodD2Q9Refined(N, M, walls, coefficient, coefficient, {}, {}, regions);
+    };
+    EXPECT_NO_THROW(build({{0, 0, 0, N, M}}));
+    EXPECT_THROW(build({{0, 0, 0, N + 1, M}}), std::invalid_argument);
+    EXPECT_THROW(build({{0, 3, 3, 0, 2}}), std::invalid_argument);
+    EXPECT_THROW(build({{1, 0, 0, 2, 2}}), std::invalid_argument);
+    EXPECT_THROW(build({{0, 0, 0, 4, 4}, {0, 3, 3, 2, 2}}), std::invalid_argument);
+    EXPECT_NO_THROW(build({{0, 0, 0, 4, 4}, {0, 4, 0, 2, 2}}));
+    // A nested block keeps one cell off the edge of its refined parent
+    EXPECT_THROW(build({{0, 2, 2, 4, 4}, {1, 0, 1, 2, 2}}), std::invalid_argument);
+    EXPECT_NO_THROW(build({{0, 2, 2, 4, 4}, {1, 1, 1, 6, 6}}));
+    EXPECT_THROW(build({{0, 2, 2, 4, 4}, {1, 1, 1, 7, 6}}), std::invalid_argument);
+    EXPECT_THROW(LatticeBoltzmannMethodD2Q9Refined(N, M, walls, coefficient, {}), std::invalid_argument);
+}
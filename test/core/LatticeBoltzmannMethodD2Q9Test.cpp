@@ -1,27 +1,775 @@
 #include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
 #include "../../src/core/LatticeBoltzmannMethodD2Q9.h"
 #include "../../src/core/LatticeBoltzmannMethodD2Q9.cpp"
+#include "AllocationCounter.h"
 
 class LatticeBoltzmannMethodD2Q9Test : public ::testing::Test {
 protected:
+    using Boundary = LatticeBoltzmannMethodD2Q9::Boundary;
+    using Sides = std::array<Boundary, 4>;  // top, bottom, left, right
+
+    static inline const Boundary adiabatic{LatticeBoltzmannMethodD2Q9::BoundaryType::ADIABATIC};
+    static inline const Boundary constant0{LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0};
+    static inline const Boundary constant1{LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 1};
+    static inline const Boundary open{LatticeBoltzmannMethodD2Q9::BoundaryType::OPEN};
+    static inline const Sides heatedRight{constant0, adiabatic, constant0, constant1};
+
     void SetUp() override {
     }
 
     void TearDown() override {
 
     }
+
+    // A field of the given size with values spread over [0.1, 1.1)
+    static Matrix<double> variedField(unsigned int rows, unsigned int cols) {
+        Matrix<double> field(rows, cols);
+        for (unsigned int i = 0; i < rows * cols; i++)
+        {
+            field.indexRevision(i / cols, i % cols, 0.1 + (i * 37 % (rows * cols)) / double(rows * cols));
+        }
+        return field;
+    }
+
+    // A solver over the nodes of the initial field, which sets both the density and the temperature
+    static std::unique_ptr<LatticeBoltzmannMethodD2Q9> makeSolver(const Matrix<double>& initial,
+        const Sides& sides = heatedRight,
+        LatticeBoltzmannMethodD2Q9::Backend backend = LatticeBoltzmannMethodD2Q9::Backend::OPENCL,
+        double viscosity = 0.25, double diffusion = 0.25) {
+        const Matrix<double> viscosityField(initial.getN(), initial.getM(), viscosity);
+        const Matrix<double> diffusionField(initial.getN(), initial.getM(), diffusion);
+        auto lbm = std::make_unique<LatticeBoltzmannMethodD2Q9>(initial.getM() - 1, initial.getN() - 1,
+            sides[0], sides[1], sides[2], sides[3], viscosityField.getShiftedData(), diffusionField.getShiftedData(),
+            initial.getShiftedData(), initial.getShiftedData());
+        lbm->setBackend(backend);
+        return lbm;
+    }
 };
 
 TEST_F(LatticeBoltzmannMethodD2Q9Test, Diffusion) {
+    auto lbm = makeSolver(Matrix<double>(8, 8));
+    for (size_t i = 0; i < 10; i++)
+    {
+        lbm->step(true);
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, SteadyStateAllocatesNothing) {
+    auto lbm = makeSolver(Matrix<double>(8, 8), heatedRight, LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    lbm->setTemporalBlocking(1, 4);
+    for (bool skipping : {false, true})
+    {
+        lbm->setTileSkipping(skipping);
+
+        // The first steps size the velocity, the tile blocks and the tile bookkeeping
+        lbm->step();
+        lbm->step();
+        const size_t before = heapAllocationCount();
+        for (size_t i = 0; i < 5; i++)
+        {
+            lbm->step();
+        }
+        EXPECT_EQ(heapAllocationCount() - before, 0u);
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, ConcurrentInstances) {
+    const Matrix<double> zero(8, 8);
+    auto reference = makeSolver(zero);
+    for (size_t i = 0; i < 10; i++)
+    {
+        reference->step();
+    }
+    reference->buildResultingTemperatureMatrix();
+
+    auto lbm1 = makeSolver(zero);
+    auto lbm2 = makeSolver(zero);
+    auto run = [](LatticeBoltzmannMethodD2Q9* lbm) {
+        for (size_t i = 0; i < 10; i++)
+        {
+            lbm->step();
+        }
+        lbm->buildResultingTemperatureMatrix();
+    };
+    std::thread thread1(run, lbm1.get());
+    std::thread thread2(run, lbm2.get());
+    thread1.join();
+    thread2.join();
+
+    EXPECT_EQ(lbm1->mResultingTemperatureMatrix.getShiftedData(), reference->mResultingTemperatureMatrix.getShiftedData());
+    EXPECT_EQ(lbm2->mResultingTemperatureMatrix.getShiftedData(), reference->mResultingTemperatureMatrix.getShiftedData());
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, SnapshotWriter) {
+    std::string directory = (std::filesystem::temp_directory_path() / "LatticeBoltzmannMethodD2Q9Test").string();
+    auto lbm = makeSolver(Matrix<double>(8, 8));
+    auto writer = std::make_shared<SnapshotWriter>(directory);
+    lbm->setSnapshotWriter(writer);
+    for (size_t i = 0; i < 10; i++)
+    {
+        lbm->step(true);
+    }
+    writer->flush();
+    EXPECT_EQ(lbm->getStep(), 10);
+
+    lbm->buildResultingDensityMatrix();
+    lbm->buildResultingTemperatureMatrix();
+    std::stringstream expected;
+    std::streambuf* coutBuffer = std::cout.rdbuf(expected.rdbuf());
+    std::cout << "mResultingDensityMatrix\n";
+    lbm->mResultingDensityMatrix.print();
+    std::cout << "mResultingTemperatureMatrix\n";
+    lbm->mResultingTemperatureMatrix.print();
+    std::cout << "mVelocityU\n";
+    Matrix<double>(8, 8).print();
+    std::cout << "mVelocityV\n";
+    Matrix<double>(8, 8).print();
+    std::cout.rdbuf(coutBuffer);
+
+    std::ifstream file(writer->getPath(10));
+    std::stringstream written;
+    written << file.rdbuf();
+    EXPECT_EQ(written.str(), expected.str());
+    std::filesystem::remove_all(directory);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, BinarySnapshotWriter) {
+    std::string directory = (std::filesystem::temp_directory_path() / "LatticeBoltzmannMethodD2Q9Test").string();
+    auto lbm = makeSolver(Matrix<double>(8, 8));
+    auto writer = std::make_shared<SnapshotWriter>(directory, "snapshot", SnapshotWriter::BINARY);
+    lbm->setSnapshotWriter(writer);
+    for (size_t i = 0; i < 10; i++)
+    {
+        lbm->step(true);
+    }
+    writer->flush();
+
+    lbm->buildResultingDensityMatrix();
+    lbm->buildResultingTemperatureMatrix();
+    FieldFile file(writer->getPath(10));
+    EXPECT_EQ(file.getStep(), 10);
+    EXPECT_EQ(file.getFieldNames().size(), 4);
+    FieldView<double> density     = file.getField<double>("mResultingDensityMatrix");
+    FieldView<double> temperature = file.getField<double>("mResultingTemperatureMatrix");
+    EXPECT_EQ(std::vector<double>(density.data, density.data + density.size()),
+              lbm->mResultingDensityMatrix.getShiftedData());
+    EXPECT_EQ(std::vector<double>(temperature.data, temperature.data + temperature.size()),
+              lbm->mResultingTemperatureMatrix.getShiftedData());
+    std::filesystem::remove_all(directory);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, CheckpointRestore) {
+    std::string path = (std::filesystem::temp_directory_path() / "LatticeBoltzmannMethodD2Q9Test.ckp").string();
     Matrix<double> m1(8, 8, 0.25);
-    LatticeBoltzmannMethodD2Q9 lbm (7, 7,
-        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0),
-        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::ADIABATIC),
-        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0),
-        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 1),
-        m1.getShiftedData(), m1.getShiftedData());
+    Matrix<double> m2(8, 8, 0.75);
+    for (bool compress : {false, true})
+    {
+        auto reference = makeSolver(m1);
+        for (size_t i = 0; i < 5; i++)
+        {
+            reference->step();
+        }
+        reference->checkpoint(path, compress);
+        for (size_t i = 0; i < 5; i++)
+        {
+            reference->step();
+        }
+        reference->buildResultingDensityMatrix();
+        reference->buildResultingTemperatureMatrix();
+
+        auto resumed = makeSolver(m2);
+        resumed->restore(path);
+        EXPECT_EQ(resumed->getStep(), 5);
+        for (size_t i = 0; i < 5; i++)
+        {
+            resumed->step();
+        }
+        resumed->buildResultingDensityMatrix();
+        resumed->buildResultingTemperatureMatrix();
+
+        EXPECT_EQ(resumed->getStep(), 10);
+        EXPECT_EQ(resumed->mResultingDensityMatrix.getShiftedData(), reference->mResultingDensityMatrix.getShiftedData());
+        EXPECT_EQ(resumed->mResultingTemperatureMatrix.getShiftedData(), reference->mResultingTemperatureMatrix.getShiftedData());
+    }
+
+    auto other = makeSolver(Matrix<double>(9, 9), {adiabatic, adiabatic, adiabatic, adiabatic});
+    EXPECT_THROW(other->restore(path), std::invalid_argument);
+    std::filesystem::remove(path);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, CheckpointRestoreScalars) {
+    // Scalar populations, diffusion coefficients and sides come back from the checkpoint
+    std::string path = (std::filesystem::temp_directory_path() / "LatticeBoltzmannMethodD2Q9ScalarTest.ckp").string();
+    Matrix<double> m1(8, 10, 0.25);
+    Matrix<double> m2(8, 10, 0.1);
+    const Matrix<double> initial = variedField(8, 10);
+    const Boundary& constant = constant1;
+    auto makeScalarSolver = [&m1]() {
+        return makeSolver(m1, {adiabatic, adiabatic, adiabatic, adiabatic}, LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    };
+
+    auto reference = makeScalarSolver();
+    reference->addScalar(m1.getShiftedData(), initial.getShiftedData(), constant, adiabatic, adiabatic, constant);
+    reference->addScalar(m2.getShiftedData(), m1.getShiftedData(), adiabatic, constant, constant, adiabatic);
+    reference->run(5);
+    reference->checkpoint(path, true);
+    reference->run(5);
+
+    // Different values and sides, all replaced by the restore
+    auto resumed = makeScalarSolver();
+    resumed->addScalar(m2.getShiftedData(), m1.getShiftedData(), adiabatic, adiabatic, adiabatic, adiabatic);
+    resumed->addScalar(m1.getShiftedData(), initial.getShiftedData(), adiabatic, adiabatic, adiabatic, adiabatic);
+    resumed->restore(path);
+    EXPECT_EQ(resumed->getStep(), 5);
+    resumed->run(5);
+    for (unsigned int s = 0; s < 2; s++)
+    {
+        EXPECT_EQ(resumed->buildResultingScalarMatrix(s).getShiftedData(),
+                  reference->buildResultingScalarMatrix(s).getShiftedData());
+    }
+
+    // A solver with another number of scalars rejects the checkpoint and keeps its state
+    auto fewer = makeScalarSolver();
+    fewer->addScalar(m1.getShiftedData(), initial.getShiftedData(), adiabatic, adiabatic, adiabatic, adiabatic);
+    fewer->run(2);
+    EXPECT_THROW(fewer->restore(path), std::invalid_argument);
+    EXPECT_EQ(fewer->getStep(), 2);
+    EXPECT_THROW(makeScalarSolver()->restore(path), std::invalid_argument);
+    std::filesystem::remove(path);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, CPUBackend) {
+    const Matrix<double> initial = variedField(8, 8);
+    auto reference = makeSolver(initial);
+    for (size_t i = 0; i < 10; i++)
+    {
+        reference->step();
+    }
+    reference->buildResultingDensityMatrix();
+    reference->buildResultingTemperatureMatrix();
+
+    auto cpu = makeSolver(initial, heatedRight, LatticeBoltzmannMethodD2Q9::Backend::CPU);
     for (size_t i = 0; i < 10; i++)
     {
-        lbm.step(true);
+        cpu->step();
+    }
+    cpu->buildResultingDensityMatrix();
+    cpu->buildResultingTemperatureMatrix();
+
+    std::vector<double> expected = reference->mResultingTemperatureMatrix.getShiftedData();
+    std::vector<double> result = cpu->mResultingTemperatureMatrix.getShiftedData();
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        EXPECT_NEAR(result[i], expected[i], 1e-12);
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, CPUBackendNonSquare) {
+    // More rows than columns, with a constant right side: both backends must set the same last column
+    const Matrix<double> initial = variedField(12, 7);
+    const Sides sides{adiabatic, constant0, adiabatic, constant1};
+    auto reference = makeSolver(initial, sides);
+    auto cpu = makeSolver(initial, sides, LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    for (size_t i = 0; i < 10; i++)
+    {
+        reference->step();
+        cpu->step();
+    }
+    reference->buildResultingDensityMatrix();
+    reference->buildResultingTemperatureMatrix();
+    cpu->buildResultingDensityMatrix();
+    cpu->buildResultingTemperatureMatrix();
+
+    std::vector<double> expected = reference->mResultingDensityMatrix.getShiftedData();
+    std::vector<double> result = cpu->mResultingDensityMatrix.getShiftedData();
+    ASSERT_EQ(result.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        EXPECT_NEAR(result[i], expected[i], 1e-12);
+    }
+    expected = reference->mResultingTemperatureMatrix.getShiftedData();
+    result = cpu->mResultingTemperatureMatrix.getShiftedData();
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        EXPECT_NEAR(result[i], expected[i], 1e-12);
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, BackendSwitch) {
+    // The OpenCL steps leave the populations shifted, the CPU steps after the switch read and replace them
+    const Matrix<double> initial = variedField(8, 10);
+    auto reference = makeSolver(initial);
+    reference->run(10);
+    reference->buildResultingTemperatureMatrix();
+
+    auto switched = makeSolver(initial);
+    switched->run(3);
+    switched->setBackend(LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    switched->run(7);
+    switched->buildResultingTemperatureMatrix();
+
+    std::vector<double> expected = reference->mResultingTemperatureMatrix.getShiftedData();
+    std::vector<double> result = switched->mResultingTemperatureMatrix.getShiftedData();
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        EXPECT_NEAR(result[i], expected[i], 1e-12);
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, RestoreShiftedCheckpoint) {
+    // A checkpoint of the OpenCL backend keeps the population shifts, the CPU backend resumes from it
+    std::string path = (std::filesystem::temp_directory_path() / "LatticeBoltzmannMethodD2Q9ShiftTest.ckp").string();
+    const Matrix<double> initial = variedField(8, 10);
+    const Sides sides{adiabatic, constant1, constant0, adiabatic};
+    auto reference = makeSolver(initial, sides);
+    reference->run(5);
+    reference->checkpoint(path);
+    reference->run(5);
+    reference->buildResultingDensityMatrix();
+
+    auto resumed = makeSolver(initial, sides, LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    resumed->restore(path);
+    resumed->run(5);
+    resumed->buildResultingDensityMatrix();
+
+    std::vector<double> expected = reference->mResultingDensityMatrix.getShiftedData();
+    std::vector<double> result = resumed->mResultingDensityMatrix.getShiftedData();
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        EXPECT_NEAR(result[i], expected[i], 1e-12);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, ShiftedPopulations) {
+    // Populations read through a shift advance like their unshifted copies, over several blocks
+    const unsigned int N = 12;
+    const unsigned int M = 14;
+    std::vector<double> values(N * M);
+    std::vector<double> u(N * M);
+    for (unsigned int i = 0; i < N * M; i++)
+    {
+        values[i] = (i * 37 % 101) / 101.0;
+        u[i] = 0.05 * std::sin(0.3 * i);
+    }
+    const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4> boundaries = {{
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}};
+    Matrix<double> viscosity(N, M, 0.1);
+    Matrix<double> diffusion(N, M, 0.2);
+    Matrix<double> velocity(N, M, u);
+    auto shifted = [](const Matrix<double>& matrix, int x, int y) {
+        Matrix<double> result(matrix.getN(), matrix.getM());
+        result.shift(x, y);
+        for (unsigned int row = 0; row < matrix.getN(); row++)
+        {
+            for (unsigned int col = 0; col < matrix.getM(); col++)
+            {
+                result.indexRevision(row, col, matrix(row, col));
+            }
+        }
+        return result;
+    };
+
+    Matrix<double> f[9];
+    Matrix<double> g[9];
+    Matrix<double> shiftedF[9];
+    Matrix<double> shiftedG[9];
+    std::vector<LatticeBoltzmannMethodD2Q9CPU::Scalar> scalars(1);
+    std::vector<LatticeBoltzmannMethodD2Q9CPU::Scalar> shiftedScalars(1);
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        f[k] = Matrix<double>(N, M, values, D2Q9::WEIGHT[k]);
+        g[k] = Matrix<double>(N, M, values, 0.5 * D2Q9::WEIGHT[k]);
+        shiftedF[k] = shifted(f[k], D2Q9::CX[k], D2Q9::CY[k]);
+        shiftedG[k] = shifted(g[k], 2 * D2Q9::CX[k], -D2Q9::CY[k]);
+        scalars[0].populations[k] = g[k];
+        shiftedScalars[0].populations[k] = shiftedG[k];
+    }
+    scalars[0].diffusionCoefficient = diffusion;
+    scalars[0].boundaries = boundaries;
+    shiftedScalars[0].diffusionCoefficient = diffusion;
+    shiftedScalars[0].boundaries = boundaries;
+
+    LatticeBoltzmannMethodD2Q9CPU cpu(1, 8);
+    LatticeBoltzmannMethodD2Q9CPU shiftedCPU(1, 8);
+    cpu.advance(f, g, viscosity, diffusion, velocity, velocity, boundaries, 3);
+    cpu.advanceScalars(scalars, velocity, velocity, 3);
+    shiftedCPU.advance(shiftedF, shiftedG, viscosity, diffusion, velocity, velocity, boundaries, 3);
+    shiftedCPU.advanceScalars(shiftedScalars, velocity, velocity, 3);
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        EXPECT_EQ(shiftedF[k].getShiftedData(), f[k].getShiftedData());
+        EXPECT_EQ(shiftedG[k].getShiftedData(), g[k].getShiftedData());
+        EXPECT_EQ(shiftedScalars[0].populations[k].getShiftedData(), scalars[0].populations[k].getShiftedData());
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, PaddedRows) {
+    // Padding changes the layout only: the CPU tiles, the fused and scalar kernels and the formulas skip it
+    const Matrix<double> initial = variedField(12, 10);
+    const Matrix<double> diffusion(12, 10, 0.1);
+    const Sides sides{constant1, adiabatic, open, adiabatic};
+    for (auto backend : {LatticeBoltzmannMethodD2Q9::Backend::OPENCL, LatticeBoltzmannMethodD2Q9::Backend::CPU})
+    {
+        auto packed = makeSolver(initial, sides, backend);
+        auto padded = makeSolver(initial, sides, backend);
+        for (auto* lbm : {packed.get(), padded.get()})
+        {
+            lbm->setCollision(CollisionOperator::TRT, CollisionOperator::MRT);
+            lbm->addScalar(diffusion.getShiftedData(), initial.getShiftedData(), constant1, adiabatic, adiabatic, open);
+        }
+        EXPECT_THROW(padded->setRowPitch(9), std::invalid_argument);
+        padded->setRowPitch(Matrix<double>::alignedPitch(10) + 3);
+        for (auto* lbm : {packed.get(), padded.get()})
+        {
+            lbm->addScalar(diffusion.getShiftedData(), initial.getShiftedData(), open, constant0, adiabatic, adiabatic);
+            lbm->run(7);
+            lbm->buildResultingDensityMatrix();
+            lbm->buildResultingTemperatureMatrix();
+        }
+        EXPECT_EQ(padded->mResultingDensityMatrix.getShiftedData(), packed->mResultingDensityMatrix.getShiftedData());
+        EXPECT_EQ(padded->mResultingTemperatureMatrix.getShiftedData(),
+                  packed->mResultingTemperatureMatrix.getShiftedData());
+        for (unsigned int s = 0; s < 2; s++)
+        {
+            EXPECT_EQ(padded->buildResultingScalarMatrix(s).getShiftedData(),
+                      packed->buildResultingScalarMatrix(s).getShiftedData());
+        }
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, TemporalBlocking) {
+    const Matrix<double> initial = variedField(12, 10);
+    const Sides sides{constant1, adiabatic, open, adiabatic};
+    auto reference = makeSolver(initial, sides, LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    reference->setTemporalBlocking(1, 64);
+    for (size_t i = 0; i < 11; i++)
+    {
+        reference->step();
+    }
+    reference->buildResultingDensityMatrix();
+
+    for (unsigned int depth : {2, 3, 5})
+    {
+        auto blocked = makeSolver(initial, sides, LatticeBoltzmannMethodD2Q9::Backend::CPU);
+        blocked->setTemporalBlocking(depth, 4);
+        blocked->run(11);
+        blocked->buildResultingDensityMatrix();
+        EXPECT_EQ(blocked->getStep(), 11);
+        EXPECT_EQ(blocked->mResultingDensityMatrix.getShiftedData(), reference->mResultingDensityMatrix.getShiftedData());
+    }
+    EXPECT_THROW(reference->setTemporalBlocking(0), std::invalid_argument);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, Diagnostics) {
+    const Matrix<double> initial = variedField(12, 10);
+    auto lbm = makeSolver(initial, {constant1, adiabatic, open, adiabatic}, LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    lbm->setTemporalBlocking(4, 4);
+
+    std::vector<LatticeBoltzmannMethodD2Q9::Diagnostics> reports;
+    lbm->setDiagnostics(3, [&reports](const LatticeBoltzmannMethodD2Q9::Diagnostics& diagnostics) {
+        reports.push_back(diagnostics);
+    });
+    lbm->run(10);
+    lbm->step();
+    lbm->step();
+    ASSERT_EQ(reports.size(), 4);
+    EXPECT_EQ(reports[0].step, 3);
+    EXPECT_EQ(reports[2].step, 9);
+    EXPECT_EQ(reports[3].step, 12);
+
+    lbm->buildResultingDensityMatrix();
+    lbm->buildResultingTemperatureMatrix();
+    double mass = 0;
+    double heat = 0;
+    for (double value : lbm->mResultingDensityMatrix.getData())
+    {
+        mass += value;
+    }
+    for (double value : lbm->mResultingTemperatureMatrix.getData())
+    {
+        heat += value;
+    }
+    EXPECT_NEAR(reports[3].mass, mass, 1e-12);
+    EXPECT_NEAR(reports[3].heat, heat, 1e-12);
+    EXPECT_EQ(reports[3].maxVelocity, 0);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, Convergence) {
+    // Slow diffusion on a larger lattice, so the residual decays over a few thousand steps
+    Matrix<double> initial(30, 30);
+    for (unsigned int i = 0; i < 900; i++)
+    {
+        initial.indexRevision(i / 30, i % 30, 0.1 + (i * 37 % 120) / 120.0);
+    }
+    auto makeSlowSolver = [&initial]() {
+        return makeSolver(initial, {constant1, constant0, adiabatic, adiabatic},
+            LatticeBoltzmannMethodD2Q9::Backend::CPU, 0.001, 0.001);
+    };
+
+    auto lbm = makeSlowSolver();
+    lbm->setConvergence(1e-9, 8, 1024);
+    lbm->run(100000);
+    EXPECT_TRUE(lbm->hasConverged());
+    EXPECT_LT(lbm->getResidual(), 1e-9);
+    EXPECT_LT(lbm->getStep(), 100000);
+    EXPECT_GT(lbm->getConvergenceInterval(), 8);
+
+    // Further runs stop right away, and the fields are steady indeed
+    unsigned int step = lbm->getStep();
+    lbm->buildResultingTemperatureMatrix();
+    std::vector<double> steady = lbm->mResultingTemperatureMatrix.getShiftedData();
+    lbm->run(10);
+    EXPECT_EQ(lbm->getStep(), step);
+    lbm->setConvergence(0);
+    lbm->run(10);
+    EXPECT_EQ(lbm->getStep(), step + 10);
+    lbm->buildResultingTemperatureMatrix();
+    std::vector<double> later = lbm->mResultingTemperatureMatrix.getShiftedData();
+    for (size_t i = 0; i < steady.size(); i++)
+    {
+        EXPECT_NEAR(later[i], steady[i], 1e-4);
     }
-}
\ No newline at end of file
+
+    // A tight tolerance is not reached within the budget
+    auto unconverged = makeSlowSolver();
+    unconverged->setConvergence(1e-15);
+    unconverged->run(200);
+    EXPECT_FALSE(unconverged->hasConverged());
+    EXPECT_EQ(unconverged->getStep(), 200);
+
+    EXPECT_THROW(unconverged->setConvergence(1e-6, 0), std::invalid_argument);
+    EXPECT_THROW(unconverged->setConvergence(1e-6, 64, 32), std::invalid_argument);
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, TileSkipping) {
+    // A hot corner in a cold lattice: most tiles stay at zero until the front reaches them
+    const unsigned int N = 64;
+    const unsigned int M = 72;
+    std::vector<double> hot(N * M, 0.0);
+    for (unsigned int row = 2; row < 6; row++)
+    {
+        for (unsigned int col = 3; col < 7; col++)
+        {
+            hot[row * M + col] = 1;
+        }
+    }
+    const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4> boundaries = {{
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}};
+    Matrix<double> viscosity(N, M, 0.1);
+    Matrix<double> diffusion(N, M, 0.2);
+    Matrix<double> velocity(N, M);
+
+    auto advance = [&](bool skipping, unsigned int depth, std::vector<unsigned int>* skipped) {
+        Matrix<double> f[9];
+        Matrix<double> g[9];
+        for (unsigned int k = 0; k < 9; k++)
+        {
+            f[k] = Matrix<double>(N, M, hot, D2Q9::WEIGHT[k]);
+            g[k] = Matrix<double>(N, M, hot, 0.5 * D2Q9::WEIGHT[k]);
+        }
+        LatticeBoltzmannMethodD2Q9CPU cpu(depth, 8);
+        cpu.setTileSkipping(skipping);
+        for (unsigned int steps : {3, 6, 1, 12, 20})
+        {
+            cpu.advance(f, g, viscosity, diffusion, velocity, velocity, boundaries, steps);
+            if (skipped != nullptr)
+            {
+                skipped->push_back(cpu.getSkippedTiles());
+            }
+        }
+        std::vector<double> result = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(f).getShiftedData();
+        std::vector<double> temperature = LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(g).getShiftedData();
+        result.insert(result.end(), temperature.begin(), temperature.end());
+        return result;
+    };
+
+    for (unsigned int depth : {1, 2, 3})
+    {
+        std::vector<unsigned int> skipped;
+        EXPECT_EQ(advance(true, depth, &skipped), advance(false, depth, nullptr));
+        EXPECT_GT(skipped[3], 0);
+        // A block of a different depth than the one before cannot rely on the recorded activity
+        EXPECT_EQ(skipped[2] == 0, depth != 1);
+    }
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, PassiveScalars) {
+    // Every scalar evolves like the temperature of a solver with its coefficient and sides
+    Matrix<double> m1(12, 10, 0.25);
+    Matrix<double> m2(12, 10, 0.1);
+    Matrix<double> initial(12, 10);
+    Matrix<double> other(12, 10);
+    for (unsigned int i = 0; i < 120; i++)
+    {
+        initial.indexRevision(i / 10, i % 10, 0.1 + (i * 37 % 120) / 120.0);
+        other.indexRevision(i / 10, i % 10, (i * 53 % 120) / 60.0);
+    }
+    // The fluid is at rest, so the density does not steer the temperature
+    const Boundary& constant = constant1;
+    auto makeScalarSolver = [](const Boundary& top, const Boundary& left, double diffusion,
+                               const Matrix<double>& temperature) {
+        return makeSolver(temperature, {top, adiabatic, left, adiabatic}, LatticeBoltzmannMethodD2Q9::Backend::CPU,
+            0.25, diffusion);
+    };
+
+    auto first = makeScalarSolver(constant, open, 0.25, initial);
+    auto second = makeScalarSolver(open, constant, 0.1, other);
+    auto lbm = makeScalarSolver(constant, open, 0.25, initial);
+    lbm->setTemporalBlocking(3, 4);
+    EXPECT_EQ(lbm->addScalar(m1.getShiftedData(), initial.getShiftedData(), constant, adiabatic, open, adiabatic), 0);
+    EXPECT_EQ(lbm->addScalar(m2.getShiftedData(), other.getShiftedData(), open, adiabatic, constant, adiabatic), 1);
+    EXPECT_EQ(lbm->getScalarCount(), 2);
+    EXPECT_THROW(lbm->addScalar(std::vector<double>(7), {}, open, open, open, open), std::invalid_argument);
+    EXPECT_THROW(lbm->buildResultingScalarMatrix(2), std::out_of_range);
+
+    first->run(7);
+    second->run(7);
+    lbm->run(7);
+    first->buildResultingTemperatureMatrix();
+    second->buildResultingTemperatureMatrix();
+    EXPECT_EQ(lbm->buildResultingScalarMatrix(0).getShiftedData(), first->mResultingTemperatureMatrix.getShiftedData());
+    EXPECT_EQ(lbm->buildResultingScalarMatrix(1).getShiftedData(), second->mResultingTemperatureMatrix.getShiftedData());
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, PassiveScalarsShareTheVelocity) {
+    const unsigned int N = 20;
+    const unsigned int M = 18;
+    std::vector<double> values(N * M);
+    std::vector<double> u(N * M);
+    std::vector<double> v(N * M);
+    for (unsigned int i = 0; i < N * M; i++)
+    {
+        values[i] = (i * 37 % 101) / 101.0;
+        u[i] = 0.05 * std::sin(0.3 * i);
+        v[i] = 0.05 * std::cos(0.2 * i);
+    }
+    const std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4> boundaries = {{
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}};
+    Matrix<double> viscosity(N, M, 0.1);
+    Matrix<double> diffusion(N, M, 0.2);
+    Matrix<double> velocityU(N, M, u);
+    Matrix<double> velocityV(N, M, v);
+
+    Matrix<double> f[9];
+    Matrix<double> g[9];
+    std::vector<LatticeBoltzmannMethodD2Q9CPU::Scalar> scalars(2);
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        f[k] = Matrix<double>(N, M, values, D2Q9::WEIGHT[k]);
+        g[k] = Matrix<double>(N, M, values, 0.5 * D2Q9::WEIGHT[k]);
+        scalars[0].populations[k] = g[k];
+        scalars[1].populations[k] = Matrix<double>(N, M, 0.25 * D2Q9::WEIGHT[k]);
+    }
+    scalars[0].diffusionCoefficient = diffusion;
+    scalars[0].boundaries = boundaries;
+    scalars[1].diffusionCoefficient = Matrix<double>(N, M, 0.05);
+    scalars[1].boundaries = {{
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}}};
+
+    std::vector<LatticeBoltzmannMethodD2Q9CPU::Scalar> alone(scalars.begin() + 1, scalars.end());
+    LatticeBoltzmannMethodD2Q9CPU cpu(2, 8);
+    cpu.advance(f, g, viscosity, diffusion, velocityU, velocityV, boundaries, 5);
+    cpu.advanceScalars(scalars, velocityU, velocityV, 5);
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        EXPECT_EQ(scalars[0].populations[k].getShiftedData(), g[k].getShiftedData());
+    }
+    // Scalars sharing a block do not see each other
+    LatticeBoltzmannMethodD2Q9CPU(1, 64).advanceScalars(alone, velocityU, velocityV, 5);
+    EXPECT_EQ(LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(scalars[1].populations).getShiftedData(),
+              LatticeBoltzmannMethodD2Q9CPU::buildResultingMatrix(alone[0].populations).getShiftedData());
+}
+
+TEST_F(LatticeBoltzmannMethodD2Q9Test, OtherDescriptors) {
+    const unsigned int N = 20;
+    const unsigned int M = 18;
+    std::vector<double> values(N * M);
+    std::vector<double> u(N * M);
+    std::vector<double> v(N * M);
+    for (unsigned int i = 0; i < N * M; i++)
+    {
+        values[i] = (i * 37 % 101) / 101.0;
+        u[i] = 0.05 * std::sin(0.3 * i);
+        v[i] = 0.05 * std::cos(0.2 * i);
+    }
+    using Sides = std::array<LatticeBoltzmannMethodD2Q9CPU::Boundary, 4>;
+    const Sides mixed = {{
+        {LatticeBoltzmannMethodD2Q9CPU::CONSTANT, 0.5},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::ADIABATIC, 0}}};
+    const Sides periodic = {{
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0},
+        {LatticeBoltzmannMethodD2Q9CPU::PERIODIC, 0}}};
+    Matrix<double> viscosity(N, M, 0.1);
+    Matrix<double> diffusion(N, M, 0.2);
+    Matrix<double> velocityU(N, M, u);
+    Matrix<double> velocityV(N, M, v);
+
+    // Populations of both fields after 7 steps, the descriptor given by a value of its type
+    auto advance = [&](auto descriptor, LatticeBoltzmannMethodD2Q9CPU& cpu, const Sides& sides) {
+        using DESCRIPTOR = decltype(descriptor);
+        Matrix<double> f[DESCRIPTOR::Q];
+        Matrix<double> g[DESCRIPTOR::Q];
+        for (unsigned int k = 0; k < DESCRIPTOR::Q; k++)
+        {
+            f[k] = Matrix<double>(N, M, values, DESCRIPTOR::WEIGHT[k]);
+            g[k] = Matrix<double>(N, M, values, 0.5 * DESCRIPTOR::WEIGHT[k]);
+        }
+        cpu.advance<DESCRIPTOR>(f, g, viscosity, diffusion, velocityU, velocityV, sides, 7);
+        std::vector<double> populations;
+        for (unsigned int k = 0; k < DESCRIPTOR::Q; k++)
+        {
+            const std::vector<double> density = f[k].getShiftedData();
+            const std::vector<double> temperature = g[k].getShiftedData();
+            populations.insert(populations.end(), density.begin(), density.end());
+            populations.insert(populations.end(), temperature.begin(), temperature.end());
+        }
+        return populations;
+    };
+
+    // The blocks of D2Q13 need a halo of three cells per step, any less and the depths would disagree
+    for (const Sides& sides : {mixed, periodic})
+    {
+        LatticeBoltzmannMethodD2Q9CPU reference(1, 64);
+        reference.setCollision(CollisionOperator::TRT, CollisionOperator::BGK);
+        reference.setSmagorinsky(0.15);
+        reference.setBuoyancy(0, -0.01, 0.5);
+        const std::vector<double> d2q5 = advance(D2Q5(), reference, sides);
+        const std::vector<double> d2q13 = advance(D2Q13(), reference, sides);
+        EXPECT_EQ(d2q5.size(), 2 * 5 * N * M);
+        EXPECT_EQ(d2q13.size(), 2 * 13 * N * M);
+        for (unsigned int depth : {2u, 3u})
+        {
+            LatticeBoltzmannMethodD2Q9CPU cpu(depth, 3);
+            cpu.setCollision(CollisionOperator::TRT, CollisionOperator::BGK);
+            cpu.setSmagorinsky(0.15);
+            cpu.setBuoyancy(0, -0.01, 0.5);
+            EXPECT_EQ(advance(D2Q5(), cpu, sides), d2q5);
+            EXPECT_EQ(advance(D2Q13(), cpu, sides), d2q13);
+        }
+    }
+
+    LatticeBoltzmannMethodD2Q9CPU mrt(2, 8);
+    mrt.setCollision(CollisionOperator::MRT, CollisionOperator::BGK);
+    EXPECT_THROW(advance(D2Q5(), mrt, periodic), std::invalid_argument);
+}
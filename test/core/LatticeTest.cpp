@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <string>
+#include "../../src/core/Lattice.hpp"
+
+class LatticeTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+    }
+
+    void TearDown() override {
+
+    }
+
+    // Moments up to the given order: weights sum to 1, odd moments vanish, c_s^2 from the descriptor, and for
+    // order 4 the isotropic fourth moments 3 c_s^4 and c_s^4
+    template<class DESCRIPTOR>
+    void expectIsotropic(unsigned int order) {
+        const double cs2 = 1 / DESCRIPTOR::INVERSE_SOUND_SPEED_SQUARED;
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(0, 0), 1, 1e-15);
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(1, 0), 0, 1e-15);
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(0, 1), 0, 1e-15);
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(2, 0), cs2, 1e-15);
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(0, 2), cs2, 1e-15);
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(1, 1), 0, 1e-15);
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(3, 0), 0, 1e-15);
+        EXPECT_NEAR(latticeMoment<DESCRIPTOR>(2, 1), 0, 1e-15);
+        if (order >= 4)
+        {
+            EXPECT_NEAR(latticeMoment<DESCRIPTOR>(4, 0), 3 * cs2 * cs2, 1e-15);
+            EXPECT_NEAR(latticeMoment<DESCRIPTOR>(2, 2), cs2 * cs2, 1e-15);
+            EXPECT_NEAR(latticeMoment<DESCRIPTOR>(3, 1), 0, 1e-15);
+        }
+    }
+
+    template<class DESCRIPTOR>
+    void expectOpposite() {
+        constexpr std::array<unsigned int, DESCRIPTOR::Q> opposite = latticeOpposite<DESCRIPTOR>();
+        for (unsigned int k = 0; k < DESCRIPTOR::Q; k++)
+        {
+            EXPECT_EQ(DESCRIPTOR::CX[opposite[k]], -DESCRIPTOR::CX[k]);
+            EXPECT_EQ(DESCRIPTOR::CY[opposite[k]], -DESCRIPTOR::CY[k]);
+            EXPECT_EQ(opposite[opposite[k]], k);
+        }
+    }
+};
+
+TEST_F(LatticeTest, Isotropy) {
+    expectIsotropic<D2Q5>(2);
+    expectIsotropic<D2Q9>(4);
+    expectIsotropic<D2Q13>(4);
+}
+
+TEST_F(LatticeTest, Opposite) {
+    expectOpposite<D2Q5>();
+    expectOpposite<D2Q9>();
+    expectOpposite<D2Q13>();
+    static_assert(LATTICE_OPPOSITE<D2Q9>[5] == 7 && LATTICE_OPPOSITE<D2Q9>[6] == 8);
+}
+
+TEST_F(LatticeTest, Reach) {
+    static_assert(latticeReach<D2Q5>() == 1);
+    static_assert(latticeReach<D2Q9>() == 1);
+    static_assert(latticeReach<D2Q13>() == 2);
+}
+
+TEST_F(LatticeTest, SidesOfD2Q9) {
+    // The directions entering through top, bottom, left and right, see LatticeBoltzmannMethodD2Q9::streaming()
+    const unsigned int entering[4][3] = {{4, 7, 8}, {2, 5, 6}, {1, 5, 8}, {3, 6, 7}};
+    for (unsigned int side = 0; side < 4; side++)
+    {
+        unsigned int count = 0;
+        for (unsigned int k = 0; k < D2Q9::Q; k++)
+        {
+            if (latticeEnters<D2Q9>(side, k))
+            {
+                ASSERT_LT(count, 3);
+                EXPECT_EQ(k, entering[side][count++]);
+            }
+        }
+        EXPECT_EQ(count, 3);
+    }
+    EXPECT_EQ(latticeRowOffset<D2Q9>()[2], -1);
+    EXPECT_EQ(latticeRowOffset<D2Q9>()[7], 1);
+}
+
+TEST_F(LatticeTest, HandUnrolledD2Q9) {
+    // The generic helpers reproduce the hand-written D2Q9 arithmetic bit for bit
+    const double u = 0.037;
+    const double v = -0.081;
+    const double expected[9] = {1,
+                                1 + 3 * u,
+                                1 + 3 * v,
+                                1 - 3 * u,
+                                1 - 3 * v,
+                                1 + 3 * u + 3 * v,
+                                1 - 3 * u + 3 * v,
+                                1 - 3 * u - 3 * v,
+                                1 + 3 * u - 3 * v};
+    const double u2 = u * u;
+    const double v2 = v * v;
+    const double uv2 = u2 + v2;
+    const double equilibrium[9] = {1 - 1.5 * uv2,
+                                   1 + 3 * u + 4.5 * u2 - 1.5 * uv2,
+                                   1 + 3 * v + 4.5 * v2 - 1.5 * uv2,
+                                   1 - 3 * u + 4.5 * u2 - 1.5 * uv2,
+                                   1 - 3 * v + 4.5 * v2 - 1.5 * uv2,
+                                   1 + 3 * u + 3 * v + 3 * uv2,
+                                   1 - 3 * u + 3 * v + 3 * uv2,
+                                   1 - 3 * u - 3 * v + 3 * uv2,
+                                   1 + 3 * u - 3 * v + 3 * uv2};
+    double f[2 * 9];
+    for (unsigned int k = 0; k < 9; k++)
+    {
+        EXPECT_EQ(latticeAdvection<D2Q9>(k, u, v), expected[k]);
+        EXPECT_EQ(latticeEquilibrium<D2Q9>(k, u, v), equilibrium[k]);
+        f[2 * k] = std::sin(k + 1.0);
+        f[2 * k + 1] = 0;
+    }
+    EXPECT_EQ(latticeSum<D2Q9>(f, 2),
+              f[0] * (4 / 9.0) + f[2] * (1 / 9.0) + f[4] * (1 / 9.0) + f[6] * (1 / 9.0) + f[8] * (1 / 9.0) +
+                  f[10] * (1 / 36.0) + f[12] * (1 / 36.0) + f[14] * (1 / 36.0) + f[16] * (1 / 36.0));
+}
+
+TEST_F(LatticeTest, FormulasOfD2Q9) {
+    // The generated text spells out the hand-written formulas, and the printed weights read back exactly
+    EXPECT_EQ(latticeAdvectionFormula<D2Q9>(0, "u", "v"), "1");
+    EXPECT_EQ(latticeAdvectionFormula<D2Q9>(7, "u", "v"), "1 - 3 * u - 3 * v");
+    EXPECT_EQ(latticeEquilibriumFormula<D2Q9>(0, "u", "v", "u2", "v2", "uv2"), "1 - 1.5 * uv2");
+    EXPECT_EQ(latticeEquilibriumFormula<D2Q9>(2, "u", "v", "u2", "v2", "uv2"), "1 + 3 * v + 4.5 * v2 - 1.5 * uv2");
+    EXPECT_EQ(latticeEquilibriumFormula<D2Q9>(8, "u", "v", "u2", "v2", "uv2"), "1 + 3 * u - 3 * v + 3 * uv2");
+    for (unsigned int k = 0; k < D2Q9::Q; k++)
+    {
+        EXPECT_EQ(std::stod(latticeLiteral(D2Q9::WEIGHT[k])), D2Q9::WEIGHT[k]);
+    }
+    const std::string sum = latticeSumFormula<D2Q9>();
+    EXPECT_EQ(sum.find("A * ("), 0u);
+    EXPECT_NE(sum.find(" + I * ("), std::string::npos);
+
+    const std::string source = latticeSource<D2Q9>();
+    EXPECT_NE(source.find("constant int OPPOSITE[9] = {0, 3, 4, 1, 2, 7, 8, 5, 6};"), std::string::npos);
+    EXPECT_NE(source.find("constant int ROW_OFFSET[9] = {0, 0, -1, 0, 1, -1, -1, 1, 1};"), std::string::npos);
+    EXPECT_NE(source.find("case 5: return 1 + 3 * u + 3 * v + 3 * uv2;"), std::string::npos);
+}
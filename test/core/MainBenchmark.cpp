@@ -3,6 +3,8 @@
 #include "../../src/core/Matrix.hpp"
 #include "../../src/core/LatticeBoltzmannMethodD2Q9.h"
 #include "../../src/core/LatticeBoltzmannMethodD2Q9.cpp"
+#include "../../src/core/LatticeBoltzmannMethodD2Q9Ensemble.h"
+#include "../../src/core/LatticeBoltzmannMethodD2Q9Ensemble.cpp"
 
 static void LatticeBoltzmannMethodD2Q9_Initiation(benchmark::State& state) {
     unsigned int SIZE = 3072;
@@ -33,6 +35,49 @@ static void LatticeBoltzmannMethodD2Q9_Step(benchmark::State& state) {
 }
 BENCHMARK(LatticeBoltzmannMethodD2Q9_Step);
 
+static void LatticeBoltzmannMethodD2Q9_TemporalBlocking(benchmark::State& state) {
+    unsigned int SIZE = 3072;
+    unsigned int DEPTH = state.range(0);
+    Matrix<double> m1(SIZE, SIZE, 0.25);
+    LatticeBoltzmannMethodD2Q9 lbm (SIZE - 1, SIZE - 1,
+        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0),
+        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::ADIABATIC),
+        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 1),
+        LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0),
+        m1.getShiftedData(), m1.getShiftedData());
+    lbm.setBackend(LatticeBoltzmannMethodD2Q9::Backend::CPU);
+    lbm.setTemporalBlocking(DEPTH);
+    for (auto _ : state) {
+        lbm.run(8);
+    }
+    state.counters["MLUPS"] = benchmark::Counter(
+        static_cast<double>(state.iterations()) * SIZE * SIZE * 8 / 1e6, benchmark::Counter::kIsRate);
+}
+BENCHMARK(LatticeBoltzmannMethodD2Q9_TemporalBlocking)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
+
+static void LatticeBoltzmannMethodD2Q9Ensemble_Step(benchmark::State& state) {
+    unsigned int SIZE = 128;
+    unsigned int MEMBERS = state.range(0);
+    Matrix<double> m1(SIZE, SIZE, 0.25);
+    std::vector<LatticeBoltzmannMethodD2Q9Ensemble::Member> members(MEMBERS);
+    for (unsigned int i = 0; i < MEMBERS; i++) {
+        members[i] = {0.25 + i * 0.001, 0.25,
+            LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0),
+            LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::ADIABATIC),
+            LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 1),
+            LatticeBoltzmannMethodD2Q9::Boundary(LatticeBoltzmannMethodD2Q9::BoundaryType::CONSTANT, 0),
+            m1.getShiftedData(), m1.getShiftedData(), {}, {}};
+    }
+    LatticeBoltzmannMethodD2Q9Ensemble ensemble(SIZE - 1, SIZE - 1, members);
+    for (auto _ : state) {
+        ensemble.step();
+        ensemble.buildResultingDensityMatrix(0);
+    }
+    state.counters["MLUPS"] = benchmark::Counter(
+        static_cast<double>(state.iterations()) * SIZE * SIZE * MEMBERS / 1e6, benchmark::Counter::kIsRate);
+}
+BENCHMARK(LatticeBoltzmannMethodD2Q9Ensemble_Step)->Arg(1)->Arg(16)->Arg(256);
+
 // static void LatticeBoltzmannMethodD2Q9_BuildResultMatrix(benchmark::State& state) {
 //     Matrix<unsigned int> m1(4096, 4096, 1);
 //     LatticeBoltzmannMethodD2Q9 lbm (4096, 4096, 
@@ -260,6 +260,116 @@ TEST_F(MatrixTest, ColRevision) {
     EXPECT_EQ(m8.getShiftedData(), m0.getShiftedData());
 }
 
+TEST_F(MatrixTest, RightDirichlet) {
+    // The last column of every row, also when the matrix has more rows than columns
+    Matrix<double> m0(4, 2);
+    Matrix<double> opposite(4, 2, {1, 2, 3, 4, 5, 6, 7, 8});
+    m0.rightDirichlet(10, opposite);
+    EXPECT_EQ(m0.getShiftedData(), std::vector<double>({0, 8, 0, 6, 0, 4, 0, 2}));
+
+    Matrix<double> m1(2, 4);
+    m1.shift(1, 1);
+    m1.rightDirichlet(10, m1);
+    EXPECT_EQ(m1.getShiftedData(), std::vector<double>({0, 0, 0, 10, 0, 0, 0, 10}));
+}
+
+TEST_F(MatrixTest, Expression) {
+    Matrix<double> a(3, 4, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12});
+    Matrix<double> b(3, 4, 2.0);
+    Matrix<double> c = a * 0.5 + b / a - 1.0 - (-a) * b;
+    ASSERT_EQ(c.getN(), 3);
+    ASSERT_EQ(c.getM(), 4);
+    EXPECT_EQ(c.getRowShiftIndex(), 0);
+    EXPECT_EQ(c.getColShiftIndex(), 0);
+    std::vector<double> values = a.getShiftedData();
+    std::vector<double> result = c.getShiftedData();
+    for (size_t i = 0; i < values.size(); ++i) {
+        EXPECT_EQ(result[i], values[i] * 0.5 + 2.0 / values[i] - 1.0 - (-values[i]) * 2.0);
+    }
+
+    Matrix<int> d = 2 * a;
+    EXPECT_EQ(d.getShiftedData(), (std::vector<int>{2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24}));
+
+    EXPECT_THROW(a + Matrix<double>(4, 3), std::invalid_argument);
+}
+
+TEST_F(MatrixTest, ExpressionShifted) {
+    Matrix<int> a(3, 3, {1, 2, 3, 4, 5, 6, 7, 8, 9});
+    Matrix<int> b(3, 3, {10, 20, 30, 40, 50, 60, 70, 80, 90});
+    a.shift(1, 0);
+    b.shift(-1, 1);
+    std::vector<int> shiftedA = a.getShiftedData();
+    std::vector<int> shiftedB = b.getShiftedData();
+
+    Matrix<int> c = a + b;
+    std::vector<int> result = c.getShiftedData();
+    for (size_t i = 0; i < result.size(); ++i) {
+        EXPECT_EQ(result[i], shiftedA[i] + shiftedB[i]);
+        EXPECT_EQ(a(i / 3, i % 3), shiftedA[i]);
+    }
+
+    // In place through the shift of the destination, which also appears in the expression
+    a = a * 2 - b;
+    EXPECT_EQ(a.getColShiftIndex(), 1);
+    result = a.getShiftedData();
+    for (size_t i = 0; i < result.size(); ++i) {
+        EXPECT_EQ(result[i], shiftedA[i] * 2 - shiftedB[i]);
+    }
+
+    // A new size reallocates, unshifted
+    Matrix<int> e(2, 2);
+    e.shift(1, 1);
+    e = a + 1;
+    EXPECT_EQ(e.getN(), 3);
+    EXPECT_EQ(e.getRowShiftIndex(), 0);
+    EXPECT_EQ(e.getShiftedData()[0], result[0] + 1);
+}
+
+TEST_F(MatrixTest, RowPitch) {
+    Matrix<double> dense(5, 3, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15});
+    dense.shift(1, 2);
+    Matrix<double> padded = dense;
+    EXPECT_EQ(padded.getPitch(), 3);
+    EXPECT_EQ(Matrix<double>::alignedPitch(3), 8);
+    EXPECT_EQ(Matrix<double>::alignedPitch(16), 16);
+    EXPECT_EQ(Matrix<double>::alignedPitch(3073), 3080);
+    EXPECT_THROW(padded.setRowPitch(2), std::invalid_argument);
+
+    padded.setRowPitch(Matrix<double>::alignedPitch(3));
+    EXPECT_EQ(padded.getPitch(), 8);
+    EXPECT_EQ(padded.getLength(), 15);
+    EXPECT_EQ(padded.getShiftIndexPair(), dense.getShiftIndexPair());
+    EXPECT_EQ(padded.getShiftedData(), dense.getShiftedData());
+    EXPECT_EQ(padded.getData(), dense.getData());
+    EXPECT_TRUE(padded == dense);
+    for (unsigned int row = 0; row < 5; ++row) {
+        // Every row starts on a cache line
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(padded.getDataData() + row * padded.getPitch()) % LATTICE_CACHE_LINE, 0u);
+    }
+
+    // Revisions, boundary routines and expressions address the padded rows
+    padded.indexRevision(1, 2, -1);
+    dense.indexRevision(1, 2, -1);
+    padded.rowRevision(3, -2);
+    dense.rowRevision(3, -2);
+    padded.topAdiabatic();
+    dense.topAdiabatic();
+    padded.rightAdiabatic();
+    dense.rightAdiabatic();
+    padded.leftDirichlet(1, padded);
+    dense.leftDirichlet(1, dense);
+    EXPECT_EQ(padded.getShiftedData(), dense.getShiftedData());
+    padded = padded * 2 + dense;
+    EXPECT_EQ(padded.getPitch(), 8);
+    EXPECT_EQ(padded.getShiftedData(), Matrix<double>(dense * 3).getShiftedData());
+
+    Matrix<double> copy(padded);
+    EXPECT_EQ(copy.getPitch(), 8);
+    copy.resetData(dense.getData());
+    EXPECT_EQ(copy.getData(), dense.getData());
+    EXPECT_EQ(copy.getRowShiftIndex(), 0);
+}
+
 // TEST_F(CartesianMatrixTest, MismatchedRowCount) {
 //     std::vector<std::vector<int>> values = {
 //         {1, 2, 3},
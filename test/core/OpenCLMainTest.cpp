@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include <deque>
+#include <map>
+#include <thread>
 #include "../../src/core/OpenCLMain.hpp"
 #include "../../src/core/Matrix.hpp"
 class OpenCLMainTest : public ::testing::Test {
@@ -125,6 +127,20 @@ TEST_F(OpenCLMainTest, ShuntingYardTest_Complex) {
     EXPECT_EQ(queueToString(result), "3 A B 4 2 / - * + C 3 / 7 E - * + E 3 + D / + 9 - ");
 }
 
+TEST_F(OpenCLMainTest, ShuntingYardTest_UnaryMinus) {
+    std::queue<std::string> result = OpenCLMain::instance().enqueueArithmeticFormula("-A * B - -2 + (-C)");
+    EXPECT_EQ(queueToString(result), "A neg B * 2 neg - C neg + ");
+}
+
+TEST_F(OpenCLMainTest, ShuntingYardTest_Functions) {
+    std::queue<std::string> result = OpenCLMain::instance().enqueueArithmeticFormula("sqrt(A * A + B * B)");
+    EXPECT_EQ(queueToString(result), "A A * B B * + sqrt ");
+    result = OpenCLMain::instance().enqueueArithmeticFormula("2 * max(A, -B) + fma(A, B, pow(C, 2))");
+    EXPECT_EQ(queueToString(result), "2 A B neg max * A B C 2 pow fma + ");
+    result = OpenCLMain::instance().enqueueArithmeticFormula("-abs(A - 1) / exp (B)");
+    EXPECT_EQ(queueToString(result), "A 1 - abs neg B exp / ");
+}
+
 TEST_F(OpenCLMainTest, EvaluateArithmeticFormulaTest_AdditionBaseCase) {
     Matrix<double> result1(8, 8, 11);
     Matrix<double> result2(8, 8, 3);
@@ -458,4 +474,147 @@ TEST_F(OpenCLMainTest, EvaluateArithmeticFormulaTest_CombinedShiftCase) {
         "3 + A * (B - 4 / 2) + (C / 3) * (7 - D) + (D + 3) / E - 9", 
         std::vector<Matrix<double>*>{&matrix5, &matrix6, &matrix7, &matrix8, &matrix0});
     EXPECT_EQ(result.getShiftedData(), result5.getShiftedData());
-}
\ No newline at end of file
+}
+
+TEST_F(OpenCLMainTest, EvaluateArithmeticFormulaTest_Functions) {
+    Matrix<double> expected(8, 8, std::pow(2.0, 3.0) + std::sqrt(3.0 * 3.0 + 4) - std::fmax(1.0, -1.0));
+    Matrix<double> result = OpenCLMain::instance().evaluateArithmeticFormula(
+        "pow(A, 3) + sqrt(B * B + 4) - max(C, -C)", std::vector<Matrix<double>*>{&m2, &m3, &m1});
+    EXPECT_EQ(result.getShiftedData(), expected.getShiftedData());
+
+    // Shifted inputs are read at their logical position
+    std::vector<double> shifted = matrix5.getShiftedData();
+    result = OpenCLMain::instance().evaluateArithmeticFormula(
+        "min(-A, abs(A))", std::vector<Matrix<double>*>{&matrix5});
+    for (size_t i = 0; i < shifted.size(); ++i) {
+        EXPECT_EQ(result.getShiftedData()[i], -std::fabs(shifted[i]));
+    }
+
+    // Constant formulas are folded on the host
+    result = OpenCLMain::instance().evaluateArithmeticFormula("fma(2, 3, -sqrt(16))");
+    EXPECT_EQ(result.getShiftedData(), std::vector<double>{2});
+
+    EXPECT_THROW(OpenCLMain::instance().evaluateArithmeticFormula(
+        "pow(A)", std::vector<Matrix<double>*>{&m1}), std::invalid_argument);
+}
+
+TEST_F(OpenCLMainTest, EvaluateArithmeticFormulasTest) {
+    std::vector<std::pair<std::string, std::string>> formulas = {
+        {"sum", "A * (1 - B) + C"}, {"difference", "A * (1 - B) - C"}, {"shifted", "D * (1 - B)"}, {"constant", "4/2"}};
+    std::map<std::string, Matrix<double>> results = OpenCLMain::instance().evaluateArithmeticFormulas(
+        formulas, std::vector<Matrix<double>*>{&m3, &m5, &m1, &matrix5});
+    ASSERT_EQ(results.size(), 4);
+    EXPECT_EQ(results.at("sum").getShiftedData(), Matrix<double>(8, 8, 3 * (1 - 5) + 1).getShiftedData());
+    EXPECT_EQ(results.at("difference").getShiftedData(), Matrix<double>(8, 8, 3 * (1 - 5) - 1).getShiftedData());
+    EXPECT_EQ(results.at("constant").getShiftedData(), Matrix<double>(8, 8, 2).getShiftedData());
+    std::vector<double> shifted = matrix5.getShiftedData();
+    for (size_t i = 0; i < shifted.size(); ++i) {
+        EXPECT_EQ(results.at("shifted").getShiftedData()[i], shifted[i] * (1 - 5));
+    }
+
+    EXPECT_THROW(OpenCLMain::instance().evaluateArithmeticFormulas(
+        {{"a", "A + 1"}, {"a", "A - 1"}}, std::vector<Matrix<double>*>{&m1}), std::invalid_argument);
+    EXPECT_THROW(OpenCLMain::instance().evaluateArithmeticFormulas(
+        {{"a", "A + B"}}, std::vector<Matrix<double>*>{&m1}), std::invalid_argument);
+}
+
+TEST_F(OpenCLMainTest, EvaluateArithmeticFormulaTest_ZeroCopy) {
+    for (bool zeroCopy : {true, false}) {
+        OpenCLStream stream;
+        stream.setZeroCopy(zeroCopy);
+        EXPECT_EQ(stream.isZeroCopy(), zeroCopy);
+
+        Matrix<double> result = stream.evaluateArithmeticFormula("A * B + 1", std::vector<Matrix<double>*>{&m2, &m3});
+        EXPECT_EQ(result.getShiftedData(), Matrix<double>(8, 8, 7).getShiftedData());
+        result = stream.evaluateArithmeticFormula("A + A", std::vector<Matrix<double>*>{&matrix1});
+        EXPECT_EQ(result.getShiftedData()[0], 2);
+
+        std::map<std::string, Matrix<double>> results = stream.evaluateArithmeticFormulas(
+            {{"product", "A * B"}, {"root", "sqrt(B)"}}, std::vector<Matrix<double>*>{&m2, &m4});
+        EXPECT_EQ(results.at("product").getShiftedData(), Matrix<double>(8, 8, 8).getShiftedData());
+        EXPECT_EQ(results.at("root").getShiftedData(), Matrix<double>(8, 8, 2).getShiftedData());
+
+        // The inputs are read in place, never written
+        EXPECT_EQ(m2.getShiftedData(), Matrix<double>(8, 8, 2).getShiftedData());
+    }
+}
+
+TEST_F(OpenCLMainTest, EvaluateArithmeticFormulaTest_PaddedRows) {
+    Matrix<double> a(3, 5, {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15});
+    Matrix<double> b(3, 5, 2.0);
+    Matrix<double> padded = a;
+    padded.setRowPitch(Matrix<double>::alignedPitch(5));
+    for (bool zeroCopy : {true, false}) {
+        OpenCLStream stream;
+        stream.setZeroCopy(zeroCopy);
+        EXPECT_EQ(stream.evaluateArithmeticFormula("A", std::vector<Matrix<double>*>{&padded}).getShiftedData(),
+                  a.getShiftedData());
+        EXPECT_EQ(stream.evaluateArithmeticFormula("A * B", std::vector<Matrix<double>*>{&padded, &b}).getShiftedData(),
+                  Matrix<double>(a * 2.0).getShiftedData());
+    }
+}
+
+TEST_F(OpenCLMainTest, EvaluateArithmeticFormulasTest_Arena) {
+    for (bool zeroCopy : {true, false}) {
+        OpenCLStream stream;
+        stream.setZeroCopy(zeroCopy);
+        for (int step = 0; step < 4; step++) {
+            std::map<std::string, Matrix<double>> results = stream.evaluateArithmeticFormulas(
+                {{"sum", "A + B"}, {"product", "A * B"}}, std::vector<Matrix<double>*>{&m2, &m3});
+            EXPECT_EQ(results.at("sum").getN(), 8);
+            // Giving the results back lets the next evaluation write into them
+            for (std::pair<const std::string, Matrix<double>>& result : results) {
+                stream.getArena().release(std::move(result.second));
+            }
+        }
+        EXPECT_EQ(stream.getArena().getAllocationCount(), 2);
+    }
+}
+
+TEST_F(OpenCLMainTest, EvaluateArithmeticFormulaTest_ConcurrentStreams) {
+    auto worker = [](unsigned int size, double value, bool* passed) {
+        OpenCLStream stream;
+        Matrix<double> a(size, size, value);
+        Matrix<double> b(size, size, 2);
+        Matrix<double> expected(size, size, value * 2 + 1);
+        *passed = true;
+        for (int i = 0; i < 20; i++) {
+            Matrix<double> result = stream.evaluateArithmeticFormula("A * B + 1", std::vector<Matrix<double>*>{&a, &b});
+            *passed = *passed && result.getShiftedData() == expected.getShiftedData();
+        }
+    };
+
+    bool passed1 = false;
+    bool passed2 = false;
+    std::thread thread1(worker, 16, 3, &passed1);
+    std::thread thread2(worker, 33, 5, &passed2);
+    thread1.join();
+    thread2.join();
+    EXPECT_TRUE(passed1);
+    EXPECT_TRUE(passed2);
+}
+
+TEST_F(OpenCLMainTest, ReductionTest) {
+    // Larger than one work-group so both passes of the tree do work
+    Matrix<double> values(67, 45);
+    double sum = 0;
+    double squares = 0;
+    for (unsigned int i = 0; i < values.getLength(); i++)
+    {
+        double value = ((i * 37) % 101) - 50.5;
+        values.indexRevision(i / 45, i % 45, value);
+        sum += value;
+        squares += value * value;
+    }
+    values.shift(3, 2);
+
+    EXPECT_NEAR(OpenCLMain::reduce(Reduction::SUM, values), sum, 1e-9);
+    EXPECT_EQ(OpenCLMain::reduce(Reduction::MIN, values), -50.5);
+    EXPECT_EQ(OpenCLMain::reduce(Reduction::MAX, values), 49.5);
+    EXPECT_NEAR(OpenCLMain::reduce(Reduction::L2, values), std::sqrt(squares), 1e-9);
+
+    // Formula results are reduced where they are computed
+    EXPECT_NEAR(OpenCLMain::evaluateArithmeticReduction(
+        Reduction::SUM, "A * 2 + B", std::vector<Matrix<double>*>{&m1, &m2}), 64 * 4, 1e-12);
+    EXPECT_EQ(OpenCLMain::evaluateArithmeticReduction(Reduction::SUM, "2 * 3"), 6);
+}
@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include "../../src/core/Reduction.hpp"
+
+class ReductionTest : public ::testing::Test {
+protected:
+    std::vector<double> values;
+
+    void SetUp() override {
+        for (int i = 0; i < 1000; i++)
+        {
+            values.push_back(((i * 37) % 101) - 50.5);
+        }
+    }
+
+    void TearDown() override {
+
+    }
+};
+
+TEST_F(ReductionTest, MatchesSequentialLoop) {
+    double sum = 0;
+    double squares = 0;
+    double min = values[0];
+    double max = values[0];
+    for (double value : values)
+    {
+        sum += value;
+        squares += value * value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+    }
+    EXPECT_NEAR(reduceValues(Reduction::SUM, values.data(), values.size()), sum, 1e-9);
+    EXPECT_EQ(reduceValues(Reduction::MIN, values.data(), values.size()), min);
+    EXPECT_EQ(reduceValues(Reduction::MAX, values.data(), values.size()), max);
+    EXPECT_NEAR(reduceValues(Reduction::L2, values.data(), values.size()), std::sqrt(squares), 1e-9);
+}
+
+TEST_F(ReductionTest, EmptyAndConstant) {
+    EXPECT_EQ(reduceValues(Reduction::SUM, values.data(), 0), 0);
+    EXPECT_EQ(reduceValues(Reduction::MIN, values.data(), 0), reductionIdentity(Reduction::MIN));
+    EXPECT_EQ(reduceValues(Reduction::MAX, values.data(), 0), reductionIdentity(Reduction::MAX));
+
+    EXPECT_EQ(reduceConstant(Reduction::SUM, 1.5, 4), 6);
+    EXPECT_EQ(reduceConstant(Reduction::MIN, -2, 4), -2);
+    EXPECT_EQ(reduceConstant(Reduction::MAX, -2, 4), -2);
+    EXPECT_EQ(reduceConstant(Reduction::L2, -2, 4), 4);
+}
+
+TEST_F(ReductionTest, PaddedRows) {
+    // 40 rows of 25 values, 32 apart, the padding holding values that would change every result
+    std::vector<double> padded(40 * 32, 1e300);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        padded[i / 25 * 32 + i % 25] = values[i];
+    }
+    for (Reduction operation : {Reduction::SUM, Reduction::MIN, Reduction::MAX, Reduction::L2})
+    {
+        EXPECT_EQ(reduceRows(operation, padded.data(), 40, 25, 32),
+                  reduceValues(operation, values.data(), values.size()));
+        EXPECT_EQ(reduceRows(operation, values.data(), 40, 25, 25),
+                  reduceValues(operation, values.data(), values.size()));
+    }
+}
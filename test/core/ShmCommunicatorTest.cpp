@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "../../src/core/ShmCommunicator.hpp"
+
+class ShmCommunicatorTest : public ::testing::Test {
+protected:
+    std::string name;
+
+    void SetUp() override {
+        name = "/d2q9_shm_test_" + std::to_string(getpid());
+    }
+
+    void TearDown() override {
+        ShmCommunicator::unlink(name);
+    }
+};
+
+TEST_F(ShmCommunicatorTest, MessagesLargerThanRing) {
+    ShmCommunicator::create(name, 2, 64);
+    std::vector<double> message(1000);
+    for (size_t i = 0; i < message.size(); i++)
+    {
+        message[i] = i * 0.5;
+    }
+
+    std::thread peer([this, &message]() {
+        ShmCommunicator communicator(name, 1);
+        communicator.send(message.data(), message.size(), 0, 7);
+        std::vector<double> received(message.size());
+        communicator.sendReceive(message.data(), message.size(), 0, 8, received.data(), received.size(), 0, 8);
+        EXPECT_EQ(received, message);
+        communicator.barrier();
+    });
+
+    ShmCommunicator communicator(name, 0);
+    EXPECT_EQ(communicator.getSize(), 2);
+    std::vector<double> received(message.size());
+    communicator.receive(received.data(), received.size(), 1, 7);
+    EXPECT_EQ(received, message);
+
+    // Both sides send first, the rings only hold a few values
+    std::fill(received.begin(), received.end(), 0);
+    communicator.sendReceive(message.data(), message.size(), 1, 8, received.data(), received.size(), 1, 8);
+    EXPECT_EQ(received, message);
+    communicator.barrier();
+    peer.join();
+}
+
+TEST_F(ShmCommunicatorTest, SendToSelf) {
+    ShmCommunicator::create(name, 1, 64);
+    ShmCommunicator     communicator(name, 0);
+    std::vector<double> message(100, 1.5);
+    std::vector<double> received(100);
+    communicator.sendReceive(message.data(), message.size(), 0, 1, received.data(), received.size(), 0, 1);
+    EXPECT_EQ(received, message);
+    communicator.barrier();
+}
+
+TEST_F(ShmCommunicatorTest, InvalidUse) {
+    ShmCommunicator::create(name, 2);
+    EXPECT_THROW(ShmCommunicator::create(name, 2), std::runtime_error);
+    EXPECT_THROW(ShmCommunicator(name, 2), std::invalid_argument);
+    EXPECT_THROW(ShmCommunicator(name + "_missing", 0), std::runtime_error);
+
+    ShmCommunicator first(name, 0);
+    ShmCommunicator second(name, 1);
+    double          values[2] = {1, 2};
+    first.send(values, 1, 1, 3);
+    EXPECT_THROW(second.receive(values, 2, 0, 3), std::runtime_error);
+}
+
+TEST_F(ShmCommunicatorTest, ReceiveByTag) {
+    ShmCommunicator::create(name, 2, 64);
+    ShmCommunicator     first(name, 0);
+    ShmCommunicator     second(name, 1);
+    std::vector<double> a(20, 1.0);
+    std::vector<double> b(30, 2.0);
+    std::vector<double> c(5, 3.0);  // fits into the ring once b is through
+    std::vector<double> receivedA(20);
+    std::vector<double> receivedB(30);
+    std::vector<double> receivedC(5);
+
+    // Received in another order than sent, the earlier message is held until its receive is posted
+    Communicator::Request sends[3] = {second.isend(a.data(), a.size(), 0, 1),
+                                      second.isend(b.data(), b.size(), 0, 2),
+                                      second.isend(c.data(), c.size(), 0, 1)};
+    Communicator::Request receiveB = first.ireceive(receivedB.data(), receivedB.size(), 1, 2);
+    bool done[4] = {false, false, false, false};
+    while (!(done[0] && done[1] && done[2] && done[3]))
+    {
+        done[0] = done[0] || first.test(receiveB);
+        for (int i = 0; i < 3; i++)
+        {
+            done[i + 1] = done[i + 1] || second.test(sends[i]);
+        }
+    }
+    EXPECT_EQ(receivedB, b);
+
+    // Messages with one tag keep their order
+    first.receive(receivedA.data(), receivedA.size(), 1, 1);
+    first.receive(receivedC.data(), receivedC.size(), 1, 1);
+    EXPECT_EQ(receivedA, a);
+    EXPECT_EQ(receivedC, c);
+}
+
+TEST_F(ShmCommunicatorTest, NonBlocking) {
+    ShmCommunicator::create(name, 2, 64);
+    ShmCommunicator     first(name, 0);
+    ShmCommunicator     second(name, 1);
+    std::vector<double> a(50, 1.0);
+    std::vector<double> b(30, 2.0);
+    std::vector<double> receivedA(50);
+    std::vector<double> receivedB(30);
+
+    // Both sides in one thread, completion only needs the peers to keep testing
+    Communicator::Request receiveA = first.ireceive(receivedA.data(), receivedA.size(), 1, 1);
+    Communicator::Request receiveB = first.ireceive(receivedB.data(), receivedB.size(), 1, 2);
+    EXPECT_FALSE(first.test(receiveA));
+    Communicator::Request sendA = second.isend(a.data(), a.size(), 0, 1);
+    Communicator::Request sendB = second.isend(b.data(), b.size(), 0, 2);
+
+    bool done[4] = {false, false, false, false};
+    while (!(done[0] && done[1] && done[2] && done[3]))
+    {
+        done[0] = done[0] || first.test(receiveA);
+        done[1] = done[1] || first.test(receiveB);
+        done[2] = done[2] || second.test(sendA);
+        done[3] = done[3] || second.test(sendB);
+    }
+    EXPECT_EQ(receivedA, a);
+    EXPECT_EQ(receivedB, b);
+    EXPECT_THROW(first.test(receiveA), std::invalid_argument);
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "../../src/core/SnapshotWriter.hpp"
+
+class SnapshotWriterTest : public ::testing::Test {
+protected:
+    std::string directory;
+
+    void SetUp() override {
+        directory = (std::filesystem::temp_directory_path() / "SnapshotWriterTest").string();
+        std::filesystem::remove_all(directory);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(directory);
+    }
+
+    static std::string readFile(const std::string& path) {
+        std::ifstream file(path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+};
+
+TEST_F(SnapshotWriterTest, WritesFrames) {
+    SnapshotWriter writer(directory, "frame");
+    for (unsigned int step = 1; step <= 5; step++)
+    {
+        double* staging = writer.acquire(step, 2, 3, {"a", "b"});
+        for (unsigned int i = 0; i < 12; i++)
+        {
+            staging[i] = step * 100 + i;
+        }
+        writer.submit();
+    }
+    writer.flush();
+
+    for (unsigned int step = 1; step <= 5; step++)
+    {
+        std::stringstream expected;
+        expected << "a\n---------------------- 3x2 ----------------------\n";
+        expected << step * 100 + 0 << " | " << step * 100 + 1 << " | " << step * 100 + 2 << "\n";
+        expected << step * 100 + 3 << " | " << step * 100 + 4 << " | " << step * 100 + 5 << "\n";
+        expected << "b\n---------------------- 3x2 ----------------------\n";
+        expected << step * 100 + 6 << " | " << step * 100 + 7 << " | " << step * 100 + 8 << "\n";
+        expected << step * 100 + 9 << " | " << step * 100 + 10 << " | " << step * 100 + 11 << "\n";
+        EXPECT_EQ(readFile(writer.getPath(step)), expected.str());
+    }
+}
+
+TEST_F(SnapshotWriterTest, SubmitWithoutAcquire) {
+    SnapshotWriter writer(directory);
+    EXPECT_THROW(writer.submit(), std::logic_error);
+
+    writer.acquire(0, 1, 1, {"a"});
+    EXPECT_THROW(writer.acquire(1, 1, 1, {"a"}), std::logic_error);
+}
+
+TEST_F(SnapshotWriterTest, SharedBetweenThreads) {
+    SnapshotWriter writer(directory, "frame");
+    // Each thread keeps its frame acquired for a while, so the other one has to take the second slot
+    auto produce = [&writer](unsigned int first) {
+        for (unsigned int step = first; step < first + 20; step++)
+        {
+            double* staging = writer.acquire(step, 1, 1, {"a"});
+            std::this_thread::yield();
+            staging[0] = step;
+            writer.submit();
+        }
+    };
+    std::thread a(produce, 0);
+    std::thread b(produce, 100);
+    a.join();
+    b.join();
+    writer.flush();
+
+    for (unsigned int first : {0u, 100u})
+    {
+        for (unsigned int step = first; step < first + 20; step++)
+        {
+            std::stringstream expected;
+            expected << "a\n---------------------- 1x1 ----------------------\n" << step << "\n";
+            EXPECT_EQ(readFile(writer.getPath(step)), expected.str());
+        }
+    }
+}